@@ -0,0 +1,173 @@
+#include "DNSBenchmark.h"
+// std
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+// system
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+// libevent
+#include <event2/dns.h>
+// server
+#include "DNSWire.h"
+
+// Нагрузочный генератор для DNS респондера: каждый поток держит окно запросов
+// в полете и досылает новые по мере прихода ответов, все пачками через sendmmsg/recvmmsg
+
+//using namespace std;
+
+#define BENCH_BATCH_SIZE 64
+
+// собирает пакет запроса, возвращает размер
+static std::size_t buildQuery(std::uint16_t id, const char* name, std::uint16_t type, std::uint8_t* out){
+    memset(out, 0, DNS_HEADER_SIZE);
+    out[0] = (std::uint8_t)(id >> 8);
+    out[1] = (std::uint8_t)(id & 0xFF);
+    out[2] = 0x01;  // RD
+    out[5] = 1;     // один вопрос
+    std::size_t size = DNS_HEADER_SIZE;
+    size += dnsEncodeName(name, strlen(name), out + size, DNS_MAX_UDP_PACKET - size - 4);
+    out[size++] = (std::uint8_t)(type >> 8);
+    out[size++] = (std::uint8_t)(type & 0xFF);
+    out[size++] = 0;
+    out[size++] = EVDNS_CLASS_INET;
+    return size;
+}
+
+int dnsResponderBenchmark(const char* serverAddress, std::uint16_t serverPort, int threadsCount, int durationSeconds, int windowSize) {
+    struct QueryTemplate {
+        const char* name;
+        std::uint16_t type;
+    };
+    const QueryTemplate queries[] = {
+        {"localhost", EVDNS_TYPE_A},
+        {"localhost", EVDNS_TYPE_AAAA},
+        {"1.0.0.127.in-addr.arpa", EVDNS_TYPE_PTR},
+        {"unknown.example", EVDNS_TYPE_A},
+    };
+    const int queriesCount = sizeof(queries) / sizeof(queries[0]);
+
+    sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(serverPort);
+    if (inet_pton(AF_INET, serverAddress, &serverAddr.sin_addr) != 1) {
+        std::cout << "Неверный адрес сервера: " << serverAddress << std::endl;
+        return 1;
+    }
+
+    std::atomic<std::uint64_t> sentTotal(0);
+    std::atomic<std::uint64_t> receivedTotal(0);
+    std::atomic_bool isRunning(true);
+
+    auto threadFunc = [&](int threadIndex){
+        // отдельный сокет на поток - разный порт источника, ядро раскидает по потокам сервера
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            return;
+        }
+        if (connect(fd, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+            close(fd);
+            return;
+        }
+
+        // готовые запросы
+        std::vector<std::vector<std::uint8_t>> packets(queriesCount, std::vector<std::uint8_t>(DNS_MAX_UDP_PACKET));
+        std::vector<std::size_t> packetSizes(queriesCount);
+        for (int i = 0; i < queriesCount; ++i) {
+            packetSizes[i] = buildQuery((std::uint16_t)(threadIndex * 1000 + i), queries[i].name, queries[i].type, packets[i].data());
+        }
+
+        mmsghdr outMessages[BENCH_BATCH_SIZE];
+        iovec outVectors[BENCH_BATCH_SIZE];
+        mmsghdr inMessages[BENCH_BATCH_SIZE];
+        iovec inVectors[BENCH_BATCH_SIZE];
+        std::vector<std::uint8_t> inBuffer(BENCH_BATCH_SIZE * DNS_MAX_UDP_PACKET);
+        memset(outMessages, 0, sizeof(outMessages));
+        memset(inMessages, 0, sizeof(inMessages));
+        for (int i = 0; i < BENCH_BATCH_SIZE; ++i) {
+            int queryIndex = i % queriesCount;
+            outVectors[i].iov_base = packets[queryIndex].data();
+            outVectors[i].iov_len = packetSizes[queryIndex];
+            outMessages[i].msg_hdr.msg_iov = &outVectors[i];
+            outMessages[i].msg_hdr.msg_iovlen = 1;
+            inVectors[i].iov_base = inBuffer.data() + i * DNS_MAX_UDP_PACKET;
+            inVectors[i].iov_len = DNS_MAX_UDP_PACKET;
+            inMessages[i].msg_hdr.msg_iov = &inVectors[i];
+            inMessages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        std::uint64_t sent = 0;
+        std::uint64_t received = 0;
+        std::int64_t inFlight = 0;
+        while (isRunning) {
+            // доливаем окно
+            while (inFlight < windowSize) {
+                int toSend = std::min<std::int64_t>(BENCH_BATCH_SIZE, windowSize - inFlight);
+                int sentCount = sendmmsg(fd, outMessages, toSend, MSG_DONTWAIT);
+                if (sentCount <= 0) {
+                    break;
+                }
+                sent += sentCount;
+                inFlight += sentCount;
+            }
+
+            pollfd pollDescriptor;
+            pollDescriptor.fd = fd;
+            pollDescriptor.events = POLLIN;
+            if (poll(&pollDescriptor, 1, 100) <= 0) {
+                // ответы потерялись - считаем окно свободным
+                inFlight = 0;
+                continue;
+            }
+
+            int receivedCount = recvmmsg(fd, inMessages, BENCH_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+            if (receivedCount > 0) {
+                received += receivedCount;
+                inFlight -= receivedCount;
+                if (inFlight < 0) {
+                    inFlight = 0;
+                }
+            }
+        }
+
+        sentTotal += sent;
+        receivedTotal += received;
+        close(fd);
+    };
+
+    std::cout << "DNS benchmark: " << serverAddress << ":" << serverPort << ", threads: " << threadsCount
+              << ", window: " << windowSize << ", duration: " << durationSeconds << "s" << std::endl;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadsCount; ++i) {
+        threads.push_back(std::thread(threadFunc, i));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(durationSeconds));
+    isRunning = false;
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::uint64_t sent = sentTotal;
+    std::uint64_t received = receivedTotal;
+    std::cout << "Sent: " << sent << ", received: " << received
+              << ", lost: " << (sent > received ? sent - received : 0) << std::endl;
+    std::cout << "QPS: " << (std::uint64_t)(received / elapsed) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,3 @@
+#include <cstdint>
+
+int dnsResponderBenchmark(const char* serverAddress, std::uint16_t serverPort, int threadsCount, int durationSeconds, int windowSize);
@@ -0,0 +1,281 @@
+#include "DNSBulkResolve.h"
+// std
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+// libevent
+#include <event2/event.h>
+#include <event2/dns.h>
+#include <event2/util.h>
+// server
+#include "DNSWire.h"
+#include "DNSResolver.h"
+
+// Поток имен из файла: в полете держится не больше concurrency запросов,
+// как только приходит ответ - читается следующее имя. Память под запросы
+// выделяется один раз (пул слотов), на каждое имя ничего не аллоцируется.
+
+//using namespace std;
+
+typedef std::unique_ptr<event_base, decltype(&event_base_free)> EventBasePtr;
+
+struct BulkResolveContext;
+
+// Гистограмма задержек фиксированного размера: память не растет с длиной входа.
+// Степень двойки делится на 16 интервалов - погрешность процентилей не больше 1/16.
+struct LatencyHistogram {
+    static const int SUB_BUCKETS = 16;
+    static const int BUCKETS = (32 - 3) * SUB_BUCKETS;  // до 2^32 мкс
+
+    std::uint64_t counts[BUCKETS];
+    std::uint64_t total;
+    std::uint32_t max;
+
+    LatencyHistogram():
+        total(0),
+        max(0){
+        memset(counts, 0, sizeof(counts));
+    }
+
+    // значения меньше 16 - точно, дальше - старшие 5 бит
+    static int bucketOf(std::uint32_t value){
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        int exponent = 31 - __builtin_clz(value);
+        int shift = exponent - 4;
+        return (shift + 1) * SUB_BUCKETS + (int)((value >> shift) - SUB_BUCKETS);
+    }
+
+    // верхняя граница интервала
+    static std::uint32_t bucketLimit(int bucket){
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        int shift = bucket / SUB_BUCKETS - 1;
+        std::uint64_t limit = ((std::uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS + 1) << shift) - 1;
+        return (std::uint32_t)std::min<std::uint64_t>(limit, UINT32_MAX);
+    }
+
+    void add(std::uint32_t value){
+        ++counts[bucketOf(value)];
+        ++total;
+        max = std::max(max, value);
+    }
+
+    std::uint32_t percentile(double fraction) const{
+        if (total == 0) {
+            return 0;
+        }
+        std::uint64_t rank = std::min(total - 1, (std::uint64_t)(fraction * total));
+        std::uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank) {
+                return std::min(bucketLimit(i), max);
+            }
+        }
+        return max;
+    }
+};
+
+// Слот пула - бывший UserData
+struct BulkResolveSlot {
+    BulkResolveContext* context;
+    std::chrono::steady_clock::time_point startTime;
+    char name[DNS_MAX_NAME_LENGTH + 2];
+};
+
+struct BulkResolveContext {
+    event_base* base;
+    DNSResolver* resolver;
+    FILE* input;
+    bool inputFinished;
+    bool filling;
+    std::vector<BulkResolveSlot> slots;
+    std::vector<BulkResolveSlot*> freeSlots;
+    // статистика
+    LatencyHistogram latencies;             // мкс
+    std::uint64_t resolved;
+    std::uint64_t notFound;
+    std::uint64_t failed;
+    std::uint64_t skipped;
+};
+
+// Следующее имя из входа: пробелы по краям и комментарии отбрасываются
+static bool readName(BulkResolveContext& context, char* name, std::size_t capacity){
+    char line[1024];
+    while (fgets(line, sizeof(line), context.input)) {
+        std::size_t length = strlen(line);
+        // слишком длинная строка - пропускаем остаток
+        bool truncated = (length == sizeof(line) - 1) && (line[length - 1] != '\n');
+        if (truncated) {
+            int c = 0;
+            while (((c = fgetc(context.input)) != EOF) && (c != '\n')) {
+            }
+        }
+
+        char* begin = line;
+        while ((*begin == ' ') || (*begin == '\t')) {
+            ++begin;
+        }
+        char* end = begin;
+        while ((*end != '\0') && (*end != ' ') && (*end != '\t') && (*end != '\r') && (*end != '\n') && (*end != '#')) {
+            ++end;
+        }
+        std::size_t nameLength = end - begin;
+        if (nameLength == 0) {
+            continue;
+        }
+        if (truncated || (nameLength >= capacity)) {
+            ++context.skipped;
+            continue;
+        }
+        memcpy(name, begin, nameLength);
+        name[nameLength] = '\0';
+        return true;
+    }
+    return false;
+}
+
+static void writeResult(const BulkResolveSlot& slot, const DNSResolveResult& result){
+    if (result.error) {
+        printf("%s\t%s\n", slot.name, evdns_err_to_string(result.error));
+        return;
+    }
+    fputs(slot.name, stdout);
+    char separator = '\t';
+    for (const DNSResolvedAddress& address: *result.addresses) {
+        char buf[128];
+        if (evutil_inet_ntop(address.family, address.address, buf, sizeof(buf))) {
+            fputc(separator, stdout);
+            fputs(buf, stdout);
+            separator = ',';
+        }
+    }
+    printf("\tttl=%u\n", result.ttl);
+}
+
+static void fillWindow(BulkResolveContext& context);
+
+static void resolveCallback(const DNSResolveResult& result, void* arg){
+    BulkResolveSlot* slot = static_cast<BulkResolveSlot*>(arg);
+    BulkResolveContext& context = *slot->context;
+
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - slot->startTime);
+    context.latencies.add((std::uint32_t)std::min<std::int64_t>(latency.count(), UINT32_MAX));
+    if (result.error == DNS_ERR_NONE) {
+        ++context.resolved;
+    } else if ((result.error == DNS_ERR_NOTEXIST) || (result.error == DNS_ERR_NODATA)) {
+        ++context.notFound;
+    } else {
+        ++context.failed;
+    }
+    writeResult(*slot, result);
+
+    context.freeSlots.push_back(slot);
+    // ответ из кеша приходит прямо внутри resolve - окно тогда дозаполняет внешний цикл
+    if (context.filling == false) {
+        fillWindow(context);
+    }
+}
+
+static void fillWindow(BulkResolveContext& context){
+    context.filling = true;
+    while ((context.inputFinished == false) && (context.freeSlots.empty() == false)) {
+        BulkResolveSlot* slot = context.freeSlots.back();
+        if (readName(context, slot->name, sizeof(slot->name)) == false) {
+            context.inputFinished = true;
+            break;
+        }
+        context.freeSlots.pop_back();
+        slot->startTime = std::chrono::steady_clock::now();
+        context.resolver->resolve(slot->name, resolveCallback, slot);
+    }
+    context.filling = false;
+
+    if (context.inputFinished && (context.freeSlots.size() == context.slots.size())) {
+        event_base_loopexit(context.base, nullptr);
+    }
+}
+
+int dnsBulkResolve(const char* inputPath, const char* upstream, int concurrency) {
+    if (concurrency <= 0) {
+        concurrency = 1;
+    }
+
+    bool useStdin = (inputPath == nullptr) || (strcmp(inputPath, "-") == 0);
+    FILE* input = useStdin ? stdin : fopen(inputPath, "r");
+    if (input == nullptr) {
+        std::cerr << "Не удалось открыть файл: " << inputPath << std::endl;
+        return 1;
+    }
+
+    EventBasePtr base(event_base_new(), &event_base_free);
+    if (!base) {
+        std::cerr << "Ошибка при создании объекта event_base." << std::endl;
+        return 2;
+    }
+
+    DNSResolverConfig config;
+    config.upstream = upstream;
+    // предел evdns считает запросы, а не имена: с AAAA на имя их два
+    config.maxInflight = concurrency * (config.resolveIPv6 ? 2 : 1);
+    DNSResolver resolver(base.get(), config);
+    if (!resolver.isValid()) {
+        return 3;
+    }
+
+    // результаты идут большими блоками, а не построчно
+    static char outputBuffer[1 << 20];
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+    BulkResolveContext context;
+    context.base = base.get();
+    context.resolver = &resolver;
+    context.input = input;
+    context.inputFinished = false;
+    context.filling = false;
+    context.resolved = 0;
+    context.notFound = 0;
+    context.failed = 0;
+    context.skipped = 0;
+    context.slots.resize(concurrency);
+    context.freeSlots.reserve(concurrency);
+    for (BulkResolveSlot& slot: context.slots) {
+        slot.context = &context;
+        context.freeSlots.push_back(&slot);
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    fillWindow(context);
+    if (context.freeSlots.size() != context.slots.size()) {
+        event_base_dispatch(base.get());
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    fflush(stdout);
+    if (useStdin == false) {
+        fclose(input);
+    }
+
+    const LatencyHistogram& latencies = context.latencies;
+    std::uint64_t total = latencies.total;
+
+    std::cerr << "Names: " << total << " (resolved: " << context.resolved << ", not found: " << context.notFound
+              << ", failed: " << context.failed << ", skipped: " << context.skipped << ")" << std::endl;
+    std::cerr << "Time: " << elapsed << " s, QPS: " << (std::uint64_t)(elapsed > 0 ? total / elapsed : 0)
+              << ", concurrency: " << concurrency << std::endl;
+    std::cerr << "Upstream queries: " << resolver.upstreamQueriesCount() << ", coalesced: " << resolver.coalescedCount()
+              << ", cache hits: " << resolver.cacheHitsCount() << std::endl;
+    std::cerr << "Latency us: p50 " << latencies.percentile(0.50) << ", p90 " << latencies.percentile(0.90)
+              << ", p99 " << latencies.percentile(0.99) << ", p99.9 " << latencies.percentile(0.999)
+              << ", max " << latencies.max << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,5 @@
+#include <cstdint>
+
+// Массовое разрешение имен: inputPath == nullptr или "-" - чтение из stdin,
+// результаты в stdout по мере прихода, статистика в stderr
+int dnsBulkResolve(const char* inputPath, const char* upstream, int concurrency);
@@ -0,0 +1,340 @@
+#include "DNSResolver.h"
+// std
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+// system
+#include <arpa/inet.h>
+// server
+#include "DNSWire.h"
+#include "DNSZone.h"
+
+
+// Ошибки, после которых имя точно не существует или у него нет адресов - их можно кешировать
+static inline bool isDefinitiveError(int error){
+    return (error == DNS_ERR_NONE) || (error == DNS_ERR_NOTEXIST) || (error == DNS_ERR_NODATA);
+}
+
+DNSResolverConfig::DNSResolverConfig():
+    upstream(nullptr),
+    resolveIPv6(true),
+    minTTL(1),
+    maxTTL(86400),
+    negativeTTL(30),
+    prefetchPercent(10),
+    prefetchMinHits(2),
+    maxEntries(100000),
+    maxInflight(64){
+}
+
+DNSResolver::DNSResolver(event_base* base, const DNSResolverConfig& config):
+    _base(base),
+    _dnsBase(nullptr),
+    _config(config),
+    _cacheHits(0),
+    _coalesced(0),
+    _upstreamQueries(0),
+    _prefetches(0){
+
+    _dnsBase = evdns_base_new(_base, _config.upstream ? 0 : EVDNS_BASE_INITIALIZE_NAMESERVERS);
+    if (!_dnsBase) {
+        std::cout << "Ошибка при создании объекта evdns_base." << std::endl;
+        return;
+    }
+    if (_config.upstream && (evdns_base_nameserver_ip_add(_dnsBase, _config.upstream) != 0)) {
+        std::cout << "Неверный адрес DNS сервера: " << _config.upstream << std::endl;
+        evdns_base_free(_dnsBase, 0);
+        _dnsBase = nullptr;
+        return;
+    }
+    // остальные запросы evdns держит в своей очереди
+    std::string maxInflight = std::to_string(_config.maxInflight);
+    evdns_base_set_option(_dnsBase, "max-inflight:", maxInflight.c_str());
+}
+
+DNSResolver::~DNSResolver(){
+    // запросы к серверу отменяются без колбеков, ожидающих уведомляем сами
+    if (_dnsBase) {
+        evdns_base_free(_dnsBase, 0);
+    }
+    for (auto& item: _entries) {
+        Entry& entry = *item.second;
+        if (entry.waiters.empty()) {
+            continue;
+        }
+        std::vector<Waiter> waiters;
+        waiters.swap(entry.waiters);
+        entry.pendingQueries = 0;
+        entry.hasAnswer = false;
+        entry.error = DNS_ERR_SHUTDOWN;
+        notifyWaiters(entry, waiters);
+    }
+}
+
+bool DNSResolver::isValid() const{
+    return _dnsBase != nullptr;
+}
+
+std::int64_t DNSResolver::nowMilliseconds(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// IP адреса и localhost не требуют запроса к серверу
+bool DNSResolver::resolveLocally(const char* name, std::vector<DNSResolvedAddress>& addresses){
+    DNSResolvedAddress address;
+    memset(&address, 0, sizeof(address));
+    if (inet_pton(AF_INET, name, address.address) == 1) {
+        address.family = AF_INET;
+        addresses.push_back(address);
+        return true;
+    }
+    if (inet_pton(AF_INET6, name, address.address) == 1) {
+        address.family = AF_INET6;
+        addresses.push_back(address);
+        return true;
+    }
+    if (strcmp(name, "localhost") == 0) {
+        address.family = AF_INET;
+        inet_pton(AF_INET, "127.0.0.1", address.address);
+        addresses.push_back(address);
+        address.family = AF_INET6;
+        inet_pton(AF_INET6, "::1", address.address);
+        addresses.push_back(address);
+        return true;
+    }
+    return false;
+}
+
+void DNSResolver::resolve(const char* name, DNSResolveCallback callback, void* arg){
+    char normalizedName[DNS_MAX_NAME_LENGTH + 1];
+    std::size_t nameLength = dnsNormalizeName(name, normalizedName, sizeof(normalizedName));
+
+    DNSResolveResult result;
+    result.name = name;
+    result.ttl = 0;
+    result.fromCache = false;
+    result.addresses = nullptr;
+
+    if ((nameLength == 0) || (_dnsBase == nullptr)) {
+        std::vector<DNSResolvedAddress> empty;
+        result.error = (nameLength == 0) ? DNS_ERR_FORMAT : DNS_ERR_SHUTDOWN;
+        result.addresses = &empty;
+        callback(result, arg);
+        return;
+    }
+
+    std::vector<DNSResolvedAddress> localAddresses;
+    if (resolveLocally(normalizedName, localAddresses)) {
+        result.error = DNS_ERR_NONE;
+        result.ttl = _config.maxTTL;
+        result.addresses = &localAddresses;
+        callback(result, arg);
+        return;
+    }
+
+    std::int64_t now = nowMilliseconds();
+    std::string key(normalizedName, nameLength);
+    auto it = _entries.find(key);
+    if (it == _entries.end()) {
+        if (_entries.size() >= _config.maxEntries) {
+            sweep();
+        }
+        EntryPtr newEntry(new Entry());
+        newEntry->resolver = this;
+        newEntry->name = key;
+        newEntry->hasAnswer = false;
+        newEntry->error = DNS_ERR_NONE;
+        newEntry->storedAt = 0;
+        newEntry->expiresAt = 0;
+        newEntry->refreshAt = 0;
+        newEntry->hits = 0;
+        newEntry->pendingQueries = 0;
+        newEntry->queryError = DNS_ERR_NONE;
+        newEntry->queryTTL = 0;
+        newEntry->idle = false;
+        it = _entries.insert(std::make_pair(key, std::move(newEntry))).first;
+    }
+    Entry& entry = *it->second;
+
+    // свежий ответ из кеша
+    if (entry.hasAnswer && (now < entry.expiresAt)) {
+        ++_cacheHits;
+        ++entry.hits;
+
+        // горячая запись скоро устареет - обновляем заранее, не задерживая клиента
+        if ((entry.pendingQueries == 0) && (entry.error == DNS_ERR_NONE) &&
+            (now >= entry.refreshAt) && (entry.hits >= _config.prefetchMinHits)) {
+            ++_prefetches;
+            startQuery(entry);
+        }
+
+        result.error = entry.error;
+        result.ttl = (std::uint32_t)((entry.expiresAt - now + 999) / 1000);
+        result.fromCache = true;
+        result.addresses = &entry.addresses;
+        callback(result, arg);
+        return;
+    }
+
+    Waiter waiter;
+    waiter.callback = callback;
+    waiter.arg = arg;
+    markBusy(entry);
+    entry.waiters.push_back(waiter);
+
+    // такой же запрос уже отправлен - ждем его
+    if (entry.pendingQueries > 0) {
+        ++_coalesced;
+        return;
+    }
+    startQuery(entry);
+}
+
+void DNSResolver::startQuery(Entry& entry){
+    markBusy(entry);
+    entry.queryError = DNS_ERR_NONE;
+    entry.queryTTL = _config.maxTTL;
+    entry.queryAddresses.clear();
+
+    int queriesCount = _config.resolveIPv6 ? 2 : 1;
+    entry.pendingQueries = queriesCount;
+    _upstreamQueries += queriesCount;
+
+    // колбеки evdns приходят через отложенные события, не внутри вызовов ниже
+    evdns_request* request = evdns_base_resolve_ipv4(_dnsBase, entry.name.c_str(), DNS_QUERY_NO_SEARCH, upstreamCallback, &entry);
+    if (request == nullptr) {
+        upstreamCallback(DNS_ERR_UNKNOWN, DNS_IPv4_A, 0, 0, nullptr, &entry);
+    }
+    if (queriesCount > 1) {
+        request = evdns_base_resolve_ipv6(_dnsBase, entry.name.c_str(), DNS_QUERY_NO_SEARCH, upstreamCallback, &entry);
+        if (request == nullptr) {
+            upstreamCallback(DNS_ERR_UNKNOWN, DNS_IPv6_AAAA, 0, 0, nullptr, &entry);
+        }
+    }
+}
+
+void DNSResolver::upstreamCallback(int result, char type, int count, int ttl, void* addresses, void* arg){
+    Entry& entry = *static_cast<Entry*>(arg);
+
+    if ((result == DNS_ERR_NONE) && (count > 0)) {
+        DNSResolvedAddress address;
+        memset(&address, 0, sizeof(address));
+        std::size_t addressSize = (type == DNS_IPv4_A) ? 4 : 16;
+        address.family = (type == DNS_IPv4_A) ? AF_INET : AF_INET6;
+        for (int i = 0; i < count; ++i) {
+            memcpy(address.address, static_cast<const std::uint8_t*>(addresses) + i * addressSize, addressSize);
+            entry.queryAddresses.push_back(address);
+        }
+        entry.queryTTL = std::min(entry.queryTTL, (std::uint32_t)std::max(ttl, 0));
+    } else if (isDefinitiveError(entry.queryError) && (result != DNS_ERR_NONE)) {
+        // временные ошибки важнее "нет записей": такой ответ нельзя запоминать
+        entry.queryError = result;
+    }
+
+    if (--entry.pendingQueries == 0) {
+        entry.resolver->completeQuery(entry);
+    }
+}
+
+void DNSResolver::completeQuery(Entry& entry){
+    std::int64_t now = nowMilliseconds();
+
+    if (entry.queryAddresses.empty() == false) {
+        std::uint32_t ttl = std::max(_config.minTTL, std::min(_config.maxTTL, entry.queryTTL));
+        entry.hasAnswer = true;
+        entry.error = DNS_ERR_NONE;
+        entry.addresses.swap(entry.queryAddresses);
+        entry.storedAt = now;
+        entry.expiresAt = now + (std::int64_t)ttl * 1000;
+        entry.refreshAt = entry.expiresAt - (std::int64_t)ttl * 10 * _config.prefetchPercent;
+        entry.hits = 0;
+    } else if (isDefinitiveError(entry.queryError)) {
+        entry.hasAnswer = true;
+        entry.error = (entry.queryError == DNS_ERR_NONE) ? DNS_ERR_NODATA : entry.queryError;
+        entry.addresses.clear();
+        entry.storedAt = now;
+        entry.expiresAt = now + (std::int64_t)_config.negativeTTL * 1000;
+        entry.refreshAt = entry.expiresAt;
+        entry.hits = 0;
+    } else if ((entry.hasAnswer == false) || (now >= entry.expiresAt)) {
+        // сервер недоступен и старого ответа нет - ошибка без кеширования
+        entry.hasAnswer = false;
+        entry.error = entry.queryError;
+        entry.addresses.clear();
+    }
+    // иначе неудачное упреждающее обновление: старый ответ живет до своего срока
+
+    if (entry.waiters.empty() == false) {
+        std::vector<Waiter> waiters;
+        waiters.swap(entry.waiters);
+        notifyWaiters(entry, waiters);
+    }
+    // колбеки могли снова запросить это имя
+    if ((entry.pendingQueries == 0) && entry.waiters.empty()) {
+        markIdle(entry);
+    }
+}
+
+void DNSResolver::notifyWaiters(Entry& entry, std::vector<Waiter>& waiters){
+    std::int64_t now = nowMilliseconds();
+
+    DNSResolveResult result;
+    result.name = entry.name.c_str();
+    result.error = entry.error;
+    result.ttl = (entry.hasAnswer && (entry.expiresAt > now)) ? (std::uint32_t)((entry.expiresAt - now + 999) / 1000) : 0;
+    result.fromCache = false;
+
+    // колбеки могут снова звать resolve, поэтому отдаем копию адресов
+    std::vector<DNSResolvedAddress> addresses(entry.addresses);
+    result.addresses = &addresses;
+    for (const Waiter& waiter: waiters) {
+        waiter.callback(result, waiter.arg);
+    }
+}
+
+void DNSResolver::markIdle(Entry& entry){
+    if (entry.idle == false) {
+        entry.idlePosition = _idle.emplace(entry.expiresAt, &entry);
+        entry.idle = true;
+    }
+}
+
+void DNSResolver::markBusy(Entry& entry){
+    if (entry.idle) {
+        _idle.erase(entry.idlePosition);
+        entry.idle = false;
+    }
+}
+
+void DNSResolver::sweep(){
+    // с запасом до 90% предела - следующие новые имена не платят за вытеснение;
+    // истекшие и неудачные записи стоят в начале, записи с запросами в индексе не участвуют
+    std::size_t batch = std::max<std::size_t>(_config.maxEntries / 10, 1);
+    std::size_t target = (_config.maxEntries > batch) ? (_config.maxEntries - batch) : 0;
+    while ((_entries.size() > target) && (_idle.empty() == false)) {
+        Entry* entry = _idle.begin()->second;
+        _idle.erase(_idle.begin());
+        _entries.erase(_entries.find(entry->name));
+    }
+}
+
+std::size_t DNSResolver::entriesCount() const{
+    return _entries.size();
+}
+
+std::uint64_t DNSResolver::cacheHitsCount() const{
+    return _cacheHits;
+}
+
+std::uint64_t DNSResolver::coalescedCount() const{
+    return _coalesced;
+}
+
+std::uint64_t DNSResolver::upstreamQueriesCount() const{
+    return _upstreamQueries;
+}
+
+std::uint64_t DNSResolver::prefetchesCount() const{
+    return _prefetches;
+}
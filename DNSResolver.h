@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <unordered_map>
+// libevent
+#include <event2/event.h>
+#include <event2/dns.h>
+
+//////////////////////////////////////////////////
+// Адрес из ответа резолвера
+//////////////////////////////////////////////////
+struct DNSResolvedAddress {
+    int family;                 // AF_INET / AF_INET6
+    std::uint8_t address[16];
+};
+
+//////////////////////////////////////////////////
+// Результат разрешения имени, живет только на время колбека
+//////////////////////////////////////////////////
+struct DNSResolveResult {
+    const char* name;
+    int error;                  // DNS_ERR_*
+    std::uint32_t ttl;          // сколько еще секунд ответ считается свежим
+    bool fromCache;
+    const std::vector<DNSResolvedAddress>* addresses;
+};
+
+typedef void (*DNSResolveCallback)(const DNSResolveResult& result, void* arg);
+
+//////////////////////////////////////////////////
+// Настройки резолвера
+//////////////////////////////////////////////////
+struct DNSResolverConfig {
+    const char* upstream;           // "ip[:port]", nullptr - серверы из /etc/resolv.conf
+    bool resolveIPv6;               // запрашивать AAAA вместе с A
+    std::uint32_t minTTL;           // границы TTL положительных ответов, сек.
+    std::uint32_t maxTTL;
+    std::uint32_t negativeTTL;      // сколько помнить NXDOMAIN / отсутствие записей
+    std::uint32_t prefetchPercent;  // горячие записи обновляются, когда осталось меньше N% TTL
+    std::uint32_t prefetchMinHits;  // сколько попаданий делает запись горячей
+    std::size_t maxEntries;         // при переполнении вытесняются свободные записи до 90% предела, ближайшие к истечению первыми
+    int maxInflight;                // предел запросов к серверу в полете (evdns max-inflight); с resolveIPv6 на имя два запроса
+
+    DNSResolverConfig();
+};
+
+//////////////////////////////////////////////////
+// Асинхронный кеширующий резолвер поверх evdns.
+// - кеш положительных и отрицательных ответов с учетом TTL
+// - одновременные запросы одного имени склеиваются в один запрос к серверу
+// - горячие записи обновляются заранее, клиенты продолжают получать старый ответ
+// Работает в потоке своего event_base, без блокировок.
+//////////////////////////////////////////////////
+class DNSResolver {
+public:
+    DNSResolver(event_base* base, const DNSResolverConfig& config);
+    // незавершенные запросы получают DNS_ERR_SHUTDOWN
+    ~DNSResolver();
+
+    DNSResolver(const DNSResolver&) = delete;
+    DNSResolver& operator=(const DNSResolver&) = delete;
+
+    bool isValid() const;
+
+    // При попадании в кеш колбек вызывается сразу, внутри resolve
+    void resolve(const char* name, DNSResolveCallback callback, void* arg);
+
+    std::size_t entriesCount() const;
+    std::uint64_t cacheHitsCount() const;
+    std::uint64_t coalescedCount() const;
+    std::uint64_t upstreamQueriesCount() const;
+    std::uint64_t prefetchesCount() const;
+
+private:
+    struct Waiter {
+        DNSResolveCallback callback;
+        void* arg;
+    };
+
+    struct Entry;
+    // свободные записи (без запросов и ожидающих) по сроку истечения - порядок вытеснения
+    typedef std::multimap<std::int64_t, Entry*> IdleIndex;
+
+    struct Entry {
+        DNSResolver* resolver;
+        std::string name;
+        // последний полученный ответ
+        bool hasAnswer;
+        int error;
+        std::vector<DNSResolvedAddress> addresses;
+        std::int64_t storedAt;      // мс, steady clock
+        std::int64_t expiresAt;
+        std::int64_t refreshAt;
+        std::uint32_t hits;
+        // запрос к серверу в процессе
+        int pendingQueries;
+        int queryError;
+        std::uint32_t queryTTL;
+        std::vector<DNSResolvedAddress> queryAddresses;
+        std::vector<Waiter> waiters;
+        // место в _idle
+        bool idle;
+        IdleIndex::iterator idlePosition;
+    };
+    typedef std::unique_ptr<Entry> EntryPtr;
+
+    event_base* _base;
+    evdns_base* _dnsBase;
+    DNSResolverConfig _config;
+    std::unordered_map<std::string, EntryPtr> _entries;
+    IdleIndex _idle;
+    std::uint64_t _cacheHits;
+    std::uint64_t _coalesced;
+    std::uint64_t _upstreamQueries;
+    std::uint64_t _prefetches;
+
+private:
+    static std::int64_t nowMilliseconds();
+    static bool resolveLocally(const char* name, std::vector<DNSResolvedAddress>& addresses);
+    static void upstreamCallback(int result, char type, int count, int ttl, void* addresses, void* arg);
+
+    void startQuery(Entry& entry);
+    void completeQuery(Entry& entry);
+    void notifyWaiters(Entry& entry, std::vector<Waiter>& waiters);
+    void markIdle(Entry& entry);
+    void markBusy(Entry& entry);
+    // вытеснение свободных записей при переполнении, от ближайших к истечению
+    void sweep();
+};
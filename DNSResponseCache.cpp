@@ -0,0 +1,165 @@
+#include "DNSResponseCache.h"
+// std
+#include <cstring>
+
+
+static inline std::uint16_t readUint16(const std::uint8_t* data){
+    return (std::uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline std::uint32_t readUint32(const std::uint8_t* data){
+    return ((std::uint32_t)data[0] << 24) | ((std::uint32_t)data[1] << 16) | ((std::uint32_t)data[2] << 8) | data[3];
+}
+
+static inline void writeUint32(std::uint8_t* data, std::uint32_t value){
+    data[0] = (std::uint8_t)(value >> 24);
+    data[1] = (std::uint8_t)(value >> 16);
+    data[2] = (std::uint8_t)(value >> 8);
+    data[3] = (std::uint8_t)(value & 0xFF);
+}
+
+DNSResponseCache::DNSResponseCache(std::size_t capacity, bool decrementTTL):
+    _mask(0),
+    _decrementTTL(decrementTTL),
+    _useCounter(0),
+    _hits(0),
+    _misses(0){
+
+    // минимум одна пара ячеек
+    std::size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    _entries.resize(size);
+    _mask = size - 1;
+    clear();
+}
+
+std::uint64_t DNSResponseCache::hashQuestion(const DNSQuestion& question){
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < question.nameLength; ++i) {
+        hash ^= (std::uint8_t)question.name[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= ((std::uint64_t)question.type << 16) | question.dnsClass;
+    hash *= 1099511628211ULL;
+    hash ^= hash >> 29;
+    return hash ? hash : 1;
+}
+
+bool DNSResponseCache::matches(const Entry& entry, std::uint64_t hash, const DNSQuestion& question) const{
+    return (entry.hash == hash) &&
+           (entry.type == question.type) &&
+           (entry.dnsClass == question.dnsClass) &&
+           (entry.nameLength == question.nameLength) &&
+           (memcmp(entry.name, question.name, question.nameLength) == 0);
+}
+
+std::size_t DNSResponseCache::lookup(const std::uint8_t* query, const DNSQuestion& question, std::uint8_t* answer, std::uint32_t now){
+    // кешируются только обычные запросы
+    if (question.flags & DNS_OPCODE_MASK) {
+        ++_misses;
+        return 0;
+    }
+
+    std::uint64_t hash = hashQuestion(question);
+    std::size_t index = (std::size_t)hash & _mask & ~(std::size_t)1;
+    Entry* entry = nullptr;
+    for (std::size_t i = index; i < index + 2; ++i) {
+        if (matches(_entries[i], hash, question)) {
+            entry = &_entries[i];
+            break;
+        }
+    }
+    if ((entry == nullptr) || (now >= entry->expiresAt)) {
+        ++_misses;
+        return 0;
+    }
+
+    entry->lastUsed = ++_useCounter;
+    ++_hits;
+
+    // готовый пакет + правки из текущего запроса
+    memcpy(answer, entry->packet, entry->packetSize);
+    answer[0] = query[0];
+    answer[1] = query[1];
+    answer[2] = (answer[2] & ~(DNS_FLAG_RD >> 8)) | (query[2] & (DNS_FLAG_RD >> 8));
+    memcpy(answer + DNS_HEADER_SIZE, query + DNS_HEADER_SIZE, question.questionEnd - DNS_HEADER_SIZE);
+
+    if (_decrementTTL && (now > entry->storedAt)) {
+        std::uint32_t age = now - entry->storedAt;
+        for (std::uint16_t i = 0; i < entry->ttlOffsetsCount; ++i) {
+            std::uint8_t* ttl = answer + entry->ttlOffsets[i];
+            std::uint32_t value = readUint32(ttl);
+            writeUint32(ttl, (value > age) ? (value - age) : 0);
+        }
+    }
+
+    return entry->packetSize;
+}
+
+void DNSResponseCache::store(const DNSQuestion& question, const std::uint8_t* answer, std::size_t answerSize, std::uint32_t maxAge, std::uint32_t now){
+    if ((question.flags & DNS_OPCODE_MASK) || (answerSize > DNS_MAX_UDP_PACKET) || (maxAge == 0)) {
+        return;
+    }
+
+    // позиции TTL всех записей ответа
+    std::uint16_t ttlOffsets[MAX_TTL_OFFSETS];
+    std::uint16_t ttlOffsetsCount = 0;
+    if (_decrementTTL) {
+        std::size_t recordsCount = (std::size_t)readUint16(answer + 6) + readUint16(answer + 8) + readUint16(answer + 10);
+        if (recordsCount > MAX_TTL_OFFSETS) {
+            return;
+        }
+        std::size_t offset = question.questionEnd;
+        for (std::size_t i = 0; i < recordsCount; ++i) {
+            // имя: метки до нуля или ссылка
+            while ((offset < answerSize) && (answer[offset] != 0) && ((answer[offset] & 0xC0) != 0xC0)) {
+                offset += answer[offset] + 1;
+            }
+            offset += ((offset < answerSize) && (answer[offset] != 0)) ? 2 : 1;
+            if (offset + 10 > answerSize) {
+                return;
+            }
+            ttlOffsets[ttlOffsetsCount++] = (std::uint16_t)(offset + 4);
+            offset += 10 + readUint16(answer + offset + 8);
+        }
+    }
+
+    // из пары ячеек вытесняем давно не использованную
+    std::uint64_t hash = hashQuestion(question);
+    std::size_t index = (std::size_t)hash & _mask & ~(std::size_t)1;
+    Entry* entry = &_entries[index];
+    if (matches(_entries[index + 1], hash, question) ||
+        ((matches(_entries[index], hash, question) == false) && (_entries[index + 1].lastUsed < _entries[index].lastUsed))) {
+        entry = &_entries[index + 1];
+    }
+
+    entry->hash = hash;
+    entry->storedAt = now;
+    entry->expiresAt = now + maxAge;
+    entry->lastUsed = ++_useCounter;
+    entry->type = question.type;
+    entry->dnsClass = question.dnsClass;
+    entry->nameLength = (std::uint16_t)question.nameLength;
+    entry->packetSize = (std::uint16_t)answerSize;
+    entry->ttlOffsetsCount = ttlOffsetsCount;
+    memcpy(entry->ttlOffsets, ttlOffsets, ttlOffsetsCount * sizeof(std::uint16_t));
+    memcpy(entry->name, question.name, question.nameLength);
+    memcpy(entry->packet, answer, answerSize);
+}
+
+void DNSResponseCache::clear(){
+    for (Entry& entry: _entries) {
+        entry.hash = 0;
+        entry.lastUsed = 0;
+    }
+}
+
+std::uint64_t DNSResponseCache::hitsCount() const{
+    return _hits;
+}
+
+std::uint64_t DNSResponseCache::missesCount() const{
+    return _misses;
+}
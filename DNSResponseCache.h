@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+// server
+#include "DNSWire.h"
+
+//////////////////////////////////////////////////
+// Кеш готовых DNS ответов по нормализованному вопросу (имя в нижнем регистре, тип, класс).
+// Хранит пакет целиком, при попадании меняются только id, флаг RD и регистр имени
+// в вопросе (0x20 кодирование резолверов), при включенном режиме - еще и TTL.
+// Один экземпляр на поток - без блокировок.
+//////////////////////////////////////////////////
+class DNSResponseCache {
+public:
+    // capacity округляется до степени двойки, decrementTTL - уменьшать TTL на возраст записи
+    DNSResponseCache(std::size_t capacity, bool decrementTTL);
+
+    // Попытка ответить из кеша, возвращает размер ответа или 0 при промахе
+    std::size_t lookup(const std::uint8_t* query, const DNSQuestion& question, std::uint8_t* answer, std::uint32_t now);
+    // Сохранение собранного ответа, maxAge - сколько секунд запись считается свежей
+    void store(const DNSQuestion& question, const std::uint8_t* answer, std::size_t answerSize, std::uint32_t maxAge, std::uint32_t now);
+    void clear();
+
+    std::uint64_t hitsCount() const;
+    std::uint64_t missesCount() const;
+
+private:
+    enum { MAX_TTL_OFFSETS = 16 };
+
+    struct Entry {
+        std::uint64_t hash;         // 0 - пустая запись
+        std::uint32_t storedAt;
+        std::uint32_t expiresAt;
+        std::uint32_t lastUsed;
+        std::uint16_t type;
+        std::uint16_t dnsClass;
+        std::uint16_t nameLength;
+        std::uint16_t packetSize;
+        std::uint16_t ttlOffsetsCount;
+        std::uint16_t ttlOffsets[MAX_TTL_OFFSETS];
+        char name[DNS_MAX_NAME_LENGTH + 1];
+        std::uint8_t packet[DNS_MAX_UDP_PACKET];
+    };
+
+    std::vector<Entry> _entries;
+    std::size_t _mask;
+    bool _decrementTTL;
+    std::uint32_t _useCounter;
+    std::uint64_t _hits;
+    std::uint64_t _misses;
+
+private:
+    static std::uint64_t hashQuestion(const DNSQuestion& question);
+    bool matches(const Entry& entry, std::uint64_t hash, const DNSQuestion& question) const;
+};
@@ -0,0 +1,200 @@
+#include "DNSWire.h"
+// std
+#include <cstring>
+
+
+static inline std::uint16_t readUint16(const std::uint8_t* data){
+    return (std::uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline void writeUint16(std::uint8_t* data, std::uint16_t value){
+    data[0] = (std::uint8_t)(value >> 8);
+    data[1] = (std::uint8_t)(value & 0xFF);
+}
+
+static inline void writeUint32(std::uint8_t* data, std::uint32_t value){
+    data[0] = (std::uint8_t)(value >> 24);
+    data[1] = (std::uint8_t)(value >> 16);
+    data[2] = (std::uint8_t)(value >> 8);
+    data[3] = (std::uint8_t)(value & 0xFF);
+}
+
+bool dnsParseQuery(const std::uint8_t* packet, std::size_t size, DNSQuestion& question){
+    if (size < DNS_HEADER_SIZE) {
+        return false;
+    }
+
+    question.id = readUint16(packet);
+    question.flags = readUint16(packet + 2);
+    std::uint16_t questionsCount = readUint16(packet + 4);
+
+    // ответы и запросы без вопросов не обрабатываем
+    if ((question.flags & DNS_FLAG_QR) || (questionsCount == 0)) {
+        return false;
+    }
+
+    // имя: метки с длиной, в нижний регистр
+    std::size_t offset = DNS_HEADER_SIZE;
+    std::size_t nameLength = 0;
+    while (true) {
+        if (offset >= size) {
+            return false;
+        }
+        std::uint8_t labelLength = packet[offset++];
+        if (labelLength == 0) {
+            break;
+        }
+        // сжатие имен в вопросе запроса не поддерживаем
+        if (labelLength & 0xC0) {
+            return false;
+        }
+        if ((offset + labelLength > size) || (nameLength + labelLength + 1 > DNS_MAX_NAME_LENGTH)) {
+            return false;
+        }
+        if (nameLength > 0) {
+            question.name[nameLength++] = '.';
+        }
+        for (std::uint8_t i = 0; i < labelLength; ++i) {
+            char c = (char)packet[offset + i];
+            if ((c >= 'A') && (c <= 'Z')) {
+                c += 'a' - 'A';
+            }
+            question.name[nameLength++] = c;
+        }
+        offset += labelLength;
+    }
+    question.name[nameLength] = '\0';
+    question.nameLength = nameLength;
+
+    // тип + класс
+    if (offset + 4 > size) {
+        return false;
+    }
+    question.type = readUint16(packet + offset);
+    question.dnsClass = readUint16(packet + offset + 2);
+    question.questionEnd = offset + 4;
+
+    return true;
+}
+
+std::size_t dnsEncodeName(const char* name, std::size_t nameLength, std::uint8_t* out, std::size_t capacity){
+    // завершающая точка не нужна
+    if ((nameLength > 0) && (name[nameLength - 1] == '.')) {
+        --nameLength;
+    }
+    if ((nameLength + 2 > capacity) || (nameLength > DNS_MAX_NAME_LENGTH - 1)) {
+        return 0;
+    }
+
+    std::size_t size = 0;
+    std::size_t labelStart = 0;
+    for (std::size_t i = 0; i <= nameLength; ++i) {
+        if ((i == nameLength) || (name[i] == '.')) {
+            std::size_t labelLength = i - labelStart;
+            if ((labelLength == 0) && (nameLength > 0)) {
+                return 0;
+            }
+            if (labelLength > 63) {
+                return 0;
+            }
+            if (labelLength > 0) {
+                out[size++] = (std::uint8_t)labelLength;
+                memcpy(out + size, name + labelStart, labelLength);
+                size += labelLength;
+            }
+            labelStart = i + 1;
+        }
+    }
+    out[size++] = 0;
+
+    return size;
+}
+
+//////////////////////////////////////////////////
+// DNSResponseWriter
+//////////////////////////////////////////////////
+DNSResponseWriter::DNSResponseWriter(std::uint8_t* buffer, std::size_t capacity):
+    _buffer(buffer),
+    _capacity(capacity),
+    _size(0),
+    _answersCount(0),
+    _truncated(false){
+}
+
+bool DNSResponseWriter::begin(const std::uint8_t* query, const DNSQuestion& question, int rcode){
+    if (question.questionEnd > _capacity) {
+        return false;
+    }
+
+    // копируем заголовок и первый вопрос как есть, регистр имени сохраняется
+    memcpy(_buffer, query, question.questionEnd);
+
+    std::uint16_t flags = DNS_FLAG_QR | DNS_FLAG_AA | (question.flags & (DNS_OPCODE_MASK | DNS_FLAG_RD)) | (rcode & 0x0F);
+    writeUint16(_buffer + 2, flags);
+    writeUint16(_buffer + 4, 1);   // вопрос
+    writeUint16(_buffer + 6, 0);   // ответы
+    writeUint16(_buffer + 8, 0);   // authority
+    writeUint16(_buffer + 10, 0);  // additional
+
+    _size = question.questionEnd;
+    _answersCount = 0;
+    _truncated = false;
+
+    return true;
+}
+
+bool DNSResponseWriter::addRecord(std::uint16_t type, std::uint32_t ttl, const void* data, std::uint16_t dataLength){
+    const std::size_t recordSize = 12 + dataLength;
+    if (_size + recordSize > _capacity) {
+        _truncated = true;
+        return false;
+    }
+
+    std::uint8_t* record = _buffer + _size;
+    writeUint16(record, 0xC000 | DNS_HEADER_SIZE);   // ссылка на имя из вопроса
+    writeUint16(record + 2, type);
+    writeUint16(record + 4, EVDNS_CLASS_INET);
+    writeUint32(record + 6, ttl);
+    writeUint16(record + 10, dataLength);
+    memcpy(record + 12, data, dataLength);
+
+    _size += recordSize;
+    ++_answersCount;
+
+    return true;
+}
+
+bool DNSResponseWriter::addNameRecord(std::uint16_t type, std::uint32_t ttl, const char* name){
+    std::uint8_t encodedName[DNS_MAX_NAME_LENGTH + 1];
+    std::size_t encodedSize = dnsEncodeName(name, strlen(name), encodedName, sizeof(encodedName));
+    if (encodedSize == 0) {
+        return false;
+    }
+    return addRecord(type, ttl, encodedName, (std::uint16_t)encodedSize);
+}
+
+bool DNSResponseWriter::addEncodedRecords(const std::uint8_t* records, std::size_t size, std::uint16_t count){
+    if (_size + size > _capacity) {
+        _truncated = true;
+        return false;
+    }
+    memcpy(_buffer + _size, records, size);
+    _size += size;
+    _answersCount += count;
+
+    return true;
+}
+
+void DNSResponseWriter::setResponseCode(int rcode){
+    std::uint16_t flags = readUint16(_buffer + 2);
+    flags = (flags & ~0x000F) | (rcode & 0x0F);
+    writeUint16(_buffer + 2, flags);
+}
+
+std::size_t DNSResponseWriter::finish(){
+    writeUint16(_buffer + 6, _answersCount);
+    if (_truncated) {
+        writeUint16(_buffer + 2, readUint16(_buffer + 2) | DNS_FLAG_TC);
+    }
+    return _size;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+// libevent
+#include <event2/dns.h>
+
+//////////////////////////////////////////////////
+// Разбор и сборка DNS пакетов в wire-формате (RFC 1035)
+// без аллокаций - используется там, где evdns_server_port
+// не подходит (пакетная обработка recvmmsg/sendmmsg)
+//////////////////////////////////////////////////
+
+#define DNS_HEADER_SIZE 12
+#define DNS_MAX_NAME_LENGTH 255
+#define DNS_MAX_UDP_PACKET 512
+
+// флаги заголовка
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_AA 0x0400
+#define DNS_FLAG_TC 0x0200
+#define DNS_FLAG_RD 0x0100
+#define DNS_OPCODE_MASK 0x7800
+
+// Вопрос из входящего запроса
+struct DNSQuestion {
+    std::uint16_t id;
+    std::uint16_t flags;
+    std::uint16_t type;
+    std::uint16_t dnsClass;
+    char name[DNS_MAX_NAME_LENGTH + 1];    // в нижнем регистре, через точку, без завершающей точки
+    std::size_t nameLength;
+    std::size_t questionEnd;    // смещение конца первого вопроса в пакете
+};
+
+// Разбор запроса: заголовок + первый вопрос.
+// false - пакет не является корректным запросом
+bool dnsParseQuery(const std::uint8_t* packet, std::size_t size, DNSQuestion& question);
+
+// Кодирование имени "a.b.c" в wire-формат, возвращает размер или 0 при ошибке
+std::size_t dnsEncodeName(const char* name, std::size_t nameLength, std::uint8_t* out, std::size_t capacity);
+
+//////////////////////////////////////////////////
+// Сборщик ответа в заранее выделенном буффере
+//////////////////////////////////////////////////
+class DNSResponseWriter {
+public:
+    DNSResponseWriter(std::uint8_t* buffer, std::size_t capacity);
+
+    // заголовок + копия вопроса из исходного запроса
+    bool begin(const std::uint8_t* query, const DNSQuestion& question, int rcode);
+    // ответная запись, имя - ссылка на имя из вопроса (0xC00C)
+    bool addRecord(std::uint16_t type, std::uint32_t ttl, const void* data, std::uint16_t dataLength);
+    // запись с именем в данных (PTR, CNAME)
+    bool addNameRecord(std::uint16_t type, std::uint32_t ttl, const char* name);
+    // заранее закодированные записи целиком
+    bool addEncodedRecords(const std::uint8_t* records, std::size_t size, std::uint16_t count);
+    void setResponseCode(int rcode);
+    // размер готового пакета
+    std::size_t finish();
+
+private:
+    std::uint8_t* _buffer;
+    std::size_t _capacity;
+    std::size_t _size;
+    std::uint16_t _answersCount;
+    bool _truncated;
+};
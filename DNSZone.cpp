@@ -0,0 +1,483 @@
+#include "DNSZone.h"
+// std
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
+// system
+#include <arpa/inet.h>
+// libevent
+#include <event2/dns.h>
+#include <event2/util.h>
+// server
+#include "DNSWire.h"
+
+
+#define ZONE_DEFAULT_TTL 3600
+#define ZONE_MAX_LINE 4096
+#define ZONE_MAX_TOKENS 64
+
+const char DNS_DEFAULT_ZONE[] =
+    "$TTL 4242\n"
+    "localhost. IN A 127.0.0.1\n"
+    "localhost. IN AAAA ::1\n"
+    "1.0.0.127.in-addr.arpa. IN PTR LOCALHOST.\n"
+    "1.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.ip6.arpa. IN PTR LOCALHOST.\n";
+
+static inline char asciiToLower(char c){
+    return ((c >= 'A') && (c <= 'Z')) ? (char)(c + ('a' - 'A')) : c;
+}
+
+std::size_t dnsNormalizeName(const char* name, char* out, std::size_t capacity){
+    std::size_t length = strlen(name);
+    if ((length > 0) && (name[length - 1] == '.')) {
+        --length;
+    }
+    if (length + 1 > capacity) {
+        return 0;
+    }
+    for (std::size_t i = 0; i < length; ++i) {
+        out[i] = asciiToLower(name[i]);
+    }
+    out[length] = '\0';
+    return length;
+}
+
+DNSZoneTable::DNSZoneTable():
+    _mask(0),
+    _namesCount(0),
+    _recordsCount(0){
+}
+
+//////////////////////////////////////////////////
+// Загрузка
+//////////////////////////////////////////////////
+bool DNSZoneTable::loadFromFile(const char* path, std::string& error){
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        error = std::string("Не получилось открыть файл зоны: ") + path;
+        return false;
+    }
+
+    std::string origin;
+    std::uint32_t defaultTTL = ZONE_DEFAULT_TTL;
+    char line[ZONE_MAX_LINE];
+    int lineNumber = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+        if (parseLine(line, origin, defaultTTL, error) == false) {
+            error = std::string(path) + ":" + std::to_string(lineNumber) + ": " + error;
+            ok = false;
+            break;
+        }
+    }
+    fclose(file);
+
+    if (ok) {
+        build();
+    }
+    return ok;
+}
+
+bool DNSZoneTable::loadFromString(const std::string& text, std::string& error){
+    std::string origin;
+    std::uint32_t defaultTTL = ZONE_DEFAULT_TTL;
+    std::vector<char> line;
+    std::size_t start = 0;
+    int lineNumber = 0;
+    while (start < text.size()) {
+        std::size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        ++lineNumber;
+        line.assign(text.begin() + start, text.begin() + end);
+        line.push_back('\0');
+        if (parseLine(line.data(), origin, defaultTTL, error) == false) {
+            error = std::to_string(lineNumber) + ": " + error;
+            return false;
+        }
+        start = end + 1;
+    }
+
+    build();
+    return true;
+}
+
+// Разбиение строки на токены, строки в кавычках - один токен без кавычек
+static int tokenizeLine(char* line, char* tokens[]){
+    int count = 0;
+    char* position = line;
+    while (*position && (count < ZONE_MAX_TOKENS)) {
+        while (*position && isspace((unsigned char)*position)) {
+            ++position;
+        }
+        if ((*position == '\0') || (*position == ';')) {
+            break;
+        }
+        if (*position == '"') {
+            tokens[count++] = ++position;
+            while (*position && (*position != '"')) {
+                ++position;
+            }
+        } else {
+            tokens[count++] = position;
+            while (*position && !isspace((unsigned char)*position)) {
+                ++position;
+            }
+        }
+        if (*position) {
+            *position++ = '\0';
+        }
+    }
+    return count;
+}
+
+static bool isNumber(const char* text){
+    if (*text == '\0') {
+        return false;
+    }
+    for (; *text; ++text) {
+        if ((*text < '0') || (*text > '9')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DNSZoneTable::parseLine(char* line, std::string& origin, std::uint32_t& defaultTTL, std::string& error){
+    // строка с пробела продолжает предыдущее имя
+    bool continuation = (line[0] == ' ') || (line[0] == '\t');
+
+    char* tokens[ZONE_MAX_TOKENS];
+    int count = tokenizeLine(line, tokens);
+    if (count == 0) {
+        return true;
+    }
+
+    // директивы
+    if (strcmp(tokens[0], "$TTL") == 0) {
+        if ((count < 2) || !isNumber(tokens[1])) {
+            error = "неверный $TTL";
+            return false;
+        }
+        defaultTTL = (std::uint32_t)strtoul(tokens[1], nullptr, 10);
+        return true;
+    }
+    if (strcmp(tokens[0], "$ORIGIN") == 0) {
+        if (count < 2) {
+            error = "неверный $ORIGIN";
+            return false;
+        }
+        origin = tokens[1];
+        return true;
+    }
+
+    // имя
+    int index = 0;
+    std::string& ownerName = _lastOwnerName;
+    if (continuation == false) {
+        const char* name = tokens[index++];
+        if (strcmp(name, "@") == 0) {
+            ownerName = origin;
+        } else {
+            ownerName = name;
+            if ((ownerName.empty() == false) && (ownerName.back() != '.') && (origin.empty() == false)) {
+                ownerName += ".";
+                ownerName += origin;
+            }
+        }
+    }
+
+    // [ttl] [IN] тип
+    std::uint32_t ttl = defaultTTL;
+    if ((index < count) && isNumber(tokens[index])) {
+        ttl = (std::uint32_t)strtoul(tokens[index++], nullptr, 10);
+    }
+    if ((index < count) && (evutil_ascii_strcasecmp(tokens[index], "IN") == 0)) {
+        ++index;
+    }
+    if (index + 1 >= count) {
+        error = "не хватает типа или данных записи";
+        return false;
+    }
+    const char* typeName = tokens[index++];
+
+    char name[DNS_MAX_NAME_LENGTH + 1];
+    std::size_t nameLength = dnsNormalizeName(ownerName.c_str(), name, sizeof(name));
+    if ((nameLength == 0) && (ownerName.empty() == false) && (ownerName != ".")) {
+        error = "слишком длинное имя";
+        return false;
+    }
+
+    // данные записи в wire-формате
+    std::uint8_t data[DNS_MAX_UDP_PACKET];
+    std::size_t dataLength = 0;
+    std::uint16_t type = 0;
+    if (evutil_ascii_strcasecmp(typeName, "A") == 0) {
+        type = EVDNS_TYPE_A;
+        if (inet_pton(AF_INET, tokens[index], data) != 1) {
+            error = "неверный IPv4 адрес";
+            return false;
+        }
+        dataLength = 4;
+    } else if (evutil_ascii_strcasecmp(typeName, "AAAA") == 0) {
+        type = EVDNS_TYPE_AAAA;
+        if (inet_pton(AF_INET6, tokens[index], data) != 1) {
+            error = "неверный IPv6 адрес";
+            return false;
+        }
+        dataLength = 16;
+    } else if ((evutil_ascii_strcasecmp(typeName, "PTR") == 0) || (evutil_ascii_strcasecmp(typeName, "CNAME") == 0)) {
+        type = (evutil_ascii_strcasecmp(typeName, "PTR") == 0) ? EVDNS_TYPE_PTR : EVDNS_TYPE_CNAME;
+        std::string target = tokens[index];
+        if (target.empty()) {
+            // пустое имя в кавычках ("")
+            error = "пустое имя в данных записи";
+            return false;
+        }
+        if ((target.back() != '.') && (origin.empty() == false)) {
+            target += ".";
+            target += origin;
+        }
+        dataLength = dnsEncodeName(target.c_str(), target.size(), data, sizeof(data));
+        if (dataLength == 0) {
+            error = "неверное имя в данных записи";
+            return false;
+        }
+    } else if (evutil_ascii_strcasecmp(typeName, "TXT") == 0) {
+        type = EVDNS_TYPE_TXT;
+        for (; index < count; ++index) {
+            std::size_t length = strlen(tokens[index]);
+            if ((length > 255) || (dataLength + length + 1 > sizeof(data))) {
+                error = "слишком длинная TXT запись";
+                return false;
+            }
+            data[dataLength++] = (std::uint8_t)length;
+            memcpy(data + dataLength, tokens[index], length);
+            dataLength += length;
+        }
+    } else {
+        error = std::string("неподдерживаемый тип записи ") + typeName;
+        return false;
+    }
+
+    return addRecord(name, nameLength, type, ttl, data, (std::uint16_t)dataLength);
+}
+
+bool DNSZoneTable::addRecord(const char* name, std::size_t nameLength, std::uint16_t type, std::uint32_t ttl,
+                             const std::uint8_t* data, std::uint16_t dataLength){
+    if ((nameLength > DNS_MAX_NAME_LENGTH) || (type == 0)) {
+        return false;
+    }
+
+    PendingRecord record;
+    record.nameOffset = (std::uint32_t)_names.size();
+    record.nameLength = (std::uint16_t)nameLength;
+    record.type = type;
+    record.recordOffset = (std::uint32_t)_records.size();
+    record.recordSize = 12 + dataLength;
+
+    for (std::size_t i = 0; i < nameLength; ++i) {
+        _names.push_back(asciiToLower(name[i]));
+    }
+
+    // RR целиком: ссылка на имя вопроса, тип, класс, ttl, данные
+    std::uint8_t header[12] = {
+        0xC0, DNS_HEADER_SIZE,
+        (std::uint8_t)(type >> 8), (std::uint8_t)(type & 0xFF),
+        0, EVDNS_CLASS_INET,
+        (std::uint8_t)(ttl >> 24), (std::uint8_t)(ttl >> 16), (std::uint8_t)(ttl >> 8), (std::uint8_t)(ttl & 0xFF),
+        (std::uint8_t)(dataLength >> 8), (std::uint8_t)(dataLength & 0xFF)
+    };
+    _records.insert(_records.end(), header, header + sizeof(header));
+    _records.insert(_records.end(), data, data + dataLength);
+
+    _pending.push_back(record);
+
+    return true;
+}
+
+//////////////////////////////////////////////////
+// Построение таблицы
+//////////////////////////////////////////////////
+std::uint64_t DNSZoneTable::hashKey(const char* name, std::size_t nameLength, std::uint16_t type){
+    // FNV-1a + перемешивание типа
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < nameLength; ++i) {
+        hash ^= (std::uint8_t)name[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= type;
+    hash *= 1099511628211ULL;
+    hash ^= hash >> 29;
+    // 0 зарезервирован под пустую ячейку
+    return hash ? hash : 1;
+}
+
+void DNSZoneTable::insertSlot(const Slot& slot){
+    std::uint64_t index = slot.hash & _mask;
+    while (_slots[index].hash != 0) {
+        index = (index + 1) & _mask;
+    }
+    _slots[index] = slot;
+}
+
+void DNSZoneTable::build(){
+    const std::vector<char>& names = _names;
+    auto compareNames = [&names](const PendingRecord& a, const PendingRecord& b) -> int {
+        std::size_t length = std::min(a.nameLength, b.nameLength);
+        int result = memcmp(names.data() + a.nameOffset, names.data() + b.nameOffset, length);
+        if (result != 0) {
+            return result;
+        }
+        return (int)a.nameLength - (int)b.nameLength;
+    };
+
+    // группируем по (имя, тип), порядок записей внутри группы сохраняем
+    std::stable_sort(_pending.begin(), _pending.end(), [&](const PendingRecord& a, const PendingRecord& b){
+        int result = compareNames(a, b);
+        if (result != 0) {
+            return result < 0;
+        }
+        return a.type < b.type;
+    });
+
+    // сколько групп и имен
+    std::size_t groupsCount = 0;
+    std::size_t namesCount = 0;
+    for (std::size_t i = 0; i < _pending.size(); ++i) {
+        bool newName = (i == 0) || (compareNames(_pending[i - 1], _pending[i]) != 0);
+        if (newName) {
+            ++namesCount;
+        }
+        if (newName || (_pending[i - 1].type != _pending[i].type)) {
+            ++groupsCount;
+        }
+    }
+
+    // таблица заполнена не больше чем наполовину
+    std::uint64_t capacity = 16;
+    while (capacity < (groupsCount + namesCount) * 2) {
+        capacity <<= 1;
+    }
+    _slots.assign(capacity, Slot());
+    _mask = capacity - 1;
+
+    // новые плотные арены: имена без повторов, записи группами подряд
+    std::vector<char> newNames;
+    std::vector<std::uint8_t> newRecords;
+    newNames.reserve(_names.size());
+    newRecords.reserve(_records.size());
+
+    struct Group {
+        std::uint32_t nameOffset;
+        std::uint16_t nameLength;
+        std::uint16_t type;
+        std::uint32_t recordsOffset;
+        std::uint32_t recordsSize;
+        std::uint16_t recordsCount;
+    };
+    std::vector<Group> groups;
+    groups.reserve(groupsCount + namesCount);
+
+    std::uint32_t currentNameOffset = 0;
+    for (std::size_t i = 0; i < _pending.size(); ++i) {
+        const PendingRecord& record = _pending[i];
+        bool newName = (i == 0) || (compareNames(_pending[i - 1], record) != 0);
+        if (newName) {
+            currentNameOffset = (std::uint32_t)newNames.size();
+            newNames.insert(newNames.end(), _names.begin() + record.nameOffset, _names.begin() + record.nameOffset + record.nameLength);
+
+            // метка существования имени
+            Group marker = {currentNameOffset, record.nameLength, 0, 0, 0, 0};
+            groups.push_back(marker);
+        }
+        if (newName || (_pending[i - 1].type != record.type)) {
+            Group group = {currentNameOffset, record.nameLength, record.type, (std::uint32_t)newRecords.size(), 0, 0};
+            groups.push_back(group);
+        }
+        Group& group = groups.back();
+        newRecords.insert(newRecords.end(), _records.begin() + record.recordOffset, _records.begin() + record.recordOffset + record.recordSize);
+        group.recordsSize += record.recordSize;
+        ++group.recordsCount;
+    }
+
+    _names.swap(newNames);
+    _records.swap(newRecords);
+    _names.shrink_to_fit();
+    _records.shrink_to_fit();
+
+    // после этого арены не меняются - можно отдавать указатели
+    for (const Group& group: groups) {
+        Slot slot;
+        slot.hash = hashKey(_names.data() + group.nameOffset, group.nameLength, group.type);
+        slot.nameOffset = group.nameOffset;
+        slot.nameLength = group.nameLength;
+        slot.type = group.type;
+        slot.answer.records = _records.data() + group.recordsOffset;
+        slot.answer.size = group.recordsSize;
+        slot.answer.count = group.recordsCount;
+        slot.answer.type = group.type;
+        insertSlot(slot);
+    }
+
+    _namesCount = namesCount;
+    _recordsCount = _pending.size();
+    _pending.clear();
+    _pending.shrink_to_fit();
+}
+
+//////////////////////////////////////////////////
+// Поиск
+//////////////////////////////////////////////////
+const DNSZoneTable::Slot* DNSZoneTable::findSlot(const char* name, std::size_t nameLength, std::uint16_t type) const{
+    if (_slots.empty()) {
+        return nullptr;
+    }
+
+    std::uint64_t hash = hashKey(name, nameLength, type);
+    std::uint64_t index = hash & _mask;
+    while (true) {
+        const Slot& slot = _slots[index];
+        if (slot.hash == 0) {
+            return nullptr;
+        }
+        if ((slot.hash == hash) &&
+            (slot.type == type) &&
+            (slot.nameLength == nameLength) &&
+            (memcmp(_names.data() + slot.nameOffset, name, nameLength) == 0)) {
+            return &slot;
+        }
+        index = (index + 1) & _mask;
+    }
+}
+
+const DNSZoneAnswer* DNSZoneTable::find(const char* name, std::size_t nameLength, std::uint16_t type) const{
+    const Slot* slot = findSlot(name, nameLength, type);
+    if (slot) {
+        return &slot->answer;
+    }
+    // имя может быть псевдонимом
+    if (type != EVDNS_TYPE_CNAME) {
+        slot = findSlot(name, nameLength, EVDNS_TYPE_CNAME);
+        if (slot) {
+            return &slot->answer;
+        }
+    }
+    return nullptr;
+}
+
+bool DNSZoneTable::hasName(const char* name, std::size_t nameLength) const{
+    return findSlot(name, nameLength, 0) != nullptr;
+}
+
+std::size_t DNSZoneTable::namesCount() const{
+    return _namesCount;
+}
+
+std::size_t DNSZoneTable::recordsCount() const{
+    return _recordsCount;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////
+// Авторитетная зона в памяти:
+// имена в нижнем регистре, open addressing таблица по (имя, тип),
+// записи заранее закодированы в wire-формат (имя - ссылка 0xC00C на вопрос)
+//////////////////////////////////////////////////
+
+// Результат поиска - готовые записи для секции ответов
+struct DNSZoneAnswer {
+    const std::uint8_t* records;
+    std::uint32_t size;
+    std::uint16_t count;
+    std::uint16_t type;     // тип найденных записей (CNAME вместо запрошенного)
+};
+
+class DNSZoneTable {
+public:
+    DNSZoneTable();
+    // в слотах лежат указатели на арены - не копируем
+    DNSZoneTable(const DNSZoneTable&) = delete;
+    DNSZoneTable& operator=(const DNSZoneTable&) = delete;
+
+    // Загрузка из файла формата:
+    //     $TTL 4242
+    //     $ORIGIN example.com.
+    //     localhost.   [ttl] [IN] A     127.0.0.1
+    //     www          CNAME localhost.
+    //     txt          TXT   "text" "more text"
+    // поддерживаются A, AAAA, PTR, CNAME, TXT
+    bool loadFromFile(const char* path, std::string& error);
+    bool loadFromString(const std::string& text, std::string& error);
+
+    // Добавление записи с готовыми данными, после добавления нужен build()
+    bool addRecord(const char* name, std::size_t nameLength, std::uint16_t type, std::uint32_t ttl,
+                   const std::uint8_t* data, std::uint16_t dataLength);
+    // Построение хеш таблицы, после этого таблица только читается
+    void build();
+
+    // Поиск без аллокаций, имя должно быть в нижнем регистре без завершающей точки.
+    // nullptr - нет записей такого типа (и нет CNAME)
+    const DNSZoneAnswer* find(const char* name, std::size_t nameLength, std::uint16_t type) const;
+    // есть ли вообще такое имя в зоне (NXDOMAIN или пустой ответ)
+    bool hasName(const char* name, std::size_t nameLength) const;
+
+    std::size_t namesCount() const;
+    std::size_t recordsCount() const;
+
+private:
+    // ячейка таблицы
+    struct Slot {
+        std::uint64_t hash;    // 0 - пустая ячейка
+        std::uint32_t nameOffset;
+        std::uint16_t nameLength;
+        std::uint16_t type;    // 0 - метка существования имени
+        DNSZoneAnswer answer;
+    };
+    // запись до построения таблицы
+    struct PendingRecord {
+        std::uint32_t nameOffset;
+        std::uint16_t nameLength;
+        std::uint16_t type;
+        std::uint32_t recordOffset;
+        std::uint32_t recordSize;
+    };
+
+    std::vector<char> _names;
+    std::vector<std::uint8_t> _records;
+    std::vector<Slot> _slots;
+    std::uint64_t _mask;
+    std::vector<PendingRecord> _pending;
+    std::size_t _namesCount;
+    std::size_t _recordsCount;
+    std::string _lastOwnerName;
+
+private:
+    static std::uint64_t hashKey(const char* name, std::size_t nameLength, std::uint16_t type);
+    const Slot* findSlot(const char* name, std::size_t nameLength, std::uint16_t type) const;
+    void insertSlot(const Slot& slot);
+    bool parseLine(char* line, std::string& origin, std::uint32_t& defaultTTL, std::string& error);
+};
+
+// Зона по умолчанию: localhost и обратные имена для 127.0.0.1 и ::1
+extern const char DNS_DEFAULT_ZONE[];
+
+// Перевод имени в нижний регистр без завершающей точки, возвращает длину или 0 если не влезло
+std::size_t dnsNormalizeName(const char* name, char* out, std::size_t capacity);
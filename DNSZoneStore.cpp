@@ -0,0 +1,144 @@
+#include "DNSZoneStore.h"
+// std
+#include <iostream>
+#include <chrono>
+// system
+#include <sys/stat.h>
+#include <signal.h>
+
+
+DNSZoneStore::DNSZoneStore(const char* zonePath, std::size_t maxReaders):
+    _path(zonePath ? zonePath : ""),
+    _domain(maxReaders),
+    _snapshot(_domain),
+    _generation(0){
+}
+
+bool DNSZoneStore::reload(std::string& error){
+    // строим новый снимок целиком, читатели продолжают работать со старым
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::unique_ptr<DNSZoneSnapshot> snapshot(new DNSZoneSnapshot());
+    bool loaded = _path.empty() ? snapshot->table.loadFromString(DNS_DEFAULT_ZONE, error) : snapshot->table.loadFromFile(_path.c_str(), error);
+    if (loaded == false) {
+        return false;
+    }
+    snapshot->generation = ++_generation;
+
+    std::size_t namesCount = snapshot->table.namesCount();
+    std::size_t recordsCount = snapshot->table.recordsCount();
+
+    // подмена + ожидание выхода читателей старого снимка
+    _snapshot.update(std::move(snapshot));
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+    std::cout << "Zone loaded (generation " << _generation << "): " << namesCount << " names, "
+              << recordsCount << " records, " << duration.count() << " ms" << std::endl;
+
+    return true;
+}
+
+int DNSZoneStore::registerReader(){
+    return _domain.registerReader();
+}
+
+RCUDomain& DNSZoneStore::domain(){
+    return _domain;
+}
+
+const DNSZoneSnapshot* DNSZoneStore::current() const{
+    return _snapshot.read();
+}
+
+const std::string& DNSZoneStore::path() const{
+    return _path;
+}
+
+//////////////////////////////////////////////////
+// DNSZoneReloader
+//////////////////////////////////////////////////
+DNSZoneReloader::DNSZoneReloader(DNSZoneStore& store):
+    _store(store),
+    _base(nullptr),
+    _lastModification(0){
+}
+
+DNSZoneReloader::~DNSZoneReloader(){
+    stop();
+}
+
+void DNSZoneReloader::start(){
+    if (_thread) {
+        return;
+    }
+    _base = event_base_new();
+    if (!_base) {
+        std::cout << "Ошибка при создании объекта event_base." << std::endl;
+        return;
+    }
+    _lastModification = modificationTime();
+    _thread.reset(new std::thread(&DNSZoneReloader::threadFunction, this));
+}
+
+void DNSZoneReloader::stop(){
+    if (!_thread) {
+        return;
+    }
+    event_base_loopexit(_base, nullptr);
+    _thread->join();
+    _thread.reset();
+    event_base_free(_base);
+    _base = nullptr;
+}
+
+std::int64_t DNSZoneReloader::modificationTime() const{
+    if (_store.path().empty()) {
+        return 0;
+    }
+    struct stat fileStat;
+    if (stat(_store.path().c_str(), &fileStat) != 0) {
+        return 0;
+    }
+    return (std::int64_t)fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec;
+}
+
+void DNSZoneReloader::reloadIfNeeded(bool force){
+    std::int64_t modification = modificationTime();
+    if ((force == false) && ((modification == 0) || (modification == _lastModification))) {
+        return;
+    }
+    _lastModification = modification;
+
+    std::string error;
+    if (_store.reload(error) == false) {
+        std::cout << "Ошибка перезагрузки зоны, работаем со старой: " << error << std::endl;
+    }
+}
+
+void DNSZoneReloader::threadFunction(){
+    // SIGHUP - принудительная перезагрузка
+    auto signalCallback = [](evutil_socket_t, short, void* arg){
+        DNSZoneReloader* reloader = static_cast<DNSZoneReloader*>(arg);
+        std::cout << "SIGHUP: reloading zone" << std::endl;
+        reloader->reloadIfNeeded(true);
+    };
+    // периодическая проверка времени изменения файла
+    auto timerCallback = [](evutil_socket_t, short, void* arg){
+        DNSZoneReloader* reloader = static_cast<DNSZoneReloader*>(arg);
+        reloader->reloadIfNeeded(false);
+    };
+
+    event* signalEvent = evsignal_new(_base, SIGHUP, signalCallback, this);
+    event_add(signalEvent, nullptr);
+
+    event* timerEvent = event_new(_base, -1, EV_PERSIST, timerCallback, this);
+    timeval interval;
+    interval.tv_sec = 1;
+    interval.tv_usec = 0;
+    event_add(timerEvent, &interval);
+
+    event_base_dispatch(_base);
+
+    event_free(timerEvent);
+    event_free(signalEvent);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+// libevent
+#include <event2/event.h>
+// server
+#include "DNSZone.h"
+#include "RCU.h"
+
+//////////////////////////////////////////////////
+// Снимок зоны: таблица + номер поколения для сброса кешей ответов
+//////////////////////////////////////////////////
+struct DNSZoneSnapshot {
+    DNSZoneTable table;
+    std::uint64_t generation;
+};
+
+//////////////////////////////////////////////////
+// Хранилище зоны с горячей перезагрузкой:
+// потоки обработки читают текущий снимок без блокировок (RCU),
+// новый снимок строится целиком в стороне и подменяется атомарно
+//////////////////////////////////////////////////
+class DNSZoneStore {
+public:
+    // zonePath == nullptr - зона по умолчанию, перезагрузка не поддерживается
+    DNSZoneStore(const char* zonePath, std::size_t maxReaders);
+
+    // первичная и повторная загрузка; при ошибке остается прежний снимок
+    bool reload(std::string& error);
+
+    // регистрация потока обработки, один раз на поток
+    int registerReader();
+    RCUDomain& domain();
+    // текущий снимок, только внутри RCUReadGuard
+    const DNSZoneSnapshot* current() const;
+
+    const std::string& path() const;
+
+private:
+    std::string _path;
+    RCUDomain _domain;
+    RCUPointer<DNSZoneSnapshot> _snapshot;
+    std::uint64_t _generation;
+};
+
+//////////////////////////////////////////////////
+// Поток перезагрузки: SIGHUP или изменение файла зоны (проверка mtime раз в секунду)
+//////////////////////////////////////////////////
+class DNSZoneReloader {
+public:
+    explicit DNSZoneReloader(DNSZoneStore& store);
+    ~DNSZoneReloader();
+
+    void start();
+    void stop();
+
+private:
+    DNSZoneStore& _store;
+    event_base* _base;
+    std::unique_ptr<std::thread> _thread;
+    std::int64_t _lastModification;
+
+private:
+    void threadFunction();
+    void reloadIfNeeded(bool force);
+    std::int64_t modificationTime() const;
+};
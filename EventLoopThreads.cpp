@@ -0,0 +1,109 @@
+#include "EventLoopThreads.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+// system
+#include <unistd.h>
+#include <fcntl.h>
+
+
+// цикл текущего потока для run
+static thread_local void* currentThreadLoop = nullptr;
+
+EventLoopThreads::EventLoopThreads(int threadsCount):
+    _threadsCount(threadsCount){
+}
+
+EventLoopThreads::~EventLoopThreads(){
+    stop();
+}
+
+bool EventLoopThreads::start(const EventLoopFunction& function){
+    for (int i = 0; i < _threadsCount; ++i) {
+        std::unique_ptr<Loop> loop(new Loop());
+        if (pipe(loop->wakeup) < 0) {
+            std::cout << "Ошибка создания канала остановки: " << strerror(errno) << std::endl;
+            stop();
+            return false;
+        }
+        fcntl(loop->wakeup[0], F_SETFD, FD_CLOEXEC);
+        fcntl(loop->wakeup[1], F_SETFD, FD_CLOEXEC);
+        loop->started = false;
+        loop->finished = false;
+        Loop* loopPtr = loop.get();
+        _loops.push_back(std::move(loop));
+
+        _threads.push_back(std::thread([this, loopPtr, function, i](){
+            std::unique_ptr<event_base, decltype(&event_base_free)> base(event_base_new(), &event_base_free);
+            if (base) {
+                currentThreadLoop = loopPtr;
+                function(*this, base.get(), i);
+                currentThreadLoop = nullptr;
+            } else {
+                std::cout << "Ошибка при создании объекта event_base." << std::endl;
+            }
+            setState(loopPtr, loopPtr->started, true);
+        }));
+
+        // ждем, пока поток запустит цикл или завершится с ошибкой
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [loopPtr](){
+            return loopPtr->started || loopPtr->finished;
+        });
+        bool started = loopPtr->started;
+        lock.unlock();
+        if (started == false) {
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void EventLoopThreads::stop(){
+    for (std::unique_ptr<Loop>& loop: _loops) {
+        char byte = 0;
+        ssize_t written = write(loop->wakeup[1], &byte, 1);
+        (void)written;
+    }
+    for (std::thread& thread: _threads) {
+        thread.join();
+    }
+    for (std::unique_ptr<Loop>& loop: _loops) {
+        close(loop->wakeup[0]);
+        close(loop->wakeup[1]);
+    }
+    _threads.clear();
+    _loops.clear();
+}
+
+void EventLoopThreads::run(event_base* base){
+    Loop* loop = static_cast<Loop*>(currentThreadLoop);
+    if (loop == nullptr) {
+        std::cout << "EventLoopThreads::run вызван не из потока пула." << std::endl;
+        return;
+    }
+    event* stopEvent = event_new(base, loop->wakeup[0], EV_READ, stopCallback, base);
+    event_add(stopEvent, nullptr);
+    setState(loop, true, false);
+
+    event_base_dispatch(base);
+
+    event_free(stopEvent);
+}
+
+int EventLoopThreads::size() const{
+    return _threadsCount;
+}
+
+void EventLoopThreads::setState(Loop* loop, bool started, bool finished){
+    std::lock_guard<std::mutex> lock(_mutex);
+    loop->started = started;
+    loop->finished = finished;
+    _condition.notify_all();
+}
+
+void EventLoopThreads::stopCallback(evutil_socket_t, short, void* arg){
+    event_base_loopbreak(static_cast<event_base*>(arg));
+}
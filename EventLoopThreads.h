@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+// libevent
+#include <event2/event.h>
+
+class EventLoopThreads;
+
+// Тело потока: создает объекты потока (серверы, листенеры) на своем стеке
+// и вызывает threads.run(base) - цикл до остановки. Возврат без run - ошибка запуска.
+typedef std::function<void(EventLoopThreads& threads, event_base* base, int index)> EventLoopFunction;
+
+//////////////////////////////////////////////////
+// Потоки, у каждого свой event_base. Потоки запускаются по очереди: следующий стартует,
+// когда предыдущий дошел до run, поэтому первый может привязать сокет, а остальные - принимать с него.
+// Остановка из любого потока: по каналу в каждом цикле, без evthread.
+//////////////////////////////////////////////////
+class EventLoopThreads {
+public:
+    explicit EventLoopThreads(int threadsCount);
+    ~EventLoopThreads();
+
+    EventLoopThreads(const EventLoopThreads&) = delete;
+    EventLoopThreads& operator=(const EventLoopThreads&) = delete;
+
+    // false - какой-то поток не дошел до run, уже запущенные остановлены
+    bool start(const EventLoopFunction& function);
+    void stop();
+
+    // из тела потока: цикл событий до stop
+    void run(event_base* base);
+
+    int size() const;
+
+private:
+    struct Loop {
+        int wakeup[2];          // канал остановки
+        bool started;           // дошел до run
+        bool finished;
+    };
+
+    int _threadsCount;
+    std::vector<std::unique_ptr<Loop>> _loops;
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+
+private:
+    void setState(Loop* loop, bool started, bool finished);
+
+    static void stopCallback(evutil_socket_t fd, short, void* arg);
+};
@@ -0,0 +1,247 @@
+#include "HTTPCompression.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+// zlib
+#include <zlib.h>
+// libevent
+#include <event2/keyvalq_struct.h>
+
+
+// размер одного куска выхода
+#define COMPRESSION_CHUNK_SIZE 16384
+
+HTTPContentEncoding httpChooseEncoding(const char* acceptEncoding){
+    if (acceptEncoding == nullptr) {
+        return HTTP_ENCODING_IDENTITY;
+    }
+
+    // q для gzip и deflate; явные значения приоритетнее "*"
+    double quality[HTTP_ENCODINGS_COUNT] = {0.0, -1.0, -1.0};
+    double anyQuality = -1.0;
+
+    const char* position = acceptEncoding;
+    while (*position != '\0') {
+        while ((*position == ' ') || (*position == ',')) {
+            ++position;
+        }
+        const char* nameEnd = position;
+        while ((*nameEnd != '\0') && (*nameEnd != ',') && (*nameEnd != ';') && (*nameEnd != ' ')) {
+            ++nameEnd;
+        }
+        std::size_t nameLength = nameEnd - position;
+        double value = 1.0;
+        const char* end = nameEnd;
+        while ((*end != '\0') && (*end != ',')) {
+            ++end;
+        }
+        const char* parameter = strstr(nameEnd, "q=");
+        if (parameter && (parameter < end)) {
+            value = atof(parameter + 2);
+        }
+
+        if ((nameLength == 4) && (strncasecmp(position, "gzip", 4) == 0)) {
+            quality[HTTP_ENCODING_GZIP] = value;
+        } else if ((nameLength == 7) && (strncasecmp(position, "deflate", 7) == 0)) {
+            quality[HTTP_ENCODING_DEFLATE] = value;
+        } else if ((nameLength == 1) && (*position == '*')) {
+            anyQuality = value;
+        }
+        position = end;
+    }
+
+    for (int i = HTTP_ENCODING_GZIP; i < HTTP_ENCODINGS_COUNT; ++i) {
+        if (quality[i] < 0.0) {
+            quality[i] = (anyQuality > 0.0) ? anyQuality : 0.0;
+        }
+    }
+    // при равенстве - gzip
+    if ((quality[HTTP_ENCODING_GZIP] > 0.0) && (quality[HTTP_ENCODING_GZIP] >= quality[HTTP_ENCODING_DEFLATE])) {
+        return HTTP_ENCODING_GZIP;
+    }
+    if (quality[HTTP_ENCODING_DEFLATE] > 0.0) {
+        return HTTP_ENCODING_DEFLATE;
+    }
+    return HTTP_ENCODING_IDENTITY;
+}
+
+const char* httpEncodingName(HTTPContentEncoding encoding){
+    switch (encoding) {
+        case HTTP_ENCODING_GZIP:
+            return "gzip";
+        case HTTP_ENCODING_DEFLATE:
+            return "deflate";
+        default:
+            return nullptr;
+    }
+}
+
+bool httpIsCompressibleType(const char* contentType){
+    if (contentType == nullptr) {
+        return false;
+    }
+    static const char* const prefixes[] = {
+        "text/",
+        "application/json",
+        "application/javascript",
+        "application/xml",
+        "application/wasm",
+        "image/svg+xml",
+    };
+    for (const char* prefix: prefixes) {
+        if (strncasecmp(contentType, prefix, strlen(prefix)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Один шаг deflate: весь текущий вход в выходной буфер
+static bool deflateInto(z_stream& stream, int flush, evbuffer* output){
+    while (true) {
+        evbuffer_iovec space;
+        if (evbuffer_reserve_space(output, COMPRESSION_CHUNK_SIZE, &space, 1) < 1) {
+            return false;
+        }
+        stream.next_out = static_cast<Bytef*>(space.iov_base);
+        stream.avail_out = (uInt)space.iov_len;
+        int result = deflate(&stream, flush);
+        space.iov_len -= stream.avail_out;
+        evbuffer_commit_space(output, &space, 1);
+
+        if (result == Z_STREAM_ERROR) {
+            return false;
+        }
+        if (flush == Z_FINISH) {
+            if (result == Z_STREAM_END) {
+                return true;
+            }
+        } else if ((stream.avail_in == 0) && (stream.avail_out != 0)) {
+            return true;
+        }
+    }
+}
+
+bool httpCompressBuffer(evbuffer* input, HTTPContentEncoding encoding, evbuffer* output){
+    if (encoding == HTTP_ENCODING_IDENTITY) {
+        return false;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    int windowBits = (encoding == HTTP_ENCODING_GZIP) ? (15 + 16) : 15;
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    // куски входного буфера как есть, без pullup
+    int chunksCount = evbuffer_peek(input, -1, nullptr, nullptr, 0);
+    std::vector<evbuffer_iovec> chunks(chunksCount > 0 ? chunksCount : 0);
+    if (chunksCount > 0) {
+        evbuffer_peek(input, -1, nullptr, chunks.data(), chunksCount);
+    }
+
+    bool success = true;
+    for (const evbuffer_iovec& chunk: chunks) {
+        stream.next_in = static_cast<Bytef*>(chunk.iov_base);
+        stream.avail_in = (uInt)chunk.iov_len;
+        if (deflateInto(stream, Z_NO_FLUSH, output) == false) {
+            success = false;
+            break;
+        }
+    }
+    if (success) {
+        stream.next_in = nullptr;
+        stream.avail_in = 0;
+        success = deflateInto(stream, Z_FINISH, output);
+    }
+    deflateEnd(&stream);
+    return success;
+}
+
+bool httpCompressData(const char* data, std::size_t size, HTTPContentEncoding encoding, std::string& output){
+    evbuffer* input = evbuffer_new();
+    evbuffer* compressed = evbuffer_new();
+    evbuffer_add_reference(input, data, size, nullptr, nullptr);
+
+    bool success = httpCompressBuffer(input, encoding, compressed);
+    if (success) {
+        output.resize(evbuffer_get_length(compressed));
+        evbuffer_remove(compressed, &output[0], output.size());
+    }
+    evbuffer_free(compressed);
+    evbuffer_free(input);
+    return success;
+}
+
+void httpCompressReply(evhttp_request* request){
+    evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+    if (evbuffer_get_length(outBuf) < HTTP_COMPRESSION_MIN_SIZE) {
+        return;
+    }
+    evkeyvalq* outputHeaders = evhttp_request_get_output_headers(request);
+    if (evhttp_find_header(outputHeaders, "Content-Encoding") ||
+        (httpIsCompressibleType(evhttp_find_header(outputHeaders, "Content-Type")) == false)) {
+        return;
+    }
+    evhttp_add_header(outputHeaders, "Vary", "Accept-Encoding");
+    HTTPContentEncoding encoding = httpChooseEncoding(evhttp_find_header(evhttp_request_get_input_headers(request), "Accept-Encoding"));
+    if (encoding == HTTP_ENCODING_IDENTITY) {
+        return;
+    }
+
+    evbuffer* compressed = evbuffer_new();
+    if (httpCompressBuffer(outBuf, encoding, compressed)) {
+        evbuffer_drain(outBuf, evbuffer_get_length(outBuf));
+        evbuffer_add_buffer(outBuf, compressed);
+        evhttp_add_header(outputHeaders, "Content-Encoding", httpEncodingName(encoding));
+    }
+    evbuffer_free(compressed);
+}
+
+//////////////////////////////////////////////////
+// HTTPCompressionPool
+//////////////////////////////////////////////////
+HTTPCompressionPool::HTTPCompressionPool(int threadsCount):
+    _enabled(true){
+    for (int i = 0; i < threadsCount; ++i) {
+        _threads.push_back(std::thread(&HTTPCompressionPool::threadFunction, this));
+    }
+}
+
+HTTPCompressionPool::~HTTPCompressionPool(){
+    {
+        std::unique_lock<std::mutex> locker(_mutex);
+        _enabled = false;
+        _conditionVariable.notify_all();
+    }
+    for (std::thread& thread: _threads) {
+        thread.join();
+    }
+}
+
+void HTTPCompressionPool::addTask(const Task& task){
+    std::unique_lock<std::mutex> locker(_mutex);
+    _queue.push(task);
+    _conditionVariable.notify_one();
+}
+
+void HTTPCompressionPool::threadFunction(){
+    while (true) {
+        std::unique_lock<std::mutex> locker(_mutex);
+        _conditionVariable.wait(locker, [&](){
+            return (_queue.empty() == false) || (_enabled == false);
+        });
+        // оставшиеся задачи доделываются до выхода
+        if (_queue.empty()) {
+            return;
+        }
+        Task task = _queue.front();
+        _queue.pop();
+        locker.unlock();
+
+        task();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+// libevent
+#include <event2/http.h>
+#include <event2/buffer.h>
+
+// тела меньше этого не сжимаются - выигрыш меньше заголовков
+#define HTTP_COMPRESSION_MIN_SIZE 256
+// тела больше этого сжимаются в пуле, а не в потоке цикла событий
+#define HTTP_COMPRESSION_OFFLOAD_SIZE (64 * 1024)
+
+enum HTTPContentEncoding {
+    HTTP_ENCODING_IDENTITY = 0,
+    HTTP_ENCODING_GZIP = 1,
+    HTTP_ENCODING_DEFLATE = 2,
+    HTTP_ENCODINGS_COUNT = 3
+};
+
+// Выбор кодировки по Accept-Encoding (с учетом q), nullptr - identity
+HTTPContentEncoding httpChooseEncoding(const char* acceptEncoding);
+// Имя для Content-Encoding, nullptr для identity
+const char* httpEncodingName(HTTPContentEncoding encoding);
+// Стоит ли сжимать такой Content-Type (текст, json, js, svg...)
+bool httpIsCompressibleType(const char* contentType);
+
+// Потоковое сжатие кусками: данные входа не склеиваются, выход пишется прямо
+// в зарезервированное место evbuffer. input не изменяется.
+bool httpCompressBuffer(evbuffer* input, HTTPContentEncoding encoding, evbuffer* output);
+bool httpCompressData(const char* data, std::size_t size, HTTPContentEncoding encoding, std::string& output);
+
+// Сжатие выходного буфера запроса перед evhttp_send_reply, если клиент это принимает,
+// тип сжимаемый и тело не слишком мало. Ставит Content-Encoding и Vary.
+void httpCompressReply(evhttp_request* request);
+
+//////////////////////////////////////////////////
+// Пул потоков для сжатия больших тел вне цикла событий
+//////////////////////////////////////////////////
+class HTTPCompressionPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit HTTPCompressionPool(int threadsCount);
+    ~HTTPCompressionPool();
+
+    HTTPCompressionPool(const HTTPCompressionPool&) = delete;
+    HTTPCompressionPool& operator=(const HTTPCompressionPool&) = delete;
+
+    void addTask(const Task& task);
+
+private:
+    std::atomic_bool _enabled;
+    std::mutex _mutex;
+    std::condition_variable _conditionVariable;
+    std::queue<Task> _queue;
+    std::vector<std::thread> _threads;
+
+private:
+    void threadFunction();
+};
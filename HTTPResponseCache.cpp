@@ -0,0 +1,324 @@
+#include "HTTPResponseCache.h"
+#include "HTTPServer.h"
+// std
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+// libevent
+#include <event2/buffer.h>
+#include <event2/keyvalq_struct.h>
+
+
+static std::int64_t nowMilliseconds(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+HTTPCachedResponse::HTTPCachedResponse():
+    status(HTTP_OK),
+    reason("OK"){
+}
+
+HTTPResponseCache::HTTPResponseCache(std::size_t maxBytes):
+    _maxBytes(maxBytes),
+    _compressionPool(nullptr),
+    _bytes(0),
+    _hits(0),
+    _misses(0),
+    _coalesced(0){
+}
+
+HTTPResponseCache::~HTTPResponseCache(){
+    // запросы ожидающих к этому моменту уже освобождены вместе с серверами
+    for (auto& item: _entries) {
+        for (Waiter* waiter: item.second.waiters) {
+            delete waiter;
+        }
+    }
+}
+
+void HTTPResponseCache::setCompressionPool(HTTPCompressionPool* compressionPool){
+    _compressionPool = compressionPool;
+}
+
+void HTTPResponseCache::routeHandler(evhttp_request* request, const HTTPRouteParams& params, void* data){
+    const HTTPCachedRoute& route = *static_cast<const HTTPCachedRoute*>(data);
+    route.cache->handle(request, params, route);
+}
+
+std::string HTTPResponseCache::buildKey(evhttp_request* request, const HTTPCachedRoute& route){
+    // HEAD и GET делят один ответ
+    std::string key("GET ");
+    const char* uri = evhttp_request_get_uri(request);
+    key.append(uri ? uri : "/");
+    evkeyvalq* headers = evhttp_request_get_input_headers(request);
+    for (const std::string& name: route.varyHeaders) {
+        const char* value = evhttp_find_header(headers, name.c_str());
+        key.push_back('\n');
+        key.append(name);
+        key.push_back(':');
+        if (value) {
+            key.append(value);
+        }
+    }
+    // по Accept-Encoding ключ не дробится - только по итоговой кодировке
+    if (route.compress) {
+        HTTPContentEncoding encoding = httpChooseEncoding(evhttp_find_header(headers, "Accept-Encoding"));
+        if (encoding != HTTP_ENCODING_IDENTITY) {
+            key.append("\nContent-Encoding:");
+            key.append(httpEncodingName(encoding));
+        }
+    }
+    return key;
+}
+
+HTTPContentEncoding HTTPResponseCache::responseEncoding(evhttp_request* request, const HTTPCachedRoute& route, HTTPCachedResponse& response){
+    if (route.compress == false) {
+        return HTTP_ENCODING_IDENTITY;
+    }
+    const char* contentType = nullptr;
+    for (const auto& header: response.headers) {
+        if (evutil_ascii_strcasecmp(header.first.c_str(), "Content-Encoding") == 0) {
+            return HTTP_ENCODING_IDENTITY;
+        }
+        if (evutil_ascii_strcasecmp(header.first.c_str(), "Content-Type") == 0) {
+            contentType = header.second.c_str();
+        }
+    }
+    if ((response.body.size() < HTTP_COMPRESSION_MIN_SIZE) || (httpIsCompressibleType(contentType) == false)) {
+        return HTTP_ENCODING_IDENTITY;
+    }
+    response.headers.push_back(std::make_pair("Vary", "Accept-Encoding"));
+    return httpChooseEncoding(evhttp_find_header(evhttp_request_get_input_headers(request), "Accept-Encoding"));
+}
+
+void HTTPResponseCache::compressResponse(HTTPCachedResponse& response, HTTPContentEncoding encoding){
+    std::string compressed;
+    if (httpCompressData(response.body.data(), response.body.size(), encoding, compressed)) {
+        response.body.swap(compressed);
+        response.headers.push_back(std::make_pair("Content-Encoding", httpEncodingName(encoding)));
+    }
+}
+
+void HTTPResponseCache::sendResponse(evhttp_request* request, const HTTPCachedResponsePtr& response, const char* cacheStatus){
+    evkeyvalq* outputHeaders = evhttp_request_get_output_headers(request);
+    for (const auto& header: response->headers) {
+        evhttp_add_header(outputHeaders, header.first.c_str(), header.second.c_str());
+    }
+    if (cacheStatus) {
+        evhttp_add_header(outputHeaders, "X-Cache", cacheStatus);
+    }
+
+    evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+    if (evhttp_request_get_command(request) == EVHTTP_REQ_HEAD) {
+        char contentLength[32];
+        snprintf(contentLength, sizeof(contentLength), "%zu", response->body.size());
+        evhttp_add_header(outputHeaders, "Content-Length", contentLength);
+    } else if (response->body.empty() == false) {
+        // тело общее для всех ответов, буфер держит ссылку на него до отправки
+        auto cleanup = [](const void*, size_t, void* extra){
+            delete static_cast<HTTPCachedResponsePtr*>(extra);
+        };
+        HTTPCachedResponsePtr* holder = new HTTPCachedResponsePtr(response);
+        if (evbuffer_add_reference(outBuf, response->body.data(), response->body.size(), cleanup, holder) != 0) {
+            delete holder;
+            evhttp_send_error(request, HTTP_INTERNAL, nullptr);
+            return;
+        }
+    }
+    evhttp_send_reply(request, response->status, response->reason.c_str(), outBuf);
+}
+
+void HTTPResponseCache::handle(evhttp_request* request, const HTTPRouteParams& params, const HTTPCachedRoute& route){
+    int command = evhttp_request_get_command(request);
+    if (((command != EVHTTP_REQ_GET) && (command != EVHTTP_REQ_HEAD)) || (route.ttlSeconds == 0)) {
+        HTTPCachedResponse* response = new HTTPCachedResponse();
+        HTTPCachedResponsePtr responsePtr(response);
+        route.producer(request, params, route.data, *response);
+        HTTPContentEncoding encoding = responseEncoding(request, route, *response);
+        if (encoding != HTTP_ENCODING_IDENTITY) {
+            compressResponse(*response, encoding);
+        }
+        sendResponse(request, responsePtr, nullptr);
+        return;
+    }
+
+    std::string key = buildKey(request, route);
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _entries.find(key);
+        if (it == _entries.end()) {
+            Entry entry;
+            entry.pending = false;
+            entry.expiresAt = 0;
+            entry.bytes = 0;
+            entry.inLRU = false;
+            it = _entries.insert(std::make_pair(key, entry)).first;
+        }
+        Entry& entry = it->second;
+
+        // свежий ответ
+        if (entry.response && (nowMilliseconds() < entry.expiresAt)) {
+            ++_hits;
+            _lru.splice(_lru.begin(), _lru, entry.lruPosition);
+            HTTPCachedResponsePtr response = entry.response;
+            lock.unlock();
+            sendResponse(request, response, "HIT");
+            return;
+        }
+
+        // ответ уже считается - ждем его, поток не блокируется
+        if (entry.pending) {
+            ++_coalesced;
+            addWaiter(entry, request, key, "HIT");
+            return;
+        }
+
+        ++_misses;
+        entry.pending = true;
+    }
+
+    HTTPCachedResponse* response = new HTTPCachedResponse();
+    HTTPCachedResponsePtr responsePtr(response);
+    route.producer(request, params, route.data, *response);
+
+    HTTPContentEncoding encoding = responseEncoding(request, route, *response);
+    if ((encoding != HTTP_ENCODING_IDENTITY) && _compressionPool && (response->body.size() >= HTTP_COMPRESSION_OFFLOAD_SIZE)) {
+        // большое тело сжимается в пуле, сам запрос ждет результата как остальные
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _entries.find(key);
+            if (it != _entries.end()) {
+                addWaiter(it->second, request, key, "MISS");
+            }
+        }
+        std::uint32_t ttlSeconds = route.ttlSeconds;
+        _compressionPool->addTask([this, key, responsePtr, response, encoding, ttlSeconds](){
+            compressResponse(*response, encoding);
+            complete(key, responsePtr, ttlSeconds);
+        });
+        return;
+    }
+    if (encoding != HTTP_ENCODING_IDENTITY) {
+        compressResponse(*response, encoding);
+    }
+
+    complete(key, responsePtr, route.ttlSeconds);
+    sendResponse(request, responsePtr, "MISS");
+}
+
+void HTTPResponseCache::addWaiter(Entry& entry, evhttp_request* request, const std::string& key, const char* cacheStatus){
+    evhttp_connection* connection = evhttp_request_get_connection(request);
+    Waiter* waiter = new Waiter();
+    waiter->cache = this;
+    waiter->request = request;
+    waiter->base = evhttp_connection_get_base(connection);
+    waiter->key = key;
+    waiter->cacheStatus = cacheStatus;
+    entry.waiters.push_back(waiter);
+    httpSetConnectionCloseCallback(connection, connectionCloseCallback, waiter);
+}
+
+void HTTPResponseCache::complete(const std::string& key, const HTTPCachedResponsePtr& response, std::uint32_t ttlSeconds){
+    std::vector<Waiter*> waiters;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(key);
+        if (it == _entries.end()) {
+            return;
+        }
+        Entry& entry = it->second;
+        entry.pending = false;
+        waiters.swap(entry.waiters);
+
+        if (entry.inLRU) {
+            _lru.erase(entry.lruPosition);
+            _bytes -= entry.bytes;
+            entry.inLRU = false;
+            entry.response.reset();
+        }
+
+        std::size_t bytes = key.size() + response->body.size() + response->reason.size();
+        for (const auto& header: response->headers) {
+            bytes += header.first.size() + header.second.size();
+        }
+        // кешируем только успешные ответы, влезающие в кеш
+        if ((response->status == HTTP_OK) && (bytes <= _maxBytes)) {
+            entry.response = response;
+            entry.expiresAt = nowMilliseconds() + (std::int64_t)ttlSeconds * 1000;
+            entry.bytes = bytes;
+            _lru.push_front(key);
+            entry.lruPosition = _lru.begin();
+            entry.inLRU = true;
+            _bytes += bytes;
+            evict();
+        } else {
+            _entries.erase(it);
+        }
+    }
+
+    // ожидающие отвечают в потоках своих соединений
+    timeval immediately = {0, 0};
+    for (Waiter* waiter: waiters) {
+        waiter->response = response;
+        if (event_base_once(waiter->base, -1, EV_TIMEOUT, deliverCallback, waiter, &immediately) != 0) {
+            std::cout << "Ошибка при передаче ответа из кеша." << std::endl;
+        }
+    }
+}
+
+void HTTPResponseCache::evict(){
+    while ((_bytes > _maxBytes) && (_lru.empty() == false)) {
+        std::string key = _lru.back();
+        _lru.pop_back();
+        Entry& entry = _entries[key];
+        _bytes -= entry.bytes;
+        entry.inLRU = false;
+        entry.response.reset();
+        // запись с идущим вычислением остается, теряется только старый ответ
+        if (entry.pending == false) {
+            _entries.erase(key);
+        }
+    }
+}
+
+void HTTPResponseCache::deliverCallback(evutil_socket_t, short, void* arg){
+    Waiter* waiter = static_cast<Waiter*>(arg);
+    if (waiter->request) {
+        httpSetConnectionCloseCallback(evhttp_request_get_connection(waiter->request), nullptr, nullptr);
+        sendResponse(waiter->request, waiter->response, waiter->cacheStatus);
+    }
+    delete waiter;
+}
+
+void HTTPResponseCache::connectionCloseCallback(evhttp_connection*, void* arg){
+    Waiter* waiter = static_cast<Waiter*>(arg);
+    HTTPResponseCache* cache = waiter->cache;
+    {
+        std::lock_guard<std::mutex> lock(cache->_mutex);
+        auto it = cache->_entries.find(waiter->key);
+        if (it != cache->_entries.end()) {
+            std::vector<Waiter*>& waiters = it->second.waiters;
+            auto position = std::find(waiters.begin(), waiters.end(), waiter);
+            if (position != waiters.end()) {
+                waiters.erase(position);
+                delete waiter;
+                return;
+            }
+        }
+    }
+    // ответ уже отправлен в наш поток - deliverCallback только освободит waiter
+    waiter->request = nullptr;
+}
+
+std::uint64_t HTTPResponseCache::hitsCount() const{
+    return _hits;
+}
+
+std::uint64_t HTTPResponseCache::missesCount() const{
+    return _misses;
+}
+
+std::uint64_t HTTPResponseCache::coalescedCount() const{
+    return _coalesced;
+}
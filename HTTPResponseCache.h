@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+// libevent
+#include <event2/event.h>
+#include <event2/http.h>
+// server
+#include "HTTPRouter.h"
+#include "HTTPCompression.h"
+
+//////////////////////////////////////////////////
+// Готовый ответ: после сохранения не меняется и разделяется между потоками
+//////////////////////////////////////////////////
+struct HTTPCachedResponse {
+    int status;
+    std::string reason;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+
+    HTTPCachedResponse();
+};
+typedef std::shared_ptr<const HTTPCachedResponse> HTTPCachedResponsePtr;
+
+// Обработчик, который не отвечает сам, а заполняет response
+typedef void (*HTTPResponseProducer)(evhttp_request* request, const HTTPRouteParams& params, void* data, HTTPCachedResponse& response);
+
+class HTTPResponseCache;
+
+//////////////////////////////////////////////////
+// Кешируемый маршрут: data для HTTPResponseCache::routeHandler
+//////////////////////////////////////////////////
+struct HTTPCachedRoute {
+    HTTPResponseCache* cache;
+    HTTPResponseProducer producer;
+    void* data;
+    std::uint32_t ttlSeconds;
+    std::vector<std::string> varyHeaders;   // заголовки запроса, входящие в ключ
+    bool compress;                          // сжимать по Accept-Encoding, в ключ входит выбранная кодировка
+};
+
+//////////////////////////////////////////////////
+// Кеш ответов идемпотентных GET/HEAD.
+// Ключ - метод, URI и значения выбранных заголовков. TTL + LRU с ограничением по объему.
+// Одновременные промахи по одному ключу (в том числе из разных потоков) ждут одного
+// вычисления: ожидающие запросы получают ответ через event_base_once в своем потоке.
+// Тело ответа добавляется в выходной буфер ссылкой (evbuffer_add_reference), без копирования.
+// Сжатые варианты хранятся как отдельные записи и сжимаются один раз; большие тела
+// сжимаются в пуле, запрос-вычислитель при этом ждет наравне с остальными.
+// Для нескольких потоков нужен evthread_use_pthreads() до создания event_base.
+//////////////////////////////////////////////////
+class HTTPResponseCache {
+public:
+    explicit HTTPResponseCache(std::size_t maxBytes);
+    ~HTTPResponseCache();
+
+    HTTPResponseCache(const HTTPResponseCache&) = delete;
+    HTTPResponseCache& operator=(const HTTPResponseCache&) = delete;
+
+    // пул для сжатия больших тел, nullptr - все сжимается на месте
+    void setCompressionPool(HTTPCompressionPool* compressionPool);
+
+    // обработчик маршрута, data - HTTPCachedRoute
+    static void routeHandler(evhttp_request* request, const HTTPRouteParams& params, void* data);
+
+    std::uint64_t hitsCount() const;
+    std::uint64_t missesCount() const;
+    std::uint64_t coalescedCount() const;
+
+private:
+    // запрос, ждущий чужого вычисления
+    struct Waiter {
+        HTTPResponseCache* cache;
+        evhttp_request* request;            // nullptr - соединение закрылось
+        event_base* base;
+        std::string key;
+        HTTPCachedResponsePtr response;
+        const char* cacheStatus;
+    };
+
+    struct Entry {
+        bool pending;
+        HTTPCachedResponsePtr response;
+        std::int64_t expiresAt;             // мс, steady clock
+        std::size_t bytes;
+        std::list<std::string>::iterator lruPosition;
+        bool inLRU;
+        std::vector<Waiter*> waiters;
+    };
+
+    std::size_t _maxBytes;
+    HTTPCompressionPool* _compressionPool;
+    std::mutex _mutex;
+    std::unordered_map<std::string, Entry> _entries;
+    std::list<std::string> _lru;            // спереди - недавно использованные
+    std::size_t _bytes;
+    std::uint64_t _hits;
+    std::uint64_t _misses;
+    std::uint64_t _coalesced;
+
+private:
+    static std::string buildKey(evhttp_request* request, const HTTPCachedRoute& route);
+    static HTTPContentEncoding responseEncoding(evhttp_request* request, const HTTPCachedRoute& route, HTTPCachedResponse& response);
+    static void compressResponse(HTTPCachedResponse& response, HTTPContentEncoding encoding);
+    static void sendResponse(evhttp_request* request, const HTTPCachedResponsePtr& response, const char* cacheStatus);
+    static void deliverCallback(evutil_socket_t, short, void* arg);
+    static void connectionCloseCallback(evhttp_connection* connection, void* arg);
+
+    void handle(evhttp_request* request, const HTTPRouteParams& params, const HTTPCachedRoute& route);
+    void complete(const std::string& key, const HTTPCachedResponsePtr& response, std::uint32_t ttlSeconds);
+    void evict();
+    void addWaiter(Entry& entry, evhttp_request* request, const std::string& key, const char* cacheStatus);
+};
@@ -0,0 +1,319 @@
+#include "HTTPRouter.h"
+// std
+#include <iostream>
+#include <cstring>
+// libevent
+#include <event2/buffer.h>
+// server
+#include "HTTPServer.h"
+
+
+static const char* const METHOD_NAMES[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "OPTIONS", "TRACE", "CONNECT", "PATCH"};
+
+//////////////////////////////////////////////////
+// HTTPRouteParams
+//////////////////////////////////////////////////
+HTTPRouteParams::HTTPRouteParams():
+    _names(nullptr),
+    _count(0){
+}
+
+std::size_t HTTPRouteParams::size() const{
+    return _count;
+}
+
+std::string_view HTTPRouteParams::operator[](std::size_t index) const{
+    return (index < _count) ? _values[index] : std::string_view();
+}
+
+std::string_view HTTPRouteParams::get(std::string_view name) const{
+    if (_names == nullptr) {
+        return std::string_view();
+    }
+    for (std::size_t i = 0; (i < _count) && (i < _names->size()); ++i) {
+        if ((*_names)[i] == name) {
+            return _values[i];
+        }
+    }
+    return std::string_view();
+}
+
+//////////////////////////////////////////////////
+// HTTPRouter
+//////////////////////////////////////////////////
+HTTPRouter::BuildNode::BuildNode(){
+    for (int i = 0; i < METHODS_COUNT; ++i) {
+        routes[i] = NO_INDEX;
+    }
+}
+
+HTTPRouter::HTTPRouter():
+    _root(new BuildNode()),
+    _compiled(false){
+}
+
+int HTTPRouter::methodIndex(int method){
+    for (int i = 0; i < METHODS_COUNT; ++i) {
+        if (method == (1 << i)) {
+            return i;
+        }
+    }
+    return NO_INDEX;
+}
+
+bool HTTPRouter::add(int methods, const char* pattern, HTTPRouteHandler handler, void* data){
+    if ((pattern == nullptr) || (pattern[0] != '/') || (handler == nullptr) || ((methods & HTTP_ROUTER_ANY_METHOD) == 0)) {
+        std::cout << "Неверный маршрут: " << (pattern ? pattern : "null") << std::endl;
+        return false;
+    }
+
+    Route route;
+    route.handler = handler;
+    route.data = data;
+
+    // разбор шаблона по сегментам, пустые сегменты пропускаются
+    BuildNode* node = _root.get();
+    const char* position = pattern;
+    while (*position != '\0') {
+        while (*position == '/') {
+            ++position;
+        }
+        if (*position == '\0') {
+            break;
+        }
+        const char* end = strchr(position, '/');
+        if (end == nullptr) {
+            end = position + strlen(position);
+        }
+        std::string segment(position, end - position);
+        position = end;
+
+        if ((segment[0] == ':') || (segment[0] == '*')) {
+            if (route.paramNames.size() >= HTTP_ROUTER_MAX_PARAMS) {
+                std::cout << "Слишком много параметров в маршруте: " << pattern << std::endl;
+                return false;
+            }
+            route.paramNames.push_back(segment.substr(1));
+        }
+
+        std::unique_ptr<BuildNode>* child = nullptr;
+        if (segment[0] == ':') {
+            child = &node->paramChild;
+        } else if (segment[0] == '*') {
+            // хвост пути - только последним сегментом
+            while (*position == '/') {
+                ++position;
+            }
+            if (*position != '\0') {
+                std::cout << "* может быть только в конце маршрута: " << pattern << std::endl;
+                return false;
+            }
+            child = &node->wildcardChild;
+        } else {
+            child = &node->children[segment];
+        }
+        if (!*child) {
+            child->reset(new BuildNode());
+        }
+        node = child->get();
+    }
+
+    for (int i = 0; i < METHODS_COUNT; ++i) {
+        if (((methods & (1 << i)) != 0) && (node->routes[i] != NO_INDEX)) {
+            std::cout << "Маршрут уже существует: " << METHOD_NAMES[i] << " " << pattern << std::endl;
+            return false;
+        }
+    }
+    _routes.push_back(route);
+    for (int i = 0; i < METHODS_COUNT; ++i) {
+        if ((methods & (1 << i)) != 0) {
+            node->routes[i] = (int)_routes.size() - 1;
+        }
+    }
+    _compiled = false;
+    return true;
+}
+
+void HTTPRouter::compile(){
+    _nodes.clear();
+    _children.clear();
+    _segments.clear();
+    compileNode(*_root);
+    _compiled = true;
+}
+
+int HTTPRouter::compileNode(const BuildNode& buildNode){
+    int index = (int)_nodes.size();
+    _nodes.push_back(Node());
+
+    // дочерние узлы лежат подряд, в порядке std::map - годится для бинарного поиска
+    std::uint32_t firstChild = (std::uint32_t)_children.size();
+    _children.resize(_children.size() + buildNode.children.size());
+    std::uint32_t childIndex = firstChild;
+    for (const auto& item: buildNode.children) {
+        Child child;
+        child.segmentOffset = (std::uint32_t)_segments.size();
+        child.segmentLength = (std::uint32_t)item.first.size();
+        _segments.append(item.first);
+        child.node = (std::uint32_t)compileNode(*item.second);
+        _children[childIndex++] = child;
+    }
+
+    Node& node = _nodes[index];
+    node.firstChild = firstChild;
+    node.childrenCount = (std::uint32_t)buildNode.children.size();
+    node.paramChild = NO_INDEX;
+    node.wildcardChild = NO_INDEX;
+    for (int i = 0; i < METHODS_COUNT; ++i) {
+        node.routes[i] = buildNode.routes[i];
+    }
+    if (buildNode.paramChild) {
+        int paramChild = compileNode(*buildNode.paramChild);
+        _nodes[index].paramChild = paramChild;
+    }
+    if (buildNode.wildcardChild) {
+        int wildcardChild = compileNode(*buildNode.wildcardChild);
+        _nodes[index].wildcardChild = wildcardChild;
+    }
+    return index;
+}
+
+void HTTPRouter::attach(evhttp* server){
+    if (_compiled == false) {
+        compile();
+    }
+    evhttp_set_gencb(server, requestCallback, this);
+}
+
+void HTTPRouter::attach(HTTPServer& server){
+    if (_compiled == false) {
+        compile();
+    }
+    server.setRequestHandler(requestCallback, this);
+}
+
+void HTTPRouter::requestCallback(evhttp_request* request, void* data){
+    static_cast<const HTTPRouter*>(data)->dispatch(request);
+}
+
+int HTTPRouter::findChild(const Node& node, std::string_view segment) const{
+    std::uint32_t low = node.firstChild;
+    std::uint32_t high = node.firstChild + node.childrenCount;
+    while (low < high) {
+        std::uint32_t middle = (low + high) / 2;
+        const Child& child = _children[middle];
+        int compare = std::string_view(_segments.data() + child.segmentOffset, child.segmentLength).compare(segment);
+        if (compare == 0) {
+            return (int)child.node;
+        }
+        if (compare < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NO_INDEX;
+}
+
+bool HTTPRouter::hasRoute(const Node& node, int method){
+    if (method < 0) {
+        for (int i = 0; i < METHODS_COUNT; ++i) {
+            if (node.routes[i] != NO_INDEX) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return (node.routes[method] != NO_INDEX) || ((method == METHOD_HEAD) && (node.routes[METHOD_GET] != NO_INDEX));
+}
+
+int HTTPRouter::matchNode(int nodeIndex, std::string_view path, std::size_t position, int method, HTTPRouteParams& params) const{
+    const Node& node = _nodes[nodeIndex];
+    while ((position < path.size()) && (path[position] == '/')) {
+        ++position;
+    }
+
+    // путь кончился
+    if (position >= path.size()) {
+        if (hasRoute(node, method)) {
+            return nodeIndex;
+        }
+        if ((node.wildcardChild != NO_INDEX) && hasRoute(_nodes[node.wildcardChild], method)) {
+            params._values[params._count++] = std::string_view();
+            return node.wildcardChild;
+        }
+        return NO_INDEX;
+    }
+
+    std::size_t end = path.find('/', position);
+    if (end == std::string_view::npos) {
+        end = path.size();
+    }
+    std::string_view segment = path.substr(position, end - position);
+
+    int child = findChild(node, segment);
+    if (child != NO_INDEX) {
+        int result = matchNode(child, path, end, method, params);
+        if (result != NO_INDEX) {
+            return result;
+        }
+    }
+    if (node.paramChild != NO_INDEX) {
+        std::size_t savedCount = params._count;
+        params._values[params._count++] = segment;
+        int result = matchNode(node.paramChild, path, end, method, params);
+        if (result != NO_INDEX) {
+            return result;
+        }
+        params._count = savedCount;
+    }
+    if ((node.wildcardChild != NO_INDEX) && hasRoute(_nodes[node.wildcardChild], method)) {
+        params._values[params._count++] = path.substr(position);
+        return node.wildcardChild;
+    }
+    return NO_INDEX;
+}
+
+void HTTPRouter::dispatch(evhttp_request* request) const{
+    const char* rawPath = evhttp_uri_get_path(evhttp_request_get_evhttp_uri(request));
+    std::string_view path = rawPath ? std::string_view(rawPath) : std::string_view("/");
+    int method = methodIndex(evhttp_request_get_command(request));
+
+    HTTPRouteParams params;
+    int nodeIndex = (method != NO_INDEX) ? matchNode(0, path, 0, method, params) : NO_INDEX;
+    if (nodeIndex == NO_INDEX) {
+        // путь есть, но без такого метода - 405 со списком допустимых
+        HTTPRouteParams anyParams;
+        sendError(request, matchNode(0, path, 0, NO_INDEX, anyParams));
+        return;
+    }
+
+    const Node& node = _nodes[nodeIndex];
+    int routeIndex = (node.routes[method] != NO_INDEX) ? node.routes[method] : node.routes[METHOD_GET];
+    const Route& route = _routes[routeIndex];
+    params._names = &route.paramNames;
+    route.handler(request, params, route.data);
+}
+
+void HTTPRouter::sendError(evhttp_request* request, int nodeIndex) const{
+    if (nodeIndex == NO_INDEX) {
+        evhttp_send_error(request, HTTP_NOTFOUND, nullptr);
+        return;
+    }
+
+    char allow[128] = {0};
+    const Node& node = _nodes[nodeIndex];
+    for (int i = 0; i < METHODS_COUNT; ++i) {
+        if ((node.routes[i] != NO_INDEX) || ((i == METHOD_HEAD) && (node.routes[METHOD_GET] != NO_INDEX))) {
+            if (allow[0] != '\0') {
+                strcat(allow, ", ");
+            }
+            strcat(allow, METHOD_NAMES[i]);
+        }
+    }
+    // evhttp_send_error сбрасывает заголовки ответа, поэтому ответ собираем сами
+    evhttp_add_header(evhttp_request_get_output_headers(request), "Allow", allow);
+    evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+    evbuffer_add_printf(outBuf, "<html><body><h1>405 Method Not Allowed</h1></body></html>");
+    evhttp_send_reply(request, HTTP_BADMETHOD, "Method Not Allowed", outBuf);
+}
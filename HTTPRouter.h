@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+// libevent
+#include <event2/http.h>
+
+class HTTPServer;
+
+// Все методы evhttp_cmd_type
+#define HTTP_ROUTER_ANY_METHOD 0x1FF
+// Максимум параметров в одном шаблоне пути
+#define HTTP_ROUTER_MAX_PARAMS 8
+
+//////////////////////////////////////////////////
+// Параметры пути (:name и *name), указывают прямо в строку запроса,
+// живут пока жив evhttp_request
+//////////////////////////////////////////////////
+class HTTPRouteParams {
+public:
+    HTTPRouteParams();
+
+    std::size_t size() const;
+    std::string_view operator[](std::size_t index) const;
+    // пустая строка если такого параметра нет
+    std::string_view get(std::string_view name) const;
+
+private:
+    friend class HTTPRouter;
+
+    const std::vector<std::string>* _names;
+    std::string_view _values[HTTP_ROUTER_MAX_PARAMS];
+    std::size_t _count;
+};
+
+typedef void (*HTTPRouteHandler)(evhttp_request* request, const HTTPRouteParams& params, void* data);
+
+//////////////////////////////////////////////////
+// Маршрутизатор поверх evhttp.
+// Шаблоны: "/users/:id/posts", "/static/*path" (хвост пути целиком, может быть пустым).
+// Маршруты добавляются при старте, compile() укладывает дерево сегментов в плоские
+// массивы; поиск идет по сегментам пути без регулярок и без выделения памяти.
+// Статический сегмент приоритетнее параметра, параметр - приоритетнее *.
+// После compile() объект только читается и может использоваться из любых потоков.
+//////////////////////////////////////////////////
+class HTTPRouter {
+public:
+    HTTPRouter();
+
+    HTTPRouter(const HTTPRouter&) = delete;
+    HTTPRouter& operator=(const HTTPRouter&) = delete;
+
+    // methods - маска evhttp_cmd_type, false при ошибке в шаблоне или повторе маршрута
+    bool add(int methods, const char* pattern, HTTPRouteHandler handler, void* data);
+    void compile();
+
+    // назначение обработчиком всех запросов сервера, компилирует если нужно
+    void attach(evhttp* server);
+    // то же для HTTPServer: его gencb занят учетом соединений
+    void attach(HTTPServer& server);
+
+    // 404 / 405 если маршрут не найден
+    void dispatch(evhttp_request* request) const;
+
+private:
+    enum { METHODS_COUNT = 9, METHOD_GET = 0, METHOD_HEAD = 2, NO_INDEX = -1 };
+
+    struct Route {
+        HTTPRouteHandler handler;
+        void* data;
+        std::vector<std::string> paramNames;
+    };
+
+    // дерево на время добавления маршрутов
+    struct BuildNode {
+        std::map<std::string, std::unique_ptr<BuildNode>> children;
+        std::unique_ptr<BuildNode> paramChild;
+        std::unique_ptr<BuildNode> wildcardChild;
+        int routes[METHODS_COUNT];
+
+        BuildNode();
+    };
+
+    // скомпилированный узел
+    struct Node {
+        std::uint32_t firstChild;
+        std::uint32_t childrenCount;
+        int paramChild;
+        int wildcardChild;
+        int routes[METHODS_COUNT];
+    };
+    struct Child {
+        std::uint32_t segmentOffset;
+        std::uint32_t segmentLength;
+        std::uint32_t node;
+    };
+
+    std::unique_ptr<BuildNode> _root;
+    std::vector<Route> _routes;
+    bool _compiled;
+
+    std::vector<Node> _nodes;
+    std::vector<Child> _children;
+    std::string _segments;
+
+private:
+    static int methodIndex(int method);
+    static void requestCallback(evhttp_request* request, void* data);
+    // есть ли у узла обработчик метода (method < 0 - любого), HEAD обслуживается GET-обработчиком
+    static bool hasRoute(const Node& node, int method);
+
+    int compileNode(const BuildNode& buildNode);
+    int matchNode(int nodeIndex, std::string_view path, std::size_t position, int method, HTTPRouteParams& params) const;
+    int findChild(const Node& node, std::string_view segment) const;
+    void sendError(evhttp_request* request, int nodeIndex) const;
+};
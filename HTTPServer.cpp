@@ -0,0 +1,296 @@
+#include "HTTPServer.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <unordered_map>
+// system
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+// server
+#include "UnixSocket.h"
+
+
+// соединения серверов этого потока: closecb занят сервером, а его аргумент из libevent не получить
+static thread_local std::unordered_map<evhttp_connection*, void*> connectionsStates;
+
+HTTPServerConfig::HTTPServerConfig():
+    address("127.0.0.1"),
+    port(5555),
+    unixPath(nullptr),
+    backlog(1024),
+    idleTimeoutSeconds(30),
+    maxHeadersSize(16 * 1024),
+    maxBodySize(64 * 1024 * 1024),
+    maxConnections(10000),
+    allowedMethods(EVHTTP_REQ_GET | EVHTTP_REQ_HEAD | EVHTTP_REQ_POST | EVHTTP_REQ_PUT | EVHTTP_REQ_DELETE | EVHTTP_REQ_OPTIONS),
+    noDelay(true),
+    tls(nullptr){
+}
+
+HTTPServer::HTTPServer(event_base* base, const HTTPServerConfig& config):
+    _base(base),
+    _config(config),
+    _http(evhttp_new(base)),
+    _tls(config.tls ? new TLSServerContext(*config.tls) : nullptr),
+    _boundSocket(nullptr),
+    _unixBoundSocket(nullptr),
+    _unixOwner(false),
+    _requestHandler(nullptr),
+    _requestArg(nullptr),
+    _attachEvent(event_new(base, -1, 0, attachCallback, this)),
+    _connections(0),
+    _acceptedTotal(0),
+    _pauses(0),
+    _paused(false),
+    _shuttingDown(false){
+
+    if (_http == nullptr) {
+        std::cout << "Ошибка создания evhttp." << std::endl;
+        return;
+    }
+    evhttp_set_timeout(_http, _config.idleTimeoutSeconds);
+    evhttp_set_max_headers_size(_http, _config.maxHeadersSize);
+    evhttp_set_max_body_size(_http, _config.maxBodySize);
+    evhttp_set_allowed_methods(_http, _config.allowedMethods);
+    evhttp_set_bevcb(_http, createBufferevent, this);
+    evhttp_set_gencb(_http, requestCallback, this);
+}
+
+HTTPServer::~HTTPServer(){
+    // соединения закрываются внутри evhttp_free и еще обращаются к серверу,
+    // но листенеры к этому моменту уже освобождены
+    _shuttingDown = true;
+    if (_http) {
+        evhttp_free(_http);
+    }
+    if (_attachEvent) {
+        event_free(_attachEvent);
+    }
+    if (_unixOwner) {
+        removeUnixSocket(_config.unixPath);
+    }
+}
+
+bool HTTPServer::isValid() const{
+    return (_http != nullptr) && (_attachEvent != nullptr) && ((_tls == nullptr) || _tls->isValid());
+}
+
+bool HTTPServer::bind(){
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_config.port);
+    if (inet_pton(AF_INET, _config.address, &address.sin_addr) != 1) {
+        std::cout << "Неверный адрес сервера: " << _config.address << std::endl;
+        return false;
+    }
+
+    // свой слушатель ради размера очереди: evhttp_bind_socket всегда слушает с очередью 128
+    unsigned flags = LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_REUSEABLE;
+    evconnlistener* listener = evconnlistener_new_bind(_base, nullptr, nullptr, flags, _config.backlog,
+                                                       reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    if (listener == nullptr) {
+        std::cout << "Ошибка привязки к " << _config.address << ":" << _config.port << std::endl;
+        return false;
+    }
+    _boundSocket = listen(listener);
+    if ((_boundSocket == nullptr) || (_config.unixPath == nullptr)) {
+        return _boundSocket != nullptr;
+    }
+
+    evutil_socket_t unixSocket = bindUnixSocket(_config.unixPath, SOCK_STREAM, _config.backlog);
+    if (unixSocket < 0) {
+        return false;
+    }
+    _unixOwner = true;
+    // сокет уже слушает: backlog 0
+    listener = evconnlistener_new(_base, nullptr, nullptr, LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC, 0, unixSocket);
+    if (listener == nullptr) {
+        std::cout << "Ошибка создания слушателя " << _config.unixPath << std::endl;
+        evutil_closesocket(unixSocket);
+        return false;
+    }
+    _unixBoundSocket = listen(listener);
+    return _unixBoundSocket != nullptr;
+}
+
+bool HTTPServer::accept(evutil_socket_t socket, evutil_socket_t unixSocket){
+    // сокеты уже слушают, владелец - другой сервер
+    evconnlistener* listener = evconnlistener_new(_base, nullptr, nullptr, LEV_OPT_CLOSE_ON_EXEC, 0, socket);
+    if (listener == nullptr) {
+        std::cout << "Ошибка приема на общем сокете." << std::endl;
+        return false;
+    }
+    _boundSocket = listen(listener);
+    if ((_boundSocket == nullptr) || (unixSocket < 0)) {
+        return _boundSocket != nullptr;
+    }
+
+    listener = evconnlistener_new(_base, nullptr, nullptr, LEV_OPT_CLOSE_ON_EXEC, 0, unixSocket);
+    if (listener == nullptr) {
+        std::cout << "Ошибка приема на общем Unix сокете." << std::endl;
+        return false;
+    }
+    _unixBoundSocket = listen(listener);
+    return _unixBoundSocket != nullptr;
+}
+
+evhttp_bound_socket* HTTPServer::listen(evconnlistener* listener){
+    evhttp_bound_socket* boundSocket = evhttp_bind_listener(_http, listener);
+    if (boundSocket == nullptr) {
+        evconnlistener_free(listener);
+    }
+    return boundSocket;
+}
+
+evutil_socket_t HTTPServer::socket() const{
+    return _boundSocket ? evhttp_bound_socket_get_fd(_boundSocket) : -1;
+}
+
+evutil_socket_t HTTPServer::unixSocket() const{
+    return _unixBoundSocket ? evhttp_bound_socket_get_fd(_unixBoundSocket) : -1;
+}
+
+void HTTPServer::setRequestHandler(void (*handler)(evhttp_request*, void*), void* arg){
+    _requestHandler = handler;
+    _requestArg = arg;
+}
+
+evhttp* HTTPServer::http() const{
+    return _http;
+}
+
+const TLSServerContext* HTTPServer::tls() const{
+    return _tls.get();
+}
+
+std::size_t HTTPServer::connectionsCount() const{
+    return _connections;
+}
+
+std::uint64_t HTTPServer::acceptedCount() const{
+    return _acceptedTotal;
+}
+
+std::uint64_t HTTPServer::pausesCount() const{
+    return _pauses;
+}
+
+void HTTPServer::attachConnections(){
+    for (bufferevent* bev : _created) {
+        // evhttp ставит соединение аргументом колбеков своего bufferevent
+        void* arg = nullptr;
+        bufferevent_getcb(bev, nullptr, nullptr, nullptr, &arg);
+        evhttp_connection* connection = static_cast<evhttp_connection*>(arg);
+        if (connection == nullptr) {
+            // evhttp не смог создать соединение (нехватка памяти)
+            --_connections;
+            continue;
+        }
+
+        // у Unix сокета нет Nagle
+        evutil_socket_t fd = bufferevent_getfd(bev);
+        int family = 0;
+        socklen_t familyLength = sizeof(family);
+        getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &family, &familyLength);
+        if (_config.noDelay && (family != AF_UNIX)) {
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+
+        Connection* state = new Connection();
+        state->server = this;
+        state->closeCallback = nullptr;
+        state->closeArg = nullptr;
+        connectionsStates[connection] = state;
+        evhttp_connection_set_closecb(connection, connectionCloseCallback, state);
+    }
+    _created.clear();
+    updateListener();
+}
+
+void HTTPServer::updateListener(){
+    if ((_boundSocket == nullptr) || _shuttingDown) {
+        return;
+    }
+    bool saturated = (connectionsCount() >= _config.maxConnections);
+    if (saturated && (_paused == false)) {
+        // остановка внутри цикла accept прерывает и его
+        evconnlistener_disable(evhttp_bound_socket_get_listener(_boundSocket));
+        if (_unixBoundSocket) {
+            evconnlistener_disable(evhttp_bound_socket_get_listener(_unixBoundSocket));
+        }
+        _paused = true;
+        ++_pauses;
+    } else if ((saturated == false) && _paused) {
+        evconnlistener_enable(evhttp_bound_socket_get_listener(_boundSocket));
+        if (_unixBoundSocket) {
+            evconnlistener_enable(evhttp_bound_socket_get_listener(_unixBoundSocket));
+        }
+        _paused = false;
+    }
+}
+
+bufferevent* HTTPServer::createBufferevent(event_base* base, void* arg){
+    HTTPServer* server = static_cast<HTTPServer*>(arg);
+    // сокет выставит evhttp, соединение для него создается сразу после возврата
+    bufferevent* bev = nullptr;
+    if (server->_tls) {
+        bev = server->_tls->createBufferevent(base, -1, BEV_OPT_CLOSE_ON_FREE);
+    } else {
+        bev = bufferevent_socket_new(base, -1, BEV_OPT_CLOSE_ON_FREE);
+    }
+    if (bev == nullptr) {
+        return nullptr;
+    }
+    ++server->_acceptedTotal;
+    ++server->_connections;
+    // closecb ставится после возврата, когда evhttp уже создал соединение,
+    // но еще до первого чтения из сокета
+    server->_created.push_back(bev);
+    if (server->_created.size() == 1) {
+        event_active(server->_attachEvent, 0, 0);
+    }
+    server->updateListener();
+    return bev;
+}
+
+void HTTPServer::requestCallback(evhttp_request* request, void* arg){
+    HTTPServer* server = static_cast<HTTPServer*>(arg);
+    if (server->_requestHandler) {
+        server->_requestHandler(request, server->_requestArg);
+    } else {
+        evhttp_send_error(request, HTTP_NOTFOUND, nullptr);
+    }
+}
+
+void HTTPServer::attachCallback(evutil_socket_t, short, void* arg){
+    static_cast<HTTPServer*>(arg)->attachConnections();
+}
+
+void HTTPServer::connectionCloseCallback(evhttp_connection* connection, void* arg){
+    Connection* state = static_cast<Connection*>(arg);
+    if (state->closeCallback) {
+        state->closeCallback(connection, state->closeArg);
+    }
+    connectionsStates.erase(connection);
+
+    HTTPServer* server = state->server;
+    delete state;
+    --server->_connections;
+    server->updateListener();
+}
+
+void httpSetConnectionCloseCallback(evhttp_connection* connection, void (*callback)(evhttp_connection*, void*), void* arg){
+    auto it = connectionsStates.find(connection);
+    if (it == connectionsStates.end()) {
+        // соединение не от HTTPServer
+        evhttp_connection_set_closecb(connection, callback, arg);
+        return;
+    }
+    HTTPServer::Connection* state = static_cast<HTTPServer::Connection*>(it->second);
+    state->closeCallback = callback;
+    state->closeArg = arg;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+// libevent
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
+// server
+#include "TLSContext.h"
+
+//////////////////////////////////////////////////
+// Настройки HTTP сервера одного event_base
+//////////////////////////////////////////////////
+struct HTTPServerConfig {
+    const char* address;
+    std::uint16_t port;
+    const char* unixPath;           // Unix сокет рядом с TCP (см. UnixSocket.h), nullptr - только TCP
+    int backlog;                    // очередь ядра для еще не принятых соединений
+    int idleTimeoutSeconds;         // простой keep-alive, а также чтение и запись запроса
+    ev_ssize_t maxHeadersSize;
+    ev_ssize_t maxBodySize;         // больше - 413 без чтения тела
+    std::size_t maxConnections;     // открытых соединений на один event_base
+    std::uint16_t allowedMethods;   // EVHTTP_REQ_*, остальные - 501 до маршрутизации
+    bool noDelay;                   // TCP_NODELAY для принятых соединений
+    const TLSConfig* tls;           // nullptr - без TLS; SSL_CTX у каждого сервера свой
+
+    HTTPServerConfig();
+};
+
+//////////////////////////////////////////////////
+// HTTP сервер поверх evhttp с учетом соединений.
+// При maxConnections открытых соединений прием приостанавливается (evconnlistener_disable):
+// новые клиенты ждут в очереди ядра размером backlog и не занимают память сервера,
+// а при общем слушающем сокете их забирают менее загруженные потоки.
+// Прием возобновляется, когда соединений становится меньше предела.
+// Соединение учитывается с момента создания bufferevent (evhttp_set_bevcb) и до его closecb:
+// evhttp_connection создается сразу после bevcb, closecb ему ставится в том же проходе
+// цикла событий, до первого чтения из сокета.
+// Запросы передаются обработчику setRequestHandler (например, HTTPRouter::attach).
+// С config.tls соединения создаются как bufferevent_openssl через evhttp_set_bevcb.
+// Один объект на event_base, работает только в его потоке.
+//////////////////////////////////////////////////
+class HTTPServer {
+public:
+    HTTPServer(event_base* base, const HTTPServerConfig& config);
+    ~HTTPServer();
+
+    HTTPServer(const HTTPServer&) = delete;
+    HTTPServer& operator=(const HTTPServer&) = delete;
+
+    bool isValid() const;
+
+    // свой слушающий сокет на address:port и, если задан unixPath, свой Unix сокет
+    bool bind();
+    // общие слушающие сокеты другого сервера (по серверу на поток); unixSocket -1 - без Unix сокета
+    bool accept(evutil_socket_t socket, evutil_socket_t unixSocket = -1);
+
+    evutil_socket_t socket() const;
+    evutil_socket_t unixSocket() const;
+    // вместо evhttp_set_gencb: gencb занят учетом соединений; без обработчика - 404
+    void setRequestHandler(void (*handler)(evhttp_request*, void*), void* arg);
+    evhttp* http() const;
+    const TLSServerContext* tls() const;   // nullptr - без TLS
+
+    std::size_t connectionsCount() const;
+    std::uint64_t acceptedCount() const;
+    std::uint64_t pausesCount() const;     // сколько раз прием останавливался по пределу
+
+private:
+    // состояние соединения, которым владеет сервер
+    struct Connection {
+        HTTPServer* server;
+        void (*closeCallback)(evhttp_connection*, void*);
+        void* closeArg;
+    };
+
+    event_base* _base;
+    HTTPServerConfig _config;
+    evhttp* _http;
+    std::unique_ptr<TLSServerContext> _tls;
+    evhttp_bound_socket* _boundSocket;
+    evhttp_bound_socket* _unixBoundSocket;
+    bool _unixOwner;                        // файл Unix сокета удаляется вместе с сервером
+    void (*_requestHandler)(evhttp_request*, void*);
+    void* _requestArg;
+    event* _attachEvent;
+    // bufferevent принятых соединений, которым еще не поставлен свой closecb
+    std::vector<bufferevent*> _created;
+    std::size_t _connections;               // от createBufferevent до connectionCloseCallback
+    std::uint64_t _acceptedTotal;
+    std::uint64_t _pauses;
+    bool _paused;
+    bool _shuttingDown;                     // evhttp_free уже освободил листенеры
+
+private:
+    evhttp_bound_socket* listen(evconnlistener* listener);
+    void attachConnections();
+    void updateListener();
+
+    static bufferevent* createBufferevent(event_base* base, void* arg);
+    static void requestCallback(evhttp_request* request, void* arg);
+    static void attachCallback(evutil_socket_t, short, void* arg);
+    static void connectionCloseCallback(evhttp_connection* connection, void* arg);
+
+    friend void httpSetConnectionCloseCallback(evhttp_connection* connection,
+                                               void (*callback)(evhttp_connection*, void*), void* arg);
+};
+
+// Обработчик закрытия соединения вместо evhttp_connection_set_closecb: closecb соединений
+// HTTPServer занят учетом, этот обработчик вызывается из него. nullptr - снять.
+// Вызывается в потоке соединения.
+void httpSetConnectionCloseCallback(evhttp_connection* connection, void (*callback)(evhttp_connection*, void*), void* arg);
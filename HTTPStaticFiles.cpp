@@ -0,0 +1,487 @@
+#include "HTTPStaticFiles.h"
+// std
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+// system
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// как часто кешированный файл сверяется с диском
+#define STATIC_REVALIDATE_INTERVAL_MS 1000
+
+static std::int64_t nowMilliseconds(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline int hexValue(char c){
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+HTTPStaticFiles::HTTPStaticFiles(const char* rootDirectory, std::size_t cacheBytes, std::size_t smallFileLimit):
+    _root(rootDirectory),
+    _cacheBytes(cacheBytes),
+    _smallFileLimit(smallFileLimit),
+    _compressionPool(nullptr),
+    _cachedBytes(0),
+    _hits(0),
+    _misses(0){
+    while ((_root.size() > 1) && (_root.back() == '/')) {
+        _root.pop_back();
+    }
+}
+
+HTTPStaticFiles::~HTTPStaticFiles(){
+    // буферы, которые еще отправляются, держат свои ссылки на сегменты
+    for (CacheEntry& entry: _lru) {
+        evbuffer_file_segment_free(entry.segment);
+    }
+}
+
+void HTTPStaticFiles::setCompressionPool(HTTPCompressionPool* compressionPool){
+    _compressionPool = compressionPool;
+}
+
+void HTTPStaticFiles::routeHandler(evhttp_request* request, const HTTPRouteParams& params, void* data){
+    HTTPStaticFiles* files = static_cast<HTTPStaticFiles*>(data);
+    files->handle(request, params.size() ? params[params.size() - 1] : std::string_view());
+}
+
+// Путь в URI -> путь на диске: percent-decoding, без выхода за корень
+bool HTTPStaticFiles::buildFilePath(const std::string& root, std::string_view path, std::string& result){
+    result = root;
+    result.push_back('/');
+    std::size_t segmentStart = result.size();
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        char c = path[i];
+        if ((c == '%') && (i + 2 < path.size()) && (hexValue(path[i + 1]) >= 0) && (hexValue(path[i + 2]) >= 0)) {
+            c = (char)(hexValue(path[i + 1]) * 16 + hexValue(path[i + 2]));
+            i += 2;
+        }
+        if (c == '\0') {
+            return false;
+        }
+        if (c == '/') {
+            if (result.compare(segmentStart, std::string::npos, "..") == 0) {
+                return false;
+            }
+            // повторные слеши схлопываем
+            if (result.size() == segmentStart) {
+                continue;
+            }
+            result.push_back(c);
+            segmentStart = result.size();
+            continue;
+        }
+        result.push_back(c);
+    }
+    if (result.compare(segmentStart, std::string::npos, "..") == 0) {
+        return false;
+    }
+    if (result.size() == segmentStart) {
+        result.append("index.html");
+    }
+    return true;
+}
+
+const char* HTTPStaticFiles::contentType(const std::string& path){
+    static const struct {
+        const char* extension;
+        const char* type;
+    } types[] = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"},
+        {"js", "application/javascript; charset=utf-8"},
+        {"json", "application/json"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"xml", "application/xml"},
+        {"svg", "image/svg+xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"ico", "image/x-icon"},
+        {"webp", "image/webp"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"wasm", "application/wasm"},
+        {"pdf", "application/pdf"},
+        {"mp4", "video/mp4"},
+    };
+    std::size_t dot = path.rfind('.');
+    std::size_t slash = path.rfind('/');
+    if ((dot != std::string::npos) && ((slash == std::string::npos) || (dot > slash))) {
+        const char* extension = path.c_str() + dot + 1;
+        for (const auto& item: types) {
+            if (strcasecmp(extension, item.extension) == 0) {
+                return item.type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+void HTTPStaticFiles::fillFileInfo(const struct stat& fileStat, const std::string& path, FileInfo& info){
+    info.size = (std::uint64_t)fileStat.st_size;
+    info.modificationTime = (std::int64_t)fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec;
+    snprintf(info.etag, sizeof(info.etag), "\"%llx-%llx\"", (unsigned long long)info.size, (unsigned long long)info.modificationTime);
+    struct tm modificationTm;
+    gmtime_r(&fileStat.st_mtim.tv_sec, &modificationTm);
+    strftime(info.lastModified, sizeof(info.lastModified), "%a, %d %b %Y %H:%M:%S GMT", &modificationTm);
+    info.contentType = contentType(path);
+}
+
+// Один диапазон "bytes=a-b" / "bytes=a-" / "bytes=-n"; false - заголовок игнорируется
+bool HTTPStaticFiles::parseRange(const char* header, std::uint64_t size, std::uint64_t& offset, std::uint64_t& length, bool& satisfiable){
+    satisfiable = true;
+    if ((header == nullptr) || (strncmp(header, "bytes=", 6) != 0) || strchr(header, ',')) {
+        // несколько диапазонов не поддерживаем - отдаем файл целиком, это допустимо
+        return false;
+    }
+    const char* position = header + 6;
+    char* end = nullptr;
+    if (*position == '-') {
+        unsigned long long suffix = strtoull(position + 1, &end, 10);
+        if ((end == position + 1) || (*end != '\0')) {
+            return false;
+        }
+        if ((suffix == 0) || (size == 0)) {
+            satisfiable = false;
+            return true;
+        }
+        length = (suffix < size) ? suffix : size;
+        offset = size - length;
+        return true;
+    }
+
+    unsigned long long first = strtoull(position, &end, 10);
+    if ((end == position) || (*end != '-')) {
+        return false;
+    }
+    position = end + 1;
+    unsigned long long last = size ? size - 1 : 0;
+    if (*position != '\0') {
+        last = strtoull(position, &end, 10);
+        if ((end == position) || (*end != '\0') || (last < first)) {
+            return false;
+        }
+        if (last >= size) {
+            last = size - 1;
+        }
+    }
+    if (first >= size) {
+        satisfiable = false;
+        return true;
+    }
+    offset = first;
+    length = last - first + 1;
+    return true;
+}
+
+//////////////////////////////////////////////////
+// Кеш
+//////////////////////////////////////////////////
+void HTTPStaticFiles::removeCached(CacheList::iterator it){
+    _cachedBytes -= it->bytes;
+    evbuffer_file_segment_free(it->segment);
+    _cache.erase(it->path);
+    _lru.erase(it);
+}
+
+HTTPStaticFiles::CacheEntry& HTTPStaticFiles::storeCached(const std::string& path, const FileInfo& info, evbuffer_file_segment* segment){
+    auto existing = _cache.find(path);
+    if (existing != _cache.end()) {
+        removeCached(existing->second);
+    }
+
+    CacheEntry entry;
+    entry.path = path;
+    entry.info = info;
+    entry.segment = segment;
+    entry.checkedAt = nowMilliseconds();
+    entry.bytes = info.size;
+    for (int i = 0; i < HTTP_ENCODINGS_COUNT; ++i) {
+        entry.variantsScheduled[i] = false;
+    }
+    _lru.push_front(entry);
+    _cache[path] = _lru.begin();
+    _cachedBytes += info.size;
+
+    evict();
+    return *_cache[path];
+}
+
+// вытеснение давно не использованных, самая свежая запись остается
+void HTTPStaticFiles::evict(){
+    while ((_lru.size() > 1) && (_cachedBytes > _cacheBytes)) {
+        removeCached(std::prev(_lru.end()));
+    }
+}
+
+void HTTPStaticFiles::scheduleVariant(CacheEntry& entry, HTTPContentEncoding encoding){
+    entry.variantsScheduled[encoding] = true;
+
+    // буфер держит ссылку на сегмент, даже если запись вытеснят до конца сжатия
+    evbuffer* source = evbuffer_new();
+    evbuffer_add_file_segment(source, entry.segment, 0, (ev_off_t)entry.info.size);
+    std::string path = entry.path;
+    std::int64_t modificationTime = entry.info.modificationTime;
+
+    _compressionPool->addTask([this, source, path, modificationTime, encoding](){
+        std::shared_ptr<std::string> variant = std::make_shared<std::string>();
+        evbuffer* compressed = evbuffer_new();
+        bool success = httpCompressBuffer(source, encoding, compressed);
+        if (success) {
+            variant->resize(evbuffer_get_length(compressed));
+            evbuffer_remove(compressed, &(*variant)[0], variant->size());
+        }
+        evbuffer_free(compressed);
+        evbuffer_free(source);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _cache.find(path);
+        if ((it == _cache.end()) || (it->second->info.modificationTime != modificationTime)) {
+            return;
+        }
+        // несжимаемое содержимое так и отдается как есть
+        CacheEntry& entry = *it->second;
+        if (success && (variant->size() < entry.info.size)) {
+            entry.variants[encoding] = variant;
+            entry.bytes += variant->size();
+            _cachedBytes += variant->size();
+            evict();
+        }
+    });
+}
+
+//////////////////////////////////////////////////
+// Заголовки + тело ответа, возвращает код; отправляет вызывающий
+//////////////////////////////////////////////////
+int HTTPStaticFiles::buildResponse(evhttp_request* request, const FileInfo& info, evbuffer_file_segment* segment, int fd, const char*& reason){
+    evkeyvalq* inputHeaders = evhttp_request_get_input_headers(request);
+    evkeyvalq* outputHeaders = evhttp_request_get_output_headers(request);
+    evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+    reason = "OK";
+
+    evhttp_add_header(outputHeaders, "ETag", info.etag);
+    evhttp_add_header(outputHeaders, "Last-Modified", info.lastModified);
+    evhttp_add_header(outputHeaders, "Accept-Ranges", "bytes");
+    if (_compressionPool && httpIsCompressibleType(info.contentType)) {
+        evhttp_add_header(outputHeaders, "Vary", "Accept-Encoding");
+    }
+
+    // клиент уже имеет эту версию
+    const char* ifNoneMatch = evhttp_find_header(inputHeaders, "If-None-Match");
+    if (ifNoneMatch && ((strcmp(ifNoneMatch, "*") == 0) || strstr(ifNoneMatch, info.etag))) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        reason = "Not Modified";
+        return HTTP_NOTMODIFIED;
+    }
+
+    std::uint64_t offset = 0;
+    std::uint64_t length = info.size;
+    bool satisfiable = true;
+    const char* range = evhttp_find_header(inputHeaders, "Range");
+    const char* ifRange = evhttp_find_header(inputHeaders, "If-Range");
+    bool partial = (ifRange == nullptr || strcmp(ifRange, info.etag) == 0) && parseRange(range, info.size, offset, length, satisfiable);
+
+    if (partial && (satisfiable == false)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        char contentRange[64];
+        snprintf(contentRange, sizeof(contentRange), "bytes */%llu", (unsigned long long)info.size);
+        evhttp_add_header(outputHeaders, "Content-Range", contentRange);
+        reason = "Range Not Satisfiable";
+        return 416;
+    }
+
+    evhttp_add_header(outputHeaders, "Content-Type", info.contentType);
+    char contentLength[32];
+    snprintf(contentLength, sizeof(contentLength), "%llu", (unsigned long long)length);
+    evhttp_add_header(outputHeaders, "Content-Length", contentLength);
+    if (partial) {
+        char contentRange[96];
+        snprintf(contentRange, sizeof(contentRange), "bytes %llu-%llu/%llu", (unsigned long long)offset,
+                 (unsigned long long)(offset + length - 1), (unsigned long long)info.size);
+        evhttp_add_header(outputHeaders, "Content-Range", contentRange);
+    }
+
+    // тело: сегмент кеша - ссылкой на отображенную память, иначе sendfile, fd закроет evbuffer
+    bool sendBody = (evhttp_request_get_command(request) != EVHTTP_REQ_HEAD) && (length > 0);
+    if (segment) {
+        if (sendBody) {
+            evbuffer_add_file_segment(outBuf, segment, (ev_off_t)offset, (ev_off_t)length);
+        }
+    } else if (sendBody) {
+        if (evbuffer_add_file(outBuf, fd, (ev_off_t)offset, (ev_off_t)length) != 0) {
+            close(fd);
+            reason = "Internal Server Error";
+            return HTTP_INTERNAL;
+        }
+    } else if (fd >= 0) {
+        close(fd);
+    }
+
+    reason = partial ? "Partial Content" : "OK";
+    return partial ? 206 : HTTP_OK;
+}
+
+int HTTPStaticFiles::buildVariantResponse(evhttp_request* request, const FileInfo& info, const std::shared_ptr<const std::string>& variant,
+                                          HTTPContentEncoding encoding, const char*& reason){
+    evkeyvalq* outputHeaders = evhttp_request_get_output_headers(request);
+    evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+
+    // у каждого варианта свой ETag
+    char etag[64];
+    snprintf(etag, sizeof(etag), "%.*s-%s\"", (int)strlen(info.etag) - 1, info.etag, httpEncodingName(encoding));
+    evhttp_add_header(outputHeaders, "ETag", etag);
+    evhttp_add_header(outputHeaders, "Last-Modified", info.lastModified);
+    evhttp_add_header(outputHeaders, "Vary", "Accept-Encoding");
+
+    const char* ifNoneMatch = evhttp_find_header(evhttp_request_get_input_headers(request), "If-None-Match");
+    if (ifNoneMatch && ((strcmp(ifNoneMatch, "*") == 0) || strstr(ifNoneMatch, etag))) {
+        reason = "Not Modified";
+        return HTTP_NOTMODIFIED;
+    }
+
+    evhttp_add_header(outputHeaders, "Content-Type", info.contentType);
+    evhttp_add_header(outputHeaders, "Content-Encoding", httpEncodingName(encoding));
+    char contentLength[32];
+    snprintf(contentLength, sizeof(contentLength), "%zu", variant->size());
+    evhttp_add_header(outputHeaders, "Content-Length", contentLength);
+
+    if (evhttp_request_get_command(request) != EVHTTP_REQ_HEAD) {
+        // сжатый вариант общий, буфер держит ссылку до отправки
+        auto cleanup = [](const void*, size_t, void* extra){
+            delete static_cast<std::shared_ptr<const std::string>*>(extra);
+        };
+        std::shared_ptr<const std::string>* holder = new std::shared_ptr<const std::string>(variant);
+        evbuffer_add_reference(outBuf, variant->data(), variant->size(), cleanup, holder);
+    }
+    reason = "OK";
+    return HTTP_OK;
+}
+
+int HTTPStaticFiles::serveCached(evhttp_request* request, CacheEntry& entry, const char*& reason){
+    // сжатый вариант: клиент принимает, тип сжимаемый, не запрос диапазона
+    evkeyvalq* inputHeaders = evhttp_request_get_input_headers(request);
+    if (_compressionPool && (entry.info.size >= HTTP_COMPRESSION_MIN_SIZE) && httpIsCompressibleType(entry.info.contentType) &&
+        (evhttp_find_header(inputHeaders, "Range") == nullptr)) {
+        HTTPContentEncoding encoding = httpChooseEncoding(evhttp_find_header(inputHeaders, "Accept-Encoding"));
+        if (encoding != HTTP_ENCODING_IDENTITY) {
+            if (entry.variants[encoding]) {
+                return buildVariantResponse(request, entry.info, entry.variants[encoding], encoding, reason);
+            }
+            if (entry.variantsScheduled[encoding] == false) {
+                scheduleVariant(entry, encoding);
+            }
+        }
+    }
+    // сегмент добавляется в буфер под мьютексом, чтобы его не вытеснили раньше
+    return buildResponse(request, entry.info, entry.segment, -1, reason);
+}
+
+void HTTPStaticFiles::handle(evhttp_request* request, std::string_view path){
+    int command = evhttp_request_get_command(request);
+    if ((command != EVHTTP_REQ_GET) && (command != EVHTTP_REQ_HEAD)) {
+        evhttp_send_error(request, HTTP_BADMETHOD, nullptr);
+        return;
+    }
+
+    std::string filePath;
+    if (buildFilePath(_root, path, filePath) == false) {
+        evhttp_send_error(request, HTTP_NOTFOUND, nullptr);
+        return;
+    }
+
+    evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+    const char* reason = nullptr;
+
+    // горячий файл из кеша: ни open, ни read
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _cache.find(filePath);
+        if (it != _cache.end()) {
+            CacheEntry& entry = *it->second;
+            std::int64_t now = nowMilliseconds();
+            bool valid = true;
+            if (now - entry.checkedAt >= STATIC_REVALIDATE_INTERVAL_MS) {
+                struct stat fileStat;
+                valid = (stat(filePath.c_str(), &fileStat) == 0) &&
+                        ((std::uint64_t)fileStat.st_size == entry.info.size) &&
+                        ((std::int64_t)fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec == entry.info.modificationTime);
+                entry.checkedAt = now;
+            }
+            if (valid) {
+                ++_hits;
+                _lru.splice(_lru.begin(), _lru, it->second);
+                int status = serveCached(request, entry, reason);
+                lock.unlock();
+                evhttp_send_reply(request, status, reason, outBuf);
+                return;
+            }
+            removeCached(it->second);
+        }
+        ++_misses;
+    }
+
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat fileStat;
+    if ((fd >= 0) && (fstat(fd, &fileStat) == 0) && S_ISDIR(fileStat.st_mode)) {
+        close(fd);
+        filePath.append("/index.html");
+        fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if ((fd < 0) || (fstat(fd, &fileStat) != 0) || (S_ISREG(fileStat.st_mode) == false)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        evhttp_send_error(request, HTTP_NOTFOUND, nullptr);
+        return;
+    }
+
+    FileInfo info;
+    fillFileInfo(fileStat, filePath, info);
+
+    if ((info.size > 0) && (info.size <= _smallFileLimit) && (info.size <= _cacheBytes)) {
+        // mmap (или чтение, если mmap недоступен), fd закрывается вместе с сегментом
+        evbuffer_file_segment* segment = evbuffer_file_segment_new(fd, 0, (ev_off_t)info.size, EVBUF_FS_CLOSE_ON_FREE | EVBUF_FS_DISABLE_SENDFILE);
+        if (segment) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            CacheEntry& entry = storeCached(filePath, info, segment);
+            int status = serveCached(request, entry, reason);
+            lock.unlock();
+            evhttp_send_reply(request, status, reason, outBuf);
+            return;
+        }
+    }
+    int status = buildResponse(request, info, nullptr, fd, reason);
+    evhttp_send_reply(request, status, reason, outBuf);
+}
+
+std::uint64_t HTTPStaticFiles::cacheHitsCount() const{
+    return _hits;
+}
+
+std::uint64_t HTTPStaticFiles::cacheMissesCount() const{
+    return _misses;
+}
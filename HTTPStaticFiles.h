@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+// system
+#include <sys/stat.h>
+// libevent
+#include <event2/http.h>
+#include <event2/buffer.h>
+// server
+#include "HTTPRouter.h"
+#include "HTTPCompression.h"
+
+//////////////////////////////////////////////////
+// Раздача статики из каталога.
+// Большие файлы уходят через evbuffer_add_file (sendfile, без копирования в user space),
+// мелкие держатся в LRU кеше отображенных в память evbuffer_file_segment и добавляются
+// в выходной буфер ссылкой. ETag/If-None-Match -> 304, один диапазон Range -> 206.
+// Для сжимаемых типов кеш хранит сжатые варианты: они готовятся один раз в пуле сжатия,
+// пока вариант не готов - отдается исходный файл.
+// Кеш общий для всех потоков; для многопоточной работы нужен evthread_use_pthreads().
+//////////////////////////////////////////////////
+class HTTPStaticFiles {
+public:
+    // cacheBytes - общий объем кеша, smallFileLimit - файлы не больше этого кешируются
+    HTTPStaticFiles(const char* rootDirectory, std::size_t cacheBytes, std::size_t smallFileLimit);
+    ~HTTPStaticFiles();
+
+    HTTPStaticFiles(const HTTPStaticFiles&) = delete;
+    HTTPStaticFiles& operator=(const HTTPStaticFiles&) = delete;
+
+    // пул для подготовки gzip/deflate вариантов, nullptr - без сжатия
+    void setCompressionPool(HTTPCompressionPool* compressionPool);
+
+    // path - путь относительно корня как есть из URI (percent-encoded)
+    void handle(evhttp_request* request, std::string_view path);
+
+    // обработчик для маршрута вида "/static/*path", data - HTTPStaticFiles
+    static void routeHandler(evhttp_request* request, const HTTPRouteParams& params, void* data);
+
+    std::uint64_t cacheHitsCount() const;
+    std::uint64_t cacheMissesCount() const;
+
+private:
+    // описание файла, общее для кешированных и отдаваемых через sendfile
+    struct FileInfo {
+        std::uint64_t size;
+        std::int64_t modificationTime;      // нс
+        char etag[48];
+        char lastModified[40];
+        const char* contentType;
+    };
+
+    struct CacheEntry {
+        std::string path;
+        FileInfo info;
+        evbuffer_file_segment* segment;
+        std::int64_t checkedAt;             // мс, когда последний раз сверялись с диском
+        std::size_t bytes;                  // файл + сжатые варианты
+        // сжатые варианты; запланирован, но пуст - сжатие не дало выигрыша или еще идет
+        std::shared_ptr<const std::string> variants[HTTP_ENCODINGS_COUNT];
+        bool variantsScheduled[HTTP_ENCODINGS_COUNT];
+    };
+    typedef std::list<CacheEntry> CacheList;
+
+    std::string _root;
+    std::size_t _cacheBytes;
+    std::size_t _smallFileLimit;
+    HTTPCompressionPool* _compressionPool;
+
+    std::mutex _mutex;
+    CacheList _lru;                         // спереди - недавно использованные
+    std::unordered_map<std::string, CacheList::iterator> _cache;
+    std::size_t _cachedBytes;
+    std::uint64_t _hits;
+    std::uint64_t _misses;
+
+private:
+    static bool buildFilePath(const std::string& root, std::string_view path, std::string& result);
+    static const char* contentType(const std::string& path);
+    static void fillFileInfo(const struct stat& fileStat, const std::string& path, FileInfo& info);
+    static bool parseRange(const char* header, std::uint64_t size, std::uint64_t& offset, std::uint64_t& length, bool& satisfiable);
+
+    CacheEntry& storeCached(const std::string& path, const FileInfo& info, evbuffer_file_segment* segment);
+    void removeCached(CacheList::iterator it);
+    void evict();
+
+    // ответ из записи кеша, под мьютексом
+    int serveCached(evhttp_request* request, CacheEntry& entry, const char*& reason);
+    void scheduleVariant(CacheEntry& entry, HTTPContentEncoding encoding);
+    int buildVariantResponse(evhttp_request* request, const FileInfo& info, const std::shared_ptr<const std::string>& variant,
+                             HTTPContentEncoding encoding, const char*& reason);
+
+    // segment - из кеша, иначе fd для sendfile (закрывается в любом случае)
+    int buildResponse(evhttp_request* request, const FileInfo& info, evbuffer_file_segment* segment, int fd, const char*& reason);
+};
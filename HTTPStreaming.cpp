@@ -0,0 +1,134 @@
+#include "HTTPStreaming.h"
+#include "HTTPServer.h"
+// std
+#include <iostream>
+#include <cstdarg>
+#include <unistd.h>
+
+
+HTTPResponseStream::HTTPResponseStream(evhttp_request* request, HTTPStreamProducer producer, HTTPStreamCleanup cleanup, void* data):
+    _request(request),
+    _producer(producer),
+    _cleanup(cleanup),
+    _data(data),
+    _chunk(evbuffer_new()),
+    _bytesSent(0),
+    _finished(false){
+}
+
+HTTPResponseStream::~HTTPResponseStream(){
+    if (_cleanup) {
+        _cleanup(_data);
+    }
+    evbuffer_free(_chunk);
+}
+
+void HTTPResponseStream::start(evhttp_request* request, int status, const char* reason,
+                               HTTPStreamProducer producer, HTTPStreamCleanup cleanup, void* data){
+    HTTPResponseStream* stream = new HTTPResponseStream(request, producer, cleanup, data);
+
+    // объект удаляется в одном из двух мест: по завершении запроса или при обрыве соединения
+    evhttp_request_set_on_complete_cb(request, requestCompleteCallback, stream);
+    httpSetConnectionCloseCallback(evhttp_request_get_connection(request), connectionCloseCallback, stream);
+
+    evhttp_send_reply_start(request, status, reason);
+
+    // у HEAD тела нет, куски libevent все равно не отправит
+    if (evhttp_request_get_command(request) == EVHTTP_REQ_HEAD) {
+        stream->_finished = true;
+        evhttp_send_reply_end(request);
+        return;
+    }
+    stream->produce();
+}
+
+evhttp_request* HTTPResponseStream::request() const{
+    return _request;
+}
+
+std::uint64_t HTTPResponseStream::bytesSent() const{
+    return _bytesSent;
+}
+
+void HTTPResponseStream::write(const void* data, std::size_t size){
+    evbuffer_add(_chunk, data, size);
+}
+
+void HTTPResponseStream::printf(const char* format, ...){
+    va_list arguments;
+    va_start(arguments, format);
+    evbuffer_add_vprintf(_chunk, format, arguments);
+    va_end(arguments);
+}
+
+void HTTPResponseStream::addBuffer(evbuffer* buffer){
+    evbuffer_add_buffer(_chunk, buffer);
+}
+
+void HTTPResponseStream::addFile(int fd, off_t offset, off_t length){
+    if (evbuffer_add_file(_chunk, fd, offset, length) != 0) {
+        std::cout << "Ошибка добавления файла в поток ответа." << std::endl;
+        close(fd);
+    }
+}
+
+void HTTPResponseStream::produce(){
+    bool more = _producer(*this, _data);
+    std::size_t length = evbuffer_get_length(_chunk);
+    _bytesSent += length;
+
+    if (more && (length > 0)) {
+        // следующий кусок - когда этот уйдет из выходного буфера соединения
+        evhttp_send_reply_chunk_with_cb(_request, _chunk, chunkSentCallback, this);
+        return;
+    }
+
+    if (length > 0) {
+        evhttp_send_reply_chunk(_request, _chunk);
+    }
+    // после send_reply_end запрос может быть сразу завершен и объект удален
+    _finished = true;
+    evhttp_send_reply_end(_request);
+}
+
+void HTTPResponseStream::chunkSentCallback(evhttp_connection*, void* arg){
+    HTTPResponseStream* stream = static_cast<HTTPResponseStream*>(arg);
+    if (stream->_finished == false) {
+        stream->produce();
+    }
+}
+
+void HTTPResponseStream::requestCompleteCallback(evhttp_request* request, void* arg){
+    HTTPResponseStream* stream = static_cast<HTTPResponseStream*>(arg);
+    evhttp_connection* connection = evhttp_request_get_connection(request);
+    if (connection) {
+        httpSetConnectionCloseCallback(connection, nullptr, nullptr);
+    }
+    delete stream;
+}
+
+void HTTPResponseStream::connectionCloseCallback(evhttp_connection*, void* arg){
+    HTTPResponseStream* stream = static_cast<HTTPResponseStream*>(arg);
+    // при обрыве libevent отсоединяет недописанный запрос и оставляет его нам,
+    // при остановке сервера запрос освобождается вместе с соединением
+    if (evhttp_request_get_connection(stream->_request) == nullptr) {
+        evhttp_request_free(stream->_request);
+    }
+    delete stream;
+}
+
+bool httpReadRequestBody(evhttp_request* request, HTTPBodyChunkHandler handler, void* arg){
+    evbuffer* input = evhttp_request_get_input_buffer(request);
+    while (evbuffer_get_length(input) > 0) {
+        evbuffer_iovec chunk;
+        if (evbuffer_peek(input, -1, nullptr, &chunk, 1) < 1) {
+            break;
+        }
+        bool proceed = handler(static_cast<const char*>(chunk.iov_base), chunk.iov_len, arg);
+        evbuffer_drain(input, chunk.iov_len);
+        if (proceed == false) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+// libevent
+#include <event2/http.h>
+#include <event2/buffer.h>
+
+class HTTPResponseStream;
+
+// Вызывается, когда предыдущий кусок ушел в сокет, и пишет в stream следующий.
+// false - тело закончено (записанное в этом вызове еще будет отправлено).
+// true без записанных данных тоже завершает поток.
+typedef bool (*HTTPStreamProducer)(HTTPResponseStream& stream, void* data);
+// Освобождение data после завершения или обрыва потока, может быть nullptr
+typedef void (*HTTPStreamCleanup)(void* data);
+
+//////////////////////////////////////////////////
+// Потоковый ответ: заголовки уходят сразу (evhttp_send_reply_start), тело - кусками
+// (chunked для HTTP/1.1). Следующий кусок запрашивается у producer только после того,
+// как предыдущий ушел в сокет, поэтому в памяти одновременно не больше одного куска
+// независимо от размера тела и скорости клиента.
+// Объект живет до отправки последнего куска или закрытия соединения.
+//////////////////////////////////////////////////
+class HTTPResponseStream {
+public:
+    // заголовки ответа ставятся до вызова; producer в первый раз вызывается сразу
+    static void start(evhttp_request* request, int status, const char* reason,
+                      HTTPStreamProducer producer, HTTPStreamCleanup cleanup, void* data);
+
+    evhttp_request* request() const;
+    std::uint64_t bytesSent() const;
+
+    void write(const void* data, std::size_t size);
+    void printf(const char* format, ...);
+    // перенос содержимого buffer без копирования
+    void addBuffer(evbuffer* buffer);
+    // кусок файла через sendfile, fd закрывается после отправки
+    void addFile(int fd, off_t offset, off_t length);
+
+private:
+    evhttp_request* _request;
+    HTTPStreamProducer _producer;
+    HTTPStreamCleanup _cleanup;
+    void* _data;
+    evbuffer* _chunk;
+    std::uint64_t _bytesSent;
+    bool _finished;
+
+private:
+    HTTPResponseStream(evhttp_request* request, HTTPStreamProducer producer, HTTPStreamCleanup cleanup, void* data);
+    ~HTTPResponseStream();
+
+    void produce();
+    static void chunkSentCallback(evhttp_connection* connection, void* arg);
+    static void requestCompleteCallback(evhttp_request* request, void* arg);
+    static void connectionCloseCallback(evhttp_connection* connection, void* arg);
+};
+
+// Обработчик очередного куска тела запроса; false - прекратить чтение
+typedef bool (*HTTPBodyChunkHandler)(const char* data, std::size_t size, void* arg);
+
+// Тело запроса кусками как они лежат в буфере, без склейки в один блок;
+// обработанный кусок сразу освобождается. false - чтение прервано обработчиком.
+// Сервер libevent 2.1 вызывает обработчик после приема всего тела, поэтому объем
+// принимаемого тела ограничивается evhttp_set_max_body_size.
+bool httpReadRequestBody(evhttp_request* request, HTTPBodyChunkHandler handler, void* arg);
@@ -0,0 +1,442 @@
+#include "HTTPWebSocket.h"
+#include "HTTPServer.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <strings.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+// libevent
+#include <event2/buffer.h>
+#include <event2/keyvalq_struct.h>
+// openssl
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+
+
+// RFC 6455, 1.3
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// коды закрытия
+#define WEBSOCKET_CLOSE_NORMAL 1000
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEBSOCKET_CLOSE_TOO_BIG 1009
+
+WebSocketFramePtr webSocketEncodeFrame(WebSocketOpcode opcode, const char* data, std::size_t size){
+    std::string* frame = new std::string();
+    frame->reserve(size + 10);
+    // сервер не маскирует и не фрагментирует
+    frame->push_back(static_cast<char>(0x80 | opcode));
+    if (size < 126) {
+        frame->push_back(static_cast<char>(size));
+    } else if (size <= 0xFFFF) {
+        frame->push_back(126);
+        frame->push_back(static_cast<char>(size >> 8));
+        frame->push_back(static_cast<char>(size));
+    } else {
+        frame->push_back(127);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame->push_back(static_cast<char>((std::uint64_t)size >> shift));
+        }
+    }
+    frame->append(data, size);
+    return WebSocketFramePtr(frame);
+}
+
+void webSocketUnmask(char* data, std::size_t size, const unsigned char mask[4]){
+    std::uint32_t mask32;
+    memcpy(&mask32, mask, sizeof(mask32));
+    std::size_t i = 0;
+
+    // шаги кратны 4, поэтому смещение маски на границах не сбивается
+#if defined(__AVX2__)
+    __m256i mask256 = _mm256_set1_epi32((int)mask32);
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(chunk, mask256));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i mask128 = _mm_set1_epi32((int)mask32);
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(chunk, mask128));
+    }
+#endif
+    std::uint64_t mask64 = ((std::uint64_t)mask32 << 32) | mask32;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        word ^= mask64;
+        memcpy(data + i, &word, sizeof(word));
+    }
+    for (; i < size; ++i) {
+        data[i] ^= mask[i & 3];
+    }
+}
+
+//////////////////////////////////////////////////
+// WebSocketConnection
+//////////////////////////////////////////////////
+WebSocketConnection::WebSocketConnection(WebSocketHub* hub, evhttp_connection* connection, bufferevent* bev):
+    _hub(hub),
+    _connection(connection),
+    _bev(bev),
+    _messageOpcode(WS_OPCODE_TEXT),
+    _messageActive(false),
+    _closing(false),
+    _dead(false){
+}
+
+WebSocketHub* WebSocketConnection::hub() const{
+    return _hub;
+}
+
+void WebSocketConnection::send(const WebSocketFramePtr& frame){
+    if (_closing || _dead) {
+        return;
+    }
+    evbuffer* output = bufferevent_get_output(_bev);
+    // отстающий клиент не должен копить память сервера
+    if (evbuffer_get_length(output) > _hub->_maxPendingBytes) {
+        _hub->retire(this);
+        return;
+    }
+    auto cleanup = [](const void*, size_t, void* extra){
+        delete static_cast<WebSocketFramePtr*>(extra);
+    };
+    WebSocketFramePtr* holder = new WebSocketFramePtr(frame);
+    if (evbuffer_add_reference(output, frame->data(), frame->size(), cleanup, holder) != 0) {
+        delete holder;
+    }
+}
+
+void WebSocketConnection::sendText(const char* data, std::size_t size){
+    send(webSocketEncodeFrame(WS_OPCODE_TEXT, data, size));
+}
+
+void WebSocketConnection::close(std::uint16_t code){
+    if (_closing || _dead) {
+        return;
+    }
+    char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+    send(webSocketEncodeFrame(WS_OPCODE_CLOSE, payload, sizeof(payload)));
+    // дальше только дописываем, соединение закроется в writeCallback
+    _closing = true;
+    bufferevent_disable(_bev, EV_READ);
+}
+
+void WebSocketConnection::fail(std::uint16_t code){
+    close(code);
+}
+
+void WebSocketConnection::processInput(){
+    evbuffer* input = bufferevent_get_input(_bev);
+    while ((_closing == false) && (_dead == false)) {
+        std::size_t available = evbuffer_get_length(input);
+        if (available < 2) {
+            return;
+        }
+        unsigned char header[14];
+        evbuffer_copyout(input, header, std::min(available, sizeof(header)));
+
+        bool fin = (header[0] & 0x80) != 0;
+        WebSocketOpcode opcode = static_cast<WebSocketOpcode>(header[0] & 0x0F);
+        // расширения не согласовывались, клиент обязан маскировать
+        if ((header[0] & 0x70) || ((header[1] & 0x80) == 0)) {
+            fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+            return;
+        }
+
+        std::uint64_t length = header[1] & 0x7F;
+        std::size_t headerSize = 2;
+        if (length == 126) {
+            length = ((std::uint64_t)header[2] << 8) | header[3];
+            headerSize = 4;
+        } else if (length == 127) {
+            length = 0;
+            for (int i = 0; i < 8; ++i) {
+                length = (length << 8) | header[2 + i];
+            }
+            headerSize = 10;
+        }
+        unsigned char mask[4];
+        memcpy(mask, header + headerSize, sizeof(mask));
+        headerSize += sizeof(mask);
+        if (available < headerSize) {
+            return;
+        }
+
+        bool control = (opcode & 0x08) != 0;
+        if (control && ((fin == false) || (length > 125))) {
+            fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+            return;
+        }
+        std::size_t used = control ? 0 : _message.size();
+        if (length > _hub->_maxMessageSize - std::min(_hub->_maxMessageSize, used)) {
+            fail(WEBSOCKET_CLOSE_TOO_BIG);
+            return;
+        }
+        // кадр целиком еще не пришел
+        if (available - headerSize < length) {
+            return;
+        }
+
+        evbuffer_drain(input, headerSize);
+        std::string& payload = control ? _control : _message;
+        std::size_t offset = control ? 0 : _message.size();
+        payload.resize(offset + length);
+        evbuffer_remove(input, &payload[offset], length);
+        webSocketUnmask(&payload[offset], length, mask);
+
+        if (processFrame(fin, opcode, payload) == false) {
+            return;
+        }
+    }
+}
+
+bool WebSocketConnection::processFrame(bool fin, WebSocketOpcode opcode, std::string& payload){
+    switch (opcode) {
+        case WS_OPCODE_CLOSE: {
+            // ответ тем же кодом, затем закрытие
+            char code[2] = {static_cast<char>(WEBSOCKET_CLOSE_NORMAL >> 8), static_cast<char>(WEBSOCKET_CLOSE_NORMAL & 0xFF)};
+            if (payload.size() >= 2) {
+                memcpy(code, payload.data(), sizeof(code));
+            }
+            close(static_cast<std::uint16_t>(((unsigned char)code[0] << 8) | (unsigned char)code[1]));
+            return false;
+        }
+        case WS_OPCODE_PING:
+            send(webSocketEncodeFrame(WS_OPCODE_PONG, payload.data(), payload.size()));
+            return true;
+        case WS_OPCODE_PONG:
+            return true;
+        case WS_OPCODE_CONTINUATION:
+            if (_messageActive == false) {
+                fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+                return false;
+            }
+            break;
+        case WS_OPCODE_TEXT:
+        case WS_OPCODE_BINARY:
+            if (_messageActive) {
+                fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+                return false;
+            }
+            _messageOpcode = opcode;
+            _messageActive = true;
+            break;
+        default:
+            fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+            return false;
+    }
+
+    if (fin) {
+        _messageActive = false;
+        _hub->_handler(*this, _messageOpcode, _message, _hub->_data);
+        _message.clear();
+    }
+    return true;
+}
+
+void WebSocketConnection::readCallback(bufferevent*, void* arg){
+    static_cast<WebSocketConnection*>(arg)->processInput();
+}
+
+void WebSocketConnection::writeCallback(bufferevent*, void* arg){
+    WebSocketConnection* connection = static_cast<WebSocketConnection*>(arg);
+    // закрывающий кадр ушел
+    if (connection->_closing) {
+        connection->_hub->retire(connection);
+    }
+}
+
+void WebSocketConnection::eventCallback(bufferevent*, short, void* arg){
+    WebSocketConnection* connection = static_cast<WebSocketConnection*>(arg);
+    connection->_hub->retire(connection);
+}
+
+void WebSocketConnection::connectionCloseCallback(evhttp_connection*, void* arg){
+    // evhttp сам освобождает соединение (остановка сервера)
+    WebSocketConnection* connection = static_cast<WebSocketConnection*>(arg);
+    WebSocketHub* hub = connection->_hub;
+    hub->_connections.erase(connection);
+    hub->_dead.erase(std::remove(hub->_dead.begin(), hub->_dead.end(), connection), hub->_dead.end());
+    delete connection;
+}
+
+//////////////////////////////////////////////////
+// WebSocketHub
+//////////////////////////////////////////////////
+WebSocketHub::WebSocketHub(event_base* base, WebSocketBroadcaster* broadcaster, WebSocketMessageHandler handler, void* data,
+                           std::size_t maxMessageSize, std::size_t maxPendingBytes):
+    _base(base),
+    _broadcaster(broadcaster),
+    _handler(handler),
+    _data(data),
+    _maxMessageSize(maxMessageSize),
+    _maxPendingBytes(maxPendingBytes),
+    _reapEvent(event_new(base, -1, 0, reapCallback, this)){
+    if (_broadcaster) {
+        _broadcaster->addHub(this);
+    }
+}
+
+WebSocketHub::~WebSocketHub(){
+    if (_broadcaster) {
+        _broadcaster->removeHub(this);
+    }
+    for (WebSocketConnection* connection: _connections) {
+        if (connection->_dead == false) {
+            _dead.push_back(connection);
+        }
+    }
+    reapCallback(-1, 0, this);
+    event_free(_reapEvent);
+}
+
+bool WebSocketHub::upgrade(evhttp_request* request){
+    evkeyvalq* headers = evhttp_request_get_input_headers(request);
+    const char* upgrade = evhttp_find_header(headers, "Upgrade");
+    const char* connectionHeader = evhttp_find_header(headers, "Connection");
+    const char* key = evhttp_find_header(headers, "Sec-WebSocket-Key");
+    const char* version = evhttp_find_header(headers, "Sec-WebSocket-Version");
+    if ((evhttp_request_get_command(request) != EVHTTP_REQ_GET) ||
+        (upgrade == nullptr) || (strcasecmp(upgrade, "websocket") != 0) ||
+        (connectionHeader == nullptr) || (strcasestr(connectionHeader, "upgrade") == nullptr) ||
+        (key == nullptr) || (version == nullptr) || (strcmp(version, "13") != 0)) {
+        return false;
+    }
+
+    // Sec-WebSocket-Accept = base64(sha1(key + GUID))
+    std::string source(key);
+    source.append(WEBSOCKET_GUID);
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(source.data()), source.size(), digest);
+    unsigned char accept[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+    EVP_EncodeBlock(accept, digest, SHA_DIGEST_LENGTH);
+
+    // bufferevent остается у evhttp_connection, меняются только колбеки:
+    // освобождение evhttp_connection делает shutdown сокета, поэтому оно откладывается до закрытия
+    evhttp_connection* evcon = evhttp_request_get_connection(request);
+    bufferevent* bev = evhttp_connection_get_bufferevent(evcon);
+    evbuffer_add_printf(bufferevent_get_output(bev),
+                        "HTTP/1.1 101 Switching Protocols\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+
+    WebSocketConnection* connection = new WebSocketConnection(this, evcon, bev);
+    _connections.insert(connection);
+    httpSetConnectionCloseCallback(evcon, WebSocketConnection::connectionCloseCallback, connection);
+
+    // таймауты простоя HTTP к долгим соединениям не относятся
+    bufferevent_set_timeouts(bev, nullptr, nullptr);
+    bufferevent_setwatermark(bev, EV_READ, 0, 0);
+    bufferevent_setcb(bev, WebSocketConnection::readCallback, WebSocketConnection::writeCallback,
+                      WebSocketConnection::eventCallback, connection);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+
+    // кадры могли прийти вместе с рукопожатием
+    connection->processInput();
+    return true;
+}
+
+void WebSocketHub::broadcast(const WebSocketFramePtr& frame){
+    for (WebSocketConnection* connection: _connections) {
+        connection->send(frame);
+    }
+}
+
+event_base* WebSocketHub::base() const{
+    return _base;
+}
+
+WebSocketBroadcaster* WebSocketHub::broadcaster() const{
+    return _broadcaster;
+}
+
+std::size_t WebSocketHub::connectionsCount() const{
+    return _connections.size() - _dead.size();
+}
+
+void WebSocketHub::retire(WebSocketConnection* connection){
+    if (connection->_dead) {
+        return;
+    }
+    connection->_dead = true;
+    bufferevent_disable(connection->_bev, EV_READ | EV_WRITE);
+    _dead.push_back(connection);
+    event_active(_reapEvent, EV_TIMEOUT, 1);
+}
+
+void WebSocketHub::reapCallback(evutil_socket_t, short, void* arg){
+    WebSocketHub* hub = static_cast<WebSocketHub*>(arg);
+    std::vector<WebSocketConnection*> dead;
+    dead.swap(hub->_dead);
+    for (WebSocketConnection* connection: dead) {
+        hub->_connections.erase(connection);
+        // соединение и запрос рукопожатия освобождает evhttp, закрытие учитывает сервер
+        httpSetConnectionCloseCallback(connection->_connection, nullptr, nullptr);
+        bufferevent_setcb(connection->_bev, nullptr, nullptr, nullptr, nullptr);
+        evhttp_connection_free(connection->_connection);
+        delete connection;
+    }
+}
+
+//////////////////////////////////////////////////
+// WebSocketBroadcaster
+//////////////////////////////////////////////////
+WebSocketBroadcaster::WebSocketBroadcaster(){
+}
+
+void WebSocketBroadcaster::addHub(WebSocketHub* hub){
+    std::lock_guard<std::mutex> lock(_mutex);
+    _hubs.push_back(hub);
+}
+
+void WebSocketBroadcaster::removeHub(WebSocketHub* hub){
+    std::lock_guard<std::mutex> lock(_mutex);
+    _hubs.erase(std::remove(_hubs.begin(), _hubs.end(), hub), _hubs.end());
+}
+
+void WebSocketBroadcaster::broadcast(const WebSocketFramePtr& frame){
+    timeval immediately = {0, 0};
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (WebSocketHub* hub: _hubs) {
+        Delivery* delivery = new Delivery();
+        delivery->hub = hub;
+        delivery->frame = frame;
+        if (event_base_once(hub->base(), -1, EV_TIMEOUT, deliverCallback, delivery, &immediately) != 0) {
+            std::cout << "Ошибка передачи кадра в поток." << std::endl;
+            delete delivery;
+        }
+    }
+}
+
+void WebSocketBroadcaster::deliverCallback(evutil_socket_t, short, void* arg){
+    Delivery* delivery = static_cast<Delivery*>(arg);
+    delivery->hub->broadcast(delivery->frame);
+    delete delivery;
+}
+
+void WebSocketBroadcaster::routeHandler(evhttp_request* request, const HTTPRouteParams&, void* data){
+    WebSocketBroadcaster* broadcaster = static_cast<WebSocketBroadcaster*>(data);
+    event_base* base = evhttp_connection_get_base(evhttp_request_get_connection(request));
+
+    WebSocketHub* hub = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(broadcaster->_mutex);
+        for (WebSocketHub* item: broadcaster->_hubs) {
+            if (item->base() == base) {
+                hub = item;
+                break;
+            }
+        }
+    }
+    if ((hub == nullptr) || (hub->upgrade(request) == false)) {
+        evhttp_send_error(request, HTTP_BADREQUEST, nullptr);
+    }
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+// libevent
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/bufferevent.h>
+// server
+#include "HTTPRouter.h"
+
+// Коды кадров RFC 6455
+enum WebSocketOpcode {
+    WS_OPCODE_CONTINUATION = 0x0,
+    WS_OPCODE_TEXT = 0x1,
+    WS_OPCODE_BINARY = 0x2,
+    WS_OPCODE_CLOSE = 0x8,
+    WS_OPCODE_PING = 0x9,
+    WS_OPCODE_PONG = 0xA
+};
+
+// Кадр сервера, закодированный один раз; разделяется всеми получателями и потоками
+typedef std::shared_ptr<const std::string> WebSocketFramePtr;
+
+WebSocketFramePtr webSocketEncodeFrame(WebSocketOpcode opcode, const char* data, std::size_t size);
+
+// Снятие маски клиента на месте: SSE2/AVX2 по 16/32 байт, хвост словами и байтами.
+// data начинается с начала полезной нагрузки кадра (смещение маски 0).
+void webSocketUnmask(char* data, std::size_t size, const unsigned char mask[4]);
+
+class WebSocketHub;
+class WebSocketConnection;
+
+// Полное (собранное из фрагментов) сообщение клиента
+typedef void (*WebSocketMessageHandler)(WebSocketConnection& connection, WebSocketOpcode opcode, const std::string& message, void* data);
+
+//////////////////////////////////////////////////
+// Соединение после рукопожатия: bufferevent соединения evhttp переходит под наши
+// колбеки, evhttp_connection остается владельцем сокета до закрытия.
+//////////////////////////////////////////////////
+class WebSocketConnection {
+public:
+    WebSocketHub* hub() const;
+
+    // кадр добавляется в выходной буфер ссылкой
+    void send(const WebSocketFramePtr& frame);
+    void sendText(const char* data, std::size_t size);
+    // закрывающий кадр, соединение закрывается после его отправки
+    void close(std::uint16_t code);
+
+private:
+    friend class WebSocketHub;
+
+    WebSocketHub* _hub;
+    evhttp_connection* _connection;
+    bufferevent* _bev;
+    std::string _message;                   // собираемое из фрагментов сообщение
+    WebSocketOpcode _messageOpcode;
+    bool _messageActive;
+    std::string _control;
+    bool _closing;                          // закрывающий кадр отправлен
+    bool _dead;                             // ждет удаления хабом
+
+private:
+    WebSocketConnection(WebSocketHub* hub, evhttp_connection* connection, bufferevent* bev);
+
+    void processInput();
+    bool processFrame(bool fin, WebSocketOpcode opcode, std::string& payload);
+    void fail(std::uint16_t code);
+
+    static void readCallback(bufferevent* bev, void* arg);
+    static void writeCallback(bufferevent* bev, void* arg);
+    static void eventCallback(bufferevent* bev, short events, void* arg);
+    static void connectionCloseCallback(evhttp_connection* connection, void* arg);
+};
+
+class WebSocketBroadcaster;
+
+//////////////////////////////////////////////////
+// Соединения одного event_base: рукопожатие, рассылка и удаление.
+// Рассылка кладет один и тот же закодированный кадр во все выходные буферы ссылкой;
+// отстающий получатель (в буфере больше maxPendingBytes) отключается.
+// Работает только в потоке своего event_base.
+//////////////////////////////////////////////////
+class WebSocketHub {
+public:
+    // broadcaster - для рассылки между потоками, может быть nullptr
+    WebSocketHub(event_base* base, WebSocketBroadcaster* broadcaster, WebSocketMessageHandler handler, void* data,
+                 std::size_t maxMessageSize, std::size_t maxPendingBytes);
+    ~WebSocketHub();
+
+    WebSocketHub(const WebSocketHub&) = delete;
+    WebSocketHub& operator=(const WebSocketHub&) = delete;
+
+    // проверка рукопожатия, ответ 101 и захват соединения; false - ответ не отправлялся
+    bool upgrade(evhttp_request* request);
+
+    void broadcast(const WebSocketFramePtr& frame);
+
+    event_base* base() const;
+    WebSocketBroadcaster* broadcaster() const;
+    std::size_t connectionsCount() const;
+
+private:
+    friend class WebSocketConnection;
+
+    event_base* _base;
+    WebSocketBroadcaster* _broadcaster;
+    WebSocketMessageHandler _handler;
+    void* _data;
+    std::size_t _maxMessageSize;
+    std::size_t _maxPendingBytes;
+    std::unordered_set<WebSocketConnection*> _connections;
+    std::vector<WebSocketConnection*> _dead;
+    event* _reapEvent;
+
+private:
+    // удаление откладывается: соединение может закрыться посреди рассылки
+    void retire(WebSocketConnection* connection);
+    static void reapCallback(evutil_socket_t, short, void* arg);
+};
+
+//////////////////////////////////////////////////
+// Рассылка по хабам всех потоков: в каждый цикл уходит только указатель на кадр
+// (event_base_once), сам кадр не копируется. Нужен evthread_use_pthreads().
+//////////////////////////////////////////////////
+class WebSocketBroadcaster {
+public:
+    WebSocketBroadcaster();
+
+    WebSocketBroadcaster(const WebSocketBroadcaster&) = delete;
+    WebSocketBroadcaster& operator=(const WebSocketBroadcaster&) = delete;
+
+    // из любого потока
+    void broadcast(const WebSocketFramePtr& frame);
+
+    // обработчик маршрута GET, data - WebSocketBroadcaster; хаб выбирается по базе соединения
+    static void routeHandler(evhttp_request* request, const HTTPRouteParams& params, void* data);
+
+private:
+    friend class WebSocketHub;
+
+    struct Delivery {
+        WebSocketHub* hub;
+        WebSocketFramePtr frame;
+    };
+
+    std::mutex _mutex;
+    std::vector<WebSocketHub*> _hubs;
+
+private:
+    void addHub(WebSocketHub* hub);
+    void removeHub(WebSocketHub* hub);
+    static void deliverCallback(evutil_socket_t, short, void* arg);
+};
@@ -0,0 +1,316 @@
+#include "IOUring.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+// system
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+static int ioUringSetup(unsigned entries, io_uring_params* params){
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags){
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+IOUring::IOUring():
+    _fd(-1),
+    _features(0),
+    _sqRing(MAP_FAILED),
+    _sqRingSize(0),
+    _sqHead(nullptr),
+    _sqTail(nullptr),
+    _sqMask(0),
+    _sqEntries(0),
+    _sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+    _sqesSize(0),
+    _sqeTail(0),
+    _sqeSubmitted(0),
+    _inFlight(0),
+    _cqRing(MAP_FAILED),
+    _cqRingSize(0),
+    _cqHead(nullptr),
+    _cqTail(nullptr),
+    _cqMask(0),
+    _cqes(nullptr),
+    _buffers(static_cast<char*>(MAP_FAILED)),
+    _buffersSize(0),
+    _bufferSize(0),
+    _bufferGroup(0){
+}
+
+IOUring::~IOUring(){
+    release();
+}
+
+void IOUring::release(){
+    cancelAll();
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqesSize);
+        _sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    }
+    if ((_cqRing != MAP_FAILED) && (_cqRing != _sqRing)) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    _cqRing = MAP_FAILED;
+    if (_sqRing != MAP_FAILED) {
+        munmap(_sqRing, _sqRingSize);
+        _sqRing = MAP_FAILED;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    // кольца уже нет - буферы приема ядру больше не доступны
+    if (_buffers != MAP_FAILED) {
+        munmap(_buffers, _buffersSize);
+        _buffers = static_cast<char*>(MAP_FAILED);
+    }
+}
+
+void IOUring::cancelAll(){
+    if ((_fd < 0) || (_sqes == MAP_FAILED) || (_cqes == nullptr) || (_inFlight == 0)) {
+        return;
+    }
+    io_uring_sqe* sqe = getSqe();
+    while (sqe == nullptr) {
+        submitAndWait(0);
+        sqe = getSqe();
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    sqe->user_data = 0;
+
+    // отмененные операции завершаются с -ECANCELED, многоразовые - последним CQE без F_MORE
+    while (_inFlight > 0) {
+        int result = submitAndWait(1);
+        if ((result < 0) && (result != -EINTR) && (result != -EAGAIN) && (result != -EBUSY)) {
+            std::cout << "Ошибка io_uring_enter при отмене операций: " << strerror(-result) << std::endl;
+            return;
+        }
+        bool unsupported = false;
+        forEachCompletion([&](const io_uring_cqe& cqe){
+            if ((cqe.user_data == 0) && (cqe.res == -EINVAL)) {
+                unsupported = true;
+            }
+        });
+        // ядро старше 5.19 без IORING_ASYNC_CANCEL_ANY: остается закрыть кольцо до освобождения буферов
+        if (unsupported) {
+            return;
+        }
+    }
+}
+
+bool IOUring::supportsRecvMultishot(){
+    // данные в сокете есть, а буферов в группе нет: поддерживается - ENOBUFS, нет - EINVAL
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0) {
+        return false;
+    }
+    char byte = 0;
+    bool supported = false;
+    io_uring_sqe* sqe = getSqe();
+    if ((send(sockets[1], &byte, sizeof(byte), MSG_NOSIGNAL) == sizeof(byte)) && sqe) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sockets[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0xFFFF;
+        sqe->user_data = 0;
+        if (submitAndWait(1) >= 0) {
+            forEachCompletion([&](const io_uring_cqe& cqe){
+                supported = (cqe.res != -EINVAL) && (cqe.res != -EOPNOTSUPP);
+            });
+        }
+    }
+    close(sockets[0]);
+    close(sockets[1]);
+    return supported;
+}
+
+bool IOUring::init(unsigned entries){
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // кольцо используется одним потоком: работа ядра выполняется только внутри io_uring_enter
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4;
+    _fd = ioUringSetup(entries, &params);
+    if ((_fd < 0) && (errno == EINVAL)) {
+        // старое ядро - без необязательных флагов
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        _fd = ioUringSetup(entries, &params);
+    }
+    if (_fd < 0) {
+        std::cout << "Ошибка io_uring_setup: " << strerror(errno) << std::endl;
+        return false;
+    }
+    _features = params.features;
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (_features & IORING_FEAT_SINGLE_MMAP) {
+        if (_cqRingSize > _sqRingSize) {
+            _sqRingSize = _cqRingSize;
+        }
+        _cqRingSize = _sqRingSize;
+    }
+
+    _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        std::cout << "Ошибка отображения очереди отправки io_uring." << std::endl;
+        release();
+        return false;
+    }
+    if (_features & IORING_FEAT_SINGLE_MMAP) {
+        _cqRing = _sqRing;
+    } else {
+        _cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cqRing == MAP_FAILED) {
+            std::cout << "Ошибка отображения очереди завершений io_uring." << std::endl;
+            release();
+            return false;
+        }
+    }
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe*>(mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+    if (_sqes == MAP_FAILED) {
+        std::cout << "Ошибка отображения SQE io_uring." << std::endl;
+        release();
+        return false;
+    }
+
+    char* sqRing = static_cast<char*>(_sqRing);
+    _sqHead = reinterpret_cast<unsigned*>(sqRing + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(sqRing + params.sq_off.tail);
+    _sqMask = *reinterpret_cast<unsigned*>(sqRing + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    // SQE всегда лежат по порядку: массив индексов заполняется один раз
+    unsigned* sqArray = reinterpret_cast<unsigned*>(sqRing + params.sq_off.array);
+    for (unsigned i = 0; i < _sqEntries; ++i) {
+        sqArray[i] = i;
+    }
+    _sqeTail = *_sqTail;
+    _sqeSubmitted = _sqeTail;
+
+    char* cqRing = static_cast<char*>(_cqRing);
+    _cqHead = reinterpret_cast<unsigned*>(cqRing + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(cqRing + params.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned*>(cqRing + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+    return true;
+}
+
+bool IOUring::isValid() const{
+    return _fd >= 0;
+}
+
+io_uring_sqe* IOUring::getSqe(){
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    if (_sqeTail - head >= _sqEntries) {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &_sqes[_sqeTail & _sqMask];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    ++_sqeTail;
+    ++_inFlight;
+    return sqe;
+}
+
+int IOUring::submitAndWait(unsigned waitCount){
+    unsigned toSubmit = _sqeTail - _sqeSubmitted;
+    __atomic_store_n(_sqTail, _sqeTail, __ATOMIC_RELEASE);
+    _sqeSubmitted = _sqeTail;
+
+    // GETEVENTS нужен и без ожидания: с DEFER_TASKRUN завершения появляются только в enter
+    int result = ioUringEnter(_fd, toSubmit, waitCount, IORING_ENTER_GETEVENTS);
+    if (result < 0) {
+        return -errno;
+    }
+    return result;
+}
+
+bool IOUring::registerBufferGroup(std::uint16_t groupId, unsigned buffersCount, unsigned bufferSize){
+    if ((buffersCount == 0) || (buffersCount > 65536)) {
+        std::cout << "Число буферов io_uring должно быть от 1 до 65536." << std::endl;
+        return false;
+    }
+    _buffersSize = static_cast<std::size_t>(buffersCount) * bufferSize;
+    void* buffers = mmap(nullptr, _buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) {
+        std::cout << "Ошибка выделения буферов io_uring: " << strerror(errno) << std::endl;
+        return false;
+    }
+    _buffers = static_cast<char*>(buffers);
+    _bufferSize = bufferSize;
+    _bufferGroup = groupId;
+
+    // один SQE принимает до 65535 буферов
+    unsigned firstId = 0;
+    while (firstId < buffersCount) {
+        unsigned count = std::min(buffersCount - firstId, 65535u);
+        provideBuffers(static_cast<std::uint16_t>(firstId), count);
+        firstId += count;
+    }
+    if (submitAndWait(1) < 0) {
+        return false;
+    }
+    int result = 0;
+    forEachCompletion([&](const io_uring_cqe& cqe){
+        if (cqe.res < 0) {
+            result = cqe.res;
+        }
+    });
+    if (result < 0) {
+        std::cout << "Ошибка IORING_OP_PROVIDE_BUFFERS: " << strerror(-result) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+char* IOUring::buffer(std::uint16_t bufferId) const{
+    return _buffers + static_cast<std::size_t>(bufferId) * _bufferSize;
+}
+
+void IOUring::recycleBuffer(std::uint16_t bufferId){
+    _recycled.push_back(bufferId);
+}
+
+void IOUring::publishBuffers(){
+    if (_recycled.empty()) {
+        return;
+    }
+    // соседние буферы лежат в памяти подряд - один SQE на каждый непрерывный диапазон
+    std::sort(_recycled.begin(), _recycled.end());
+    std::size_t first = 0;
+    for (std::size_t i = 1; i <= _recycled.size(); ++i) {
+        if ((i == _recycled.size()) || (_recycled[i] != _recycled[i - 1] + 1)) {
+            provideBuffers(_recycled[first], static_cast<unsigned>(i - first));
+            first = i;
+        }
+    }
+    _recycled.clear();
+}
+
+void IOUring::provideBuffers(std::uint16_t firstId, unsigned count){
+    io_uring_sqe* sqe = getSqe();
+    while (sqe == nullptr) {
+        submitAndWait(0);
+        sqe = getSqe();
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<std::int32_t>(count);
+    sqe->addr = reinterpret_cast<std::uint64_t>(buffer(firstId));
+    sqe->len = _bufferSize;
+    sqe->off = firstId;
+    sqe->buf_group = _bufferGroup;
+    sqe->user_data = 0;
+}
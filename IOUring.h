@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+// system
+#include <linux/io_uring.h>
+
+//////////////////////////////////////////////////
+// Кольцо io_uring напрямую через системные вызовы, без liburing.
+// SQE копятся в кольце и уходят в ядро одним io_uring_enter в submitAndWait.
+// Работает только в одном потоке. user_data 0 занят служебными операциями кольца.
+// При уничтожении незавершенные операции отменяются и дожидаются, и только потом
+// освобождаются кольцо и буферы - ядро не пишет в уже отданную память.
+//////////////////////////////////////////////////
+class IOUring {
+public:
+    IOUring();
+    ~IOUring();
+
+    IOUring(const IOUring&) = delete;
+    IOUring& operator=(const IOUring&) = delete;
+
+    // entries - размер очереди отправки, очередь завершений вчетверо больше
+    bool init(unsigned entries);
+    bool isValid() const;
+    // многоразовый recv (IORING_RECV_MULTISHOT, ядро 6.0+) с выбором буфера из группы
+    bool supportsRecvMultishot();
+
+    // Свободный обнуленный SQE; nullptr - очередь полна, нужен submitAndWait
+    io_uring_sqe* getSqe();
+    // отправка накопленных SQE и ожидание хотя бы waitCount завершений; < 0 - -errno
+    int submitAndWait(unsigned waitCount);
+
+    // Завершения без копирования: handler вызывается для каждого CQE, затем они освобождаются.
+    // Возвращает количество обработанных.
+    template <typename Handler>
+    unsigned forEachCompletion(Handler&& handler);
+
+    // Группа буферов для recv с IOSQE_BUFFER_SELECT: buffersCount (до 65536) буферов по bufferSize
+    // в одной области памяти. Ядру отдаются через IORING_OP_PROVIDE_BUFFERS, а не кольцом
+    // IORING_REGISTER_PBUF_RING: на части ядер recv из кольца получает ENOBUFS.
+    bool registerBufferGroup(std::uint16_t groupId, unsigned buffersCount, unsigned bufferSize);
+    char* buffer(std::uint16_t bufferId) const;
+    // буфер снова доступен ядру после publishBuffers
+    void recycleBuffer(std::uint16_t bufferId);
+    // SQE возврата буферов, уходят со следующим submitAndWait
+    void publishBuffers();
+
+private:
+    int _fd;
+    unsigned _features;
+    // очередь отправки
+    void* _sqRing;
+    std::size_t _sqRingSize;
+    unsigned* _sqHead;
+    unsigned* _sqTail;
+    unsigned _sqMask;
+    unsigned _sqEntries;
+    io_uring_sqe* _sqes;
+    std::size_t _sqesSize;
+    unsigned _sqeTail;          // локальный хвост, в ядро публикуется при отправке
+    unsigned _sqeSubmitted;
+    unsigned _inFlight;         // операции без последнего CQE (у многоразовых - без IORING_CQE_F_MORE)
+    // очередь завершений
+    void* _cqRing;
+    std::size_t _cqRingSize;
+    unsigned* _cqHead;
+    unsigned* _cqTail;
+    unsigned _cqMask;
+    io_uring_cqe* _cqes;
+    // группа буферов приема
+    char* _buffers;
+    std::size_t _buffersSize;
+    unsigned _bufferSize;
+    std::uint16_t _bufferGroup;
+    std::vector<std::uint16_t> _recycled;   // освобожденные буферы до publishBuffers
+
+private:
+    void release();
+    // отмена всех операций и ожидание их завершений
+    void cancelAll();
+    void provideBuffers(std::uint16_t firstId, unsigned count);
+};
+
+template <typename Handler>
+unsigned IOUring::forEachCompletion(Handler&& handler){
+    unsigned head = *_cqHead;
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = tail - head;
+    for ( ; head != tail; ++head) {
+        const io_uring_cqe& cqe = _cqes[head & _cqMask];
+        if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+            --_inFlight;
+        }
+        handler(cqe);
+    }
+    // ядро может переиспользовать слоты только после обработки
+    __atomic_store_n(_cqHead, tail, __ATOMIC_RELEASE);
+    return count;
+}
@@ -0,0 +1,608 @@
+#include "IOUringServer.h"
+#include "IOUring.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <future>
+#include <unordered_set>
+#include <algorithm>
+// system
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+// server
+#include "UnixSocket.h"
+
+
+// группа буферов приема
+#define IOURING_BUFFER_GROUP 0
+// максимальные данные одного кадра: длина - один байт
+#define IOURING_MAX_FRAME 255
+
+// тип операции в младших битах user_data, в остальных - указатель на соединение
+enum IOUringOperation {
+    IOURING_OP_ACCEPT = 1,
+    IOURING_OP_WAKEUP = 2,
+    IOURING_OP_RECV = 3,
+    IOURING_OP_SEND = 4,
+    IOURING_OP_ACCEPT_UNIX = 5
+};
+#define IOURING_OP_MASK 7ULL
+
+static std::uint64_t encodeUserData(IOUringConnection* connection, IOUringOperation operation){
+    return reinterpret_cast<std::uint64_t>(connection) | operation;
+}
+
+//////////////////////////////////////////////////
+// Цикл одного потока: свое кольцо, свой слушающий сокет и свои соединения
+//////////////////////////////////////////////////
+class IOUringLoop {
+public:
+    IOUringLoop(IOUringServer* server);
+    ~IOUringLoop();
+
+    bool init();
+    void run();
+    // из потока кольца после run: SINGLE_ISSUER не дает отменять операции из другого потока
+    void releaseRing();
+    // из любого потока
+    void wakeup();
+
+    void markDirty(IOUringConnection* connection);
+    void closeConnection(IOUringConnection* connection);
+
+private:
+    IOUringServer* _server;
+    const IOUringServerConfig& _config;
+    const IOUringCallbacks& _callbacks;
+    std::unique_ptr<IOUring> _ring;
+    int _listenFd;
+    int _wakeupFd;
+    std::uint64_t _wakeupValue;
+    std::unordered_set<IOUringConnection*> _connections;
+    std::vector<IOUringConnection*> _dirty;
+    std::vector<IOUringConnection*> _starved;
+    std::uint64_t _accepted;
+    std::uint64_t _messages;
+
+private:
+    bool listen();
+    io_uring_sqe* getSqe();
+    void armAccept(int fd, IOUringOperation operation);
+    void armWakeup();
+    void armRecv(IOUringConnection* connection);
+    void submitSend(IOUringConnection* connection);
+    void flushSends();
+
+    void handleCompletion(const io_uring_cqe& cqe);
+    void handleAccept(const io_uring_cqe& cqe, bool unix);
+    void handleRecv(IOUringConnection* connection, const io_uring_cqe& cqe);
+    void handleSend(IOUringConnection* connection, const io_uring_cqe& cqe);
+    void processInput(IOUringConnection* connection, const char* data, std::size_t size);
+    std::size_t parseFrames(IOUringConnection* connection, const char* data, std::size_t size);
+    void tryFinalize(IOUringConnection* connection);
+};
+
+//////////////////////////////////////////////////
+// IOUringConnection
+//////////////////////////////////////////////////
+IOUringConnection::IOUringConnection(IOUringLoop* loop, int fd):
+    data(nullptr),
+    _loop(loop),
+    _fd(fd),
+    _sendOffset(0),
+    _recvActive(false),
+    _recvStarved(false),
+    _sendInFlight(false),
+    _dirty(false),
+    _closing(false){
+}
+
+void IOUringConnection::send(const char* data, std::size_t size){
+    if (_closing) {
+        return;
+    }
+    do {
+        std::size_t frameSize = std::min<std::size_t>(size, IOURING_MAX_FRAME);
+        _output.push_back(static_cast<char>(frameSize));
+        _output.append(data, frameSize);
+        data += frameSize;
+        size -= frameSize;
+    } while (size > 0);
+    _loop->markDirty(this);
+}
+
+void IOUringConnection::close(){
+    if (_closing) {
+        return;
+    }
+    _closing = true;
+    // уже добавленные данные уйдут, сокет закроется после них
+    if (_output.empty() && (_sendInFlight == false)) {
+        _loop->closeConnection(this);
+    }
+}
+
+int IOUringConnection::fd() const{
+    return _fd;
+}
+
+//////////////////////////////////////////////////
+// IOUringLoop
+//////////////////////////////////////////////////
+IOUringLoop::IOUringLoop(IOUringServer* server):
+    _server(server),
+    _config(server->_config),
+    _callbacks(server->_callbacks),
+    _listenFd(-1),
+    _wakeupFd(-1),
+    _wakeupValue(0),
+    _accepted(0),
+    _messages(0){
+}
+
+IOUringLoop::~IOUringLoop(){
+    releaseRing();
+    for (IOUringConnection* connection: _connections) {
+        delete connection;
+    }
+    if (_listenFd >= 0) {
+        ::close(_listenFd);
+    }
+    if (_wakeupFd >= 0) {
+        ::close(_wakeupFd);
+    }
+}
+
+void IOUringLoop::releaseRing(){
+    // сначала кольцо: его деструктор отменяет и дожидается операций ядра, только потом
+    // освобождаются буферы приема и строки отправки соединений
+    for (IOUringConnection* connection: _connections) {
+        if (connection->_fd >= 0) {
+            ::close(connection->_fd);
+            connection->_fd = -1;
+        }
+    }
+    _ring.reset();
+}
+
+bool IOUringLoop::listen(){
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_config.port);
+    if (inet_pton(AF_INET, _config.address, &address.sin_addr) != 1) {
+        std::cout << "Неверный адрес сервера: " << _config.address << std::endl;
+        return false;
+    }
+
+    _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0) {
+        std::cout << "Ошибка создания сокета: " << strerror(errno) << std::endl;
+        return false;
+    }
+    // сокет на поток: ядро само раскидывает соединения по потокам
+    int enable = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+    if (bind(_listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cout << "Ошибка привязки к " << _config.address << ":" << _config.port << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (::listen(_listenFd, _config.backlog) < 0) {
+        std::cout << "Ошибка listen: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool IOUringLoop::init(){
+    _ring.reset(new IOUring());
+    if (_ring->init(_config.queueDepth) == false) {
+        return false;
+    }
+    if (_ring->registerBufferGroup(IOURING_BUFFER_GROUP, _config.buffersCount, _config.bufferSize) == false) {
+        return false;
+    }
+    _wakeupFd = eventfd(0, EFD_CLOEXEC);
+    if (_wakeupFd < 0) {
+        std::cout << "Ошибка создания eventfd: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (listen() == false) {
+        return false;
+    }
+    armAccept(_listenFd, IOURING_OP_ACCEPT);
+    if (_server->_unixFd >= 0) {
+        armAccept(_server->_unixFd, IOURING_OP_ACCEPT_UNIX);
+    }
+    armWakeup();
+    return true;
+}
+
+void IOUringLoop::wakeup(){
+    std::uint64_t value = 1;
+    ssize_t written = write(_wakeupFd, &value, sizeof(value));
+    (void)written;
+}
+
+io_uring_sqe* IOUringLoop::getSqe(){
+    io_uring_sqe* sqe = _ring->getSqe();
+    while (sqe == nullptr) {
+        // очередь полна - отправляем накопленное без ожидания
+        _ring->submitAndWait(0);
+        sqe = _ring->getSqe();
+    }
+    return sqe;
+}
+
+void IOUringLoop::armAccept(int fd, IOUringOperation operation){
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = encodeUserData(nullptr, operation);
+}
+
+void IOUringLoop::armWakeup(){
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = _wakeupFd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&_wakeupValue);
+    sqe->len = sizeof(_wakeupValue);
+    sqe->user_data = encodeUserData(nullptr, IOURING_OP_WAKEUP);
+}
+
+void IOUringLoop::armRecv(IOUringConnection* connection){
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IOURING_BUFFER_GROUP;
+    sqe->user_data = encodeUserData(connection, IOURING_OP_RECV);
+    connection->_recvActive = true;
+    connection->_recvStarved = false;
+}
+
+void IOUringLoop::submitSend(IOUringConnection* connection){
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = connection->_fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(connection->_sending.data() + connection->_sendOffset);
+    sqe->len = static_cast<unsigned>(connection->_sending.size() - connection->_sendOffset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = encodeUserData(connection, IOURING_OP_SEND);
+    connection->_sendInFlight = true;
+}
+
+void IOUringLoop::markDirty(IOUringConnection* connection){
+    if (connection->_dirty == false) {
+        connection->_dirty = true;
+        _dirty.push_back(connection);
+    }
+}
+
+void IOUringLoop::flushSends(){
+    // по одной отправке на соединение: все, что накопилось за итерацию, уходит одним SQE
+    for (IOUringConnection* connection: _dirty) {
+        connection->_dirty = false;
+        if (connection->_sendInFlight || connection->_output.empty()) {
+            continue;
+        }
+        connection->_sending.swap(connection->_output);
+        connection->_output.clear();
+        connection->_sendOffset = 0;
+        submitSend(connection);
+    }
+    _dirty.clear();
+}
+
+void IOUringLoop::run(){
+    while (true) {
+        flushSends();
+        int result = _ring->submitAndWait(1);
+        if ((result < 0) && (result != -EINTR) && (result != -EAGAIN) && (result != -EBUSY)) {
+            std::cout << "Ошибка io_uring_enter: " << strerror(-result) << std::endl;
+            break;
+        }
+
+        bool stopping = false;
+        _ring->forEachCompletion([&](const io_uring_cqe& cqe){
+            if ((cqe.user_data & IOURING_OP_MASK) == IOURING_OP_WAKEUP) {
+                stopping = true;
+                return;
+            }
+            handleCompletion(cqe);
+        });
+        // освобожденные буферы - ядру, по SQE на непрерывный диапазон
+        _ring->publishBuffers();
+
+        // соединения, которым не хватило буферов, снова читают
+        if (_starved.empty() == false) {
+            std::vector<IOUringConnection*> starved;
+            starved.swap(_starved);
+            for (IOUringConnection* connection: starved) {
+                if (connection->_recvStarved == false) {
+                    continue;
+                }
+                if (connection->_closing) {
+                    // закрыт без активного recv - завершения, которое его удалит, не будет
+                    connection->_recvStarved = false;
+                    tryFinalize(connection);
+                } else {
+                    armRecv(connection);
+                }
+            }
+        }
+
+        if (stopping) {
+            break;
+        }
+    }
+
+    _server->_accepted += _accepted;
+    _server->_messages += _messages;
+}
+
+void IOUringLoop::handleCompletion(const io_uring_cqe& cqe){
+    IOUringOperation operation = static_cast<IOUringOperation>(cqe.user_data & IOURING_OP_MASK);
+    IOUringConnection* connection = reinterpret_cast<IOUringConnection*>(cqe.user_data & ~IOURING_OP_MASK);
+    switch (operation) {
+        case IOURING_OP_ACCEPT:
+            handleAccept(cqe, false);
+            break;
+        case IOURING_OP_ACCEPT_UNIX:
+            handleAccept(cqe, true);
+            break;
+        case IOURING_OP_RECV:
+            handleRecv(connection, cqe);
+            break;
+        case IOURING_OP_SEND:
+            handleSend(connection, cqe);
+            break;
+        default:
+            break;
+    }
+}
+
+void IOUringLoop::handleAccept(const io_uring_cqe& cqe, bool unix){
+    if (cqe.res >= 0) {
+        if (unix == false) {
+            int enable = 1;
+            setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+
+        IOUringConnection* connection = new IOUringConnection(this, cqe.res);
+        _connections.insert(connection);
+        ++_accepted;
+        if (_callbacks.accepted) {
+            _callbacks.accepted(*connection, _callbacks.arg);
+        }
+        if (connection->_closing == false) {
+            armRecv(connection);
+        } else {
+            tryFinalize(connection);
+        }
+    } else if ((cqe.res != -EAGAIN) && (cqe.res != -EINTR)) {
+        std::cout << "Ошибка accept: " << strerror(-cqe.res) << std::endl;
+    }
+
+    // multishot закончился (ошибка или переполнение CQ) - заводим заново
+    if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+        if (unix) {
+            armAccept(_server->_unixFd, IOURING_OP_ACCEPT_UNIX);
+        } else {
+            armAccept(_listenFd, IOURING_OP_ACCEPT);
+        }
+    }
+}
+
+void IOUringLoop::handleRecv(IOUringConnection* connection, const io_uring_cqe& cqe){
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    if (more == false) {
+        connection->_recvActive = false;
+    }
+
+    if (cqe.res > 0) {
+        std::uint16_t bufferId = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (connection->_closing == false) {
+            processInput(connection, _ring->buffer(bufferId), static_cast<std::size_t>(cqe.res));
+        }
+        _ring->recycleBuffer(bufferId);
+        if ((more == false) && (connection->_closing == false)) {
+            armRecv(connection);
+        }
+    } else if (cqe.res == -ENOBUFS) {
+        // свободных буферов нет: ждем, пока другие соединения вернут буферы
+        if (more == false) {
+            connection->_recvStarved = true;
+            _starved.push_back(connection);
+        }
+    } else if (more == false) {
+        // 0 - клиент закрыл соединение, иначе ошибка
+        closeConnection(connection);
+    }
+
+    if (connection->_recvActive == false) {
+        tryFinalize(connection);
+    }
+}
+
+void IOUringLoop::handleSend(IOUringConnection* connection, const io_uring_cqe& cqe){
+    connection->_sendInFlight = false;
+    if (cqe.res < 0) {
+        connection->_sending.clear();
+        connection->_output.clear();
+        closeConnection(connection);
+        tryFinalize(connection);
+        return;
+    }
+
+    connection->_sendOffset += static_cast<std::size_t>(cqe.res);
+    if (connection->_sendOffset < connection->_sending.size()) {
+        // ядро приняло часть - досылаем остаток
+        submitSend(connection);
+        return;
+    }
+    connection->_sending.clear();
+    connection->_sendOffset = 0;
+
+    if (connection->_output.empty() == false) {
+        markDirty(connection);
+    } else if (connection->_closing) {
+        closeConnection(connection);
+        tryFinalize(connection);
+    }
+}
+
+void IOUringLoop::processInput(IOUringConnection* connection, const char* data, std::size_t size){
+    if (connection->_input.empty()) {
+        // кадры разбираются прямо в буфере ядра, копируется только хвост
+        std::size_t consumed = parseFrames(connection, data, size);
+        if ((consumed < size) && (connection->_closing == false)) {
+            connection->_input.assign(data + consumed, size - consumed);
+        }
+        return;
+    }
+    connection->_input.append(data, size);
+    std::size_t consumed = parseFrames(connection, connection->_input.data(), connection->_input.size());
+    connection->_input.erase(0, consumed);
+}
+
+std::size_t IOUringLoop::parseFrames(IOUringConnection* connection, const char* data, std::size_t size){
+    std::size_t offset = 0;
+    while ((offset < size) && (connection->_closing == false)) {
+        std::size_t frameSize = static_cast<unsigned char>(data[offset]);
+        if (size - offset < frameSize + 1) {
+            break;
+        }
+        ++_messages;
+        if (_callbacks.message) {
+            _callbacks.message(*connection, data + offset + 1, frameSize, _callbacks.arg);
+        }
+        offset += frameSize + 1;
+    }
+    return offset;
+}
+
+void IOUringLoop::closeConnection(IOUringConnection* connection){
+    connection->_closing = true;
+    // shutdown завершает multishot recv, сам сокет закрывается после всех операций
+    shutdown(connection->_fd, SHUT_RDWR);
+}
+
+void IOUringLoop::tryFinalize(IOUringConnection* connection){
+    if ((connection->_closing == false) || connection->_recvActive || connection->_sendInFlight) {
+        return;
+    }
+    if (_connections.erase(connection) == 0) {
+        return;
+    }
+    if (_callbacks.closed) {
+        _callbacks.closed(*connection, _callbacks.arg);
+    }
+    ::close(connection->_fd);
+    // соединение может еще стоять в списках отправки или ожидания буферов
+    _dirty.erase(std::remove(_dirty.begin(), _dirty.end(), connection), _dirty.end());
+    _starved.erase(std::remove(_starved.begin(), _starved.end(), connection), _starved.end());
+    delete connection;
+}
+
+//////////////////////////////////////////////////
+// IOUringServer
+//////////////////////////////////////////////////
+IOUringServerConfig::IOUringServerConfig():
+    address("0.0.0.0"),
+    port(5555),
+    unixPath(nullptr),
+    threadsCount(2),
+    queueDepth(4096),
+    buffersCount(4096),
+    bufferSize(4096),
+    backlog(4096){
+}
+
+IOUringServer::IOUringServer(const IOUringServerConfig& config, const IOUringCallbacks& callbacks):
+    _config(config),
+    _callbacks(callbacks),
+    _unixFd(-1),
+    _accepted(0),
+    _messages(0){
+}
+
+IOUringServer::~IOUringServer(){
+    stop();
+}
+
+bool IOUringServer::isSupported(){
+    // кольцо есть и в старых ядрах, а прием построен на многоразовом recv
+    IOUring ring;
+    if (ring.init(4) == false) {
+        return false;
+    }
+    return ring.supportsRecvMultishot();
+}
+
+bool IOUringServer::start(){
+    if (_config.unixPath) {
+        _unixFd = bindUnixSocket(_config.unixPath, SOCK_STREAM, _config.backlog);
+        if (_unixFd < 0) {
+            return false;
+        }
+        // accept ждет в кольце, а не возвращает EAGAIN
+        fcntl(_unixFd, F_SETFL, fcntl(_unixFd, F_GETFL) & ~O_NONBLOCK);
+    }
+    for (int i = 0; i < _config.threadsCount; ++i) {
+        _loops.push_back(std::unique_ptr<IOUringLoop>(new IOUringLoop(this)));
+        IOUringLoop* loop = _loops.back().get();
+
+        // кольцо создается в своем потоке: SINGLE_ISSUER привязывает его к создателю
+        std::promise<bool> initPromise;
+        std::future<bool> initResult = initPromise.get_future();
+        _threads.push_back(std::thread([loop, &initPromise](){
+            bool initialized = loop->init();
+            initPromise.set_value(initialized);
+            if (initialized) {
+                loop->run();
+            }
+            loop->releaseRing();
+        }));
+        if (initResult.get() == false) {
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void IOUringServer::stop(){
+    for (std::unique_ptr<IOUringLoop>& loop: _loops) {
+        loop->wakeup();
+    }
+    for (std::thread& thread: _threads) {
+        thread.join();
+    }
+    _threads.clear();
+    _loops.clear();
+    if (_unixFd >= 0) {
+        ::close(_unixFd);
+        removeUnixSocket(_config.unixPath);
+        _unixFd = -1;
+    }
+}
+
+std::uint64_t IOUringServer::acceptedCount() const{
+    return _accepted;
+}
+
+std::uint64_t IOUringServer::messagesCount() const{
+    return _messages;
+}
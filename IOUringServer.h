@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+class IOUringLoop;
+
+//////////////////////////////////////////////////
+// Соединение движка io_uring. Протокол тот же, что у MultiThreadedTCPFilter:
+// кадр - байт длины и до 255 байт данных. Работает только в потоке своего цикла.
+//////////////////////////////////////////////////
+class IOUringConnection {
+public:
+    // данные уходят кадрами, длинные режутся на несколько; отправка - пачкой в конце итерации цикла
+    void send(const char* data, std::size_t size);
+    // закрытие после отправки уже добавленных данных
+    void close();
+
+    int fd() const;
+
+public:
+    void* data;     // пользовательские данные соединения
+
+private:
+    friend class IOUringLoop;
+
+    IOUringLoop* _loop;
+    int _fd;
+    std::string _input;         // начало недочитанного кадра
+    std::string _output;        // добавлено после начала текущей отправки
+    std::string _sending;       // отправляется сейчас
+    std::size_t _sendOffset;
+    bool _recvActive;           // multishot recv еще активен
+    bool _recvStarved;          // recv остановлен нехваткой буферов
+    bool _sendInFlight;
+    bool _dirty;                // ждет отправки в конце итерации
+    bool _closing;
+
+private:
+    IOUringConnection(IOUringLoop* loop, int fd);
+};
+
+// колбеки в духе accept_connection_cb / echo_read_cb / echo_event_cb, любой может быть nullptr
+typedef void (*IOUringConnectionHandler)(IOUringConnection& connection, void* arg);
+typedef void (*IOUringMessageHandler)(IOUringConnection& connection, const char* data, std::size_t size, void* arg);
+
+struct IOUringCallbacks {
+    IOUringConnectionHandler accepted;
+    IOUringMessageHandler message;          // один полный кадр без байта длины
+    IOUringConnectionHandler closed;
+    void* arg;
+};
+
+//////////////////////////////////////////////////
+// Настройки движка io_uring
+//////////////////////////////////////////////////
+struct IOUringServerConfig {
+    const char* address;
+    std::uint16_t port;
+    const char* unixPath;       // Unix сокет, общий для всех потоков (см. UnixSocket.h); nullptr - только TCP
+    int threadsCount;           // по кольцу и сокету SO_REUSEPORT на поток
+    unsigned queueDepth;        // размер очереди отправки кольца
+    unsigned buffersCount;      // буферов приема на поток, до 65536
+    unsigned bufferSize;
+    int backlog;
+
+    IOUringServerConfig();
+};
+
+//////////////////////////////////////////////////
+// Многопоточный TCP сервер на io_uring вместо epoll и bufferevent.
+// В каждом потоке: multishot accept на своем сокете SO_REUSEPORT, multishot recv
+// в общую группу буферов потока (без буфера на соединение), отправки всех соединений
+// одним io_uring_enter на итерацию. Unix сокет у потоков один: multishot accept в каждом кольце.
+//////////////////////////////////////////////////
+class IOUringServer {
+public:
+    IOUringServer(const IOUringServerConfig& config, const IOUringCallbacks& callbacks);
+    ~IOUringServer();
+
+    IOUringServer(const IOUringServer&) = delete;
+    IOUringServer& operator=(const IOUringServer&) = delete;
+
+    // io_uring с многоразовыми accept и recv доступен в этом ядре и не запрещен
+    static bool isSupported();
+
+    // false - не запустился хотя бы один поток, остальные остановлены
+    bool start();
+    void stop();
+
+    std::uint64_t acceptedCount() const;
+    std::uint64_t messagesCount() const;
+
+private:
+    IOUringServerConfig _config;
+    IOUringCallbacks _callbacks;
+    int _unixFd;
+    std::vector<std::unique_ptr<IOUringLoop>> _loops;
+    std::vector<std::thread> _threads;
+    std::atomic<std::uint64_t> _accepted;
+    std::atomic<std::uint64_t> _messages;
+
+private:
+    friend class IOUringLoop;
+};
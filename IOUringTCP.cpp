@@ -0,0 +1,62 @@
+#include "IOUringTCP.h"
+#include "IOUringServer.h"
+// std
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+
+//////////////////////////////////////////////////
+// TCP Server
+//////////////////////////////////////////////////
+int ioUringTcpServer() {
+    if (IOUringServer::isSupported() == false) {
+        std::cout << "io_uring недоступен в этом ядре, используйте tcp-filter." << std::endl;
+        return 1;
+    }
+
+    IOUringServerConfig config;
+    config.port = 5555;
+    config.unixPath = "/tmp/libeventserver-5555.sock";
+    config.threadsCount = 2;
+
+    //////////////////////////////////////////////////
+    // Callbacks
+    //////////////////////////////////////////////////
+    IOUringCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    // ответ как у фильтра: префикс и данные одним кадром
+    callbacks.message = [](IOUringConnection& connection, const char* data, std::size_t size, void*) {
+        static const char prefix[] = "Server handled: ";
+        char reply[sizeof(prefix) - 1 + 255];
+        memcpy(reply, prefix, sizeof(prefix) - 1);
+        memcpy(reply + sizeof(prefix) - 1, data, size);
+        connection.send(reply, sizeof(prefix) - 1 + size);
+    };
+
+    IOUringServer server(config, callbacks);
+    if (server.start() == false) {
+        std::cout << "Не получилось запустить сервер io_uring" << std::endl;
+        return 1;
+    }
+
+    // ожидаем нажатия для завершения
+    std::cout << "Write \"Exit\" fot quit." << std::endl;
+    std::string text;
+    std::cin >> text;
+    while (text.find("Exit") == std::string::npos) {
+        text.clear();
+        std::cin >> text;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
+    std::cout << "Quit in progress." << std::endl;
+
+    server.stop();
+    std::cout << "Принято соединений: " << server.acceptedCount()
+              << ", обработано сообщений: " << server.messagesCount() << std::endl;
+    std::cout << "Quit complete." << std::endl;
+
+    return 0;
+}
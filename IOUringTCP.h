@@ -0,0 +1,4 @@
+#pragma once
+
+// Эхо-сервер с протоколом MultiThreadedTCPFilter на движке io_uring
+int ioUringTcpServer();
@@ -0,0 +1,383 @@
+#include "MultiThreadedDNSResponder.h"
+// std
+#include <stdexcept>
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <future>
+// system
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+// libevent
+#include <event2/event.h>
+#include <event2/dns.h>
+#include <event2/util.h>
+#include <event2/thread.h>
+// server
+#include "DNSWire.h"
+#include "DNSZone.h"
+#include "DNSZoneStore.h"
+#include "DNSResponseCache.h"
+#include "UnixSocket.h"
+
+// пакетный прием/отправка
+// http://man7.org/linux/man-pages/man2/recvmmsg.2.html
+// http://man7.org/linux/man-pages/man2/sendmmsg.2.html
+// балансировка UDP по потокам ядром - SO_REUSEPORT
+// https://lwn.net/Articles/542629/
+
+//using namespace std;
+
+typedef std::shared_ptr<event_base>  EventBasePtr;
+typedef std::unique_ptr<std::thread, std::function<void(std::thread*)>> ThreadPtr;  // указатель на поток + функция, вызываемая при уничтожении
+typedef std::vector<ThreadPtr> ThreadPool;  // пулл потоков
+
+
+#define LISTEN_PORT 5550
+// unixgram сокет для клиентов на этом же хосте, один на все потоки
+#define UNIX_SOCKET_PATH "/tmp/libeventserver-dns.sock"
+
+// сколько пакетов забираем одним системным вызовом
+#define BATCH_SIZE 64
+// сколько пачек подряд обрабатываем за одно срабатывание события, чтобы не голодали таймеры
+#define MAX_BATCHES_PER_EVENT 16
+// кеш готовых ответов: записей на поток и время жизни записи в секундах
+#define RESPONSE_CACHE_SIZE 4096
+#define RESPONSE_CACHE_MAX_AGE 60
+
+//////////////////////////////////////////////////
+// Буфферы пакетной обработки одного потока
+//////////////////////////////////////////////////
+struct DNSBatch {
+    // входящие
+    mmsghdr inMessages[BATCH_SIZE];
+    iovec inVectors[BATCH_SIZE];
+    sockaddr_storage inAddresses[BATCH_SIZE];
+    std::uint8_t inPackets[BATCH_SIZE][DNS_MAX_UDP_PACKET];
+    // исходящие
+    mmsghdr outMessages[BATCH_SIZE];
+    iovec outVectors[BATCH_SIZE];
+    std::uint8_t outPackets[BATCH_SIZE][DNS_MAX_UDP_PACKET];
+
+    DNSZoneStore& store;
+    int reader;                 // слот читателя RCU этого потока
+    std::uint64_t generation;   // поколение зоны, по которому заполнен кеш
+    DNSResponseCache cache;
+    evutil_socket_t fd;
+    std::uint64_t handledCount;
+
+    DNSBatch(DNSZoneStore& zoneStore, evutil_socket_t socketFd):
+        store(zoneStore),
+        reader(zoneStore.registerReader()),
+        generation(0),
+        cache(RESPONSE_CACHE_SIZE, false),  // зона авторитетная - TTL отдаем как есть
+        fd(socketFd),
+        handledCount(0){
+        memset(inMessages, 0, sizeof(inMessages));
+        memset(outMessages, 0, sizeof(outMessages));
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            inVectors[i].iov_base = inPackets[i];
+            inVectors[i].iov_len = DNS_MAX_UDP_PACKET;
+            inMessages[i].msg_hdr.msg_iov = &inVectors[i];
+            inMessages[i].msg_hdr.msg_iovlen = 1;
+            inMessages[i].msg_hdr.msg_name = &inAddresses[i];
+
+            outVectors[i].iov_base = outPackets[i];
+            outMessages[i].msg_hdr.msg_iov = &outVectors[i];
+            outMessages[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+};
+
+// Формирование ответа на один запрос: из кеша готовых пакетов или из зоны,
+// возвращает размер ответа или 0 если отвечать не нужно
+static std::size_t buildAnswer(DNSBatch& batch, const DNSZoneTable& zone, const std::uint8_t* query, std::size_t querySize, std::uint8_t* answer, std::uint32_t now){
+    DNSQuestion question;
+    if (dnsParseQuery(query, querySize, question) == false) {
+        return 0;
+    }
+
+    // горячие имена - только правка id и копирование
+    std::size_t answerSize = batch.cache.lookup(query, question, answer, now);
+    if (answerSize > 0) {
+        return answerSize;
+    }
+
+    DNSResponseWriter writer(answer, DNS_MAX_UDP_PACKET);
+    if (writer.begin(query, question, DNS_ERR_NONE) == false) {
+        return 0;
+    }
+
+    // записи уже закодированы - просто копируем
+    const DNSZoneAnswer* zoneAnswer = zone.find(question.name, question.nameLength, question.type);
+    if (zoneAnswer) {
+        writer.addEncodedRecords(zoneAnswer->records, zoneAnswer->size, zoneAnswer->count);
+    } else if (zone.hasName(question.name, question.nameLength) == false) {
+        writer.setResponseCode(DNS_ERR_NOTEXIST);
+    }
+
+    answerSize = writer.finish();
+    batch.cache.store(question, answer, answerSize, RESPONSE_CACHE_MAX_AGE, now);
+
+    return answerSize;
+}
+
+// Обработка готовности сокета: читаем пачками, отвечаем пачками
+static void readCallback(evutil_socket_t fd, short events, void* arg){
+    DNSBatch& batch = *(static_cast<DNSBatch*>(arg));
+
+    // снимок зоны не освободится, пока не выйдем из секции чтения
+    RCUReadGuard guard(batch.store.domain(), batch.reader);
+    const DNSZoneSnapshot* zone = batch.store.current();
+    if (zone->generation != batch.generation) {
+        // зону перезагрузили - готовые ответы устарели
+        batch.cache.clear();
+        batch.generation = zone->generation;
+    }
+
+    for (int round = 0; round < MAX_BATCHES_PER_EVENT; ++round) {
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            batch.inMessages[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        }
+
+        int receivedCount = recvmmsg(fd, batch.inMessages, BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        if (receivedCount <= 0) {
+            if ((receivedCount < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                std::cout << "Ошибка recvmmsg: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        // формируем ответы
+        std::uint32_t now = (std::uint32_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        int answersCount = 0;
+        for (int i = 0; i < receivedCount; ++i) {
+            std::size_t answerSize = buildAnswer(batch, zone->table, batch.inPackets[i], batch.inMessages[i].msg_len, batch.outPackets[answersCount], now);
+            if (answerSize == 0) {
+                continue;
+            }
+            // клиент Unix сокета без своего адреса - ответить некуда, а ошибка sendmmsg оборвала бы пачку
+            if (batch.inMessages[i].msg_hdr.msg_namelen <= sizeof(sa_family_t)) {
+                continue;
+            }
+            mmsghdr& out = batch.outMessages[answersCount];
+            batch.outVectors[answersCount].iov_len = answerSize;
+            out.msg_hdr.msg_name = &batch.inAddresses[i];
+            out.msg_hdr.msg_namelen = batch.inMessages[i].msg_hdr.msg_namelen;
+            ++answersCount;
+        }
+
+        // отправляем одним вызовом, при частичной отправке досылаем остаток
+        int sentTotal = 0;
+        while (sentTotal < answersCount) {
+            int sentCount = sendmmsg(fd, batch.outMessages + sentTotal, answersCount - sentTotal, MSG_DONTWAIT);
+            if (sentCount <= 0) {
+                if ((sentCount < 0) && (errno == EINTR)) {
+                    continue;
+                }
+                // буффер отправки переполнен - UDP, оставшиеся ответы теряются
+                break;
+            }
+            sentTotal += sentCount;
+        }
+        batch.handledCount += sentTotal;
+
+        // очередь сокета опустела
+        if (receivedCount < BATCH_SIZE) {
+            return;
+        }
+    }
+}
+
+// UDP сокет с SO_REUSEPORT: у каждого потока свой, ядро распределяет запросы по хешу адреса
+static evutil_socket_t createReusePortSocket(std::uint16_t port){
+    evutil_socket_t fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int enable = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        evutil_closesocket(fd);
+        return -1;
+    }
+
+    sockaddr_in listenAddress;
+    memset(&listenAddress, 0, sizeof(listenAddress));
+    listenAddress.sin_family = AF_INET;
+    listenAddress.sin_port = htons(port);
+    listenAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (sockaddr*)&listenAddress, sizeof(listenAddress)) < 0) {
+        evutil_closesocket(fd);
+        return -1;
+    }
+
+    if (evutil_make_socket_nonblocking(fd) < 0) {
+        evutil_closesocket(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+//////////////////////////////////////////////////
+// DNS Responder
+//////////////////////////////////////////////////
+int multiThreadedDNSResponder(const char* zonePath) {
+    // циклы останавливаются из главного потока
+    evthread_use_pthreads();
+
+    int threadsCount = std::thread::hardware_concurrency();
+    if (threadsCount <= 0) {
+        threadsCount = 4;
+    }
+
+    // зона общая для всех потоков: неизменяемый снимок, подменяется при перезагрузке
+    DNSZoneStore zoneStore(zonePath, threadsCount);
+    std::string error;
+    if (zoneStore.reload(error) == false) {
+        std::cout << "Ошибка загрузки зоны: " << error << std::endl;
+        return 1;
+    }
+
+    // перезагрузка по SIGHUP и изменению файла
+    DNSZoneReloader zoneReloader(zoneStore);
+    zoneReloader.start();
+
+    std::vector<EventBasePtr> events;
+    std::atomic<std::uint64_t> handledTotal(0);
+    std::atomic<std::uint64_t> cacheHitsTotal(0);
+    std::atomic<std::uint64_t> cacheMissesTotal(0);
+
+    // каждый поток имеет свой объект обработки событий, создаем заранее,
+    // чтобы завершение не разминулось с еще не стартовавшим потоком
+    events.reserve(threadsCount);
+    for (int i = 0 ; i < threadsCount ; ++i) {
+        EventBasePtr eventBase(event_base_new(), &event_base_free);
+        if (!eventBase){
+            std::cout << "Ошибка при создании объекта event_base." << std::endl;
+            return 1;
+        }
+        events.push_back(eventBase);
+    }
+
+    // Unix сокет читают все потоки, каждый своими буферами; без него работает только UDP
+    evutil_socket_t unixFd = bindUnixSocket(UNIX_SOCKET_PATH, SOCK_DGRAM, 0);
+
+    // Функция в потоке
+    // результат запуска отдается главному потоку через started
+    auto threadFunc = [&] (EventBasePtr eventBase, std::promise<bool>* started){
+        evutil_socket_t fd = createReusePortSocket(LISTEN_PORT);
+        if (fd < 0) {
+            std::cout << "Не получилось создать UDP сокет: " << strerror(errno) << std::endl;
+            started->set_value(false);
+            return;
+        }
+
+        // буфферы большие, на стеке не держим
+        std::unique_ptr<DNSBatch> batch(new DNSBatch(zoneStore, fd));
+        if (batch->reader < 0) {
+            // слотов RCU столько же, сколько потоков
+            std::cout << "Нет свободного слота читателя зоны." << std::endl;
+            evutil_closesocket(fd);
+            started->set_value(false);
+            return;
+        }
+
+        event* readEvent = event_new(eventBase.get(), fd, EV_READ | EV_PERSIST, readCallback, batch.get());
+        event_add(readEvent, nullptr);
+        // колбек берет сокет из события, буферы и кеш потока - те же
+        event* unixReadEvent = nullptr;
+        if (unixFd >= 0) {
+            unixReadEvent = event_new(eventBase.get(), unixFd, EV_READ | EV_PERSIST, readCallback, batch.get());
+            event_add(unixReadEvent, nullptr);
+        }
+
+        started->set_value(true);
+        // запуск цикла - блокирующий
+        event_base_dispatch(eventBase.get());
+
+        event_free(readEvent);
+        if (unixReadEvent) {
+            event_free(unixReadEvent);
+        }
+        evutil_closesocket(fd);
+        handledTotal += batch->handledCount;
+        cacheHitsTotal += batch->cache.hitsCount();
+        cacheMissesTotal += batch->cache.missesCount();
+    };
+
+    // пулл потоков
+    ThreadPool threads;
+    threads.reserve(threadsCount);
+
+    // не дает завершиться потокам
+    auto threadDeleter = [&] (std::thread *t) {
+        t->join();
+        delete t;
+    };
+
+    // потоки запускаются по одному, до первой ошибки
+    bool startFailed = false;
+    for (int i = 0 ; (i < threadsCount) && (startFailed == false) ; ++i) {
+        std::promise<bool> started;
+        std::future<bool> startResult = started.get_future();
+        ThreadPtr thread(new std::thread(threadFunc, events[i], &started), threadDeleter);
+        threads.push_back(std::move(thread));
+        startFailed = (startResult.get() == false);
+    }
+    if (startFailed) {
+        std::cout << "Ошибка запуска потоков DNS responder." << std::endl;
+        zoneReloader.stop();
+        for (const EventBasePtr& event: events) {
+            event_base_loopexit(event.get(), nullptr);
+        }
+        threads.clear();
+        events.clear();
+        if (unixFd >= 0) {
+            evutil_closesocket(unixFd);
+            removeUnixSocket(UNIX_SOCKET_PATH);
+        }
+        return 1;
+    }
+
+    std::cout << "DNS responder on port " << LISTEN_PORT << ", threads: " << threadsCount << std::endl;
+    if (unixFd >= 0) {
+        std::cout << "DNS responder on unix socket " << UNIX_SOCKET_PATH << std::endl;
+    }
+
+    // ожидаем нажатия для завершения
+    std::cout << "Write \"Exit\" fot quit." << std::endl;
+    std::string text;
+    while ((std::cin >> text) && (text.find("Exit") == std::string::npos)) {
+        text.clear();
+    }
+    std::cout << "Quit in progress." << std::endl;
+
+    // завершение
+    zoneReloader.stop();
+    for (const EventBasePtr& event: events) {
+        event_base_loopexit(event.get(), nullptr);
+    }
+    threads.clear();
+    events.clear();
+    if (unixFd >= 0) {
+        evutil_closesocket(unixFd);
+        removeUnixSocket(UNIX_SOCKET_PATH);
+    }
+
+    std::cout << "Quit complete, handled queries: " << handledTotal
+              << ", cache hits: " << cacheHitsTotal << ", misses: " << cacheMissesTotal << std::endl;
+
+    return 0;
+}
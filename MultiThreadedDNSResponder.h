@@ -0,0 +1 @@
+int multiThreadedDNSResponder(const char* zonePath);
@@ -7,6 +7,9 @@
 #include <thread>
 #include <cstdint>
 #include <vector>
+#include <utility>
+#include <string>
+#include <cstdlib>
 // libevent
 #include <event2/listener.h>
 #include <event2/bufferevent.h>
@@ -14,6 +17,17 @@
 #include <event2/event.h>
 #include <event.h>
 #include <evhttp.h>
+#include <event2/thread.h>
+// zlib
+#include <zlib.h>
+// server
+#include "HTTPRouter.h"
+#include "HTTPStaticFiles.h"
+#include "HTTPResponseCache.h"
+#include "HTTPCompression.h"
+#include "HTTPStreaming.h"
+#include "HTTPServer.h"
+#include "HTTPWebSocket.h"
 
 
 // примеры
@@ -24,38 +38,124 @@
 //using namespace std;
 
 typedef std::unique_ptr<event_base, decltype(&event_base_free)>  EventHandler;
-typedef std::unique_ptr<evhttp, decltype(&evhttp_free)> ServerPtr;
 
 
-int multithreadedServer() {
-    char const serverAddress[] = "127.0.0.1";
-    std::uint16_t const serverPort = 5555;
+int multithreadedServer(const char* staticRoot, const TLSConfig* tls) {
     int const threadsCount = 8;
     
+    // настройки сервера каждого потока: предел соединений на поток, дальше их забирают
+    // другие потоки или они ждут в общей очереди ядра
+    HTTPServerConfig serverConfig;
+    serverConfig.address = "127.0.0.1";
+    serverConfig.port = 5555;
+    serverConfig.unixPath = "/tmp/libeventserver-5555.sock";
+    serverConfig.backlog = 4096;
+    serverConfig.maxConnections = 2000;
+    // TLS: SSL_CTX в каждом потоке свой, ключи билетов общие
+    serverConfig.tls = tls;
+    
     try
     {
-        // коллбек запроса
-        void (*receivedRequest)(evhttp_request *, void *) = [] (evhttp_request *req, void *) {
-            // выходной буффер запроса
-            auto *outBuf = evhttp_request_get_output_buffer(req);
-            if (!outBuf){
-                return;
-            }
-            
+        // обработчик по умолчанию - на любой путь, ответ кешируется
+        HTTPResponseProducer receivedRequest = [] (evhttp_request *, const HTTPRouteParams&, void *, HTTPCachedResponse& response) {
             // тестовая задержка
             std::this_thread::sleep_for(std::chrono::milliseconds(40));
             
             // Выходные данные
-            evbuffer_add_printf(outBuf, "<html><body><center><h1>Hello Wotld!</h1></center></body></html>");
-            
-            // отвечаем на запрос
+            response.headers.push_back(std::make_pair("Content-Type", "text/html; charset=utf-8"));
+            response.body = "<html><body><center><h1>Hello Wotld!</h1></center></body></html>";
+        };
+        
+        // приветствие по имени из пути
+        HTTPRouteHandler helloRequest = [] (evhttp_request *req, const HTTPRouteParams& params, void *) {
+            auto *outBuf = evhttp_request_get_output_buffer(req);
+            if (!outBuf){
+                return;
+            }
+            std::string_view name = params.get("name");
+            evbuffer_add_printf(outBuf, "<html><body><center><h1>Hello %.*s!</h1></center></body></html>", (int)name.size(), name.data());
+            evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "text/html; charset=utf-8");
+            httpCompressReply(req);
             evhttp_send_reply(req, HTTP_OK, "", outBuf);
         };
         
+        // потоковая выдача /stream/:lines - в памяти не больше одного куска при любом числе строк
+        HTTPRouteHandler streamRequest = [](evhttp_request* req, const HTTPRouteParams& params, void*){
+            typedef std::pair<std::uint64_t, std::uint64_t> LinesState;     // следующая, всего
+            std::string linesCount(params.get("lines"));
+            LinesState* state = new LinesState(0, strtoull(linesCount.c_str(), nullptr, 10));
+            evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "text/plain; charset=utf-8");
+        
+            HTTPStreamProducer producer = [](HTTPResponseStream& stream, void* data){
+                LinesState& state = *static_cast<LinesState*>(data);
+                for (int i = 0; (i < 1024) && (state.first < state.second); ++i, ++state.first) {
+                    stream.printf("line %llu\n", (unsigned long long)state.first);
+                }
+                return state.first < state.second;
+            };
+            HTTPStreamCleanup cleanup = [](void* data){
+                delete static_cast<LinesState*>(data);
+            };
+            HTTPResponseStream::start(req, HTTP_OK, "OK", producer, cleanup, state);
+        };
+        
+        // прием тела кусками: размер и adler32 без копирования тела
+        HTTPRouteHandler uploadRequest = [](evhttp_request* req, const HTTPRouteParams&, void*){
+            typedef std::pair<std::uint64_t, uLong> UploadState;            // байт, контрольная сумма
+            UploadState state(0, adler32(0, nullptr, 0));
+            HTTPBodyChunkHandler chunkHandler = [](const char* data, std::size_t size, void* arg){
+                UploadState& state = *static_cast<UploadState*>(arg);
+                state.first += size;
+                state.second = adler32(state.second, reinterpret_cast<const Bytef*>(data), (uInt)size);
+                return true;
+            };
+            httpReadRequestBody(req, chunkHandler, &state);
+        
+            evbuffer* outBuf = evhttp_request_get_output_buffer(req);
+            evbuffer_add_printf(outBuf, "size %llu adler32 %08lx\n", (unsigned long long)state.first, (unsigned long)state.second);
+            evhttp_send_reply(req, HTTP_OK, "OK", outBuf);
+        };
+        
+        // маршруты общие для всех потоков, после компиляции только читаются
+        HTTPRouter router;
+        router.add(EVHTTP_REQ_GET, "/hello/:name", helloRequest, nullptr);
+        router.add(EVHTTP_REQ_GET, "/stream/:lines", streamRequest, nullptr);
+        router.add(EVHTTP_REQ_POST | EVHTTP_REQ_PUT, "/upload", uploadRequest, nullptr);
+        
+        // статика: кеш общий для потоков, сегменты файлов со счетчиком ссылок под блокировкой libevent
+        evthread_use_pthreads();
+        HTTPStaticFiles staticFiles(staticRoot, 64 * 1024 * 1024, 256 * 1024);
+        router.add(EVHTTP_REQ_GET, "/static/*path", HTTPStaticFiles::routeHandler, &staticFiles);
+        
+        // кеш общий для потоков: одновременные промахи ждут одного вычисления
+        HTTPResponseCache responseCache(16 * 1024 * 1024);
+        HTTPCachedRoute cachedRoute;
+        cachedRoute.cache = &responseCache;
+        cachedRoute.producer = receivedRequest;
+        cachedRoute.data = nullptr;
+        cachedRoute.ttlSeconds = 5;
+        cachedRoute.compress = true;
+        router.add(HTTP_ROUTER_ANY_METHOD, "/*path", HTTPResponseCache::routeHandler, &cachedRoute);
+        
+        // сжатие больших тел и вариантов статики вне цикла событий;
+        // пул объявлен после кешей, чтобы остановиться раньше них
+        HTTPCompressionPool compressionPool(2);
+        staticFiles.setCompressionPool(&compressionPool);
+        responseCache.setCompressionPool(&compressionPool);
+        
+        // WebSocket /ws: каждое сообщение клиента рассылается всем подключенным во всех потоках
+        WebSocketBroadcaster broadcaster;
+        WebSocketMessageHandler webSocketMessage = [] (WebSocketConnection&, WebSocketOpcode opcode, const std::string& message, void* data) {
+            static_cast<WebSocketBroadcaster*>(data)->broadcast(webSocketEncodeFrame(opcode, message.data(), message.size()));
+        };
+        router.add(EVHTTP_REQ_GET, "/ws", WebSocketBroadcaster::routeHandler, &broadcaster);
+        router.compile();
+        
         std::exception_ptr initException;
         
         bool volatile isRunning = true;
         evutil_socket_t socket = -1;
+        evutil_socket_t unixSocket = -1;
         
         // Функция в потоке
         auto threadFunc = [&] (){
@@ -67,32 +167,34 @@ int multithreadedServer() {
                 }
                 
                 // Создаем сервер с обработчиком событий
-                ServerPtr eventHttp(evhttp_new(eventBase.get()), &evhttp_free);
-                if (!eventHttp){
+                HTTPServer server(eventBase.get(), serverConfig);
+                if (!server.isValid()){
                     throw std::runtime_error("Failed to create new evhttp.");
                 }
                 
-                // привязываем функцию обработчик к серверу
-                evhttp_set_gencb(eventHttp.get(), receivedRequest, nullptr);
+                // привязываем маршрутизатор к серверу
+                router.attach(server);
+                
+                // WebSocket соединения потока, закрываются раньше сервера
+                WebSocketHub webSockets(eventBase.get(), &broadcaster, webSocketMessage, &broadcaster, 1024 * 1024, 4 * 1024 * 1024);
                 
                 // если у нас есть уже сокет или его еще нету
                 if (socket == -1){
                     // связываем сервер с адресом и портом
-                    auto* bindedSocket = evhttp_bind_socket_with_handle(eventHttp.get(), serverAddress, serverPort);
-                    if (!bindedSocket){
+                    if (!server.bind()){
                         throw std::runtime_error("Failed to bind server socket.");
                     }
                     
                     // сокет создается на основании связки
-                    socket = evhttp_bound_socket_get_fd(bindedSocket);
+                    socket = server.socket();
+                    unixSocket = server.unixSocket();
                     if (socket == -1){
                         throw std::runtime_error("Failed to get server socket for next instance.");
                     }
                 }
                 else {
                     //
-                    int status = evhttp_accept_socket(eventHttp.get(), socket);
-                    if (status == -1){
+                    if (!server.accept(socket, unixSocket)){
                         throw std::runtime_error("Failed to bind server socket for new instance.");
                     }
                 }
@@ -103,6 +205,11 @@ int multithreadedServer() {
                     
                     std::this_thread::sleep_for(std::chrono::milliseconds(10));
                 }
+                
+                if (server.tls()) {
+                    std::cout << "TLS рукопожатий: " << server.tls()->handshakesCount()
+                              << ", из них возобновлено: " << server.tls()->resumedCount() << std::endl;
+                }
             }
             catch (...){
                 initException = std::current_exception();
@@ -1,2 +1,5 @@
 
-int multithreadedServer();
+struct TLSConfig;
+
+// staticRoot - каталог, раздаваемый по /static/; tls - nullptr для HTTP
+int multithreadedServer(const char* staticRoot, const TLSConfig* tls);
@@ -1,25 +1,13 @@
 #include "MultiThreadedTCP.h"
+#include "TCPServer.h"
+#include "EventLoopThreads.h"
 // std
-#include <stdexcept>
 #include <iostream>
-#include <memory>
 #include <chrono>
 #include <thread>
 #include <cstdint>
-#include <vector>
-#include <memory>
-#include <queue>
 #include <string>
-#include <list>
-#include <unordered_map>
-// libevent
-#include <event2/listener.h>
-#include <event2/bufferevent.h>
-#include <event2/buffer.h>
-#include <event2/event.h>
-#include <event2/thread.h>
-#include <event.h>
-#include <evhttp.h>
+#include <atomic>
 
 // примеры
 // https://habrahabr.ru/post/217437/
@@ -29,240 +17,86 @@
 
 //using namespace std;
 
-typedef std::shared_ptr<event_base>  EventBasePtr;
-typedef std::unique_ptr<evconnlistener, decltype(&evconnlistener_free)> ServerListenerPtr;  // указатель на сервер + функция, вызываемая при уничтожении
-typedef std::unique_ptr<std::thread, std::function<void(std::thread*)>> ThreadPtr;  // указатель на поток + функция, вызываемая при уничтожении
-typedef std::vector<ThreadPtr> ThreadPool;  // пулл потоков
-typedef std::function<void()> Task;
-typedef std::queue<Task> TasksQueue;
-typedef std::lock_guard<std::mutex> LockGuard;
-typedef std::unique_lock<std::mutex> UniqueLock;
+
+//////////////////////////////////////////////////
+// Обработчик: кадр с байтом длины на входе, ответ без кадра
+//////////////////////////////////////////////////
+struct DelayedEchoHandler {
+    typedef TCPConnection<LengthPrefixCodec<std::uint8_t>, DelayedEchoHandler> Connection;
+
+    std::atomic<std::uint64_t> messages;
+
+    DelayedEchoHandler():
+        messages(0){
+    }
+
+    void onConnected(Connection& connection){
+        ucred credentials;
+        if (connection.peerCredentials(credentials)) {
+            std::cout << "Клиент Unix сокета: pid " << credentials.pid << ", uid " << credentials.uid << std::endl;
+        }
+    }
+
+    void onMessage(Connection& connection, const char* data, std::size_t size){
+        ++messages;
+        
+        // искусственная задержка
+        std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+        
+        // выводим данные
+        evbuffer* buf_output = connection.output();
+        evbuffer_add_printf(buf_output, "Server handled: ");
+        evbuffer_add(buf_output, data, size);
+    }
+
+    void onClosed(Connection&){
+    }
+};
+
+typedef TCPServer<LengthPrefixCodec<std::uint8_t>, DelayedEchoHandler> DelayedEchoServer;
 
 
 //////////////////////////////////////////////////
 // TCP Server
 //////////////////////////////////////////////////
 int multiThreadedTcpServer() {
-    std::uint16_t const serverPort = 5555;
     int const threadsCount = 16;
     
+    // ограничения клиентов: ведра в каждом потоке свои, счетчики соединений по IP общие
+    TCPAddressCounters addressCounters;
+    TCPMemoryCounters memoryCounters;
+    TCPServerConfig config;
+    config.port = 5555;
+    config.unixPath = "/tmp/libeventserver-5555.sock";
+    config.addressCounters = &addressCounters;
+    config.memoryCounters = &memoryCounters;
     
-    std::mutex mutex;
-    std::condition_variable condVar;
-    std::atomic_bool isActive(true);
-    std::vector<EventBasePtr> events;
+    DelayedEchoHandler handler;
     std::atomic<evutil_socket_t> socket(-1);
+    std::atomic<evutil_socket_t> unixSocket(-1);
     
-    // Функция в потоке
-    auto threadFunc = [&] (){
-        //////////////////////////////////////////////////
-        // Callbacks
-        //////////////////////////////////////////////////
-        // обработка принятия соединения
-        auto accept_connection_cb = [](evconnlistener* listener,
-                                       evutil_socket_t fd, sockaddr* addr, int sock_len,
-                                       void* arg) {
-            // обработчик ивентов базовый
-            event_base* base = evconnlistener_get_base(listener);
-            
-            // При обработке запроса нового соединения необходимо создать для него объект bufferevent
-            bufferevent* buf_ev = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE /*| BEV_OPT_THREADSAFE | BEV_OPT_DEFER_CALLBACKS | BEV_OPT_UNLOCK_CALLBACKS*/);
-            if (buf_ev == nullptr) {
-                std::cout << "Ошибка при создании объекта bufferevent." << std::endl;
-                return;
-            }
-            
-            // Функция обратного вызова для события: данные готовы для чтения в buf_ev
-            auto echo_read_cb = [](bufferevent* buf_ev, void *arg) {
-                evbuffer* buf_input = bufferevent_get_input(buf_ev);
-                evbuffer* buf_output = bufferevent_get_output(buf_ev);
-                
-                // Читаем данные
-                size_t receivedDataSize = evbuffer_get_length(buf_input);
-                
-                // размер информации о размере
-                typedef char DataSizeType;
-                
-                // если мало данных о размере - ждем
-                if (receivedDataSize < sizeof(DataSizeType)) {
-                    return;
-                }
-
-                int64_t dataSize = 0;
-                evbuffer_copyout(buf_input, &dataSize, sizeof(DataSizeType));
-
-                // если мало данных в буффере - ждем еще
-                if (receivedDataSize < (sizeof(DataSizeType) + dataSize)) {
-                    return;
-                }
-                
-                // удаляем данные о размере из начала
-                evbuffer_drain(buf_input, sizeof(DataSizeType));
-                
-                // новый размер буффера
-                receivedDataSize = evbuffer_get_length(buf_input);
-                
-                // временная область с данными
-                std::vector<char> dataBuffer;
-                dataBuffer.resize(receivedDataSize);
-                
-                // копируем
-                evbuffer_copyout(buf_input, dataBuffer.data(), receivedDataSize);
-                
-                // чистим входной буффер
-                evbuffer_drain(buf_input, receivedDataSize);
-                
-                
-                // искусственная задержка
-                std::this_thread::sleep_for(std::chrono::milliseconds(5000));
-                
-                
-                // выводим данные
-                size_t outSize = evbuffer_get_length(buf_output);
-                
-                evbuffer_add_printf(buf_output, "Server handled: ");
-                evbuffer_add(buf_output, dataBuffer.data(), dataBuffer.size());
-                
-                // чистим выходной буффер
-                evbuffer_drain(buf_output, outSize);
-                
-            };
-            
-            // Функция обратного вызова для события: данные готовы для записи в buf_ev
-            auto echo_write_cb = [](bufferevent* buf_ev, void *arg) {
-                //std::cout << "Write callback" << std::endl;
-            };
-            
-            // коллбек обработки ивента
-            auto echo_event_cb = [](bufferevent* buf_ev, short events, void *arg){
-                if(events & BEV_EVENT_READING){
-                    std::cout << "Ошибка во время чтения bufferevent" << std::endl;
-                }
-                if(events & BEV_EVENT_WRITING){
-                    std::cout << "Ошибка во время записи bufferevent" << std::endl;
-                }
-                if(events & BEV_EVENT_ERROR){
-                    std::cout << "Ошибка объекта bufferevent" << std::endl;
-                }
-                if(events & BEV_EVENT_TIMEOUT){
-                    // пишем в буффер об долгом пинге
-                    //evbuffer* buf_output = bufferevent_get_output(buf_ev);
-                    //evbuffer_add_printf(buf_output, "Kick by timeout\n");
-                    // уничтожаем объект буффер
-                    if (buf_ev) {
-                        bufferevent_free(buf_ev);
-                        buf_ev = nullptr;
-                    }
-                    std::cout << "Таймаут bufferevent\n" << std::endl;
-                }
-                if(events & BEV_EVENT_CONNECTED){
-                    std::cout << "Соединение в bufferevent" << std::endl;
-                }
-                if(events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)){
-                    // уничтожаем объект буффер
-                    if (buf_ev) {
-                        bufferevent_free(buf_ev);
-                        buf_ev = nullptr;
-                    }
-                }
-            };
-            
-            // коллбеки обработи
-            bufferevent_setcb(buf_ev, echo_read_cb, echo_write_cb, echo_event_cb, nullptr);
-            bufferevent_enable(buf_ev, (EV_READ | EV_WRITE));
-            // размеры буффера для вызова коллбеков
-            bufferevent_setwatermark(buf_ev, EV_READ, 20, 0);   // 20+
-            bufferevent_setwatermark(buf_ev, EV_WRITE, 20, 0);   // 20+
-            // таймауты
-            timeval readWriteTimeout;
-            readWriteTimeout.tv_sec = 600;
-            readWriteTimeout.tv_usec = 0;
-            bufferevent_set_timeouts(buf_ev, &readWriteTimeout, &readWriteTimeout);
-        };
-        
-        //////////////////////////////////////////////////
-        // Setup
-        //////////////////////////////////////////////////
-        // каждый поток имеет свой объект обработки событий, в однопотоном варианте - это event_init
-        EventBasePtr eventBase(event_base_new(), &event_base_free);
-        if (!eventBase){
-            std::cout << "Ошибка при создании объекта event_base." << std::endl;
+    // Функция в потоке: первый сервер привязывается к порту, остальные принимают с его сокета
+    EventLoopThreads threads(threadsCount);
+    bool started = threads.start([&](EventLoopThreads& threads, event_base* base, int index){
+        DelayedEchoServer server(base, config, handler);
+        bool listening = (index == 0) ? server.bind() : server.accept(socket, unixSocket);
+        if (!listening){
+            std::cout << "Не получилось создать listener" << std::endl;
             return;
         }
-        
-        mutex.lock();
-        events.push_back(eventBase);
-        mutex.unlock();
-        
-        // Будущий объект listener
-        evconnlistener* listenerPtr = nullptr;
-        
-        // если у нас есть уже сокет или его еще нету
-        if (socket == -1){
-            // адрес
-            sockaddr_in sin;
-            memset(&sin, 0, sizeof(sin));
-            sin.sin_family = AF_INET;    /* работа с доменом IP-адресов */
-            sin.sin_addr.s_addr = htonl(INADDR_ANY);  /* принимать запросы с любых адресов */
-            sin.sin_port = htons(serverPort);
-            
-            // Создаем сервер с обработчиком событий
-            listenerPtr = evconnlistener_new_bind(eventBase.get(), accept_connection_cb, nullptr,
-                                                                  (LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE | LEV_OPT_THREADSAFE),
-                                                                  -1, (sockaddr*)&sin, sizeof(sin));
-            if (!listenerPtr){
-                std::cout << "Не получилось создать listener" << std::endl;
-                return;
-            }
-        
-            // сокет создается на основании связки
-            socket = evconnlistener_get_fd(listenerPtr);
-            if (socket == -1){
-                std::cout << "Не получилось получить объект сокет из listener" << std::endl;
-            }
-        } else {
-            // Создаем сервер с обработчиком событий
-            evconnlistener* listenerPtr = evconnlistener_new(eventBase.get(), accept_connection_cb, nullptr,
-                                                             (LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE | LEV_OPT_THREADSAFE),
-                                                             -1, socket);
-            if (!listenerPtr){
-                std::cout << "Не получилось создать listener с сокетом" << std::endl;
-                return;
-            }
+        if (index == 0) {
+            socket = server.socket();
+            unixSocket = server.unixSocket();
         }
         
-        // листенер
-        ServerListenerPtr listener(listenerPtr, &evconnlistener_free);
-        
-        // запуск (неблокирующий)
-//        event_base_loop(eventBase.get(), EVLOOP_NONBLOCK);
-        
-        // запуск цикла - блокирующий
-        event_base_dispatch(eventBase.get());
+        threads.run(base);
         
-        std::cout << "Выход из цикла обработки" << std::endl;
-    };
-    
-    // пулл потоков
-    ThreadPool threads;
-    threads.reserve(threadsCount);
-    
-    // не дает завершиться потокам
-    auto threadDeleter = [&] (std::thread *t) {
-        t->join();
-        delete t;
-    };
-    
-    events.reserve(threadsCount);
-    
-    for (int i = 0 ; i < threadsCount ; ++i) {
-        ThreadPtr Thread(new std::thread(threadFunc), threadDeleter);
-        
-        // задержка старта следующего потока
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        
-        // сохраняем поток
-        threads.push_back(std::move(Thread));
+        std::cout << "Выход из цикла обработки, отклонено соединений: " << server.core().rateLimiter().rejectedCount()
+                  << ", пауз по лимиту сообщений: " << server.core().rateLimiter().throttledCount() << std::endl;
+        printTCPMemoryStats(server.core().memory().stats());
+    });
+    if (!started) {
+        return 1;
     }
     
     // ожидаем нажатия для завершения
@@ -275,19 +109,11 @@ int multiThreadedTcpServer() {
     }
     std::cout << "Quit in progress." << std::endl;
     
-    // завершение
-    timeval timeVal;
-    timeVal.tv_sec = 0;
-    timeVal.tv_usec = 500;
-    for (const EventBasePtr& event: events) {
-        event_base_loopexit(event.get(), &timeVal);
-        //event_base_loopbreak(event.get());
-    }
-    events.clear();
-    threads.clear();
+    threads.stop();
     
+    std::cout << "Обработано сообщений: " << handler.messages << std::endl;
+    std::cout << "Память буферов всех потоков: " << memoryCounters.bytes() << " байт, пик: " << memoryCounters.peakBytes() << std::endl;
     std::cout << "Quit complete." << std::endl;
     
     return 0;
 }
-
@@ -1,4 +1,8 @@
 #include "MultiThreadedTCP.h"
+#include "TCPRateLimiter.h"
+#include "TCPMemoryBudget.h"
+#include "TLSContext.h"
+#include "UnixSocket.h"
 // std
 #include <stdexcept>
 #include <iostream>
@@ -7,6 +11,11 @@
 #include <thread>
 #include <cstdint>
 #include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
 #include <memory>
 #include <queue>
 #include <string>
@@ -50,8 +59,9 @@ std::queue<evconnlistener*> freeListeners;
 //////////////////////////////////////////////////
 // TCP Server
 //////////////////////////////////////////////////
-int multiThreadedTcpServerFilter() {
+int multiThreadedTcpServerFilter(const TLSConfig* tls, bool rateLimits) {
     std::uint16_t const serverPort = 5555;
+    const char* const serverUnixPath = "/tmp/libeventserver-5555.sock";
     int const threadsCount = 2;
     
     
@@ -60,6 +70,21 @@ int multiThreadedTcpServerFilter() {
     std::atomic_bool isActive(true);
     std::vector<EventBasePtr> events;
     std::atomic<evutil_socket_t> socket(-1);
+    std::atomic<evutil_socket_t> unixSocket(-1);
+    
+    // ограничения клиентов: ведра в каждом потоке свои, счетчики соединений по IP общие
+    TCPRateLimitConfig rateLimitConfig = rateLimits ? TCPRateLimitConfig() : TCPRateLimitConfig::unlimited();
+    TCPAddressCounters addressCounters;
+    // память буферов: учет в каждом потоке свой, общий предел - по сумме всех потоков
+    TCPMemoryConfig memoryConfig;
+    TCPMemoryCounters memoryCounters;
+    
+    // состояние потока для колбеков листенера и соединений
+    struct ListenerContext {
+        TCPRateLimiter* rateLimiter;
+        TCPMemoryBudget* memory;
+        TLSServerContext* tls;      // nullptr - без TLS
+    };
     
     // Функция в потоке
     auto threadFunc = [&] (){
@@ -70,12 +95,20 @@ int multiThreadedTcpServerFilter() {
         auto accept_connection_cb = [](evconnlistener* listener,
                                        evutil_socket_t fd, sockaddr* addr, int sock_len,
                                        void* arg) {
+            ListenerContext* context = static_cast<ListenerContext*>(arg);
+            TCPRateLimiter* rateLimiter = context->rateLimiter;
 
             // обработчик ивентов базовый
             event_base* base = evconnlistener_get_base(listener);
             
-            // При обработке запроса нового соединения необходимо создать для него объект bufferevent
-            bufferevent* buf_ev_classic = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE /*| BEV_OPT_THREADSAFE | BEV_OPT_DEFER_CALLBACKS | BEV_OPT_UNLOCK_CALLBACKS*/);
+            // При обработке запроса нового соединения необходимо создать для него объект bufferevent;
+            // TLS идет под фильтром - фильтр работает с уже расшифрованными данными
+            bufferevent* buf_ev_classic = nullptr;
+            if (context->tls) {
+                buf_ev_classic = context->tls->createBufferevent(base, fd, BEV_OPT_CLOSE_ON_FREE);
+            } else {
+                buf_ev_classic = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE /*| BEV_OPT_THREADSAFE | BEV_OPT_DEFER_CALLBACKS | BEV_OPT_UNLOCK_CALLBACKS*/);
+            }
             if (buf_ev_classic == nullptr) {
                 std::cout << "Ошибка при создании объекта bufferevent." << std::endl;
                 return;
@@ -127,13 +160,34 @@ int multiThreadedTcpServerFilter() {
             };
             auto filterDestroyCallback = [](void*){
             };
-            bufferevent* buf_ev = bufferevent_filter_new(buf_ev_classic, inputFilter, outFilter, 0, filterDestroyCallback, nullptr);
+            // фильтр владеет bufferevent сокета и освобождает его вместе с собой
+            bufferevent* buf_ev = bufferevent_filter_new(buf_ev_classic, inputFilter, outFilter, BEV_OPT_CLOSE_ON_FREE, filterDestroyCallback, nullptr);
             if (buf_ev_classic == nullptr) {
                 std::cout << "Ошибка при создании ФИЛЬТРУЮЩЕГО объекта bufferevent." << std::endl;
                 return;
             }
+            
+            // превышен предел соединений с этого IP - закрываем сразу, до первого чтения;
+            // байты ограничиваются на сокете, сообщения - на фильтре
+            if (rateLimiter->attach(buf_ev, addr, buf_ev_classic) == false) {
+                bufferevent_free(buf_ev);
+                return;
+            }
+            // буферы всех соединений уже заняли общий предел памяти
+            if (context->memory->attach(buf_ev) == false) {
+                rateLimiter->detach(buf_ev);
+                bufferevent_free(buf_ev);
+                return;
+            }
             // Функция обратного вызова для события: данные готовы для чтения в buf_ev
             auto echo_read_cb = [](bufferevent* buf_ev, void *arg) {
+                TCPRateLimiter* rateLimiter = static_cast<ListenerContext*>(arg)->rateLimiter;
+                
+                // лимит сообщений исчерпан - сообщение ждет в буффере, колбек вызовется снова
+                if (rateLimiter->allowMessage(buf_ev) == false) {
+                    return;
+                }
+                
                 evbuffer* buf_input = bufferevent_get_input(buf_ev);
                 evbuffer* buf_output = bufferevent_get_output(buf_ev);
                 
@@ -167,6 +221,8 @@ int multiThreadedTcpServerFilter() {
             
             // коллбек обработки ивента
             auto echo_event_cb = [](bufferevent* buf_ev, short events, void *arg){
+                ListenerContext* context = static_cast<ListenerContext*>(arg);
+                
                 if(events & BEV_EVENT_READING){
                     std::cout << "Ошибка во время чтения bufferevent" << std::endl;
                 }
@@ -188,6 +244,8 @@ int multiThreadedTcpServerFilter() {
                 if(events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)){
                     // уничтожаем объект буффер
                     if (buf_ev) {
+                        context->memory->detach(buf_ev);
+                        context->rateLimiter->detach(buf_ev);
                         bufferevent_free(buf_ev);
                         buf_ev = nullptr;
                     }
@@ -195,7 +253,7 @@ int multiThreadedTcpServerFilter() {
             };
             
             // коллбеки обработи
-            bufferevent_setcb(buf_ev, echo_read_cb, echo_write_cb, echo_event_cb, (void*)listener);
+            bufferevent_setcb(buf_ev, echo_read_cb, echo_write_cb, echo_event_cb, context);
             bufferevent_enable(buf_ev, (EV_READ | EV_WRITE));
             // размеры буффера для вызова коллбеков
             //bufferevent_setwatermark(buf_ev, EV_READ, 2, 0);   // 2+
@@ -225,6 +283,21 @@ int multiThreadedTcpServerFilter() {
         events.push_back(eventBase);
         mutex.unlock();
         
+        // ограничитель этого потока, живет дольше листенера
+        TCPRateLimiter rateLimiter(eventBase.get(), rateLimitConfig, &addressCounters);
+        TCPMemoryBudget memoryBudget(eventBase.get(), memoryConfig, &memoryCounters);
+        
+        // SSL_CTX потока: свой кеш сессий, общие ключи билетов
+        std::unique_ptr<TLSServerContext> tlsContext;
+        if (tls) {
+            tlsContext.reset(new TLSServerContext(*tls));
+            if (!tlsContext->isValid()){
+                std::cout << "Не получилось создать контекст TLS" << std::endl;
+                return;
+            }
+        }
+        ListenerContext listenerContext = {&rateLimiter, &memoryBudget, tlsContext.get()};
+        
         // Будущий объект listener
         evconnlistener* listenerPtr = nullptr;
         
@@ -239,7 +312,7 @@ int multiThreadedTcpServerFilter() {
             sin.sin_port = htons(serverPort);
             
             // Создаем сервер с обработчиком событий
-            listenerPtr = evconnlistener_new_bind(eventBase.get(), accept_connection_cb, nullptr,
+            listenerPtr = evconnlistener_new_bind(eventBase.get(), accept_connection_cb, &listenerContext,
                                                                   (/*LEV_OPT_LEAVE_SOCKETS_BLOCKING | */LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE | LEV_OPT_THREADSAFE),
                                                                   -1, (sockaddr*)&sin, sizeof(sin));
             if (!listenerPtr){
@@ -258,7 +331,7 @@ int multiThreadedTcpServerFilter() {
             
         } else {
             // Создаем сервер с обработчиком событий
-            evconnlistener* listenerPtr = evconnlistener_new(eventBase.get(), accept_connection_cb, nullptr,
+            evconnlistener* listenerPtr = evconnlistener_new(eventBase.get(), accept_connection_cb, &listenerContext,
                                                              (/*LEV_OPT_LEAVE_SOCKETS_BLOCKING | */LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE | LEV_OPT_THREADSAFE),
                                                              -1, socket);
             if (!listenerPtr){
@@ -269,10 +342,27 @@ int multiThreadedTcpServerFilter() {
             // коллбек отвала соединения
             evconnlistener_set_error_cb(listenerPtr, listenerErrorCallback);
         }
+        
+        // Unix сокет для клиентов на этом же хосте: тот же колбек, первый поток создает сокет
+        if (unixSocket == -1){
+            unixSocket = bindUnixSocket(serverUnixPath, SOCK_STREAM, 1024);
+        }
+        evconnlistener* unixListenerPtr = nullptr;
+        if (unixSocket != -1){
+            // сокет уже слушает - backlog 0, закрывается в конце вместе с файлом
+            unixListenerPtr = evconnlistener_new(eventBase.get(), accept_connection_cb, &listenerContext,
+                                                 LEV_OPT_THREADSAFE, 0, unixSocket);
+            if (!unixListenerPtr){
+                std::cout << "Не получилось создать listener Unix сокета" << std::endl;
+            } else {
+                evconnlistener_set_error_cb(unixListenerPtr, listenerErrorCallback);
+            }
+        }
         lock.unlock();
         
         // листенер
         ServerListenerPtr listener(listenerPtr, &evconnlistener_free);
+        ServerListenerPtr unixListener(unixListenerPtr, &evconnlistener_free);
         
         // запуск (неблокирующий)
 //        event_base_loop(eventBase.get(), EVLOOP_NONBLOCK);
@@ -280,7 +370,13 @@ int multiThreadedTcpServerFilter() {
         // запуск цикла - блокирующий
         event_base_dispatch(eventBase.get());
         
-        std::cout << "Выход из цикла обработки" << std::endl;
+        std::cout << "Выход из цикла обработки, отклонено соединений: " << rateLimiter.rejectedCount()
+                  << ", пауз по лимиту сообщений: " << rateLimiter.throttledCount() << std::endl;
+        printTCPMemoryStats(memoryBudget.stats());
+        if (tlsContext) {
+            std::cout << "TLS рукопожатий: " << tlsContext->handshakesCount()
+                      << ", из них возобновлено: " << tlsContext->resumedCount() << std::endl;
+        }
     };
     
     // пулл потоков
@@ -325,7 +421,12 @@ int multiThreadedTcpServerFilter() {
     }
     events.clear();
     threads.clear();
+    if (unixSocket != -1) {
+        evutil_closesocket(unixSocket);
+        removeUnixSocket(serverUnixPath);
+    }
     
+    std::cout << "Память буферов всех потоков: " << memoryCounters.bytes() << " байт, пик: " << memoryCounters.peakBytes() << std::endl;
     std::cout << "Quit complete." << std::endl;
     
     return 0;
@@ -1,3 +1,6 @@
 
-int multiThreadedTcpServerFilter();
+struct TLSConfig;
+
+// tls - nullptr для открытого TCP; rateLimits - false для замеров без ограничений клиентов
+int multiThreadedTcpServerFilter(const TLSConfig* tls, bool rateLimits);
 
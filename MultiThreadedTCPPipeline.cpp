@@ -0,0 +1,214 @@
+#include "MultiThreadedTCPPipeline.h"
+#include "TCPServer.h"
+#include "TCPPipeline.h"
+#include "ProtobufStage.h"
+#include "TCPCoroutine.h"
+#include "EventLoopThreads.h"
+#include "data.pb.h"
+// std
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <atomic>
+
+// Тот же эхо-сервер, что MultiThreadedTCPFilter, но протокол собран из стадий при компиляции:
+// кадры режутся прямо во входном буфере сокета, ответ пишется прямо в выходной.
+
+//using namespace std;
+
+
+//////////////////////////////////////////////////
+// Протокол фильтра: байт длины и данные; ответ "Server handled: " и данные одним кадром
+//////////////////////////////////////////////////
+typedef Pipeline<LengthPrefixCodec<std::uint8_t>> FilterProtocol;
+
+struct FilterEchoHandler {
+    typedef TCPConnection<FilterProtocol, FilterEchoHandler> Connection;
+
+    std::atomic<std::uint64_t> messages;
+
+    FilterEchoHandler():
+        messages(0){
+    }
+
+    void onConnected(Connection&){
+    }
+
+    void onMessage(Connection& connection, const char* data, std::size_t size){
+        messages.fetch_add(1, std::memory_order_relaxed);
+
+        // ответ длиннее 255 байт в кадр не помещается - префикс и данные идут двумя кадрами, как в tcp-uring
+        static const char prefix[] = "Server handled: ";
+        char reply[LengthPrefixCodec<std::uint8_t>::maxPayloadSize];
+        std::size_t replySize = sizeof(prefix) - 1 + size;
+        if (replySize > sizeof(reply)) {
+            connection.send(static_cast<const char*>(prefix), sizeof(prefix) - 1);
+            connection.send(data, size);
+            return;
+        }
+        memcpy(reply, prefix, sizeof(prefix) - 1);
+        memcpy(reply + sizeof(prefix) - 1, data, size);
+        connection.send(reply, replySize);
+    }
+
+    void onClosed(Connection&){
+    }
+};
+
+//////////////////////////////////////////////////
+// 4 байта длины, CRC32, EchoMessage; ответ - тот же id и "Server handled: " с данными
+//////////////////////////////////////////////////
+typedef Pipeline<LengthPrefixCodec<std::uint32_t>, ChecksumStage, ProtobufStage<EchoMessage>> ProtobufProtocol;
+
+struct ProtobufEchoHandler {
+    typedef TCPConnection<ProtobufProtocol, ProtobufEchoHandler> Connection;
+
+    std::atomic<std::uint64_t> messages;
+
+    ProtobufEchoHandler():
+        messages(0){
+    }
+
+    void onConnected(Connection&){
+    }
+
+    void onMessage(Connection& connection, const EchoMessage& message){
+        messages.fetch_add(1, std::memory_order_relaxed);
+
+        // ответ на поток переиспользуется, как и разбираемое сообщение
+        static thread_local EchoMessage reply;
+        reply.set_id(message.id());
+        std::string* payload = reply.mutable_payload();
+        payload->assign("Server handled: ");
+        payload->append(message.payload());
+        connection.send(reply);
+    }
+
+    void onClosed(Connection&){
+    }
+};
+
+//////////////////////////////////////////////////
+// Протокол фильтра, но сессия - корутина: чтение кадра и ответ идут подряд в одной функции
+//////////////////////////////////////////////////
+struct CoroutineEchoHandler {
+    typedef TCPCoroutineConnection<FilterProtocol, CoroutineEchoHandler> Connection;
+
+    std::atomic<std::uint64_t> messages;
+
+    CoroutineEchoHandler():
+        messages(0){
+    }
+
+    TCPCoroutineTask session(Connection& connection){
+        static const char prefix[] = "Server handled: ";
+        // буфер ответа живет в кадре корутины, а не на куче
+        char reply[LengthPrefixCodec<std::uint8_t>::maxPayloadSize];
+        memcpy(reply, prefix, sizeof(prefix) - 1);
+
+        while (true) {
+            TCPFrame frame = co_await connection.readFrame();
+            if (frame.data == nullptr) {
+                break;
+            }
+            messages.fetch_add(1, std::memory_order_relaxed);
+
+            // как FilterEchoHandler: длинный ответ - префикс и данные двумя кадрами
+            std::size_t replySize = sizeof(prefix) - 1 + frame.size;
+            if (replySize > sizeof(reply)) {
+                if ((co_await connection.write(static_cast<const char*>(prefix), sizeof(prefix) - 1)) == false) {
+                    break;
+                }
+                if ((co_await connection.write(frame.data, frame.size)) == false) {
+                    break;
+                }
+                continue;
+            }
+            memcpy(reply + sizeof(prefix) - 1, frame.data, frame.size);
+            if ((co_await connection.write(static_cast<const char*>(reply), replySize)) == false) {
+                break;
+            }
+        }
+    }
+};
+
+//////////////////////////////////////////////////
+// Запуск по серверу на поток, ожидание Exit
+//////////////////////////////////////////////////
+template <typename Server, typename Handler>
+static int runPipelineServer(Handler& handler){
+    int const threadsCount = 2;
+
+    // как tcp-filter-unlimited: замеряется протокол, а не ограничения клиентов
+    TCPServerConfig config;
+    config.port = 5555;
+    config.unixPath = "/tmp/libeventserver-5555.sock";
+    config.rateLimits = TCPRateLimitConfig::unlimited();
+    TCPMemoryCounters memoryCounters;
+    config.memoryCounters = &memoryCounters;
+
+    std::atomic<evutil_socket_t> socket(-1);
+    std::atomic<evutil_socket_t> unixSocket(-1);
+
+    EventLoopThreads threads(threadsCount);
+    bool started = threads.start([&](EventLoopThreads& threads, event_base* base, int index){
+        Server server(base, config, handler);
+        bool listening = (index == 0) ? server.bind() : server.accept(socket, unixSocket);
+        if (!listening){
+            std::cout << "Не получилось создать listener" << std::endl;
+            return;
+        }
+        if (index == 0) {
+            socket = server.socket();
+            unixSocket = server.unixSocket();
+        }
+
+        threads.run(base);
+
+        std::cout << "Выход из цикла обработки, принято соединений: " << server.core().acceptedCount()
+                  << ", кадров корутин: " << TCPCoroutineFramePool::allocatedCount()
+                  << ", из пула: " << TCPCoroutineFramePool::reusedCount() << std::endl;
+        printTCPMemoryStats(server.core().memory().stats());
+    });
+    if (!started) {
+        return 1;
+    }
+
+    // ожидаем нажатия для завершения
+    std::cout << "Write \"Exit\" fot quit." << std::endl;
+    std::string text;
+    std::cin >> text;
+    while (text.find("Exit") == std::string::npos) {
+        text.clear();
+        std::cin >> text;
+    }
+    std::cout << "Quit in progress." << std::endl;
+
+    threads.stop();
+
+    std::cout << "Обработано сообщений: " << handler.messages << std::endl;
+    std::cout << "Память буферов всех потоков: " << memoryCounters.bytes() << " байт, пик: " << memoryCounters.peakBytes() << std::endl;
+    std::cout << "Quit complete." << std::endl;
+
+    return 0;
+}
+
+//////////////////////////////////////////////////
+// TCP Server
+//////////////////////////////////////////////////
+int multiThreadedTcpServerPipeline(bool protobuf) {
+    if (protobuf) {
+        ProtobufEchoHandler handler;
+        return runPipelineServer<TCPServer<ProtobufProtocol, ProtobufEchoHandler>>(handler);
+    }
+    FilterEchoHandler handler;
+    return runPipelineServer<TCPServer<FilterProtocol, FilterEchoHandler>>(handler);
+}
+
+int multiThreadedTcpServerCoroutine() {
+    CoroutineEchoHandler handler;
+    return runPipelineServer<TCPCoroutineServer<FilterProtocol, CoroutineEchoHandler>>(handler);
+}
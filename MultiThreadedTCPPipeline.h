@@ -0,0 +1,9 @@
+#pragma once
+
+// Эхо-сервер на TCPServer с протоколом Pipeline вместо фильтров bufferevent.
+// protobuf - false: протокол MultiThreadedTCPFilter (байт длины), для сравнения с tcp-filter-unlimited;
+// true: 4 байта длины, CRC32 и EchoMessage из data.proto
+int multiThreadedTcpServerPipeline(bool protobuf);
+
+// Тот же протокол фильтра на TCPCoroutineServer: сессия соединения - корутина C++20
+int multiThreadedTcpServerCoroutine();
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+// protobuf
+#include <google/protobuf/message_lite.h>
+// server
+#include "TCPPipeline.h"
+
+//////////////////////////////////////////////////
+// Последняя стадия Pipeline: данные кадра - сообщение protobuf Message.
+// Обработчик получает onMessage(connection, const Message&), ответ - connection.send(message).
+// Разбор прямо из входного буфера, сериализация прямо в выходной.
+//////////////////////////////////////////////////
+template <typename Message>
+struct ProtobufStage {
+    template <typename Next, typename Function>
+    static bool decode(const char* data, std::size_t size, Function& function){
+        static_assert(std::is_same<Next, PipelineChain<>>::value, "ProtobufStage must be the last pipeline stage");
+        // объект на поток: память полей остается от прошлых сообщений, ParseFromArray его очищает
+        static thread_local Message message;
+        if (message.ParseFromArray(data, static_cast<int>(size)) == false) {
+            return false;
+        }
+        function(static_cast<const Message&>(message));
+        return true;
+    }
+
+    // ByteSizeLong запоминает размер - сериализация его не пересчитывает
+    template <typename Next>
+    static std::size_t encodedSize(const Message& message){
+        return message.ByteSizeLong();
+    }
+
+    template <typename Next>
+    static char* encode(char* out, const Message& message){
+        std::uint8_t* end = message.SerializeWithCachedSizesToArray(reinterpret_cast<std::uint8_t*>(out));
+        return reinterpret_cast<char*>(end);
+    }
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////
+// Простейший RCU на эпохах:
+// читатель отмечает в своем слоте эпоху на время чтения (без блокировок и ожиданий),
+// писатель подменяет указатель, сдвигает эпоху и ждет, пока все читатели
+// старых эпох выйдут, после чего освобождает старый объект.
+// Все ожидание - на стороне писателя, потоки обработки не тормозят.
+//////////////////////////////////////////////////
+class RCUDomain {
+public:
+    explicit RCUDomain(std::size_t maxReaders):
+        _globalEpoch(1),
+        _readersCount(0),
+        _readers(maxReaders){
+        for (ReaderSlot& slot: _readers) {
+            slot.epoch.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Регистрация потока-читателя, возвращает номер слота или -1 если слоты кончились;
+    // -1 в readLock/readUnlock не передается - вызывающий проверяет результат
+    int registerReader(){
+        std::size_t index = _readersCount.fetch_add(1);
+        if (index >= _readers.size()) {
+            return -1;
+        }
+        return (int)index;
+    }
+
+    void readLock(int reader){
+        _readers[reader].epoch.store(_globalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+
+    void readUnlock(int reader){
+        _readers[reader].epoch.store(0, std::memory_order_release);
+    }
+
+    // Ожидание выхода всех читателей, начавших чтение до вызова
+    void synchronize(){
+        std::uint64_t target = _globalEpoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        std::size_t count = std::min(_readersCount.load(), _readers.size());
+        for (std::size_t i = 0; i < count; ++i) {
+            while (true) {
+                std::uint64_t epoch = _readers[i].epoch.load(std::memory_order_seq_cst);
+                if ((epoch == 0) || (epoch >= target)) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    // слот на свою кеш-линию, чтобы читатели не мешали друг другу
+    struct alignas(64) ReaderSlot {
+        std::atomic<std::uint64_t> epoch;
+    };
+
+    std::atomic<std::uint64_t> _globalEpoch;
+    std::atomic<std::size_t> _readersCount;
+    std::vector<ReaderSlot> _readers;
+};
+
+//////////////////////////////////////////////////
+// Секция чтения
+//////////////////////////////////////////////////
+class RCUReadGuard {
+public:
+    RCUReadGuard(RCUDomain& domain, int reader):
+        _domain(domain),
+        _reader(reader){
+        _domain.readLock(_reader);
+    }
+    ~RCUReadGuard(){
+        _domain.readUnlock(_reader);
+    }
+    RCUReadGuard(const RCUReadGuard&) = delete;
+    RCUReadGuard& operator=(const RCUReadGuard&) = delete;
+
+private:
+    RCUDomain& _domain;
+    int _reader;
+};
+
+//////////////////////////////////////////////////
+// Указатель на неизменяемый снимок данных
+//////////////////////////////////////////////////
+template<typename T>
+class RCUPointer {
+public:
+    explicit RCUPointer(RCUDomain& domain):
+        _domain(domain),
+        _pointer(nullptr){
+    }
+
+    ~RCUPointer(){
+        delete _pointer.load();
+    }
+
+    RCUPointer(const RCUPointer&) = delete;
+    RCUPointer& operator=(const RCUPointer&) = delete;
+
+    // только внутри секции чтения, объект живет до ее окончания
+    const T* read() const{
+        return _pointer.load(std::memory_order_seq_cst);
+    }
+
+    // подмена снимка; блокирует вызывающего до освобождения старого,
+    // писатели сериализуются между собой
+    void update(std::unique_ptr<T> value){
+        std::lock_guard<std::mutex> lock(_writersMutex);
+        T* old = _pointer.exchange(value.release(), std::memory_order_seq_cst);
+        _domain.synchronize();
+        delete old;
+    }
+
+private:
+    RCUDomain& _domain;
+    std::atomic<T*> _pointer;
+    std::mutex _writersMutex;
+};
@@ -0,0 +1,438 @@
+#include "ServerTasksHandler.h"
+// std
+#include <chrono>
+#include <algorithm>
+
+
+typedef std::lock_guard<std::mutex> LockGuard;
+typedef std::unique_lock<std::mutex> UniqueLock;
+
+TasksQueueConfig::TasksQueueConfig():
+    capacity(4096),
+    resumeSize(2048),
+    overflowPolicy(TASK_OVERFLOW_BLOCK),
+    deadline(0){
+    weights[TASK_PRIORITY_CONTROL] = 16;
+    weights[TASK_PRIORITY_NORMAL] = 4;
+    weights[TASK_PRIORITY_BULK] = 1;
+}
+
+TaskOptions::TaskOptions():
+    producer(nullptr),
+    deadline(0),
+    priority(TASK_PRIORITY_NORMAL),
+    client(nullptr){
+}
+
+ServerTasksHandler::ServerTasksHandler(event_base* base, int threadsCount, const TasksQueueConfig& config):
+    _enabled(true),
+    _config(config),
+    _tasksCount(0),
+    _sequence(0),
+    _virtualTime(0.0),
+    _base(base),
+    _updateEventObject(nullptr),
+    _resumeEvent(event_new(base, -1, 0, resumeCallback, this)),
+    _resumePending(false),
+    _stats(){
+    
+    for (int i = 0; i < TASK_PRIORITIES_COUNT; ++i) {
+        _classes[i].count = 0;
+        _classes[i].virtualStart = 0.0;
+        if (_config.weights[i] == 0) {
+            _config.weights[i] = 1;
+        }
+    }
+    
+    //createMainLoopCallbacksHandler();
+    creatThreads(threadsCount);
+}
+
+ServerTasksHandler::~ServerTasksHandler(){
+    // будим потоки, чтобы они завершились, и ждем их
+    UniqueLock locker(_mutex);
+    _enabled = false;
+    _conditionVariable.notify_all();
+    locker.unlock();
+    _threads.clear();
+    
+    // задачи, до которых потоки не дошли, не выполнятся - ждущих их результата отпускаем
+    std::vector<Task> droppedTasks;
+    locker.lock();
+    QueuedTask queuedTask;
+    TaskPriority priority = TASK_PRIORITY_NORMAL;
+    while (popTask(queuedTask, priority)) {
+        ++_stats.cancelled;
+        ++_stats.classes[priority].cancelled;
+        if (queuedTask.dropped) {
+            droppedTasks.push_back(std::move(queuedTask.dropped));
+        }
+    }
+    locker.unlock();
+    for (Task& dropped: droppedTasks) {
+        dropped();
+    }
+    
+    if (_updateEventObject) {
+        event_free(_updateEventObject);
+    }
+    if (_resumeEvent) {
+        event_free(_resumeEvent);
+    }
+}
+
+void ServerTasksHandler::creatThreads(int threadsCount){
+    // не дает завершиться потокам при удалении объекта
+    auto threadDeleteLock = [&] (std::thread *t) {
+        t->join();
+        delete t;
+    };
+    
+    // резервируем память под указатели потоков
+    _threads.reserve(threadsCount);
+    
+    for (int i = 0; i < threadsCount ; ++i) {
+        // создаем обхект потока
+        auto threadPtrObject = new std::thread(std::bind(&ServerTasksHandler::threadFunction, this));
+        ThreadPtr thread(threadPtrObject, threadDeleteLock);
+        
+        // задержка старта следующего потока
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        // сохраняем поток
+        _threads.push_back(std::move(thread));
+    }
+}
+
+void ServerTasksHandler::createMainLoopCallbacksHandler(){
+    // коллбек таймаута чтения
+    auto updateEvent = [](evutil_socket_t socketFd, short flags, void* arg){
+        ServerTasksHandler* thisObj = (static_cast<ServerTasksHandler*>(arg));
+        TasksQueue& queue = thisObj->_mainLoopQueue;
+        std::mutex& mutex = thisObj->_mutex;
+        
+        // сброс
+        UniqueLock lock(mutex);
+        if (queue.size() == 0) {
+            return;
+        }
+        TasksQueue tasksCopy = queue;
+        queue = TasksQueue();
+        lock.unlock();
+        
+        while (tasksCopy.size() > 0) {
+            Task& task = tasksCopy.front();
+            task();
+            tasksCopy.pop();
+        }
+    };
+    
+    _updateEventObject = event_new(_base, -1, EV_PERSIST | EV_READ | EV_WRITE, updateEvent, this);
+    timeval time;
+    time.tv_sec = 0;
+    time.tv_usec = 50;
+    event_add(_updateEventObject, &time);
+}
+
+void ServerTasksHandler::addTaskToQueue(const Task& task){
+    addTaskToQueue(task, TaskOptions());
+}
+
+bool ServerTasksHandler::addTaskToQueue(const Task& task, const TaskOptions& options){
+    Clock::time_point now = Clock::now();
+    std::chrono::milliseconds deadline = (options.deadline.count() > 0) ? options.deadline : _config.deadline;
+    
+    QueuedTask queuedTask;
+    queuedTask.task = task;
+    queuedTask.dropped = options.dropped;
+    queuedTask.queuedTime = now;
+    queuedTask.deadline = (deadline.count() > 0) ? (now + deadline) : Clock::time_point::max();
+    
+    // вытесненная задача уведомляется уже без блокировки
+    Task droppedTask;
+    
+    // объект блокировки
+    UniqueLock locker(_mutex);
+    // обработчик уничтожается - задачу уже никто не выполнит
+    if (_enabled == false) {
+        ++_stats.rejected;
+        return false;
+    }
+    if ((_config.capacity > 0) && (_tasksCount >= _config.capacity)) {
+        TaskOverflowPolicy policy = _config.overflowPolicy;
+        if ((policy == TASK_OVERFLOW_BLOCK) && (options.producer == nullptr)) {
+            policy = TASK_OVERFLOW_REJECT;
+        }
+        // вытесняются только задачи не важнее новой
+        if ((policy == TASK_OVERFLOW_DROP_OLDEST) && (dropOldest(options.priority, droppedTask) == false)) {
+            policy = TASK_OVERFLOW_REJECT;
+        }
+        if (policy == TASK_OVERFLOW_REJECT) {
+            ++_stats.rejected;
+            return false;
+        }
+        if (policy == TASK_OVERFLOW_BLOCK) {
+            // задача принимается сверх лимита, но новых от этого соединения не будет до разгрузки
+            bufferevent_disable(options.producer, EV_READ);
+            if (std::find(_pausedProducers.begin(), _pausedProducers.end(), options.producer) == _pausedProducers.end()) {
+                _pausedProducers.push_back(options.producer);
+                ++_stats.pauses;
+            }
+        }
+    }
+    pushTask(options.priority, options.client ? options.client : options.producer, std::move(queuedTask));
+    _conditionVariable.notify_one();
+    locker.unlock();
+    
+    if (droppedTask) {
+        droppedTask();
+    }
+    return true;
+}
+
+void ServerTasksHandler::removeProducer(bufferevent* producer){
+    LockGuard locker(_mutex);
+    _pausedProducers.erase(std::remove(_pausedProducers.begin(), _pausedProducers.end(), producer), _pausedProducers.end());
+}
+
+bool ServerTasksHandler::syncTaskDispatch(const Task& task){
+    // свои мютекс и условие: общий _mutex держат потоки пула при выборе задач
+    struct Waiter {
+        std::mutex mutex;
+        std::condition_variable condVar;
+        bool complete = false;
+        bool executed = false;
+        
+        void finish(bool taskExecuted){
+            LockGuard locker(mutex);
+            if (complete) {
+                return;
+            }
+            executed = taskExecuted;
+            complete = true;
+            condVar.notify_all();
+        }
+    };
+    // задача уничтожена, не выполнившись и не вызвав dropped, - ожидание тоже завершается
+    struct Guard {
+        std::shared_ptr<Waiter> waiter;
+        
+        ~Guard(){
+            waiter->finish(false);
+        }
+    };
+    std::shared_ptr<Waiter> waiter = std::make_shared<Waiter>();
+    std::shared_ptr<Guard> guard = std::make_shared<Guard>();
+    guard->waiter = waiter;
+    
+    TaskOptions options;
+    options.dropped = [waiter, guard](){
+        waiter->finish(false);
+    };
+    Task taskWrapper = [waiter, guard, task](){
+        task();
+        waiter->finish(true);
+    };
+    guard.reset();
+    bool queued = addTaskToQueue(taskWrapper, options);
+    taskWrapper = nullptr;
+    options.dropped = nullptr;
+    if (queued == false) {
+        return false;
+    }
+    
+    UniqueLock locker(waiter->mutex);
+    waiter->condVar.wait(locker, [&](){
+        return waiter->complete;
+    });
+    return waiter->executed;
+}
+
+TasksQueueStats ServerTasksHandler::getStats(){
+    UniqueLock locker(_mutex);
+    TasksQueueStats stats = _stats;
+    stats.queued = _tasksCount;
+    for (int i = 0; i < TASK_PRIORITIES_COUNT; ++i) {
+        stats.classes[i].queued = _classes[i].count;
+    }
+    return stats;
+}
+
+size_t ServerTasksHandler::getTaskCount(){
+    UniqueLock locker(_mutex);
+    return _tasksCount;
+}
+
+bool ServerTasksHandler::isEmpty(){
+    UniqueLock locker(_mutex);
+    return _tasksCount == 0;
+}
+
+void ServerTasksHandler::callbackInMainLoop(const Task& task){
+    // цикл просыпается сам, запускать его из чужого потока нельзя
+    postToEventBase(_base, task);
+}
+
+void ServerTasksHandler::threadFunction() {
+    while (_enabled) {
+        // объект блокировки
+        std::unique_lock<std::mutex> locker(_mutex);
+        
+        // Ожидаем уведомления, и убедимся что это не ложное пробуждение
+        // Поток должен проснуться если очередь не пустая либо он выключен
+        auto conditionFunction = [&](){
+            bool enable = (_tasksCount > 0) || (_enabled == false);
+            return enable;
+        };
+        _conditionVariable.wait(locker, conditionFunction);
+        
+        // выключен - оставшиеся задачи не выполняются
+        if (_enabled == false) {
+            break;
+        }
+
+        // выдергиваем функцию
+        QueuedTask queuedTask;
+        TaskPriority priority = TASK_PRIORITY_NORMAL;
+        popTask(queuedTask, priority);
+        TaskClassStats& classStats = _stats.classes[priority];
+        
+        // очередь разгрузилась - приостановленные соединения возобновляются в потоке цикла
+        if ((_pausedProducers.empty() == false) && (_resumePending == false) && (_tasksCount <= _config.resumeSize)) {
+            _resumePending = true;
+            event_active(_resumeEvent, EV_TIMEOUT, 1);
+        }
+        
+        // срок истек, пока задача ждала - клиент ответа уже не ждет, выполнять незачем
+        Clock::time_point now = Clock::now();
+        bool expired = now > queuedTask.deadline;
+        if (expired) {
+            ++_stats.expired;
+            ++classStats.expired;
+        } else {
+            std::chrono::microseconds wait = std::chrono::duration_cast<std::chrono::microseconds>(now - queuedTask.queuedTime);
+            _stats.totalWait += wait;
+            _stats.maxWait = std::max(_stats.maxWait, wait);
+            ++_stats.executed;
+            classStats.totalWait += wait;
+            classStats.maxWait = std::max(classStats.maxWait, wait);
+            ++classStats.executed;
+        }
+        
+        // Разблокируем мютекс перед вызовом функтора
+        locker.unlock();
+        
+        // вызываем функцию
+        if (expired) {
+            if (queuedTask.dropped) {
+                queuedTask.dropped();
+            }
+        } else {
+            queuedTask.task();
+        }
+    }
+}
+
+void ServerTasksHandler::pushTask(TaskPriority priority, const void* client, QueuedTask&& task){
+    TaskClass& taskClass = _classes[priority];
+    // класс вступает в очередь с текущей меткой - простой не копит ему долю потоков
+    if (taskClass.count == 0) {
+        taskClass.virtualStart = std::max(taskClass.virtualStart, _virtualTime);
+    }
+    std::deque<QueuedTask>& tasks = taskClass.clients[client];
+    if (tasks.empty()) {
+        taskClass.activeClients.push_back(client);
+    }
+    task.sequence = _sequence++;
+    taskClass.order.emplace(task.sequence, client);
+    // по сроку; с одинаковым сроком по умолчанию задача почти всегда встает в конец
+    auto position = tasks.end();
+    while ((position != tasks.begin()) && ((position - 1)->deadline > task.deadline)) {
+        --position;
+    }
+    tasks.insert(position, std::move(task));
+    ++taskClass.count;
+    ++_tasksCount;
+}
+
+bool ServerTasksHandler::popTask(QueuedTask& task, TaskPriority& priority){
+    // класс с наименьшей меткой, при равенстве - более важный
+    int selected = -1;
+    for (int i = 0; i < TASK_PRIORITIES_COUNT; ++i) {
+        if ((_classes[i].count > 0) && ((selected < 0) || (_classes[i].virtualStart < _classes[selected].virtualStart))) {
+            selected = i;
+        }
+    }
+    if (selected < 0) {
+        return false;
+    }
+    TaskClass& taskClass = _classes[selected];
+    _virtualTime = taskClass.virtualStart;
+    taskClass.virtualStart += 1.0 / _config.weights[selected];
+    
+    // клиент из начала обхода отдает одну задачу и уходит в конец, если у него есть еще
+    const void* client = taskClass.activeClients.front();
+    taskClass.activeClients.pop_front();
+    auto clientTasks = taskClass.clients.find(client);
+    task = std::move(clientTasks->second.front());
+    clientTasks->second.pop_front();
+    taskClass.order.erase(task.sequence);
+    if (clientTasks->second.empty()) {
+        taskClass.clients.erase(clientTasks);
+    } else {
+        taskClass.activeClients.push_back(client);
+    }
+    --taskClass.count;
+    --_tasksCount;
+    priority = static_cast<TaskPriority>(selected);
+    return true;
+}
+
+bool ServerTasksHandler::dropOldest(TaskPriority newPriority, Task& dropped){
+    // наименее важный непустой класс, но не важнее новой задачи
+    int selected = -1;
+    for (int i = TASK_PRIORITIES_COUNT - 1; i >= newPriority; --i) {
+        if (_classes[i].count > 0) {
+            selected = i;
+            break;
+        }
+    }
+    if (selected < 0) {
+        return false;
+    }
+    // раньше всех поставленная задача класса; у клиента задачи по сроку, она не обязательно первая
+    TaskClass& taskClass = _classes[selected];
+    auto first = taskClass.order.begin();
+    const void* oldestClient = first->second;
+    std::deque<QueuedTask>* oldest = &taskClass.clients[oldestClient];
+    auto position = oldest->begin();
+    while (position->sequence != first->first) {
+        ++position;
+    }
+    taskClass.order.erase(first);
+    dropped = std::move(position->dropped);
+    oldest->erase(position);
+    if (oldest->empty()) {
+        taskClass.clients.erase(oldestClient);
+        taskClass.activeClients.erase(std::find(taskClass.activeClients.begin(), taskClass.activeClients.end(), oldestClient));
+    }
+    --taskClass.count;
+    --_tasksCount;
+    ++_stats.droppedOldest;
+    ++_stats.classes[selected].droppedOldest;
+    return true;
+}
+
+void ServerTasksHandler::resumeCallback(evutil_socket_t, short, void* arg){
+    ServerTasksHandler* thisObj = static_cast<ServerTasksHandler*>(arg);
+    
+    UniqueLock locker(thisObj->_mutex);
+    std::vector<bufferevent*> producers;
+    producers.swap(thisObj->_pausedProducers);
+    thisObj->_resumePending = false;
+    locker.unlock();
+    
+    for (bufferevent* producer: producers) {
+        bufferevent_enable(producer, EV_READ);
+    }
+}
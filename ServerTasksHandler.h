@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <queue>
+#include <map>
+#include <unordered_map>
+// libevent
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+// server
+#include "TaskFuture.h"
+
+typedef std::function<void()> Task;
+typedef std::queue<Task> TasksQueue;
+
+// Что делать с новой задачей, когда очередь заполнена
+enum TaskOverflowPolicy {
+    TASK_OVERFLOW_BLOCK = 0,        // задача принимается, чтение ее соединения приостанавливается до разгрузки очереди
+    TASK_OVERFLOW_REJECT = 1,       // задача не принимается - клиенту сразу отказ
+    TASK_OVERFLOW_DROP_OLDEST = 2   // вытесняется раньше всех поставленная задача наименее важного класса
+};
+
+// Классы задач: доля потоков класса задается весом, пока очередь есть у нескольких классов
+enum TaskPriority {
+    TASK_PRIORITY_CONTROL = 0,      // проверки здоровья и управляющие сообщения
+    TASK_PRIORITY_NORMAL = 1,
+    TASK_PRIORITY_BULK = 2,         // фоновая и пакетная работа
+    TASK_PRIORITIES_COUNT = 3
+};
+
+//////////////////////////////////////////////////
+// Ограничения очереди задач
+//////////////////////////////////////////////////
+struct TasksQueueConfig {
+    std::size_t capacity;                   // 0 - без ограничения
+    std::size_t resumeSize;                 // TASK_OVERFLOW_BLOCK: чтение возобновляется, когда задач не больше
+    TaskOverflowPolicy overflowPolicy;
+    std::chrono::milliseconds deadline;     // срок выполнения от постановки в очередь, 0 - без срока
+    unsigned weights[TASK_PRIORITIES_COUNT];    // веса классов, не меньше 1
+
+    TasksQueueConfig();
+};
+
+//////////////////////////////////////////////////
+// Параметры одной задачи
+//////////////////////////////////////////////////
+struct TaskOptions {
+    bufferevent* producer;                  // TASK_OVERFLOW_BLOCK: чье чтение приостановить; nullptr - отказ, как REJECT
+    Task dropped;                           // задача вытеснена или просрочена и не выполнится; может быть пустой
+    std::chrono::milliseconds deadline;     // 0 - срок из TasksQueueConfig
+    TaskPriority priority;
+    const void* client;                     // задачи разных клиентов класса идут по очереди; nullptr - producer
+
+    TaskOptions();
+};
+
+//////////////////////////////////////////////////
+// Счетчики класса задач - для подбора весов
+//////////////////////////////////////////////////
+struct TaskClassStats {
+    std::size_t queued;
+    std::uint64_t executed;
+    std::uint64_t droppedOldest;
+    std::uint64_t expired;
+    std::uint64_t cancelled;
+    std::chrono::microseconds totalWait;
+    std::chrono::microseconds maxWait;
+};
+
+//////////////////////////////////////////////////
+// Счетчики очереди задач
+//////////////////////////////////////////////////
+struct TasksQueueStats {
+    std::size_t queued;                     // ждут сейчас
+    std::uint64_t executed;
+    std::uint64_t rejected;
+    std::uint64_t droppedOldest;
+    std::uint64_t expired;                  // срок истек до начала выполнения
+    std::uint64_t cancelled;                // не выполнены: обработчик уничтожен раньше
+    std::uint64_t pauses;                   // приостановок чтения соединений
+    std::chrono::microseconds totalWait;    // ожидание в очереди выполненных задач
+    std::chrono::microseconds maxWait;
+    TaskClassStats classes[TASK_PRIORITIES_COUNT];
+};
+
+//////////////////////////////////////////////////
+// Многопоточный обработчик запросов: задачи из цикла событий выполняются в пуле потоков.
+// Очередь ограничена TasksQueueConfig: при переполнении соединение приостанавливается,
+// задача отклоняется или вытесняет самую старую; просроченные задачи не выполняются.
+// Порядок: классы - взвешенная справедливая очередь (WFQ) по весам, внутри класса клиенты
+// по кругу - всплеск одного клиента не занимает все потоки, у клиента - по сроку (EDF).
+// addTaskToQueue и removeProducer вызываются из потока event_base. Для TASK_OVERFLOW_BLOCK
+// нужен evthread_use_pthreads() до создания event_base: потоки будят цикл для возобновления чтения.
+//////////////////////////////////////////////////
+class ServerTasksHandler{
+public:
+    ServerTasksHandler(event_base* base, int threadsCount, const TasksQueueConfig& config = TasksQueueConfig());
+    ~ServerTasksHandler();
+
+    void creatThreads(int threadsCount);
+    void createMainLoopCallbacksHandler();
+
+    void addTaskToQueue(const Task& task);
+    // false - задача отклонена; dropped вызывается в потоке, где задача вытеснена или найдена просроченной,
+    // а для невыполненных при уничтожении обработчика - в потоке деструктора
+    bool addTaskToQueue(const Task& task, const TaskOptions& options);
+    // Из потока event_base: результат function приходит в продолжение TaskFuture в этом же потоке,
+    // цикл не блокируется. Неудача (отказ, вытеснение, срок) - продолжение с nullptr и TASK_FUTURE_FAILED,
+    // задача не выполнена до уничтожения обработчика - TASK_FUTURE_CANCELLED.
+    // Продолжение вызывается в цикле - если он уже не крутится, статус виден через status().
+    template <typename Function>
+    TaskFuture<typename TaskResultOf<Function>::Type> submit(const Function& function, const TaskOptions& options = TaskOptions());
+    // Блокирует вызывающий поток до выполнения задачи - не для потока event_base, там submit.
+    // false - задача не выполнена: отклонена, вытеснена, просрочена или обработчик уничтожен
+    bool syncTaskDispatch(const Task& task);
+
+    // соединение закрывается: больше не возобновлять его чтение
+    void removeProducer(bufferevent* producer);
+
+    size_t getTaskCount();
+    bool isEmpty();
+    TasksQueueStats getStats();
+
+    // выполнение task в потоке event_base; можно вызывать из потоков пула
+    void callbackInMainLoop(const Task& task);
+
+private:
+    typedef std::unique_ptr<std::thread, std::function<void(std::thread*)>> ThreadPtr;  // указатель на поток + функция, вызываемая при уничтожении
+    typedef std::vector<ThreadPtr> ThreadPool;  // пулл потоков
+    typedef std::chrono::steady_clock Clock;
+
+    struct QueuedTask {
+        Task task;
+        Task dropped;
+        Clock::time_point queuedTime;
+        Clock::time_point deadline;         // time_point::max() - без срока
+        std::uint64_t sequence;             // номер постановки в очередь
+    };
+
+    // очередь класса: задачи по клиентам, клиенты с задачами - в порядке обхода
+    struct TaskClass {
+        std::unordered_map<const void*, std::deque<QueuedTask>> clients;
+        std::deque<const void*> activeClients;
+        std::map<std::uint64_t, const void*> order;     // номера задач класса по порядку постановки - для вытеснения
+        std::size_t count;
+        double virtualStart;                // метка WFQ следующей задачи класса
+    };
+
+    std::atomic_bool _enabled;
+    std::mutex _mutex;
+    std::condition_variable _conditionVariable;
+    TasksQueueConfig _config;
+    TaskClass _classes[TASK_PRIORITIES_COUNT];
+    std::size_t _tasksCount;
+    std::uint64_t _sequence;                // номер следующей поставленной задачи
+    double _virtualTime;                    // метка WFQ последней выданной задачи
+    ThreadPool _threads;
+    TasksQueue _mainLoopQueue;
+    event_base* _base;
+    event* _updateEventObject;
+    // приостановленные соединения и событие их возобновления в цикле
+    std::vector<bufferevent*> _pausedProducers;
+    event* _resumeEvent;
+    bool _resumePending;
+    TasksQueueStats _stats;
+
+private:
+    void threadFunction();
+
+    // под _mutex
+    void pushTask(TaskPriority priority, const void* client, QueuedTask&& task);
+    bool popTask(QueuedTask& task, TaskPriority& priority);
+    bool dropOldest(TaskPriority newPriority, Task& dropped);
+
+    static void resumeCallback(evutil_socket_t, short, void* arg);
+};
+
+template <typename Function>
+TaskFuture<typename TaskResultOf<Function>::Type> ServerTasksHandler::submit(const Function& function, const TaskOptions& options){
+    typedef typename TaskResultOf<Function>::Type Result;
+    TaskPromise<Result> promise(_base);
+    TaskFuture<Result> future = promise.future();
+
+    TaskOptions taskOptions = options;
+    Task dropped = options.dropped;
+    // при уничтожении обработчика dropped вызывается из деструктора, объект еще жив
+    taskOptions.dropped = [this, promise, dropped]() mutable {
+        if (dropped) {
+            dropped();
+        }
+        if (_enabled) {
+            promise.fail();
+        } else {
+            promise.cancel();
+        }
+    };
+    Function taskFunction(function);
+    bool queued = addTaskToQueue([promise, taskFunction]() mutable {
+        promise.setValue(TaskResultOf<Function>::invoke(taskFunction));
+    }, taskOptions);
+    // отказ в потоке цикла - продолжение выполнится сразу при then
+    if (queued == false) {
+        promise.fail(true);
+    }
+    return future;
+}
@@ -7,6 +7,7 @@
 #include <thread>
 #include <cstdint>
 #include <vector>
+#include <cstring>
 // libevent
 #include <event2/listener.h>
 #include <event2/bufferevent.h>
@@ -17,6 +18,8 @@
 #include <event.h>
 #include <evhttp.h>
 #include <evdns.h>
+// server
+#include "DNSResolver.h"
 
 
 // примеры
@@ -30,103 +33,82 @@ typedef std::unique_ptr<event_base, decltype(&event_base_free)>  EventHandler;
 typedef std::unique_ptr<evhttp, decltype(&evhttp_free)> ServerPtr;
 
 
-int n_pending_requests = 0;
-struct event_base *base = NULL;
+// Состояние пачки запросов: цикл останавливается после последнего ответа
+struct ResolveBatch {
+    event_base* base;
+    int pendingRequests;
+};
 
 struct UserData {
-    char *name; /* the name we're resolving */
+    ResolveBatch* batch;
+    const char *name; /* the name we're resolving */
     int idx; /* its position on the command line */
 };
 
-void dnsCallback(int errcode, struct evutil_addrinfo *addr, void *ptr)
+void dnsCallback(const DNSResolveResult& result, void *ptr)
 {
     UserData* data = (UserData*)ptr;
     const char *name = data->name;
-    if (errcode) {
-        printf("%d. %s -> %s\n", data->idx, name, evutil_gai_strerror(errcode));
+    if (result.error) {
+        printf("%d. %s -> %s\n", data->idx, name, evdns_err_to_string(result.error));
     } else {
-        struct evutil_addrinfo *ai;
-        printf("%d. %s", data->idx, name);
-        if (addr->ai_canonname){
-            printf(" [%s]", addr->ai_canonname);
-        }
-        puts("");
-        for (ai = addr; ai; ai = ai->ai_next) {
+        printf("%d. %s (ttl %u%s)\n", data->idx, name, result.ttl, result.fromCache ? ", cached" : "");
+        for (const DNSResolvedAddress& address: *result.addresses) {
             char buf[128];
-            const char *s = NULL;
-            if (ai->ai_family == AF_INET) {
-                struct sockaddr_in *sin = (struct sockaddr_in *)ai->ai_addr;
-                s = evutil_inet_ntop(AF_INET, &sin->sin_addr, buf, 128);
-            } else if (ai->ai_family == AF_INET6) {
-                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ai->ai_addr;
-                s = evutil_inet_ntop(AF_INET6, &sin6->sin6_addr, buf, 128);
-            }
+            const char *s = evutil_inet_ntop(address.family, address.address, buf, 128);
             if (s)
                 printf("    -> %s\n", s);
         }
-        evutil_freeaddrinfo(addr);
     }
-    free(data->name);
-    free(data);
-    if (--n_pending_requests == 0)
-        event_base_loopexit(base, NULL);
+    if (--data->batch->pendingRequests == 0)
+        event_base_loopexit(data->batch->base, NULL);
 }
 
 /* Take a list of domain names from the command line and resolve them in
- * parallel. */
-int singleThreadDNSServer()
+ * parallel. Repeated names share one upstream query, the second pass is
+ * answered from the resolver cache. */
+int singleThreadDNSServer(const char* upstream, int namesCount, const char* const* names)
 {
-    int adressesCount = 1;
-    const char* adresses[] = {"localhost"};
+    const char* defaultNames[] = {"localhost"};
+    if (namesCount == 0) {
+        namesCount = 1;
+        names = defaultNames;
+    }
 
-    base = event_base_new();
+    EventHandler base(event_base_new(), &event_base_free);
     if (!base){
         return 1;
     }
-    
-    evdns_base* dnsbase = evdns_base_new(base, 1);
-    if (!dnsbase){
+
+    DNSResolverConfig config;
+    config.upstream = upstream;
+    DNSResolver resolver(base.get(), config);
+    if (!resolver.isValid()){
         return 2;
     }
 
-    for (int i = 0; i < adressesCount; ++i) {
-        /* Unless we specify a socktype, we'll get at least two entries for
-         * each address: one for TCP and one for UDP. That's not what we
-         * want. */
-        evutil_addrinfo hints;
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_UNSPEC;
-        hints.ai_flags = EVUTIL_AI_CANONNAME;
-        hints.ai_socktype = SOCK_STREAM;    // тут был коммент
-        hints.ai_protocol = IPPROTO_TCP;
-        
-        UserData* userDataPtr = (UserData*)malloc(sizeof(UserData));
-        if (!userDataPtr) {
-            perror("malloc");
-            exit(1);
-        }
-        if (!(userDataPtr->name = strdup(adresses[i]))) {
-            perror("strdup");
-            exit(1);
+    ResolveBatch batch;
+    batch.base = base.get();
+    std::vector<UserData> userData(namesCount);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        printf("Pass %d\n", pass + 1);
+        batch.pendingRequests = namesCount;
+        for (int i = 0; i < namesCount; ++i) {
+            userData[i].batch = &batch;
+            userData[i].name = names[i];
+            userData[i].idx = i;
+            resolver.resolve(names[i], dnsCallback, &userData[i]);
         }
-        userDataPtr->idx = i;
-        
-        ++n_pending_requests;
-        evdns_getaddrinfo_request* req = evdns_getaddrinfo(dnsbase, adresses[i], NULL /* no service name given */,
-                                &hints, dnsCallback, userDataPtr);
-        if (req == NULL) {
-            printf("    [request for %s returned immediately]\n", adresses[i]);
-            /* No need to free user_data or decrement n_pending_requests; that
-             * happened in the callback. */
+        /* Cached answers come back right inside resolve() */
+        if (batch.pendingRequests > 0){
+            event_base_dispatch(base.get());
         }
     }
-    
-    if (n_pending_requests > 0){
-        event_base_dispatch(base);
-    }
-    
-    evdns_base_free(dnsbase, 0);
-    event_base_free(base);
-    
+
+    std::cout << "Upstream queries: " << resolver.upstreamQueriesCount()
+              << ", coalesced: " << resolver.coalescedCount()
+              << ", cache hits: " << resolver.cacheHitsCount() << std::endl;
+
     return 0;
 }
@@ -1,2 +1,3 @@
 
-int singleThreadDNSServer();
+// upstream - "ip[:port]" DNS сервера или nullptr для /etc/resolv.conf
+int singleThreadDNSServer(const char* upstream, int namesCount, const char* const* names);
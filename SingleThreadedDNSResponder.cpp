@@ -7,6 +7,8 @@
 #include <thread>
 #include <cstdint>
 #include <vector>
+#include <cstring>
+#include <string>
 // libevent
 #include <event2/listener.h>
 #include <event2/bufferevent.h>
@@ -14,9 +16,15 @@
 #include <event2/event.h>
 #include <event2/dns.h>
 #include <event2/util.h>
+#include <event2/thread.h>
 #include <event.h>
 #include <evhttp.h>
 #include <evdns.h>
+// server
+#include "DNSWire.h"
+#include "DNSZone.h"
+#include "DNSZoneStore.h"
+#include "UnixSocket.h"
 
 
 // примеры
@@ -33,21 +41,28 @@ typedef std::unique_ptr<evhttp, decltype(&evhttp_free)> ServerPtr;
 /* Let's try binding to 5353.  Port 53 is more traditional, but on most
  operating systems it requires root privileges. */
 #define LISTEN_PORT 5550
+/* Unixgram socket for resolvers on the same host. A client has to bind its
+ own socket (a path or an abstract name), otherwise there is no address to
+ send the reply to. */
+#define UNIX_SOCKET_PATH "/tmp/libeventserver-dns.sock"
 
-#define LOCALHOST_IPV4_ARPA "1.0.0.127.in-addr.arpa"
-#define LOCALHOST_IPV6_ARPA ("1.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0."         \
-"0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.ip6.arpa")
+// Зона + слот читателя RCU потока обработки
+struct ResponderContext {
+    DNSZoneStore* store;
+    int reader;
+};
 
-const ev_uint8_t LOCALHOST_IPV4[] = { 127, 0, 0, 1 };
-const ev_uint8_t LOCALHOST_IPV6[] = { 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1 };
-
-#define TTL 4242
-
-/* This toy DNS server callback answers requests for localhost (mapping it to
- 127.0.0.1 or ::1) and for 127.0.0.1 or ::1 (mapping them to localhost).
+/* This toy DNS server callback answers requests from the in-memory zone
+ (by default localhost -> 127.0.0.1 / ::1 and the reverse names).
+ Records are already wire-encoded, lookup is one hash probe.
  */
 void server_callback(struct evdns_server_request *request, void *data)
 {
+    ResponderContext& context = *(static_cast<ResponderContext*>(data));
+    /* The zone snapshot may be swapped by a reload at any moment; the read
+     guard keeps the current one alive until the reply is built. */
+    RCUReadGuard guard(context.store->domain(), context.reader);
+    const DNSZoneTable& zone = context.store->current()->table;
     int i;
     int error=DNS_ERR_NONE;
     /* We should try to answer all the questions.  Some DNS servers don't do
@@ -55,25 +70,24 @@ void server_callback(struct evdns_server_request *request, void *data)
      questions in one request yourself. */
     for (i=0; i < request->nquestions; ++i) {
         const struct evdns_server_question *q = request->questions[i];
-        int ok=-1;
-        /* We don't use regular strcasecmp here, since we want a locale-
-         independent comparison. */
-        if (0 == evutil_ascii_strcasecmp(q->name, "localhost")) {
-            if (q->type == EVDNS_TYPE_A)
-                ok = evdns_server_request_add_a_reply(
-                                                      request, q->name, 1, LOCALHOST_IPV4, TTL);
-            else if (q->type == EVDNS_TYPE_AAAA)
-                ok = evdns_server_request_add_aaaa_reply(
-                                                         request, q->name, 1, LOCALHOST_IPV6, TTL);
-        } else if (0 == evutil_ascii_strcasecmp(q->name, LOCALHOST_IPV4_ARPA)) {
-            if (q->type == EVDNS_TYPE_PTR)
-                ok = evdns_server_request_add_ptr_reply(
-                                                        request, NULL, q->name, "LOCALHOST", TTL);
-        } else if (0 == evutil_ascii_strcasecmp(q->name, LOCALHOST_IPV6_ARPA)) {
-            if (q->type == EVDNS_TYPE_PTR)
-                ok = evdns_server_request_add_ptr_reply(
-                                                        request, NULL, q->name, "LOCALHOST", TTL);
-        } else {
+        int ok=0;
+        /* Zone keys are lowercase, so normalize once instead of a
+         locale-independent strcasecmp per candidate. */
+        char name[DNS_MAX_NAME_LENGTH + 1];
+        std::size_t nameLength = dnsNormalizeName(q->name, name, sizeof(name));
+        const DNSZoneAnswer* answer = zone.find(name, nameLength, q->type);
+        if (answer) {
+            // каждая запись: ссылка на имя(2) тип(2) класс(2) ttl(4) длина(2) данные
+            const std::uint8_t* record = answer->records;
+            for (std::uint16_t j = 0; (j < answer->count) && (ok >= 0); ++j) {
+                int type = (record[2] << 8) | record[3];
+                int ttl = (record[6] << 24) | (record[7] << 16) | (record[8] << 8) | record[9];
+                int dataLength = (record[10] << 8) | record[11];
+                ok = evdns_server_request_add_reply(request, EVDNS_ANSWER_SECTION, q->name, type, EVDNS_CLASS_INET,
+                                                    ttl, dataLength, 0, (const char*)(record + 12));
+                record += 12 + dataLength;
+            }
+        } else if (zone.hasName(name, nameLength) == false) {
             error = DNS_ERR_NOTEXIST;
         }
         if (ok<0 && error==DNS_ERR_NONE)
@@ -83,11 +97,35 @@ void server_callback(struct evdns_server_request *request, void *data)
     evdns_server_request_respond(request, error);
 }
 
-int singleThreadDNSResponder()
+int singleThreadDNSResponder(const char* zonePath)
 {
+    // поток перезагрузки останавливает свой цикл из этого потока
+    evthread_use_pthreads();
+
+    DNSZoneStore zoneStore(zonePath, 1);
+    std::string zoneError;
+    if (!zoneStore.reload(zoneError)) {
+        std::cout << "Ошибка загрузки зоны: " << zoneError << std::endl;
+        return 5;
+    }
+    ResponderContext context;
+    context.store = &zoneStore;
+    context.reader = zoneStore.registerReader();
+    if (context.reader < 0) {
+        std::cout << "Нет свободного слота читателя зоны." << std::endl;
+        return 6;
+    }
+
+    /* Reloads (SIGHUP or zone file change) are parsed on a separate thread,
+     so the loop below never stalls on a big zone. */
+    DNSZoneReloader zoneReloader(zoneStore);
+    zoneReloader.start();
+
     struct event_base *base;
     struct evdns_server_port *server;
+    struct evdns_server_port *unix_server = NULL;
     evutil_socket_t server_fd;
+    evutil_socket_t unix_fd;
     struct sockaddr_in listenaddr;
     
     base = event_base_new();
@@ -107,11 +145,20 @@ int singleThreadDNSResponder()
     if(evutil_make_socket_nonblocking(server_fd)<0)
         return 4;
     server = evdns_add_server_port_with_base(base, server_fd, 0,
-                                             server_callback, NULL);
+                                             server_callback, &context);
+    /* Same callback and zone; the unix socket is already non-blocking. */
+    unix_fd = bindUnixSocket(UNIX_SOCKET_PATH, SOCK_DGRAM, 0);
+    if (unix_fd >= 0)
+        unix_server = evdns_add_server_port_with_base(base, unix_fd, 0,
+                                                      server_callback, &context);
     
     event_base_dispatch(base);
     
     evdns_close_server_port(server);
+    if (unix_server) {
+        evdns_close_server_port(unix_server);
+        removeUnixSocket(UNIX_SOCKET_PATH);
+    }
     event_base_free(base);
     
     return 0;
@@ -1,2 +1 @@
-
-int singleThreadDNSResponder();
+int singleThreadDNSResponder(const char* zonePath);
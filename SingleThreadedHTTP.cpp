@@ -7,6 +7,9 @@
 #include <thread>
 #include <cstdint>
 #include <vector>
+#include <utility>
+#include <string>
+#include <cstdlib>
 // libevent
 #include <event2/listener.h>
 #include <event2/bufferevent.h>
@@ -14,6 +17,16 @@
 #include <event2/event.h>
 #include <event.h>
 #include <evhttp.h>
+#include <event2/thread.h>
+// zlib
+#include <zlib.h>
+// server
+#include "HTTPRouter.h"
+#include "HTTPStaticFiles.h"
+#include "HTTPResponseCache.h"
+#include "HTTPCompression.h"
+#include "HTTPStreaming.h"
+#include "HTTPServer.h"
 
 
 // примеры
@@ -24,49 +37,122 @@
 //using namespace std;
 
 typedef std::unique_ptr<event_base, decltype(&event_base_free)>  EventHandler;
-typedef std::unique_ptr<evhttp, decltype(&evhttp_free)> ServerPtr;
 
 
-int simpleOneThreadServer(){
+int simpleOneThreadServer(const char* staticRoot, const TLSConfig* tls){
+    // пул сжатия отдает результаты в цикл из своих потоков
+    evthread_use_pthreads();
+    
     // Инициализация цикла, только для однопоточного режима
-    if (!event_init()) {
+    event_base* base = event_init();
+    if (!base) {
         std::cerr << "Failed to init libevent." << std::endl;
         return -1;
     }
     
-    // создаем сервер
-    char const* serverAddress = "127.0.0.1";
-    uint16_t serverPort = 5555;
-    
-    // сервер + функция, вызываемая при уничтожении
-    ServerPtr server(evhttp_start(serverAddress, serverPort), &evhttp_free);
+    // создаем сервер: keep-alive 30 сек., до 10000 соединений, дальше ждут в очереди ядра;
+    // привязан к базе явно: кеш отвечает ожидающим через event_base_once в базу соединения
+    HTTPServerConfig serverConfig;
+    serverConfig.address = "127.0.0.1";
+    serverConfig.port = 5555;
+    serverConfig.unixPath = "/tmp/libeventserver-5555.sock";
+    serverConfig.tls = tls;
+    HTTPServer server(base, serverConfig);
     
     // не удалось создать сервер
-    if (!server) {
+    if (!server.isValid() || !server.bind()) {
         std::cerr << "Failed to init http server." << std::endl;
         return -1;
     }
     
-    // коллбек запроса
-    void (*receivedRequest)(evhttp_request*, void*) = [](evhttp_request* request, void* data){
-        // выходной буффер запроса
-        evbuffer* outBuf = evhttp_request_get_output_buffer(request);
-        if (!outBuf){
-            return;
-        }
-        
+    // обработчик по умолчанию - на любой путь, ответ кешируется
+    HTTPResponseProducer receivedRequest = [](evhttp_request* request, const HTTPRouteParams& params, void* data, HTTPCachedResponse& response){
         // тестовая задержка
         std::this_thread::sleep_for(std::chrono::milliseconds(40));
         
         // Выходные данные
-        evbuffer_add_printf(outBuf, "<html><body><center><h1>Hello Wotld! TestData!!!</h1></center></body></html>");
-        
-        // отвечаем на запрос
+        response.headers.push_back(std::make_pair("Content-Type", "text/html; charset=utf-8"));
+        response.body = "<html><body><center><h1>Hello Wotld! TestData!!!</h1></center></body></html>";
+    };
+    
+    // приветствие по имени из пути
+    HTTPRouteHandler helloRequest = [](evhttp_request* request, const HTTPRouteParams& params, void* data){
+        evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+        if (!outBuf){
+            return;
+        }
+        std::string_view name = params.get("name");
+        evbuffer_add_printf(outBuf, "<html><body><center><h1>Hello %.*s!</h1></center></body></html>", (int)name.size(), name.data());
+        evhttp_add_header(evhttp_request_get_output_headers(request), "Content-Type", "text/html; charset=utf-8");
+        httpCompressReply(request);
         evhttp_send_reply(request, HTTP_OK, "", outBuf);
     };
     
+    // потоковая выдача /stream/:lines - в памяти не больше одного куска при любом числе строк
+    HTTPRouteHandler streamRequest = [](evhttp_request* request, const HTTPRouteParams& params, void*){
+        typedef std::pair<std::uint64_t, std::uint64_t> LinesState;     // следующая, всего
+        std::string linesCount(params.get("lines"));
+        LinesState* state = new LinesState(0, strtoull(linesCount.c_str(), nullptr, 10));
+        evhttp_add_header(evhttp_request_get_output_headers(request), "Content-Type", "text/plain; charset=utf-8");
+    
+        HTTPStreamProducer producer = [](HTTPResponseStream& stream, void* data){
+            LinesState& state = *static_cast<LinesState*>(data);
+            for (int i = 0; (i < 1024) && (state.first < state.second); ++i, ++state.first) {
+                stream.printf("line %llu\n", (unsigned long long)state.first);
+            }
+            return state.first < state.second;
+        };
+        HTTPStreamCleanup cleanup = [](void* data){
+            delete static_cast<LinesState*>(data);
+        };
+        HTTPResponseStream::start(request, HTTP_OK, "OK", producer, cleanup, state);
+    };
+    
+    // прием тела кусками: размер и adler32 без копирования тела
+    HTTPRouteHandler uploadRequest = [](evhttp_request* request, const HTTPRouteParams&, void*){
+        typedef std::pair<std::uint64_t, uLong> UploadState;            // байт, контрольная сумма
+        UploadState state(0, adler32(0, nullptr, 0));
+        HTTPBodyChunkHandler chunkHandler = [](const char* data, std::size_t size, void* arg){
+            UploadState& state = *static_cast<UploadState*>(arg);
+            state.first += size;
+            state.second = adler32(state.second, reinterpret_cast<const Bytef*>(data), (uInt)size);
+            return true;
+        };
+        httpReadRequestBody(request, chunkHandler, &state);
+    
+        evbuffer* outBuf = evhttp_request_get_output_buffer(request);
+        evbuffer_add_printf(outBuf, "size %llu adler32 %08lx\n", (unsigned long long)state.first, (unsigned long)state.second);
+        evhttp_send_reply(request, HTTP_OK, "OK", outBuf);
+    };
+    
+    // маршруты
+    HTTPRouter router;
+    router.add(EVHTTP_REQ_GET, "/hello/:name", helloRequest, nullptr);
+    router.add(EVHTTP_REQ_GET, "/stream/:lines", streamRequest, nullptr);
+    router.add(EVHTTP_REQ_POST | EVHTTP_REQ_PUT, "/upload", uploadRequest, nullptr);
+    
+    // статика: кеш 64Мб, в памяти файлы до 256Кб, остальное через sendfile
+    HTTPStaticFiles staticFiles(staticRoot, 64 * 1024 * 1024, 256 * 1024);
+    router.add(EVHTTP_REQ_GET, "/static/*path", HTTPStaticFiles::routeHandler, &staticFiles);
+    
+    // GET/HEAD на 5 секунд, сжатые варианты кешируются отдельно
+    HTTPResponseCache responseCache(16 * 1024 * 1024);
+    HTTPCachedRoute cachedRoute;
+    cachedRoute.cache = &responseCache;
+    cachedRoute.producer = receivedRequest;
+    cachedRoute.data = nullptr;
+    cachedRoute.ttlSeconds = 5;
+    cachedRoute.compress = true;
+    router.add(HTTP_ROUTER_ANY_METHOD, "/*path", HTTPResponseCache::routeHandler, &cachedRoute);
+    
+    // сжатие больших тел и вариантов статики вне цикла событий;
+    // пул объявлен после кешей, чтобы остановиться раньше них
+    HTTPCompressionPool compressionPool(2);
+    staticFiles.setCompressionPool(&compressionPool);
+    responseCache.setCompressionPool(&compressionPool);
+    
     // включаем обработчик вызовов
-    evhttp_set_gencb(server.get(), receivedRequest, nullptr);
+    router.attach(server);
     
     // ошибка цикла LibEvent
     if (event_dispatch() == -1){
@@ -1,2 +1,5 @@
 
-int simpleOneThreadServer();
+struct TLSConfig;
+
+// staticRoot - каталог, раздаваемый по /static/; tls - nullptr для HTTP
+int simpleOneThreadServer(const char* staticRoot, const TLSConfig* tls);
@@ -0,0 +1,626 @@
+#include "TCPBenchmark.h"
+// std
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+// system
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+// server
+#include "UnixSocket.h"
+
+// Нагрузочный клиент для эхо-серверов с кадрами "байт длины + данные". Один поток на epoll:
+// каждое соединение отправляет кадр и ждет полный кадр ответа, затем отправляет следующий.
+
+//using namespace std;
+
+// данные запроса, ответ - "Server handled: " и они же
+static const char benchmarkPayload[] = "ping-0123456789";
+
+struct BenchmarkConnection {
+    int fd;
+    std::size_t received;       // байт текущего ответа
+    std::size_t expected;       // размер кадра ответа вместе с байтом длины, 0 - еще неизвестен
+    std::chrono::steady_clock::time_point sentAt;
+};
+
+static bool sendRequest(BenchmarkConnection& connection){
+    char frame[sizeof(benchmarkPayload)];
+    frame[0] = static_cast<char>(sizeof(benchmarkPayload) - 1);
+    memcpy(frame + 1, benchmarkPayload, sizeof(benchmarkPayload) - 1);
+    connection.received = 0;
+    connection.expected = 0;
+    connection.sentAt = std::chrono::steady_clock::now();
+    // кадр маленький - буфер сокета пуст, пока ждем ответ
+    return send(connection.fd, frame, sizeof(frame), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(frame));
+}
+
+// итог одного прогона эхо: задержки полных ответов в микросекундах, отсортированы
+struct EchoBenchmarkResult {
+    int connectionsCount;
+    std::uint64_t roundTrips;
+    std::uint64_t failed;
+    double elapsed;
+    std::vector<std::int64_t> latencies;
+};
+
+// адрес сервера: "/путь" или "@имя" - Unix сокет, иначе IPv4 и порт
+static bool benchmarkAddress(const char* serverAddress, std::uint16_t serverPort, sockaddr_storage& address, socklen_t& addressLength){
+    memset(&address, 0, sizeof(address));
+    if (isUnixSocketPath(serverAddress)) {
+        if (makeUnixAddress(serverAddress, reinterpret_cast<sockaddr_un&>(address), addressLength) == false) {
+            std::cout << "Неверный путь Unix сокета: " << serverAddress << std::endl;
+            return false;
+        }
+        return true;
+    }
+    sockaddr_in& address4 = reinterpret_cast<sockaddr_in&>(address);
+    address4.sin_family = AF_INET;
+    address4.sin_port = htons(serverPort);
+    if (inet_pton(AF_INET, serverAddress, &address4.sin_addr) != 1) {
+        std::cout << "Неверный адрес сервера: " << serverAddress << std::endl;
+        return false;
+    }
+    addressLength = sizeof(address4);
+    return true;
+}
+
+static std::int64_t averageLatency(const std::vector<std::int64_t>& latencies){
+    if (latencies.empty()) {
+        return 0;
+    }
+    std::int64_t total = 0;
+    for (std::int64_t latency: latencies) {
+        total += latency;
+    }
+    return total / static_cast<std::int64_t>(latencies.size());
+}
+
+static void printEchoLatency(const EchoBenchmarkResult& result){
+    if (result.latencies.empty()) {
+        return;
+    }
+    const std::vector<std::int64_t>& latencies = result.latencies;
+    std::cout << "Latency us avg/p50/p99/max: " << averageLatency(latencies)
+              << "/" << latencies[latencies.size() / 2] << "/" << latencies[latencies.size() * 99 / 100]
+              << "/" << latencies.back() << std::endl;
+}
+
+static bool runEchoBenchmark(const char* serverAddress, std::uint16_t serverPort, int connectionsCount, int durationSeconds,
+                             EchoBenchmarkResult& result){
+    sockaddr_storage serverAddr;
+    socklen_t serverAddrLength = 0;
+    if (benchmarkAddress(serverAddress, serverPort, serverAddr, serverAddrLength) == false) {
+        return false;
+    }
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        std::cout << "Ошибка epoll_create1: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<BenchmarkConnection> connections(connectionsCount);
+    int connectedCount = 0;
+    for (int i = 0; i < connectionsCount; ++i) {
+        BenchmarkConnection& connection = connections[i];
+        connection.fd = socket(serverAddr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (connection.fd < 0) {
+            std::cout << "Ошибка создания сокета: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (serverAddr.ss_family == AF_INET) {
+            int enable = 1;
+            setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        // подключение блокирующее, дальше - только неблокирующее чтение
+        if (connect(connection.fd, (const sockaddr*)&serverAddr, serverAddrLength) < 0) {
+            std::cout << "Ошибка подключения: " << strerror(errno) << std::endl;
+            close(connection.fd);
+            connection.fd = -1;
+            break;
+        }
+        fcntl(connection.fd, F_SETFL, fcntl(connection.fd, F_GETFL) | O_NONBLOCK);
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = &connection;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, connection.fd, &event);
+        ++connectedCount;
+    }
+    connections.resize(connectedCount);
+
+    std::cout << "Echo benchmark: " << serverAddress;
+    if (serverAddr.ss_family == AF_INET) {
+        std::cout << ":" << serverPort;
+    }
+    std::cout << ", connections: " << connectedCount << ", duration: " << durationSeconds << "s" << std::endl;
+
+    result.connectionsCount = connectedCount;
+    result.roundTrips = 0;
+    result.failed = 0;
+    result.latencies.clear();
+    for (BenchmarkConnection& connection: connections) {
+        if (sendRequest(connection) == false) {
+            ++result.failed;
+        }
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto endTime = startTime + std::chrono::seconds(durationSeconds);
+    std::vector<epoll_event> events(1024);
+    char buffer[4096];
+    while (std::chrono::steady_clock::now() < endTime) {
+        int eventsCount = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < eventsCount; ++i) {
+            BenchmarkConnection& connection = *static_cast<BenchmarkConnection*>(events[i].data.ptr);
+            ssize_t readSize = recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (readSize <= 0) {
+                if ((readSize < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+                    continue;
+                }
+                // сервер закрыл соединение - больше его не опрашиваем
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+                ++result.failed;
+                continue;
+            }
+            if (connection.expected == 0) {
+                connection.expected = static_cast<unsigned char>(buffer[0]) + 1;
+            }
+            connection.received += static_cast<std::size_t>(readSize);
+            if (connection.received >= connection.expected) {
+                ++result.roundTrips;
+                auto latency = std::chrono::steady_clock::now() - connection.sentAt;
+                result.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+                if (sendRequest(connection) == false) {
+                    ++result.failed;
+                }
+            }
+        }
+    }
+    result.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::sort(result.latencies.begin(), result.latencies.end());
+
+    for (BenchmarkConnection& connection: connections) {
+        close(connection.fd);
+    }
+    close(epollFd);
+    return true;
+}
+
+int tcpEchoBenchmark(const char* serverAddress, std::uint16_t serverPort, int connectionsCount, int durationSeconds) {
+    EchoBenchmarkResult result;
+    if (runEchoBenchmark(serverAddress, serverPort, connectionsCount, durationSeconds, result) == false) {
+        return 1;
+    }
+    std::cout << "Round trips: " << result.roundTrips << ", failed: " << result.failed << std::endl;
+    std::cout << "Round trips per second: " << (std::uint64_t)(result.roundTrips / result.elapsed) << std::endl;
+    printEchoLatency(result);
+    return 0;
+}
+
+int tcpUnixLatencyBenchmark(const char* serverAddress, std::uint16_t serverPort, const char* unixPath, int connectionsCount, int durationSeconds) {
+    // одни и те же соединения, кадры и сервер - разница только в транспорте
+    EchoBenchmarkResult results[2];
+    const char* endpoints[2] = {serverAddress, unixPath};
+    const char* names[2] = {"tcp loopback", "unix socket"};
+    for (int i = 0; i < 2; ++i) {
+        if (runEchoBenchmark(endpoints[i], serverPort, connectionsCount, durationSeconds, results[i]) == false) {
+            return 1;
+        }
+    }
+
+    std::cout << "transport        round trips/s   avg us   p50 us   p99 us   max us" << std::endl;
+    for (int i = 0; i < 2; ++i) {
+        const EchoBenchmarkResult& result = results[i];
+        std::size_t count = result.latencies.size();
+        char line[160];
+        snprintf(line, sizeof(line), "%-16s %13llu %8lld %8lld %8lld %8lld", names[i],
+                 static_cast<unsigned long long>(result.roundTrips / result.elapsed),
+                 static_cast<long long>(averageLatency(result.latencies)),
+                 static_cast<long long>(count ? result.latencies[count / 2] : 0),
+                 static_cast<long long>(count ? result.latencies[count * 99 / 100] : 0),
+                 static_cast<long long>(count ? result.latencies.back() : 0));
+        std::cout << line << std::endl;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////
+// Число соединений: ступени до maxConnections
+//////////////////////////////////////////////////
+
+// connect одновременно в полете
+#define SCALE_CONNECT_WINDOW 512
+// простой перед замером памяти, затем редкие запросы
+#define SCALE_IDLE_SECONDS 2
+#define SCALE_SPARSE_SECONDS 2
+#define SCALE_SPARSE_INTERVAL_US 2000
+// ответ на редкий запрос дольше - запрос потерян
+#define SCALE_SPARSE_TIMEOUT_SECONDS 5
+
+// RSS процесса в байтах, 0 - не прочитать
+static std::size_t processRSS(int pid){
+    std::ifstream file("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return static_cast<std::size_t>(strtoull(line.c_str() + 6, nullptr, 10)) * 1024;
+        }
+    }
+    return 0;
+}
+
+// буферы TCP ядра всех сокетов в байтах
+static std::size_t kernelTCPMemory(){
+    std::ifstream file("/proc/net/sockstat");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 4, "TCP:") != 0) {
+            continue;
+        }
+        std::size_t position = line.find(" mem ");
+        if (position == std::string::npos) {
+            return 0;
+        }
+        return static_cast<std::size_t>(strtoull(line.c_str() + position + 5, nullptr, 10)) * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+}
+
+// процесс со слушающим сокетом на port: inode из /proc/net/tcp*, затем он же среди /proc/*/fd
+static int findListeningProcess(std::uint16_t port){
+    std::vector<std::string> sockets;
+    const char* tables[] = {"/proc/net/tcp", "/proc/net/tcp6"};
+    for (const char* table: tables) {
+        std::ifstream file(table);
+        std::string line;
+        std::getline(file, line);
+        while (std::getline(file, line)) {
+            // sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode
+            std::istringstream fields(line);
+            std::string slot, local, remote, state, queues, timer, retransmits, uid, timeout, inode;
+            fields >> slot >> local >> remote >> state >> queues >> timer >> retransmits >> uid >> timeout >> inode;
+            std::size_t colon = local.rfind(':');
+            if ((state != "0A") || (colon == std::string::npos)) {
+                continue;
+            }
+            if (strtoul(local.c_str() + colon + 1, nullptr, 16) == port) {
+                sockets.push_back("socket:[" + inode + "]");
+            }
+        }
+    }
+    if (sockets.empty()) {
+        return 0;
+    }
+
+    int found = 0;
+    DIR* processes = opendir("/proc");
+    if (processes == nullptr) {
+        return 0;
+    }
+    dirent* process = nullptr;
+    while ((found == 0) && ((process = readdir(processes)) != nullptr)) {
+        int pid = atoi(process->d_name);
+        if (pid <= 0) {
+            continue;
+        }
+        std::string fdPath = "/proc/" + std::string(process->d_name) + "/fd/";
+        DIR* descriptors = opendir(fdPath.c_str());
+        if (descriptors == nullptr) {
+            continue;
+        }
+        dirent* descriptor = nullptr;
+        while ((found == 0) && ((descriptor = readdir(descriptors)) != nullptr)) {
+            char target[64];
+            ssize_t length = readlink((fdPath + descriptor->d_name).c_str(), target, sizeof(target) - 1);
+            if (length <= 0) {
+                continue;
+            }
+            target[length] = '\0';
+            if (std::find(sockets.begin(), sockets.end(), target) != sockets.end()) {
+                found = pid;
+            }
+        }
+        closedir(descriptors);
+    }
+    closedir(processes);
+    return found;
+}
+
+// Неблокирующие connect окном SCALE_CONNECT_WINDOW до target соединений.
+// Источники - 127.0.0.1..127.0.0.sourcesCount по кругу, порт выбирает ядро при connect
+// (IP_BIND_ADDRESS_NO_PORT), поэтому на каждый адрес - весь диапазон эфемерных портов.
+// false - открыть больше нельзя: кончились дескрипторы, порты или сервер отказал.
+static bool openConnections(int epollFd, const sockaddr_in& serverAddr, int sourcesCount, std::size_t target, std::vector<int>& connections){
+    std::vector<epoll_event> events(SCALE_CONNECT_WINDOW);
+    std::size_t inFlight = 0;
+    bool exhausted = false;
+    while (connections.size() < target) {
+        while ((exhausted == false) && (inFlight < SCALE_CONNECT_WINDOW) && (connections.size() + inFlight < target)) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                std::cout << "Ошибка создания сокета: " << strerror(errno) << std::endl;
+                exhausted = true;
+                break;
+            }
+            if (sourcesCount > 0) {
+                int enable = 1;
+                setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enable, sizeof(enable));
+                sockaddr_in source;
+                memset(&source, 0, sizeof(source));
+                source.sin_family = AF_INET;
+                source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + static_cast<std::uint32_t>((connections.size() + inFlight) % sourcesCount));
+                if (bind(fd, (const sockaddr*)&source, sizeof(source)) < 0) {
+                    std::cout << "Ошибка bind адреса источника: " << strerror(errno) << std::endl;
+                    close(fd);
+                    exhausted = true;
+                    break;
+                }
+            }
+            if ((connect(fd, (const sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) && (errno != EINPROGRESS)) {
+                std::cout << "Ошибка подключения: " << strerror(errno) << std::endl;
+                close(fd);
+                exhausted = true;
+                break;
+            }
+            epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLOUT;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            ++inFlight;
+        }
+        if (inFlight == 0) {
+            break;
+        }
+
+        // очередь accept сервера полна - SYN повторяются, ждем дальше
+        int eventsCount = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 1000);
+        for (int i = 0; i < eventsCount; ++i) {
+            int fd = events[i].data.fd;
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            --inFlight;
+            int error = 0;
+            socklen_t errorLength = sizeof(error);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLength);
+            if (error != 0) {
+                if (exhausted == false) {
+                    std::cout << "Ошибка подключения: " << strerror(error) << std::endl;
+                }
+                close(fd);
+                exhausted = true;
+                continue;
+            }
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            connections.push_back(fd);
+        }
+    }
+    return (exhausted == false);
+}
+
+// Редкие запросы: раз в SCALE_SPARSE_INTERVAL_US кадр случайному соединению,
+// время до полного ответа - задержка цикла сервера при таком числе соединений.
+// Соединения без ответа или с ошибкой закрываются и убираются из connections: поздний ответ
+// был бы принят за ответ на следующий запрос. Следующая ступень откроет их заново.
+static void sparseTraffic(int epollFd, std::vector<int>& connections, std::mt19937& random,
+                          std::vector<std::int64_t>& latencies, std::uint64_t& lost){
+    struct Pending {
+        std::chrono::steady_clock::time_point sentAt;
+        std::size_t received;
+        std::size_t expected;
+    };
+    std::unordered_map<int, Pending> pending;
+    std::unordered_set<int> broken;
+    std::uniform_int_distribution<std::size_t> pick(0, connections.size() - 1);
+
+    char frame[sizeof(benchmarkPayload)];
+    frame[0] = static_cast<char>(sizeof(benchmarkPayload) - 1);
+    memcpy(frame + 1, benchmarkPayload, sizeof(benchmarkPayload) - 1);
+
+    std::vector<epoll_event> events(256);
+    char buffer[4096];
+    auto startTime = std::chrono::steady_clock::now();
+    auto endTime = startTime + std::chrono::seconds(SCALE_SPARSE_SECONDS);
+    auto timeoutTime = endTime + std::chrono::seconds(SCALE_SPARSE_TIMEOUT_SECONDS);
+    auto nextSend = startTime;
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        if ((now >= endTime) && pending.empty()) {
+            break;
+        }
+        if (now >= timeoutTime) {
+            for (auto& it: pending) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, it.first, nullptr);
+                broken.insert(it.first);
+            }
+            lost += pending.size();
+            break;
+        }
+        if ((now < endTime) && (now >= nextSend)) {
+            nextSend += std::chrono::microseconds(SCALE_SPARSE_INTERVAL_US);
+            // на соединение - один запрос за раз
+            int fd = connections[pick(random)];
+            if ((pending.count(fd) == 0) && (broken.count(fd) == 0)) {
+                if (send(fd, frame, sizeof(frame), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(frame))) {
+                    broken.insert(fd);
+                    ++lost;
+                } else {
+                    epoll_event event;
+                    memset(&event, 0, sizeof(event));
+                    event.events = EPOLLIN;
+                    event.data.fd = fd;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+                    pending[fd] = Pending{now, 0, 0};
+                }
+            }
+        }
+
+        int eventsCount = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 1);
+        for (int i = 0; i < eventsCount; ++i) {
+            int fd = events[i].data.fd;
+            auto it = pending.find(fd);
+            if (it == pending.end()) {
+                continue;
+            }
+            Pending& request = it->second;
+            ssize_t readSize = recv(fd, buffer, sizeof(buffer), 0);
+            if (readSize <= 0) {
+                if ((readSize < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+                    continue;
+                }
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+                pending.erase(it);
+                broken.insert(fd);
+                ++lost;
+                continue;
+            }
+            if (request.expected == 0) {
+                request.expected = static_cast<unsigned char>(buffer[0]) + 1;
+            }
+            request.received += static_cast<std::size_t>(readSize);
+            if (request.received >= request.expected) {
+                auto latency = std::chrono::steady_clock::now() - request.sentAt;
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+                pending.erase(it);
+            }
+        }
+    }
+
+    if (broken.empty() == false) {
+        for (int fd: broken) {
+            close(fd);
+        }
+        connections.erase(std::remove_if(connections.begin(), connections.end(), [&broken](int fd){
+            return broken.count(fd) > 0;
+        }), connections.end());
+    }
+}
+
+int tcpConnectionsBenchmark(const char* serverAddress, std::uint16_t serverPort, int maxConnections, int stepConnections, int serverPid) {
+    sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(serverPort);
+    if (inet_pton(AF_INET, serverAddress, &serverAddr.sin_addr) != 1) {
+        std::cout << "Неверный адрес сервера: " << serverAddress << std::endl;
+        return 1;
+    }
+
+    // дескриптор на соединение: мягкий предел поднимается до жесткого
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < static_cast<rlim_t>(maxConnections) + 64) {
+            maxConnections = static_cast<int>(limit.rlim_cur) - 64;
+            std::cout << "Предел дескрипторов клиента " << limit.rlim_cur << ", соединений будет не больше " << maxConnections
+                      << " (ulimit -n поднимать и клиенту, и серверу)." << std::endl;
+        }
+    }
+    if ((stepConnections <= 0) || (stepConnections > maxConnections)) {
+        stepConnections = maxConnections;
+    }
+
+    // адресов источника столько, чтобы хватило эфемерных портов; только для сервера на loopback
+    int sourcesCount = 0;
+    if ((ntohl(serverAddr.sin_addr.s_addr) >> 24) == 127) {
+        int portsFirst = 32768;
+        int portsLast = 60999;
+        std::ifstream range("/proc/sys/net/ipv4/ip_local_port_range");
+        range >> portsFirst >> portsLast;
+        int portsPerSource = std::max(portsLast - portsFirst + 1, 1);
+        sourcesCount = std::min(maxConnections / portsPerSource + 1, 254);
+    }
+
+    if (serverPid == 0) {
+        serverPid = findListeningProcess(serverPort);
+    }
+    if (serverPid == 0) {
+        std::cout << "Процесс сервера не найден, RSS не замеряется." << std::endl;
+    }
+    std::size_t baseRSS = (serverPid > 0) ? processRSS(serverPid) : 0;
+    std::size_t baseKernel = kernelTCPMemory();
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        std::cout << "Ошибка epoll_create1: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::cout << "TCP connections benchmark: " << serverAddress << ":" << serverPort << ", server pid: " << serverPid
+              << ", up to " << maxConnections << " connections by " << stepConnections
+              << ", source addresses: " << std::max(sourcesCount, 1) << std::endl;
+
+    std::vector<int> connections;
+    connections.reserve(maxConnections);
+    std::mt19937 random(5555);
+    for (std::size_t target = stepConnections; ; target += stepConnections) {
+        target = std::min(target, static_cast<std::size_t>(maxConnections));
+
+        // скорость приема: очередь accept сервера сглаживает только первую тысячу соединений ступени
+        std::size_t openedBefore = connections.size();
+        auto connectStart = std::chrono::steady_clock::now();
+        bool canOpen = openConnections(epollFd, serverAddr, sourcesCount, target, connections);
+        double connectSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - connectStart).count();
+        std::size_t opened = connections.size() - openedBefore;
+        if (connections.empty()) {
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(SCALE_IDLE_SECONDS));
+        std::size_t rss = (serverPid > 0) ? processRSS(serverPid) : 0;
+        std::size_t kernel = kernelTCPMemory();
+
+        // замеры памяти - при этом числе соединений; после запросов часть может закрыться
+        std::size_t measured = connections.size();
+        std::vector<std::int64_t> latencies;
+        std::uint64_t lost = 0;
+        sparseTraffic(epollFd, connections, random, latencies, lost);
+        std::sort(latencies.begin(), latencies.end());
+
+        double count = static_cast<double>(measured);
+        std::cout << "Connections: " << measured
+                  << ", accept/s: " << static_cast<std::uint64_t>((connectSeconds > 0) ? opened / connectSeconds : 0)
+                  << ", server RSS: " << rss / (1024 * 1024) << " MB (" << static_cast<std::int64_t>((static_cast<double>(rss) - static_cast<double>(baseRSS)) / count) << " B/conn)"
+                  << ", kernel TCP: " << kernel / (1024 * 1024) << " MB (" << static_cast<std::int64_t>((static_cast<double>(kernel) - static_cast<double>(baseKernel)) / count) << " B/conn)";
+        if (latencies.empty() == false) {
+            std::cout << ", latency us p50/p99/max: " << latencies[latencies.size() / 2] << "/" << latencies[latencies.size() * 99 / 100] << "/" << latencies.back();
+        }
+        std::cout << ", requests: " << latencies.size() << ", lost: " << lost << std::endl;
+
+        if ((canOpen == false) || (target >= static_cast<std::size_t>(maxConnections))) {
+            break;
+        }
+    }
+
+    for (int fd: connections) {
+        close(fd);
+    }
+    close(epollFd);
+    return 0;
+}
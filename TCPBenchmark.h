@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// Эхо с кадрами MultiThreadedTCPFilter: connectionsCount соединений в режиме пинг-понг,
+// запросов в секунду и задержка ответа. Подходит и для tcp-filter, и для tcp-uring.
+// serverAddress "/путь" или "@имя" - Unix сокет сервера, serverPort тогда не нужен.
+int tcpEchoBenchmark(const char* serverAddress, std::uint16_t serverPort, int connectionsCount, int durationSeconds);
+
+// Тот же эхо-замер подряд через loopback TCP и через Unix сокет одного сервера,
+// таблица запросов в секунду и задержек для обоих транспортов.
+int tcpUnixLatencyBenchmark(const char* serverAddress, std::uint16_t serverPort, const char* unixPath, int connectionsCount, int durationSeconds);
+
+// Сколько соединений держит сервер: ступенями по stepConnections до maxConnections соединений
+// с 127.0.0.x (адресов столько, чтобы хватило портов), на каждой ступени - скорость приема,
+// RSS сервера на соединение после простоя и задержка ответа при редких запросах.
+// serverPid 0 - процесс ищется по слушающему порту.
+int tcpConnectionsBenchmark(const char* serverAddress, std::uint16_t serverPort, int maxConnections, int stepConnections, int serverPid);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+// libevent
+#include <event2/buffer.h>
+
+//////////////////////////////////////////////////
+// Кодеки кадров для TCPServer. Кодек - класс со статическими функциями:
+//   std::size_t frame(evbuffer* input, std::size_t& headerSize)
+//       полный размер кадра в начале input вместе с заголовком, 0 - заголовок еще не пришел;
+//       кадр может быть больше данных в input - сервер дождется остального
+//   template <typename Function> bool decode(const char* data, std::size_t size, Function&& function)
+//       данные кадра без заголовка в сообщение: function получает аргументы onMessage
+//       после соединения; false - ошибка протокола, соединение закрывается
+//   bool encode(evbuffer* output, const char* data, std::size_t size)
+//       или encode(evbuffer* output, const Message& message) - для TCPConnection::send;
+//       false - сообщение не помещается в кадр, в output ничего не записано
+// Вызовы разрешаются при компиляции и встраиваются в колбек чтения.
+// Цепочки из нескольких преобразований - Pipeline из TCPPipeline.h.
+//////////////////////////////////////////////////
+
+// Длина кадра в начале, SizeType байт в сетевом порядке.
+// LengthPrefixCodec<std::uint8_t> - протокол MultiThreadedTCPFilter.
+template <typename SizeType>
+struct LengthPrefixCodec {
+    static constexpr std::size_t headerLength = sizeof(SizeType);
+    static constexpr std::size_t maxPayloadSize = static_cast<SizeType>(~SizeType(0));
+
+    static std::size_t frame(evbuffer* input, std::size_t& headerSize){
+        headerSize = sizeof(SizeType);
+        unsigned char header[sizeof(SizeType)];
+        if (evbuffer_copyout(input, header, sizeof(header)) < static_cast<ev_ssize_t>(sizeof(header))) {
+            return 0;
+        }
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < sizeof(SizeType); ++i) {
+            size = (size << 8) | header[i];
+        }
+        return sizeof(SizeType) + size;
+    }
+
+    template <typename Function>
+    static bool decode(const char* data, std::size_t size, Function&& function){
+        function(data, size);
+        return true;
+    }
+
+    // заголовок кадра с данными size байт в out, size не больше maxPayloadSize
+    static void writeHeader(char* out, std::size_t size){
+        for (std::size_t i = 0; i < sizeof(SizeType); ++i) {
+            out[i] = static_cast<char>(size >> (8 * (sizeof(SizeType) - 1 - i)));
+        }
+    }
+
+    // данные длиннее maxPayloadSize не отправляются: на части их режет обработчик, кодек кадры не склеивает
+    static bool encode(evbuffer* output, const char* data, std::size_t size){
+        if (size > maxPayloadSize) {
+            return false;
+        }
+        char header[sizeof(SizeType)];
+        writeHeader(header, size);
+        evbuffer_add(output, header, sizeof(header));
+        return evbuffer_add(output, data, size) == 0;
+    }
+};
+
+// Без кадров: все прочитанное - одно сообщение, отправка как есть
+struct RawCodec {
+    static std::size_t frame(evbuffer* input, std::size_t& headerSize){
+        headerSize = 0;
+        return evbuffer_get_length(input);
+    }
+
+    template <typename Function>
+    static bool decode(const char* data, std::size_t size, Function&& function){
+        function(data, size);
+        return true;
+    }
+
+    static bool encode(evbuffer* output, const char* data, std::size_t size){
+        return evbuffer_add(output, data, size) == 0;
+    }
+};
@@ -0,0 +1,135 @@
+#include "TCPCoroutine.h"
+// std
+#include <iostream>
+#include <new>
+
+
+//////////////////////////////////////////////////
+// TCPCoroutineFramePool
+//////////////////////////////////////////////////
+
+// размеры кадров округляются до шага; больше последнего класса - обычный operator new
+static const std::size_t framesSizeStep = 64;
+static const std::size_t framesClassesCount = 64;
+// свободных кадров одного класса: больше - память возвращается в кучу
+static const std::size_t framesMaxCached = 4096;
+
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+struct FramePoolState {
+    FreeFrame* freeFrames[framesClassesCount];
+    std::size_t freeCount[framesClassesCount];
+    std::uint64_t allocated;
+    std::uint64_t reused;
+
+    FramePoolState():
+        allocated(0),
+        reused(0){
+        for (std::size_t i = 0; i < framesClassesCount; ++i) {
+            freeFrames[i] = nullptr;
+            freeCount[i] = 0;
+        }
+    }
+
+    ~FramePoolState(){
+        for (std::size_t i = 0; i < framesClassesCount; ++i) {
+            while (freeFrames[i]) {
+                FreeFrame* frame = freeFrames[i];
+                freeFrames[i] = frame->next;
+                ::operator delete(frame);
+            }
+        }
+    }
+};
+
+static thread_local FramePoolState framePool;
+
+void* TCPCoroutineFramePool::allocate(std::size_t size){
+    ++framePool.allocated;
+    std::size_t index = (size + framesSizeStep - 1) / framesSizeStep - 1;
+    if (index >= framesClassesCount) {
+        return ::operator new(size);
+    }
+    FreeFrame* frame = framePool.freeFrames[index];
+    if (frame) {
+        framePool.freeFrames[index] = frame->next;
+        --framePool.freeCount[index];
+        ++framePool.reused;
+        return frame;
+    }
+    return ::operator new((index + 1) * framesSizeStep);
+}
+
+void TCPCoroutineFramePool::release(void* frame, std::size_t size){
+    std::size_t index = (size + framesSizeStep - 1) / framesSizeStep - 1;
+    if (index >= framesClassesCount || framePool.freeCount[index] >= framesMaxCached) {
+        ::operator delete(frame);
+        return;
+    }
+    FreeFrame* freeFrame = static_cast<FreeFrame*>(frame);
+    freeFrame->next = framePool.freeFrames[index];
+    framePool.freeFrames[index] = freeFrame;
+    ++framePool.freeCount[index];
+}
+
+std::uint64_t TCPCoroutineFramePool::allocatedCount(){
+    return framePool.allocated;
+}
+
+std::uint64_t TCPCoroutineFramePool::reusedCount(){
+    return framePool.reused;
+}
+
+//////////////////////////////////////////////////
+// TCPCoroutineTask
+//////////////////////////////////////////////////
+TCPCoroutineTask TCPCoroutineTask::promise_type::get_return_object(){
+    return TCPCoroutineTask(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+std::suspend_always TCPCoroutineTask::promise_type::initial_suspend() noexcept{
+    return std::suspend_always();
+}
+
+std::suspend_always TCPCoroutineTask::promise_type::final_suspend() noexcept{
+    // кадр остается до destroy - соединение проверяет done() после каждого resume
+    return std::suspend_always();
+}
+
+void TCPCoroutineTask::promise_type::return_void(){
+}
+
+void TCPCoroutineTask::promise_type::unhandled_exception(){
+    std::cout << "Исключение в корутине соединения, соединение закрывается." << std::endl;
+}
+
+void* TCPCoroutineTask::promise_type::operator new(std::size_t size){
+    return TCPCoroutineFramePool::allocate(size);
+}
+
+void TCPCoroutineTask::promise_type::operator delete(void* frame, std::size_t size){
+    TCPCoroutineFramePool::release(frame, size);
+}
+
+TCPCoroutineTask::TCPCoroutineTask(std::coroutine_handle<promise_type> handle):
+    _handle(handle){
+}
+
+TCPCoroutineTask::TCPCoroutineTask(TCPCoroutineTask&& other) noexcept:
+    _handle(other._handle){
+    other._handle = nullptr;
+}
+
+TCPCoroutineTask::~TCPCoroutineTask(){
+    if (_handle) {
+        _handle.destroy();
+    }
+}
+
+std::coroutine_handle<> TCPCoroutineTask::release(){
+    std::coroutine_handle<> handle = _handle;
+    _handle = nullptr;
+    return handle;
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <coroutine>
+#include <unordered_set>
+// libevent
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+// server
+#include "TCPServer.h"
+
+//////////////////////////////////////////////////
+// Пул кадров корутин. Каждый event_base крутится в своем потоке, поэтому пул на поток -
+// это пул цикла: кадры сессий одного размера переиспользуются без malloc и блокировок.
+// Кадр освобождается в том же потоке, где выделен - соединение живет в потоке своего цикла.
+//////////////////////////////////////////////////
+class TCPCoroutineFramePool {
+public:
+    static void* allocate(std::size_t size);
+    static void release(void* frame, std::size_t size);
+
+    // статистика пула текущего потока
+    static std::uint64_t allocatedCount();
+    static std::uint64_t reusedCount();     // взято из пула без operator new
+};
+
+//////////////////////////////////////////////////
+// Корутина сессии соединения TCPCoroutineServer. Не стартует сама: первый resume
+// делает соединение, оно же уничтожает кадр после завершения или при закрытии.
+//////////////////////////////////////////////////
+class TCPCoroutineTask {
+public:
+    struct promise_type {
+        TCPCoroutineTask get_return_object();
+        std::suspend_always initial_suspend() noexcept;
+        std::suspend_always final_suspend() noexcept;
+        void return_void();
+        // исключение завершает сессию, соединение закрывается
+        void unhandled_exception();
+
+        static void* operator new(std::size_t size);
+        static void operator delete(void* frame, std::size_t size);
+    };
+
+    TCPCoroutineTask(TCPCoroutineTask&& other) noexcept;
+    ~TCPCoroutineTask();
+
+    TCPCoroutineTask(const TCPCoroutineTask&) = delete;
+    TCPCoroutineTask& operator=(const TCPCoroutineTask&) = delete;
+
+    // владение кадром переходит вызывающему
+    std::coroutine_handle<> release();
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+
+private:
+    explicit TCPCoroutineTask(std::coroutine_handle<promise_type> handle);
+};
+
+template <typename Codec, typename Handler>
+class TCPCoroutineServer;
+
+//////////////////////////////////////////////////
+// Соединение с сессией-корутиной. Ожидания возобновляются из колбеков bufferevent
+// в потоке event_base - блокировок и отдельных потоков нет.
+//   TCPFrame frame = co_await connection.readFrame();   // data == nullptr - соединение закрыто
+//   bool sent = co_await connection.write(data, size);  // false - соединение разорвано или кадр больше предела Codec
+// Кадр лежит прямо во входном буфере и действителен до следующего readFrame.
+// Codec - как у TCPServer (TCPCodec.h, TCPPipeline.h), decode должен отдавать байты.
+//////////////////////////////////////////////////
+struct TCPFrame {
+    const char* data;
+    std::size_t size;
+};
+
+template <typename Codec, typename Handler>
+class TCPCoroutineConnection {
+public:
+    typedef TCPCoroutineServer<Codec, Handler> Server;
+
+    // выходной буфер больше - write ждет, пока он не уйдет в сокет
+    static constexpr std::size_t writeHighWatermark = 64 * 1024;
+
+    class ReadAwaiter {
+    public:
+        explicit ReadAwaiter(TCPCoroutineConnection* connection);
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        TCPFrame await_resume();
+
+    private:
+        TCPCoroutineConnection* _connection;
+    };
+
+    class WriteAwaiter {
+    public:
+        WriteAwaiter(TCPCoroutineConnection* connection, bool encoded);
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume();
+
+    private:
+        TCPCoroutineConnection* _connection;
+        bool _encoded;          // false - Codec::encode отказал, ждать нечего
+    };
+
+    ReadAwaiter readFrame();
+    // кадр через Codec::encode сразу попадает в выходной буфер; ожидание - только при переполнении
+    template <typename... Message>
+    WriteAwaiter write(const Message&... message);
+    // новых кадров не будет, соединение закроется после выхода из корутины
+    void close();
+
+    bufferevent* bufferEvent() const;
+    Server& server() const;
+    // клиент на Unix сокете: pid, uid, gid процесса; false - TCP клиент
+    bool peerCredentials(ucred& credentials) const;
+
+public:
+    void* data;     // пользовательские данные соединения
+
+private:
+    friend class TCPCoroutineServer<Codec, Handler>;
+
+    Server* _server;
+    bufferevent* _bev;
+    std::coroutine_handle<> _coroutine;
+    std::coroutine_handle<> _reader;    // ждет кадр
+    std::coroutine_handle<> _writer;    // ждет отправки вывода
+    TCPFrame _frame;
+    std::size_t _consumed;      // выданный кадр, удаляется из буфера следующим readFrame
+    bool _eof;                  // собеседник закончил передачу: остались кадры в буфере
+    bool _broken;               // ошибка или таймаут: ни чтения, ни записи
+    bool _closing;
+
+private:
+    TCPCoroutineConnection(Server* server, bufferevent* bev);
+
+    bool takeFrame();
+    void resume(std::coroutine_handle<> handle);
+    void finish();
+
+    static void readCallback(bufferevent* bev, void* arg);
+    static void writeCallback(bufferevent* bev, void* arg);
+    static void eventCallback(bufferevent* bev, short events, void* arg);
+};
+
+//////////////////////////////////////////////////
+// TCP сервер одного event_base, где протокол соединения - последовательный код корутины:
+//   TCPCoroutineTask session(TCPCoroutineConnection<Codec, Handler>& connection);
+// Состояние запроса живет в локальных переменных корутины, кадр корутины - из пула цикла.
+// Остальное как у TCPServer: ограничения, TLS, по серверу на поток.
+//////////////////////////////////////////////////
+template <typename Codec, typename Handler>
+class TCPCoroutineServer {
+public:
+    typedef TCPCoroutineConnection<Codec, Handler> Connection;
+
+    TCPCoroutineServer(event_base* base, const TCPServerConfig& config, Handler& handler);
+    // открытые соединения закрываются, кадры их корутин уничтожаются
+    ~TCPCoroutineServer();
+
+    TCPCoroutineServer(const TCPCoroutineServer&) = delete;
+    TCPCoroutineServer& operator=(const TCPCoroutineServer&) = delete;
+
+    bool isValid() const;
+    bool bind();
+    bool accept(evutil_socket_t socket, evutil_socket_t unixSocket = -1);
+    evutil_socket_t socket() const;
+    evutil_socket_t unixSocket() const;
+
+    Handler& handler();
+    TCPServerCore& core();
+
+private:
+    friend class TCPCoroutineConnection<Codec, Handler>;
+
+    TCPServerCore _core;
+    Handler& _handler;
+    std::unordered_set<Connection*> _connections;
+
+private:
+    void destroy(Connection* connection);
+
+    static void connectedCallback(TCPServerCore& core, bufferevent* bev, void* arg);
+};
+
+//////////////////////////////////////////////////
+// TCPCoroutineConnection
+//////////////////////////////////////////////////
+template <typename Codec, typename Handler>
+TCPCoroutineConnection<Codec, Handler>::ReadAwaiter::ReadAwaiter(TCPCoroutineConnection* connection):
+    _connection(connection){
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineConnection<Codec, Handler>::ReadAwaiter::await_ready(){
+    return _connection->takeFrame();
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::ReadAwaiter::await_suspend(std::coroutine_handle<> handle){
+    _connection->_reader = handle;
+}
+
+template <typename Codec, typename Handler>
+TCPFrame TCPCoroutineConnection<Codec, Handler>::ReadAwaiter::await_resume(){
+    return _connection->_frame;
+}
+
+template <typename Codec, typename Handler>
+TCPCoroutineConnection<Codec, Handler>::WriteAwaiter::WriteAwaiter(TCPCoroutineConnection* connection, bool encoded):
+    _connection(connection),
+    _encoded(encoded){
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineConnection<Codec, Handler>::WriteAwaiter::await_ready(){
+    if (_connection->_broken || (_encoded == false)) {
+        return true;
+    }
+    return evbuffer_get_length(bufferevent_get_output(_connection->_bev)) <= writeHighWatermark;
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::WriteAwaiter::await_suspend(std::coroutine_handle<> handle){
+    // writeCallback вызовется, когда выходной буфер опустеет
+    _connection->_writer = handle;
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineConnection<Codec, Handler>::WriteAwaiter::await_resume(){
+    return (_connection->_broken == false) && _encoded;
+}
+
+template <typename Codec, typename Handler>
+TCPCoroutineConnection<Codec, Handler>::TCPCoroutineConnection(Server* server, bufferevent* bev):
+    data(nullptr),
+    _server(server),
+    _bev(bev),
+    _frame{nullptr, 0},
+    _consumed(0),
+    _eof(false),
+    _broken(false),
+    _closing(false){
+}
+
+template <typename Codec, typename Handler>
+typename TCPCoroutineConnection<Codec, Handler>::ReadAwaiter TCPCoroutineConnection<Codec, Handler>::readFrame(){
+    return ReadAwaiter(this);
+}
+
+template <typename Codec, typename Handler>
+template <typename... Message>
+typename TCPCoroutineConnection<Codec, Handler>::WriteAwaiter TCPCoroutineConnection<Codec, Handler>::write(const Message&... message){
+    bool encoded = (_broken == false) && Codec::encode(bufferevent_get_output(_bev), message...);
+    return WriteAwaiter(this, encoded);
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::close(){
+    _closing = true;
+    bufferevent_disable(_bev, EV_READ);
+}
+
+template <typename Codec, typename Handler>
+bufferevent* TCPCoroutineConnection<Codec, Handler>::bufferEvent() const{
+    return _bev;
+}
+
+template <typename Codec, typename Handler>
+typename TCPCoroutineConnection<Codec, Handler>::Server& TCPCoroutineConnection<Codec, Handler>::server() const{
+    return *_server;
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineConnection<Codec, Handler>::peerCredentials(ucred& credentials) const{
+    return getPeerCredentials(bufferevent_getfd(_bev), credentials);
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineConnection<Codec, Handler>::takeFrame(){
+    evbuffer* input = bufferevent_get_input(_bev);
+    if (_consumed > 0) {
+        evbuffer_unfreeze(input, 1);
+        evbuffer_drain(input, _consumed);
+        _consumed = 0;
+    }
+    _frame.data = nullptr;
+    _frame.size = 0;
+    if (_broken || _closing) {
+        return true;
+    }
+
+    std::size_t headerSize = 0;
+    std::size_t frameSize = Codec::frame(input, headerSize);
+    if (frameSize == 0 || evbuffer_get_length(input) < frameSize) {
+        // после EOF недостающая часть кадра уже не придет
+        return _eof;
+    }
+    if (frameSize - headerSize > _server->_core.config().maxMessageSize) {
+        close();
+        return true;
+    }
+    // лимит сообщений исчерпан - ограничитель сам вызовет колбек чтения позже
+    if (_server->_core.rateLimiter().allowMessage(_bev) == false) {
+        return false;
+    }
+
+    const char* data = reinterpret_cast<const char*>(evbuffer_pullup(input, static_cast<ev_ssize_t>(frameSize)));
+    bool valid = Codec::decode(data + headerSize, frameSize - headerSize, [this](const char* data, std::size_t size){
+        _frame.data = data;
+        _frame.size = size;
+    });
+    _consumed = frameSize;
+    // пока кадр у корутины, начало буфера не трогают (TCPMemoryBudget не переупакует)
+    if (valid) {
+        evbuffer_freeze(input, 1);
+    } else {
+        // ошибка протокола - корутина получает закрытие
+        _frame.data = nullptr;
+        _frame.size = 0;
+        close();
+    }
+    return true;
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::resume(std::coroutine_handle<> handle){
+    handle.resume();
+    // сессия закончилась - после finish соединения может уже не быть
+    if (_coroutine.done()) {
+        finish();
+    }
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::finish(){
+    // остаток вывода уйдет, затем writeCallback удалит соединение
+    bufferevent_disable(_bev, EV_READ);
+    if (_broken || evbuffer_get_length(bufferevent_get_output(_bev)) == 0) {
+        _server->destroy(this);
+    }
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::readCallback(bufferevent*, void* arg){
+    TCPCoroutineConnection* connection = static_cast<TCPCoroutineConnection*>(arg);
+    // корутина занята записью - данные подождут в буфере
+    if (!connection->_reader || connection->takeFrame() == false) {
+        return;
+    }
+    std::coroutine_handle<> reader = connection->_reader;
+    connection->_reader = nullptr;
+    connection->resume(reader);
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::writeCallback(bufferevent*, void* arg){
+    // вывод отправлен полностью
+    TCPCoroutineConnection* connection = static_cast<TCPCoroutineConnection*>(arg);
+    if (connection->_coroutine.done()) {
+        connection->_server->destroy(connection);
+        return;
+    }
+    if (!connection->_writer) {
+        return;
+    }
+    std::coroutine_handle<> writer = connection->_writer;
+    connection->_writer = nullptr;
+    connection->resume(writer);
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineConnection<Codec, Handler>::eventCallback(bufferevent*, short events, void* arg){
+    TCPCoroutineConnection* connection = static_cast<TCPCoroutineConnection*>(arg);
+    if ((events & (BEV_EVENT_EOF | BEV_EVENT_ERROR | BEV_EVENT_TIMEOUT)) == 0) {
+        return;
+    }
+    if (connection->_coroutine.done()) {
+        connection->_server->destroy(connection);
+        return;
+    }
+    if (events & BEV_EVENT_EOF) {
+        connection->_eof = true;
+    } else {
+        connection->_broken = true;
+    }
+
+    // корутина ждет только одно: кадр или отправку
+    if (connection->_reader && connection->takeFrame()) {
+        std::coroutine_handle<> reader = connection->_reader;
+        connection->_reader = nullptr;
+        connection->resume(reader);
+    } else if (connection->_writer && connection->_broken) {
+        std::coroutine_handle<> writer = connection->_writer;
+        connection->_writer = nullptr;
+        connection->resume(writer);
+    }
+}
+
+//////////////////////////////////////////////////
+// TCPCoroutineServer
+//////////////////////////////////////////////////
+template <typename Codec, typename Handler>
+TCPCoroutineServer<Codec, Handler>::TCPCoroutineServer(event_base* base, const TCPServerConfig& config, Handler& handler):
+    _core(base, config, connectedCallback, this),
+    _handler(handler){
+}
+
+template <typename Codec, typename Handler>
+TCPCoroutineServer<Codec, Handler>::~TCPCoroutineServer(){
+    while (_connections.empty() == false) {
+        destroy(*_connections.begin());
+    }
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineServer<Codec, Handler>::isValid() const{
+    return _core.isValid();
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineServer<Codec, Handler>::bind(){
+    return _core.bind();
+}
+
+template <typename Codec, typename Handler>
+bool TCPCoroutineServer<Codec, Handler>::accept(evutil_socket_t socket, evutil_socket_t unixSocket){
+    return _core.accept(socket, unixSocket);
+}
+
+template <typename Codec, typename Handler>
+evutil_socket_t TCPCoroutineServer<Codec, Handler>::socket() const{
+    return _core.socket();
+}
+
+template <typename Codec, typename Handler>
+evutil_socket_t TCPCoroutineServer<Codec, Handler>::unixSocket() const{
+    return _core.unixSocket();
+}
+
+template <typename Codec, typename Handler>
+Handler& TCPCoroutineServer<Codec, Handler>::handler(){
+    return _handler;
+}
+
+template <typename Codec, typename Handler>
+TCPServerCore& TCPCoroutineServer<Codec, Handler>::core(){
+    return _core;
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineServer<Codec, Handler>::destroy(Connection* connection){
+    if (_connections.erase(connection) == 0) {
+        return;
+    }
+    // кадр возвращается в пул, локальные переменные сессии разрушаются
+    if (connection->_coroutine) {
+        connection->_coroutine.destroy();
+    }
+    _core.release(connection->_bev);
+    delete connection;
+}
+
+template <typename Codec, typename Handler>
+void TCPCoroutineServer<Codec, Handler>::connectedCallback(TCPServerCore&, bufferevent* bev, void* arg){
+    TCPCoroutineServer* server = static_cast<TCPCoroutineServer*>(arg);
+    Connection* connection = new Connection(server, bev);
+    server->_connections.insert(connection);
+
+    bufferevent_setcb(bev, Connection::readCallback, Connection::writeCallback, Connection::eventCallback, connection);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+
+    // сессия идет до первого ожидания
+    connection->_coroutine = server->_handler.session(*connection).release();
+    connection->resume(connection->_coroutine);
+}
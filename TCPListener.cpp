@@ -0,0 +1,136 @@
+#include "TCPListener.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+// system
+#include <netinet/in.h>
+#include <arpa/inet.h>
+// server
+#include "UnixSocket.h"
+
+
+TCPListener::TCPListener(event_base* base, TCPAcceptHandler handler, void* arg):
+    _base(base),
+    _handler(handler),
+    _arg(arg),
+    _listener(nullptr),
+    _retryEvent(evtimer_new(base, retryCallback, this)),
+    _paused(false){
+}
+
+TCPListener::~TCPListener(){
+    if (_retryEvent) {
+        event_free(_retryEvent);
+    }
+    if (_listener) {
+        evconnlistener_free(_listener);
+    }
+    removeUnixSocket(_unixPath.c_str());
+}
+
+bool TCPListener::bind(const char* address, std::uint16_t port, int backlog){
+    sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &sin.sin_addr) != 1) {
+        std::cout << "Неверный адрес сервера: " << address << std::endl;
+        return false;
+    }
+
+    unsigned flags = LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_REUSEABLE;
+    evconnlistener* listener = evconnlistener_new_bind(_base, acceptCallback, this, flags, backlog,
+                                                       reinterpret_cast<sockaddr*>(&sin), sizeof(sin));
+    if (listener == nullptr) {
+        std::cout << "Ошибка привязки к " << address << ":" << port << std::endl;
+        return false;
+    }
+    return listen(listener);
+}
+
+bool TCPListener::bindUnix(const char* path, int backlog){
+    evutil_socket_t socket = bindUnixSocket(path, SOCK_STREAM, backlog);
+    if (socket < 0) {
+        return false;
+    }
+    // сокет уже слушает: backlog 0
+    evconnlistener* listener = evconnlistener_new(_base, acceptCallback, this, LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC, 0, socket);
+    if (listener == nullptr) {
+        std::cout << "Ошибка создания листенера " << path << std::endl;
+        evutil_closesocket(socket);
+        removeUnixSocket(path);
+        return false;
+    }
+    _unixPath = path;
+    return listen(listener);
+}
+
+bool TCPListener::accept(evutil_socket_t socket){
+    // сокет уже слушает, владелец - другой листенер
+    evconnlistener* listener = evconnlistener_new(_base, acceptCallback, this, LEV_OPT_CLOSE_ON_EXEC, 0, socket);
+    if (listener == nullptr) {
+        std::cout << "Ошибка приема на общем сокете." << std::endl;
+        return false;
+    }
+    return listen(listener);
+}
+
+bool TCPListener::listen(evconnlistener* listener){
+    if (_listener) {
+        evconnlistener_free(_listener);
+    }
+    _listener = listener;
+    evconnlistener_set_error_cb(_listener, errorCallback);
+    return true;
+}
+
+void TCPListener::pause(){
+    _paused = true;
+    if (_listener) {
+        evconnlistener_disable(_listener);
+    }
+}
+
+void TCPListener::resume(){
+    _paused = false;
+    if (_retryEvent) {
+        evtimer_del(_retryEvent);
+    }
+    if (_listener) {
+        evconnlistener_enable(_listener);
+    }
+}
+
+evutil_socket_t TCPListener::socket() const{
+    return _listener ? evconnlistener_get_fd(_listener) : -1;
+}
+
+void TCPListener::acceptCallback(evconnlistener*, evutil_socket_t fd, sockaddr* address, int addressLength, void* arg){
+    TCPListener* listener = static_cast<TCPListener*>(arg);
+    listener->_handler(fd, address, addressLength, listener->_arg);
+}
+
+void TCPListener::errorCallback(evconnlistener* listener, void* arg){
+    TCPListener* thisObj = static_cast<TCPListener*>(arg);
+    int error = EVUTIL_SOCKET_ERROR();
+    std::cout << "Ошибка " << error << " (" << evutil_socket_error_to_string(error) << ") в мониторе соединений." << std::endl;
+
+    // соединение остается в очереди ядра, сокет сразу снова читаем - без паузы цикл крутится вхолостую
+    if ((error == EMFILE) || (error == ENFILE) || (error == ENOBUFS) || (error == ENOMEM)) {
+        evconnlistener_disable(listener);
+        if (thisObj->_retryEvent) {
+            timeval delay;
+            delay.tv_sec = 0;
+            delay.tv_usec = ACCEPT_RETRY_MS * 1000;
+            evtimer_add(thisObj->_retryEvent, &delay);
+        }
+    }
+}
+
+void TCPListener::retryCallback(evutil_socket_t, short, void* arg){
+    TCPListener* thisObj = static_cast<TCPListener*>(arg);
+    if ((thisObj->_paused == false) && thisObj->_listener) {
+        evconnlistener_enable(thisObj->_listener);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+// libevent
+#include <event2/event.h>
+#include <event2/listener.h>
+// system
+#include <sys/socket.h>
+
+// новое соединение: fd принадлежит обработчику
+typedef void (*TCPAcceptHandler)(evutil_socket_t fd, sockaddr* address, int addressLength, void* arg);
+
+//////////////////////////////////////////////////
+// Слушающий сокет одного event_base. Первый листенер привязывается к адресу,
+// листенеры других потоков принимают с того же сокета (как HTTPServer::accept).
+// Работает только в потоке своего event_base.
+//////////////////////////////////////////////////
+class TCPListener {
+public:
+    TCPListener(event_base* base, TCPAcceptHandler handler, void* arg);
+    ~TCPListener();
+
+    TCPListener(const TCPListener&) = delete;
+    TCPListener& operator=(const TCPListener&) = delete;
+
+    // свой слушающий сокет на address:port, сокет закрывается вместе с листенером
+    bool bind(const char* address, std::uint16_t port, int backlog);
+    // свой Unix сокет (см. UnixSocket.h), файл сокета удаляется вместе с листенером
+    bool bindUnix(const char* path, int backlog);
+    // общий слушающий сокет другого листенера
+    bool accept(evutil_socket_t socket);
+
+    // прием приостанавливается, клиенты ждут в очереди ядра.
+    // При нехватке дескрипторов (EMFILE, ENFILE) листенер сам отключается и повторяет прием через ACCEPT_RETRY_MS
+    void pause();
+    void resume();
+
+    evutil_socket_t socket() const;
+
+private:
+    event_base* _base;
+    TCPAcceptHandler _handler;
+    void* _arg;
+    evconnlistener* _listener;
+    std::string _unixPath;      // файл своего Unix сокета
+    event* _retryEvent;         // повтор приема после нехватки дескрипторов
+    bool _paused;               // приостановлен через pause - повтор не включает прием
+
+private:
+    static const int ACCEPT_RETRY_MS = 100;
+
+    bool listen(evconnlistener* listener);
+
+    static void acceptCallback(evconnlistener*, evutil_socket_t fd, sockaddr* address, int addressLength, void* arg);
+    static void errorCallback(evconnlistener* listener, void* arg);
+    static void retryCallback(evutil_socket_t, short, void* arg);
+};
@@ -0,0 +1,237 @@
+#include "TCPMemoryBudget.h"
+// std
+#include <iostream>
+#include <vector>
+
+
+// шаг сброса счетчиков в общие и отсчета простоя
+#define TCP_MEMORY_TICK_SECONDS 1
+
+TCPMemoryConfig::TCPMemoryConfig():
+    connectionInputLimit(256 * 1024),
+    globalLimit(0),
+    idleSeconds(30){
+}
+
+//////////////////////////////////////////////////
+// TCPMemoryCounters
+//////////////////////////////////////////////////
+TCPMemoryCounters::TCPMemoryCounters():
+    _bytes(0),
+    _peak(0){
+}
+
+void TCPMemoryCounters::add(std::int64_t delta){
+    std::int64_t bytes = _bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+    std::int64_t peak = _peak.load(std::memory_order_relaxed);
+    while ((bytes > peak) && (_peak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed) == false)) {
+    }
+}
+
+std::size_t TCPMemoryCounters::bytes() const{
+    std::int64_t bytes = _bytes.load(std::memory_order_relaxed);
+    return (bytes > 0) ? static_cast<std::size_t>(bytes) : 0;
+}
+
+std::size_t TCPMemoryCounters::peakBytes() const{
+    return static_cast<std::size_t>(_peak.load(std::memory_order_relaxed));
+}
+
+void printTCPMemoryStats(const TCPMemoryStats& stats){
+    std::cout << "Память буферов цикла: " << stats.bufferedBytes << " байт в " << stats.connections << " соединениях"
+              << ", пик: " << stats.peakBufferedBytes
+              << ", переупаковано буферов: " << stats.compactedBuffers << " (" << stats.compactedBytes << " байт)"
+              << ", отклонено по памяти: " << stats.rejected << std::endl;
+}
+
+//////////////////////////////////////////////////
+// TCPMemoryBudget
+//////////////////////////////////////////////////
+TCPMemoryBudget::TCPMemoryBudget(event_base* base, const TCPMemoryConfig& config, TCPMemoryCounters* counters):
+    _base(base),
+    _config(config),
+    _counters(counters),
+    _timer(nullptr),
+    _bytes(0),
+    _peak(0),
+    _published(0),
+    _ticks(0),
+    _sweeps(0),
+    _compacted(0),
+    _compactedBytes(0),
+    _rejected(0),
+    _compacting(false){
+    _timer = event_new(base, -1, EV_PERSIST, timerCallback, this);
+    timeval tick;
+    tick.tv_sec = TCP_MEMORY_TICK_SECONDS;
+    tick.tv_usec = 0;
+    if ((_timer == nullptr) || (evtimer_add(_timer, &tick) != 0)) {
+        std::cout << "Ошибка создания таймера учета памяти." << std::endl;
+    }
+}
+
+TCPMemoryBudget::~TCPMemoryBudget(){
+    if (_timer) {
+        event_free(_timer);
+    }
+    // соединения должны быть уже отключены - колбеки буферов не переживут Connection
+    for (auto& it: _connections) {
+        Connection* connection = it.second;
+        for (std::size_t i = 0; i < connection->levels; ++i) {
+            evbuffer_remove_cb_entry(bufferevent_get_input(connection->bevs[i]), connection->callbacks[i * 2]);
+            evbuffer_remove_cb_entry(bufferevent_get_output(connection->bevs[i]), connection->callbacks[i * 2 + 1]);
+        }
+        delete connection;
+    }
+    _bytes = 0;
+    publish();
+}
+
+bool TCPMemoryBudget::attach(bufferevent* bev){
+    publish();
+    if ((_config.globalLimit > 0) && (_counters != nullptr) && (_counters->bytes() >= _config.globalLimit)) {
+        ++_rejected;
+        return false;
+    }
+
+    Connection* connection = new Connection();
+    connection->budget = this;
+    connection->levels = 0;
+    connection->bytes = 0;
+    connection->activeSweep = _sweeps;
+    connection->listed = false;
+    // фильтры и TLS: данные лежат и в буферах под верхним bufferevent
+    for (bufferevent* level = bev; (level != nullptr) && (connection->levels < maxLevels); level = bufferevent_get_underlying(level)) {
+        std::size_t index = connection->levels++;
+        connection->bevs[index] = level;
+        evbuffer* input = bufferevent_get_input(level);
+        evbuffer* output = bufferevent_get_output(level);
+        connection->bytes += evbuffer_get_length(input) + evbuffer_get_length(output);
+        connection->callbacks[index * 2] = evbuffer_add_cb(input, bufferCallback, connection);
+        connection->callbacks[index * 2 + 1] = evbuffer_add_cb(output, bufferCallback, connection);
+        if (_config.connectionInputLimit > 0) {
+            bufferevent_setwatermark(level, EV_READ, 0, _config.connectionInputLimit);
+        }
+    }
+    _bytes += connection->bytes;
+    _connections[bev] = connection;
+    return true;
+}
+
+void TCPMemoryBudget::detach(bufferevent* bev){
+    auto it = _connections.find(bev);
+    if (it == _connections.end()) {
+        return;
+    }
+    Connection* connection = it->second;
+    _connections.erase(it);
+    if (connection->listed) {
+        _buffered.erase(connection);
+    }
+    for (std::size_t i = 0; i < connection->levels; ++i) {
+        evbuffer_remove_cb_entry(bufferevent_get_input(connection->bevs[i]), connection->callbacks[i * 2]);
+        evbuffer_remove_cb_entry(bufferevent_get_output(connection->bevs[i]), connection->callbacks[i * 2 + 1]);
+    }
+    _bytes -= connection->bytes;
+    delete connection;
+}
+
+const TCPMemoryConfig& TCPMemoryBudget::config() const{
+    return _config;
+}
+
+TCPMemoryStats TCPMemoryBudget::stats() const{
+    TCPMemoryStats stats;
+    stats.connections = _connections.size();
+    stats.bufferedBytes = _bytes;
+    stats.peakBufferedBytes = _peak;
+    stats.compactedBuffers = _compacted;
+    stats.compactedBytes = _compactedBytes;
+    stats.rejected = _rejected;
+    return stats;
+}
+
+void TCPMemoryBudget::publish(){
+    if (_counters == nullptr) {
+        return;
+    }
+    std::int64_t bytes = static_cast<std::int64_t>(_bytes);
+    if (bytes != _published) {
+        _counters->add(bytes - _published);
+        _published = bytes;
+    }
+}
+
+void TCPMemoryBudget::sweep(){
+    ++_sweeps;
+    for (auto it = _buffered.begin(); it != _buffered.end();) {
+        Connection* connection = *it;
+        if (connection->bytes == 0) {
+            connection->listed = false;
+            it = _buffered.erase(it);
+            continue;
+        }
+        // без изменений буферов весь прошлый интервал
+        if (connection->activeSweep + 1 < _sweeps) {
+            compact(connection);
+        }
+        ++it;
+    }
+}
+
+void TCPMemoryBudget::compact(Connection* connection){
+    _compacting = true;
+    std::vector<char> data;
+    for (std::size_t i = 0; i < connection->levels; ++i) {
+        evbuffer* input = bufferevent_get_input(connection->bevs[i]);
+        std::size_t length = evbuffer_get_length(input);
+        if (length == 0) {
+            continue;
+        }
+        data.resize(length);
+        evbuffer_copyout(input, data.data(), length);
+        // начало буфера заморожено - на эти данные еще есть указатели
+        if (evbuffer_drain(input, length) != 0) {
+            continue;
+        }
+        // конец входного буфера сокета libevent морозит вне чтения - данные возвращаются в начало
+        evbuffer_prepend(input, data.data(), length);
+        ++_compacted;
+        _compactedBytes += length;
+    }
+    _compacting = false;
+    // следующий раз - только после новой активности и нового простоя
+    connection->activeSweep = _sweeps;
+}
+
+void TCPMemoryBudget::bufferCallback(evbuffer*, const evbuffer_cb_info* info, void* arg){
+    Connection* connection = static_cast<Connection*>(arg);
+    TCPMemoryBudget* budget = connection->budget;
+    if ((info->n_added == 0) && (info->n_deleted == 0)) {
+        return;
+    }
+    connection->bytes += info->n_added;
+    connection->bytes -= info->n_deleted;
+    budget->_bytes += info->n_added;
+    budget->_bytes -= info->n_deleted;
+    if (budget->_bytes > budget->_peak) {
+        budget->_peak = budget->_bytes;
+    }
+    if (budget->_compacting) {
+        return;
+    }
+    connection->activeSweep = budget->_sweeps;
+    if ((connection->listed == false) && (connection->bytes > 0)) {
+        connection->listed = true;
+        budget->_buffered.insert(connection);
+    }
+}
+
+void TCPMemoryBudget::timerCallback(evutil_socket_t, short, void* arg){
+    TCPMemoryBudget* budget = static_cast<TCPMemoryBudget*>(arg);
+    budget->publish();
+    ++budget->_ticks;
+    if ((budget->_config.idleSeconds > 0) && (budget->_ticks % (budget->_config.idleSeconds / TCP_MEMORY_TICK_SECONDS) == 0)) {
+        budget->sweep();
+    }
+}
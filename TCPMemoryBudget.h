@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+// libevent
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+
+//////////////////////////////////////////////////
+// Память буферов TCP сервера. 0 - без ограничения.
+//////////////////////////////////////////////////
+struct TCPMemoryConfig {
+    std::size_t connectionInputLimit;   // high-watermark чтения каждого bufferevent соединения
+    std::size_t globalLimit;            // данные в буферах всех циклов: больше - новые соединения отклоняются
+    int idleSeconds;                    // простой, после которого входные буферы переупаковываются
+
+    TCPMemoryConfig();
+};
+
+//////////////////////////////////////////////////
+// Байты в буферах всех циклов. Циклы сбрасывают сюда свои изменения раз в секунду
+// и при приеме соединения, а не на каждое изменение буфера.
+//////////////////////////////////////////////////
+class TCPMemoryCounters {
+public:
+    TCPMemoryCounters();
+
+    TCPMemoryCounters(const TCPMemoryCounters&) = delete;
+    TCPMemoryCounters& operator=(const TCPMemoryCounters&) = delete;
+
+    void add(std::int64_t delta);
+
+    std::size_t bytes() const;
+    // пик по сброшенным значениям, кратковременные всплески внутри секунды не видны
+    std::size_t peakBytes() const;
+
+private:
+    std::atomic<std::int64_t> _bytes;
+    std::atomic<std::int64_t> _peak;
+};
+
+struct TCPMemoryStats {
+    std::size_t connections;
+    std::size_t bufferedBytes;          // данные в буферах соединений цикла
+    std::size_t peakBufferedBytes;
+    std::uint64_t compactedBuffers;     // входных буферов, переупакованных при простое
+    std::uint64_t compactedBytes;
+    std::uint64_t rejected;             // соединений отклонено по общему пределу
+};
+
+// строка статистики цикла в std::cout
+void printTCPMemoryStats(const TCPMemoryStats& stats);
+
+//////////////////////////////////////////////////
+// Учет памяти соединений одного event_base, работает только в его потоке.
+// Байты считаются колбеками evbuffer всех уровней bufferevent (фильтры, TLS, сокет),
+// рост входных буферов ограничен high-watermark чтения. Раз в idleSeconds входные
+// буферы соединений без активности переупаковываются: недочитанный хвост кадра
+// переносится из крупных цепочек прошлого чтения в одну цепочку по размеру.
+// Пустые буферы libevent освобождает сам при полном вычитывании.
+//////////////////////////////////////////////////
+class TCPMemoryBudget {
+public:
+    // counters - общие счетчики всех циклов, может быть nullptr
+    TCPMemoryBudget(event_base* base, const TCPMemoryConfig& config, TCPMemoryCounters* counters);
+    ~TCPMemoryBudget();
+
+    TCPMemoryBudget(const TCPMemoryBudget&) = delete;
+    TCPMemoryBudget& operator=(const TCPMemoryBudget&) = delete;
+
+    // Из колбека accept, bev - верхний bufferevent соединения.
+    // false - превышен общий предел памяти, bev надо освободить.
+    bool attach(bufferevent* bev);
+    // перед bufferevent_free
+    void detach(bufferevent* bev);
+
+    const TCPMemoryConfig& config() const;
+    TCPMemoryStats stats() const;
+
+private:
+    // верхний bufferevent и все, что под ним
+    static const std::size_t maxLevels = 4;
+
+    struct Connection {
+        TCPMemoryBudget* budget;
+        std::size_t levels;
+        bufferevent* bevs[maxLevels];
+        evbuffer_cb_entry* callbacks[maxLevels * 2];
+        std::size_t bytes;
+        std::uint64_t activeSweep;      // номер обхода, во время которого менялись буферы
+        bool listed;                    // в _buffered
+    };
+
+    event_base* _base;
+    TCPMemoryConfig _config;
+    TCPMemoryCounters* _counters;
+    event* _timer;
+    std::unordered_map<bufferevent*, Connection*> _connections;
+    // соединения с данными в буферах; опустевшие удаляются при обходе
+    std::unordered_set<Connection*> _buffered;
+    std::size_t _bytes;
+    std::size_t _peak;
+    std::int64_t _published;            // часть _bytes, уже учтенная в _counters
+    std::uint64_t _ticks;
+    std::uint64_t _sweeps;
+    std::uint64_t _compacted;
+    std::uint64_t _compactedBytes;
+    std::uint64_t _rejected;
+    bool _compacting;                   // переупаковка не считается активностью
+
+private:
+    void publish();
+    void sweep();
+    void compact(Connection* connection);
+
+    static void bufferCallback(evbuffer* buffer, const evbuffer_cb_info* info, void* arg);
+    static void timerCallback(evutil_socket_t, short, void* arg);
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+// libevent
+#include <event2/buffer.h>
+// zlib
+#include <zlib.h>
+
+//////////////////////////////////////////////////
+// Протокол из стадий, собранный при компиляции, вместо цепочки bufferevent_filter_new.
+// Pipeline<Framing, Stages...> - кодек TCPServer (см. TCPCodec.h):
+//   Framing - кодек кадров с headerLength, maxPayloadSize и writeHeader (LengthPrefixCodec)
+//   Stages  - преобразования данных кадра по порядку от сети к обработчику
+// Промежуточных evbuffer и вызовов по указателям нет: кадр разбирается прямо во входном
+// буфере bufferevent, ответ собирается в зарезервированном месте выходного буфера.
+//
+// Стадия - класс со статическими функциями, Next - оставшаяся часть цепочки:
+//   template <typename Next, typename Function>
+//   bool decode(const char* data, std::size_t size, Function& function)
+//       проверить, преобразовать и передать дальше через Next::decode; false - ошибка протокола
+//   template <typename Next, typename... Message>
+//   std::size_t encodedSize(const Message&... message)
+//   template <typename Next, typename... Message>
+//   char* encode(char* out, const Message&... message)
+//       записать в out ровно encodedSize байт, вернуть конец записанного
+//////////////////////////////////////////////////
+
+template <typename... Stages>
+struct PipelineChain;
+
+// конец цепочки: сообщение - байты кадра
+template <>
+struct PipelineChain<> {
+    template <typename Function>
+    static bool decode(const char* data, std::size_t size, Function& function){
+        function(data, size);
+        return true;
+    }
+
+    static std::size_t encodedSize(const char*, std::size_t size){
+        return size;
+    }
+
+    static char* encode(char* out, const char* data, std::size_t size){
+        memcpy(out, data, size);
+        return out + size;
+    }
+};
+
+template <typename Stage, typename... Stages>
+struct PipelineChain<Stage, Stages...> {
+    typedef PipelineChain<Stages...> Next;
+
+    template <typename Function>
+    static bool decode(const char* data, std::size_t size, Function& function){
+        return Stage::template decode<Next>(data, size, function);
+    }
+
+    template <typename... Message>
+    static std::size_t encodedSize(const Message&... message){
+        return Stage::template encodedSize<Next>(message...);
+    }
+
+    template <typename... Message>
+    static char* encode(char* out, const Message&... message){
+        return Stage::template encode<Next>(out, message...);
+    }
+};
+
+template <typename Framing, typename... Stages>
+struct Pipeline {
+    typedef PipelineChain<Stages...> Chain;
+
+    static std::size_t frame(evbuffer* input, std::size_t& headerSize){
+        return Framing::frame(input, headerSize);
+    }
+
+    template <typename Function>
+    static bool decode(const char* data, std::size_t size, Function&& function){
+        return Chain::decode(data, size, function);
+    }
+
+    // кадр целиком собирается в одном зарезервированном куске выходного буфера;
+    // false - сообщение не помещается в кадр Framing, ничего не записано
+    template <typename... Message>
+    static bool encode(evbuffer* output, const Message&... message){
+        std::size_t size = Chain::encodedSize(message...);
+        if (size > Framing::maxPayloadSize) {
+            return false;
+        }
+        std::size_t frameSize = Framing::headerLength + size;
+        evbuffer_iovec space;
+        if (evbuffer_reserve_space(output, static_cast<ev_ssize_t>(frameSize), &space, 1) != 1) {
+            std::cout << "Ошибка резервирования места в выходном буфере." << std::endl;
+            return false;
+        }
+        char* out = static_cast<char*>(space.iov_base);
+        Framing::writeHeader(out, size);
+        Chain::encode(out + Framing::headerLength, message...);
+        space.iov_len = frameSize;
+        return evbuffer_commit_space(output, &space, 1) == 0;
+    }
+};
+
+//////////////////////////////////////////////////
+// CRC32 данных в конце кадра, 4 байта в сетевом порядке.
+// Кадр с неверной суммой - ошибка протокола.
+//////////////////////////////////////////////////
+struct ChecksumStage {
+    static constexpr std::size_t trailerLength = 4;
+
+    static std::uint32_t checksum(const char* data, std::size_t size){
+        return static_cast<std::uint32_t>(crc32_z(0L, reinterpret_cast<const Bytef*>(data), size));
+    }
+
+    template <typename Next, typename Function>
+    static bool decode(const char* data, std::size_t size, Function& function){
+        if (size < trailerLength) {
+            return false;
+        }
+        size -= trailerLength;
+        const unsigned char* trailer = reinterpret_cast<const unsigned char*>(data + size);
+        std::uint32_t expected = (static_cast<std::uint32_t>(trailer[0]) << 24) | (static_cast<std::uint32_t>(trailer[1]) << 16) |
+                                 (static_cast<std::uint32_t>(trailer[2]) << 8) | static_cast<std::uint32_t>(trailer[3]);
+        if (checksum(data, size) != expected) {
+            return false;
+        }
+        return Next::decode(data, size, function);
+    }
+
+    template <typename Next, typename... Message>
+    static std::size_t encodedSize(const Message&... message){
+        return Next::encodedSize(message...) + trailerLength;
+    }
+
+    // сумма считается по уже записанным следующими стадиями данным
+    template <typename Next, typename... Message>
+    static char* encode(char* out, const Message&... message){
+        char* end = Next::encode(out, message...);
+        std::uint32_t sum = checksum(out, static_cast<std::size_t>(end - out));
+        end[0] = static_cast<char>(sum >> 24);
+        end[1] = static_cast<char>(sum >> 16);
+        end[2] = static_cast<char>(sum >> 8);
+        end[3] = static_cast<char>(sum);
+        return end + trailerLength;
+    }
+};
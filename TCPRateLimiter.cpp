@@ -0,0 +1,348 @@
+#include "TCPRateLimiter.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+// system
+#include <netinet/in.h>
+// server
+#include "UnixSocket.h"
+
+
+// шаг пополнения ведер байтов libevent: меньше шаг - ровнее поток, но чаще таймеры
+#define TCP_RATE_LIMIT_TICK_MS 100
+
+TCPRateLimitConfig::TCPRateLimitConfig():
+    connectionBytesPerSecond(1024 * 1024),
+    connectionBurstBytes(256 * 1024),
+    addressBytesPerSecond(4 * 1024 * 1024),
+    addressBurstBytes(1024 * 1024),
+    connectionMessagesPerSecond(50),
+    connectionBurstMessages(20),
+    addressMessagesPerSecond(200),
+    addressBurstMessages(100),
+    maxConnectionsPerAddress(256){
+}
+
+TCPRateLimitConfig TCPRateLimitConfig::unlimited(){
+    TCPRateLimitConfig config;
+    config.connectionBytesPerSecond = 0;
+    config.connectionBurstBytes = 0;
+    config.addressBytesPerSecond = 0;
+    config.addressBurstBytes = 0;
+    config.connectionMessagesPerSecond = 0;
+    config.connectionBurstMessages = 0;
+    config.addressMessagesPerSecond = 0;
+    config.addressBurstMessages = 0;
+    config.maxConnectionsPerAddress = 0;
+    return config;
+}
+
+//////////////////////////////////////////////////
+// TCPAddressCounters
+//////////////////////////////////////////////////
+TCPAddressCounters::TCPAddressCounters(std::size_t slotsCount):
+    _mask(0){
+    std::size_t size = 1;
+    while (size < slotsCount) {
+        size <<= 1;
+    }
+    _slots.reset(new std::atomic<std::uint32_t>[size]);
+    for (std::size_t i = 0; i < size; ++i) {
+        _slots[i].store(0, std::memory_order_relaxed);
+    }
+    _mask = size - 1;
+}
+
+bool TCPAddressCounters::acquire(std::size_t addressHash, std::uint32_t limit){
+    std::atomic<std::uint32_t>& slot = _slots[addressHash & _mask];
+    std::uint32_t current = slot.load(std::memory_order_relaxed);
+    do {
+        if (current >= limit) {
+            return false;
+        }
+    } while (slot.compare_exchange_weak(current, current + 1, std::memory_order_relaxed) == false);
+    return true;
+}
+
+void TCPAddressCounters::release(std::size_t addressHash){
+    _slots[addressHash & _mask].fetch_sub(1, std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////
+// TCPTokenBucket
+//////////////////////////////////////////////////
+TCPTokenBucket::TCPTokenBucket():
+    _rate(0),
+    _burst(0),
+    _tokens(0),
+    _updated(0){
+}
+
+void TCPTokenBucket::configure(double rate, double burst, std::int64_t nowMicroseconds){
+    _rate = rate;
+    // хотя бы одно сообщение должно помещаться в ведро
+    _burst = std::max(burst, 1.0);
+    _tokens = _burst;
+    _updated = nowMicroseconds;
+}
+
+bool TCPTokenBucket::isLimited() const{
+    return _rate > 0;
+}
+
+void TCPTokenBucket::refill(std::int64_t nowMicroseconds){
+    if ((isLimited() == false) || (nowMicroseconds <= _updated)) {
+        return;
+    }
+    double added = static_cast<double>(nowMicroseconds - _updated) * _rate / 1000000.0;
+    _tokens = std::min(_burst, _tokens + added);
+    _updated = nowMicroseconds;
+}
+
+bool TCPTokenBucket::hasTokens(double count) const{
+    return (isLimited() == false) || (_tokens >= count);
+}
+
+void TCPTokenBucket::take(double count){
+    if (isLimited()) {
+        _tokens -= count;
+    }
+}
+
+std::int64_t TCPTokenBucket::waitMicroseconds(double count) const{
+    if (hasTokens(count)) {
+        return 0;
+    }
+    return static_cast<std::int64_t>(std::ceil((count - _tokens) * 1000000.0 / _rate));
+}
+
+//////////////////////////////////////////////////
+// TCPRateLimiter
+//////////////////////////////////////////////////
+
+// ключ адреса: байты IPv4/IPv6, IPv4 внутри IPv6 - как IPv4; Unix сокет - 'p' и pid клиента
+// (адреса у клиентов Unix сокета обычно нет); остальные семейства - один общий ключ
+static std::string addressKey(const sockaddr* address, evutil_socket_t fd){
+    if (address == nullptr) {
+        return std::string();
+    }
+    if (address->sa_family == AF_UNIX) {
+        ucred credentials;
+        if (getPeerCredentials(fd, credentials) == false) {
+            return std::string();
+        }
+        // по uid все процессы пользователя делили бы один предел соединений и одно ведро сообщений
+        return std::string("p") + std::string(reinterpret_cast<const char*>(&credentials.pid), sizeof(credentials.pid));
+    }
+    if (address->sa_family == AF_INET) {
+        const sockaddr_in* address4 = reinterpret_cast<const sockaddr_in*>(address);
+        return std::string(reinterpret_cast<const char*>(&address4->sin_addr), sizeof(address4->sin_addr));
+    }
+    if (address->sa_family == AF_INET6) {
+        const sockaddr_in6* address6 = reinterpret_cast<const sockaddr_in6*>(address);
+        const char* bytes = reinterpret_cast<const char*>(&address6->sin6_addr);
+        if (IN6_IS_ADDR_V4MAPPED(&address6->sin6_addr)) {
+            return std::string(bytes + 12, 4);
+        }
+        return std::string(bytes, sizeof(address6->sin6_addr));
+    }
+    return std::string();
+}
+
+// ведро libevent на одинаковые чтение и запись; nullptr - без ограничения
+static ev_token_bucket_cfg* createBytesBucket(std::size_t bytesPerSecond, std::size_t burstBytes){
+    if (bytesPerSecond == 0) {
+        return nullptr;
+    }
+    std::size_t ratePerTick = std::max<std::size_t>(bytesPerSecond * TCP_RATE_LIMIT_TICK_MS / 1000, 1);
+    std::size_t burst = std::max(burstBytes, ratePerTick);
+    timeval tick;
+    tick.tv_sec = TCP_RATE_LIMIT_TICK_MS / 1000;
+    tick.tv_usec = (TCP_RATE_LIMIT_TICK_MS % 1000) * 1000;
+    ev_token_bucket_cfg* bucket = ev_token_bucket_cfg_new(ratePerTick, burst, ratePerTick, burst, &tick);
+    if (bucket == nullptr) {
+        std::cout << "Ошибка создания ведра токенов libevent." << std::endl;
+    }
+    return bucket;
+}
+
+TCPRateLimiter::TCPRateLimiter(event_base* base, const TCPRateLimitConfig& config, TCPAddressCounters* counters):
+    _base(base),
+    _config(config),
+    _counters(counters),
+    _connectionBytes(createBytesBucket(config.connectionBytesPerSecond, config.connectionBurstBytes)),
+    _addressBytes(createBytesBucket(config.addressBytesPerSecond, config.addressBurstBytes)),
+    _rejected(0),
+    _throttled(0){
+}
+
+TCPRateLimiter::~TCPRateLimiter(){
+    // оставшиеся соединения выходят из групп до их удаления
+    while (_connections.empty() == false) {
+        Connection* connection = _connections.begin()->second;
+        _connections.erase(_connections.begin());
+        release(connection);
+    }
+    if (_connectionBytes) {
+        ev_token_bucket_cfg_free(_connectionBytes);
+    }
+    if (_addressBytes) {
+        ev_token_bucket_cfg_free(_addressBytes);
+    }
+}
+
+bool TCPRateLimiter::attach(bufferevent* bev, const sockaddr* address, bufferevent* socketBev){
+    std::string key = addressKey(address, bufferevent_getfd(socketBev ? socketBev : bev));
+    std::size_t hash = std::hash<std::string>()(key);
+
+    // предел соединений: общий для всех циклов, без счетчиков - только этого цикла
+    std::uint32_t maxConnections = _config.maxConnectionsPerAddress;
+    if (maxConnections > 0) {
+        if (_counters) {
+            if (_counters->acquire(hash, maxConnections) == false) {
+                ++_rejected;
+                return false;
+            }
+        } else {
+            auto it = _addresses.find(key);
+            if ((it != _addresses.end()) && (it->second.connections >= maxConnections)) {
+                ++_rejected;
+                return false;
+            }
+        }
+    }
+
+    std::int64_t nowMicroseconds = now();
+    auto inserted = _addresses.emplace(key, Address());
+    Address& addressState = inserted.first->second;
+    if (inserted.second) {
+        addressState.bytesGroup = _addressBytes ? bufferevent_rate_limit_group_new(_base, _addressBytes) : nullptr;
+        addressState.messages.configure(_config.addressMessagesPerSecond, _config.addressBurstMessages, nowMicroseconds);
+        addressState.hash = hash;
+        addressState.connections = 0;
+    }
+    ++addressState.connections;
+
+    Connection* connection = new Connection();
+    connection->limiter = this;
+    connection->bev = bev;
+    connection->socketBev = socketBev ? socketBev : bev;
+    connection->address = &addressState;
+    connection->addressKey = key;
+    connection->messages.configure(_config.connectionMessagesPerSecond, _config.connectionBurstMessages, nowMicroseconds);
+    connection->resumeEvent = evtimer_new(_base, resumeCallback, connection);
+    connection->paused = false;
+
+    // байты ограничивает сам bufferevent сокета: чтение и запись встают, пока ведро пустое
+    if (_connectionBytes) {
+        bufferevent_set_rate_limit(connection->socketBev, _connectionBytes);
+    }
+    if (addressState.bytesGroup) {
+        bufferevent_add_to_rate_limit_group(connection->socketBev, addressState.bytesGroup);
+    }
+
+    _connections[bev] = connection;
+    return true;
+}
+
+void TCPRateLimiter::detach(bufferevent* bev){
+    auto it = _connections.find(bev);
+    if (it == _connections.end()) {
+        return;
+    }
+    Connection* connection = it->second;
+    _connections.erase(it);
+    release(connection);
+}
+
+void TCPRateLimiter::release(Connection* connection){
+    if (connection->resumeEvent) {
+        event_free(connection->resumeEvent);
+    }
+
+    Address* address = connection->address;
+    if (_connectionBytes) {
+        bufferevent_set_rate_limit(connection->socketBev, nullptr);
+    }
+    // группу нельзя освободить, пока в ней есть участники
+    if (address->bytesGroup) {
+        bufferevent_remove_from_rate_limit_group(connection->socketBev);
+    }
+
+    if (_counters && (_config.maxConnectionsPerAddress > 0)) {
+        _counters->release(address->hash);
+    }
+    --address->connections;
+    if (address->connections == 0) {
+        if (address->bytesGroup) {
+            bufferevent_rate_limit_group_free(address->bytesGroup);
+        }
+        _addresses.erase(connection->addressKey);
+    }
+    delete connection;
+}
+
+bool TCPRateLimiter::allowMessage(bufferevent* bev){
+    auto it = _connections.find(bev);
+    if (it == _connections.end()) {
+        return true;
+    }
+    Connection* connection = it->second;
+    if (connection->paused) {
+        return false;
+    }
+
+    std::int64_t nowMicroseconds = now();
+    TCPTokenBucket& connectionBucket = connection->messages;
+    TCPTokenBucket& addressBucket = connection->address->messages;
+    connectionBucket.refill(nowMicroseconds);
+    addressBucket.refill(nowMicroseconds);
+
+    // токен списывается только если он есть в обоих ведрах
+    if (connectionBucket.hasTokens(1) && addressBucket.hasTokens(1)) {
+        connectionBucket.take(1);
+        addressBucket.take(1);
+        return true;
+    }
+
+    // клиент не читается до появления токенов: данные копятся в ядре, а не в памяти сервера
+    std::int64_t wait = std::max(connectionBucket.waitMicroseconds(1), addressBucket.waitMicroseconds(1));
+    timeval delay;
+    delay.tv_sec = wait / 1000000;
+    delay.tv_usec = wait % 1000000;
+    connection->paused = true;
+    bufferevent_disable(bev, EV_READ);
+    evtimer_add(connection->resumeEvent, &delay);
+    ++_throttled;
+    return false;
+}
+
+std::size_t TCPRateLimiter::connectionsCount() const{
+    return _connections.size();
+}
+
+std::uint64_t TCPRateLimiter::rejectedCount() const{
+    return _rejected;
+}
+
+std::uint64_t TCPRateLimiter::throttledCount() const{
+    return _throttled;
+}
+
+std::int64_t TCPRateLimiter::now() const{
+    timeval time;
+    event_base_gettimeofday_cached(_base, &time);
+    return static_cast<std::int64_t>(time.tv_sec) * 1000000 + time.tv_usec;
+}
+
+void TCPRateLimiter::resumeCallback(evutil_socket_t, short, void* arg){
+    Connection* connection = static_cast<Connection*>(arg);
+    connection->paused = false;
+    bufferevent_enable(connection->bev, EV_READ);
+    // отложенное сообщение уже во входном буфере, новых данных может и не быть;
+    // колбек может закрыть соединение, после него connection не трогаем
+    bufferevent_trigger(connection->bev, EV_READ, BEV_TRIG_IGNORE_WATERMARKS);
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+// libevent
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+// system
+#include <sys/socket.h>
+
+//////////////////////////////////////////////////
+// Ограничения клиентов TCP сервера. 0 - без ограничения.
+// Байты и сообщения считаются в каждом цикле отдельно: клиент, чьи соединения
+// попали в N потоков, получает до N долей адресного лимита.
+// "Адрес" клиента Unix сокета - pid процесса (SO_PEERCRED): у локальных сервисов
+// одного пользователя адресные лимиты свои, а не один на всех с этим uid.
+//////////////////////////////////////////////////
+struct TCPRateLimitConfig {
+    std::size_t connectionBytesPerSecond;   // чтение и запись одного соединения
+    std::size_t connectionBurstBytes;
+    std::size_t addressBytesPerSecond;      // все соединения одного IP в цикле
+    std::size_t addressBurstBytes;
+    double connectionMessagesPerSecond;
+    double connectionBurstMessages;
+    double addressMessagesPerSecond;
+    double addressBurstMessages;
+    std::uint32_t maxConnectionsPerAddress; // во всех циклах вместе
+
+    TCPRateLimitConfig();
+
+    // все ограничения сняты - для замеров производительности
+    static TCPRateLimitConfig unlimited();
+};
+
+//////////////////////////////////////////////////
+// Открытые соединения по IP, общие для всех циклов.
+// Атомарные ячейки по хешу адреса вместо таблицы под мютексом:
+// при коллизии адреса делят ячейку, и предел только ужесточается.
+//////////////////////////////////////////////////
+class TCPAddressCounters {
+public:
+    // slotsCount округляется вверх до степени двойки
+    explicit TCPAddressCounters(std::size_t slotsCount = 65536);
+
+    TCPAddressCounters(const TCPAddressCounters&) = delete;
+    TCPAddressCounters& operator=(const TCPAddressCounters&) = delete;
+
+    bool acquire(std::size_t addressHash, std::uint32_t limit);
+    void release(std::size_t addressHash);
+
+private:
+    std::unique_ptr<std::atomic<std::uint32_t>[]> _slots;
+    std::size_t _mask;
+};
+
+//////////////////////////////////////////////////
+// Ведро токенов: rate токенов в секунду, не больше burst. rate 0 - без ограничения.
+//////////////////////////////////////////////////
+class TCPTokenBucket {
+public:
+    TCPTokenBucket();
+
+    void configure(double rate, double burst, std::int64_t nowMicroseconds);
+    bool isLimited() const;
+
+    // пополнение на момент now
+    void refill(std::int64_t nowMicroseconds);
+    bool hasTokens(double count) const;
+    void take(double count);
+    // через сколько накопится count токенов
+    std::int64_t waitMicroseconds(double count) const;
+
+private:
+    double _rate;
+    double _burst;
+    double _tokens;
+    std::int64_t _updated;
+};
+
+//////////////////////////////////////////////////
+// Ограничитель одного event_base, работает только в его потоке и без блокировок.
+// Байты - средствами libevent: ведро соединения (bufferevent_set_rate_limit)
+// и группа на IP (bufferevent_rate_limit_group). Сообщения - свои ведра соединения и IP:
+// при их исчерпании чтение соединения приостанавливается и по таймеру
+// возобновляется с повторным вызовом колбека чтения.
+//////////////////////////////////////////////////
+class TCPRateLimiter {
+public:
+    // counters - общие счетчики соединений всех циклов, может быть nullptr
+    TCPRateLimiter(event_base* base, const TCPRateLimitConfig& config, TCPAddressCounters* counters);
+    ~TCPRateLimiter();
+
+    TCPRateLimiter(const TCPRateLimiter&) = delete;
+    TCPRateLimiter& operator=(const TCPRateLimiter&) = delete;
+
+    // Из колбека accept до первого чтения. false - предел соединений IP, bev надо освободить.
+    // socketBev - bufferevent сокета под фильтром, ограничение байтов ставится на него.
+    bool attach(bufferevent* bev, const sockaddr* address, bufferevent* socketBev = nullptr);
+    // перед bufferevent_free
+    void detach(bufferevent* bev);
+
+    // Перед обработкой очередного сообщения: false - лимит исчерпан, сообщение надо
+    // оставить во входном буфере, колбек чтения будет вызван снова после паузы.
+    bool allowMessage(bufferevent* bev);
+
+    std::size_t connectionsCount() const;
+    std::uint64_t rejectedCount() const;    // отклонено при приеме
+    std::uint64_t throttledCount() const;   // пауз чтения по лимиту сообщений
+
+private:
+    struct Address {
+        bufferevent_rate_limit_group* bytesGroup;
+        TCPTokenBucket messages;
+        std::size_t hash;
+        std::uint32_t connections;
+    };
+
+    struct Connection {
+        TCPRateLimiter* limiter;
+        bufferevent* bev;
+        bufferevent* socketBev;
+        Address* address;
+        std::string addressKey;
+        TCPTokenBucket messages;
+        event* resumeEvent;
+        bool paused;
+    };
+
+    event_base* _base;
+    TCPRateLimitConfig _config;
+    TCPAddressCounters* _counters;
+    ev_token_bucket_cfg* _connectionBytes;
+    ev_token_bucket_cfg* _addressBytes;
+    std::unordered_map<std::string, Address> _addresses;
+    std::unordered_map<bufferevent*, Connection*> _connections;
+    std::uint64_t _rejected;
+    std::uint64_t _throttled;
+
+private:
+    std::int64_t now() const;
+    void release(Connection* connection);
+
+    static void resumeCallback(evutil_socket_t, short, void* arg);
+};
@@ -0,0 +1,156 @@
+#include "TCPServer.h"
+// std
+#include <iostream>
+// system
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+// запас на заголовок кадра сверх maxMessageSize во входном буфере
+#define TCP_FRAME_HEADER_RESERVE 64
+
+// кадр предельного размера должен помещаться во входной буфер целиком, иначе чтение встанет
+static TCPMemoryConfig memoryConfig(const TCPServerConfig& config){
+    TCPMemoryConfig memory = config.memory;
+    std::size_t frameLimit = config.maxMessageSize + TCP_FRAME_HEADER_RESERVE;
+    if ((memory.connectionInputLimit > 0) && (memory.connectionInputLimit < frameLimit)) {
+        memory.connectionInputLimit = frameLimit;
+    }
+    return memory;
+}
+
+TCPServerConfig::TCPServerConfig():
+    address("0.0.0.0"),
+    port(5555),
+    unixPath(nullptr),
+    backlog(1024),
+    timeoutSeconds(600),
+    maxMessageSize(1024 * 1024),
+    noDelay(true),
+    addressCounters(nullptr),
+    memoryCounters(nullptr),
+    tls(nullptr){
+}
+
+TCPServerCore::TCPServerCore(event_base* base, const TCPServerConfig& config, TCPConnectedHandler handler, void* arg):
+    _base(base),
+    _config(config),
+    _handler(handler),
+    _arg(arg),
+    _rateLimiter(base, config.rateLimits, config.addressCounters),
+    _memory(base, memoryConfig(config), config.memoryCounters),
+    _tls(config.tls ? new TLSServerContext(*config.tls) : nullptr),
+    _listener(base, acceptCallback, this),
+    _unixListener(base, acceptCallback, this),
+    _connections(0),
+    _accepted(0){
+}
+
+TCPServerCore::~TCPServerCore(){
+}
+
+bool TCPServerCore::isValid() const{
+    return (_tls == nullptr) || _tls->isValid();
+}
+
+bool TCPServerCore::bind(){
+    if (_listener.bind(_config.address, _config.port, _config.backlog) == false) {
+        return false;
+    }
+    return (_config.unixPath == nullptr) || _unixListener.bindUnix(_config.unixPath, _config.backlog);
+}
+
+bool TCPServerCore::accept(evutil_socket_t socket, evutil_socket_t unixSocket){
+    if (_listener.accept(socket) == false) {
+        return false;
+    }
+    return (unixSocket < 0) || _unixListener.accept(unixSocket);
+}
+
+evutil_socket_t TCPServerCore::socket() const{
+    return _listener.socket();
+}
+
+evutil_socket_t TCPServerCore::unixSocket() const{
+    return _unixListener.socket();
+}
+
+event_base* TCPServerCore::base() const{
+    return _base;
+}
+
+const TCPServerConfig& TCPServerCore::config() const{
+    return _config;
+}
+
+TCPRateLimiter& TCPServerCore::rateLimiter(){
+    return _rateLimiter;
+}
+
+TCPMemoryBudget& TCPServerCore::memory(){
+    return _memory;
+}
+
+const TLSServerContext* TCPServerCore::tls() const{
+    return _tls.get();
+}
+
+void TCPServerCore::release(bufferevent* bev){
+    _memory.detach(bev);
+    _rateLimiter.detach(bev);
+    bufferevent_free(bev);
+    --_connections;
+}
+
+std::size_t TCPServerCore::connectionsCount() const{
+    return _connections;
+}
+
+std::uint64_t TCPServerCore::acceptedCount() const{
+    return _accepted;
+}
+
+void TCPServerCore::acceptCallback(evutil_socket_t fd, sockaddr* address, int, void* arg){
+    TCPServerCore* core = static_cast<TCPServerCore*>(arg);
+
+    // у Unix сокета нет Nagle
+    if (core->_config.noDelay && (address->sa_family != AF_UNIX)) {
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+
+    bufferevent* bev = nullptr;
+    if (core->_tls) {
+        bev = core->_tls->createBufferevent(core->_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    } else {
+        bev = bufferevent_socket_new(core->_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    }
+    if (bev == nullptr) {
+        std::cout << "Ошибка при создании объекта bufferevent." << std::endl;
+        evutil_closesocket(fd);
+        return;
+    }
+
+    // превышен предел соединений с этого IP - закрываем сразу, до первого чтения
+    if (core->_rateLimiter.attach(bev, address) == false) {
+        bufferevent_free(bev);
+        return;
+    }
+    // буферы всех соединений уже заняли общий предел памяти
+    if (core->_memory.attach(bev) == false) {
+        core->_rateLimiter.detach(bev);
+        bufferevent_free(bev);
+        return;
+    }
+    ++core->_connections;
+    ++core->_accepted;
+
+    if (core->_config.timeoutSeconds > 0) {
+        timeval timeout;
+        timeout.tv_sec = core->_config.timeoutSeconds;
+        timeout.tv_usec = 0;
+        bufferevent_set_timeouts(bev, &timeout, &timeout);
+    }
+
+    core->_handler(*core, bev, core->_arg);
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <unordered_set>
+// libevent
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+// server
+#include "TCPCodec.h"
+#include "TCPListener.h"
+#include "TCPRateLimiter.h"
+#include "TCPMemoryBudget.h"
+#include "TLSContext.h"
+#include "UnixSocket.h"
+
+//////////////////////////////////////////////////
+// Настройки TCP сервера одного event_base
+//////////////////////////////////////////////////
+struct TCPServerConfig {
+    const char* address;
+    std::uint16_t port;
+    const char* unixPath;               // Unix сокет рядом с TCP (см. UnixSocket.h), nullptr - только TCP
+    int backlog;
+    int timeoutSeconds;                 // чтение и запись, 0 - без таймаута
+    std::size_t maxMessageSize;         // больше - соединение закрывается
+    bool noDelay;                       // TCP_NODELAY для принятых соединений
+    TCPRateLimitConfig rateLimits;
+    TCPAddressCounters* addressCounters;    // общие для серверов всех потоков, может быть nullptr
+    TCPMemoryConfig memory;             // connectionInputLimit поднимается до кадра maxMessageSize
+    TCPMemoryCounters* memoryCounters;  // общие для серверов всех потоков, может быть nullptr
+    const TLSConfig* tls;               // nullptr - без TLS; SSL_CTX у каждого сервера свой
+
+    TCPServerConfig();
+};
+
+class TCPServerCore;
+// соединение принято и ограничитель его пропустил - создание объекта соединения
+typedef void (*TCPConnectedHandler)(TCPServerCore& core, bufferevent* bev, void* arg);
+
+//////////////////////////////////////////////////
+// Нешаблонная часть TCPServer: листенер, bufferevent (TLS или сокет), ограничения, учет.
+// Работает только в потоке своего event_base.
+//////////////////////////////////////////////////
+class TCPServerCore {
+public:
+    TCPServerCore(event_base* base, const TCPServerConfig& config, TCPConnectedHandler handler, void* arg);
+    ~TCPServerCore();
+
+    TCPServerCore(const TCPServerCore&) = delete;
+    TCPServerCore& operator=(const TCPServerCore&) = delete;
+
+    bool isValid() const;
+    // TCP и, если задан unixPath, Unix сокет
+    bool bind();
+    // общие сокеты первого сервера; unixSocket -1 - без Unix сокета
+    bool accept(evutil_socket_t socket, evutil_socket_t unixSocket = -1);
+    evutil_socket_t socket() const;
+    evutil_socket_t unixSocket() const;
+
+    event_base* base() const;
+    const TCPServerConfig& config() const;
+    TCPRateLimiter& rateLimiter();
+    TCPMemoryBudget& memory();
+    const TLSServerContext* tls() const;   // nullptr - без TLS
+
+    // закрытое соединение: ограничитель и bufferevent
+    void release(bufferevent* bev);
+
+    std::size_t connectionsCount() const;
+    std::uint64_t acceptedCount() const;
+
+private:
+    event_base* _base;
+    TCPServerConfig _config;
+    TCPConnectedHandler _handler;
+    void* _arg;
+    TCPRateLimiter _rateLimiter;
+    TCPMemoryBudget _memory;
+    std::unique_ptr<TLSServerContext> _tls;
+    TCPListener _listener;
+    TCPListener _unixListener;
+    std::size_t _connections;
+    std::uint64_t _accepted;
+
+private:
+    static void acceptCallback(evutil_socket_t fd, sockaddr* address, int addressLength, void* arg);
+};
+
+template <typename Codec, typename Handler>
+class TCPServer;
+
+//////////////////////////////////////////////////
+// Соединение TCPServer. Живет от Handler::onConnected до Handler::onClosed,
+// работает только в потоке своего event_base.
+//////////////////////////////////////////////////
+template <typename Codec, typename Handler>
+class TCPConnection {
+public:
+    typedef TCPServer<Codec, Handler> Server;
+
+    // кадр через Codec::encode: данные и размер или сообщение кодека;
+    // false - сообщение не помещается в кадр кодека и не отправлено
+    template <typename... Message>
+    bool send(const Message&... message);
+    // закрытие после отправки уже добавленных данных
+    void close();
+
+    // для записи без кодека и прямой работы с bufferevent
+    evbuffer* output() const;
+    bufferevent* bufferEvent() const;
+    Server& server() const;
+    // клиент на Unix сокете: pid, uid, gid процесса; false - TCP клиент
+    bool peerCredentials(ucred& credentials) const;
+
+public:
+    void* data;     // пользовательские данные соединения
+
+private:
+    friend class TCPServer<Codec, Handler>;
+
+    Server* _server;
+    bufferevent* _bev;
+    bool _inCallback;       // закрытие откладывается до выхода из колбека
+    bool _closing;
+
+private:
+    TCPConnection(Server* server, bufferevent* bev);
+
+    void finish();
+
+    static void readCallback(bufferevent* bev, void* arg);
+    static void writeCallback(bufferevent* bev, void* arg);
+    static void eventCallback(bufferevent* bev, short events, void* arg);
+};
+
+//////////////////////////////////////////////////
+// TCP сервер одного event_base с протоколом на шаблонах: Codec режет входной поток
+// на кадры и разбирает их (см. TCPCodec.h, TCPPipeline.h), Handler обрабатывает события соединений:
+//   void onConnected(TCPConnection<Codec, Handler>& connection);
+//   void onMessage(TCPConnection<Codec, Handler>& connection, const char* data, std::size_t size);
+//       или onMessage(connection, const Message& message) - по тому, что отдает Codec::decode
+//   void onClosed(TCPConnection<Codec, Handler>& connection);
+// Кадр передается прямо из входного буфера bufferevent и действителен только во время onMessage.
+// Вызовы кодека и обработчика известны при компиляции и встраиваются в колбек чтения.
+// Для нескольких потоков - по серверу на поток: первый bind, остальные accept(socket(), unixSocket()).
+//////////////////////////////////////////////////
+template <typename Codec, typename Handler>
+class TCPServer {
+public:
+    typedef TCPConnection<Codec, Handler> Connection;
+
+    TCPServer(event_base* base, const TCPServerConfig& config, Handler& handler);
+    // открытые соединения закрываются с вызовом onClosed
+    ~TCPServer();
+
+    TCPServer(const TCPServer&) = delete;
+    TCPServer& operator=(const TCPServer&) = delete;
+
+    bool isValid() const;
+    bool bind();
+    bool accept(evutil_socket_t socket, evutil_socket_t unixSocket = -1);
+    evutil_socket_t socket() const;
+    evutil_socket_t unixSocket() const;
+
+    Handler& handler();
+    TCPServerCore& core();
+
+private:
+    friend class TCPConnection<Codec, Handler>;
+
+    TCPServerCore _core;
+    Handler& _handler;
+    std::unordered_set<Connection*> _connections;
+
+private:
+    void destroy(Connection* connection);
+
+    static void connectedCallback(TCPServerCore& core, bufferevent* bev, void* arg);
+};
+
+//////////////////////////////////////////////////
+// TCPConnection
+//////////////////////////////////////////////////
+template <typename Codec, typename Handler>
+TCPConnection<Codec, Handler>::TCPConnection(Server* server, bufferevent* bev):
+    data(nullptr),
+    _server(server),
+    _bev(bev),
+    _inCallback(false),
+    _closing(false){
+}
+
+template <typename Codec, typename Handler>
+template <typename... Message>
+bool TCPConnection<Codec, Handler>::send(const Message&... message){
+    return Codec::encode(bufferevent_get_output(_bev), message...);
+}
+
+template <typename Codec, typename Handler>
+void TCPConnection<Codec, Handler>::close(){
+    if (_closing) {
+        return;
+    }
+    _closing = true;
+    if (_inCallback == false) {
+        finish();
+    }
+}
+
+template <typename Codec, typename Handler>
+evbuffer* TCPConnection<Codec, Handler>::output() const{
+    return bufferevent_get_output(_bev);
+}
+
+template <typename Codec, typename Handler>
+bufferevent* TCPConnection<Codec, Handler>::bufferEvent() const{
+    return _bev;
+}
+
+template <typename Codec, typename Handler>
+typename TCPConnection<Codec, Handler>::Server& TCPConnection<Codec, Handler>::server() const{
+    return *_server;
+}
+
+template <typename Codec, typename Handler>
+bool TCPConnection<Codec, Handler>::peerCredentials(ucred& credentials) const{
+    return getPeerCredentials(bufferevent_getfd(_bev), credentials);
+}
+
+template <typename Codec, typename Handler>
+void TCPConnection<Codec, Handler>::finish(){
+    // новые данные уже не нужны; остаток вывода уйдет, затем writeCallback удалит соединение
+    bufferevent_disable(_bev, EV_READ);
+    if (evbuffer_get_length(bufferevent_get_output(_bev)) == 0) {
+        _server->destroy(this);
+    }
+}
+
+template <typename Codec, typename Handler>
+void TCPConnection<Codec, Handler>::readCallback(bufferevent* bev, void* arg){
+    TCPConnection* connection = static_cast<TCPConnection*>(arg);
+    Server& server = *connection->_server;
+    evbuffer* input = bufferevent_get_input(bev);
+    std::size_t const maxMessageSize = server._core.config().maxMessageSize;
+
+    connection->_inCallback = true;
+    while (connection->_closing == false) {
+        std::size_t headerSize = 0;
+        std::size_t frameSize = Codec::frame(input, headerSize);
+        if (frameSize == 0) {
+            break;
+        }
+        if (frameSize - headerSize > maxMessageSize) {
+            connection->_closing = true;
+            break;
+        }
+        if (evbuffer_get_length(input) < frameSize) {
+            break;
+        }
+        // лимит сообщений исчерпан - кадр ждет в буфере, колбек вызовется снова
+        if (server._core.rateLimiter().allowMessage(bev) == false) {
+            break;
+        }
+        // кадр в цепочке обычно лежит одним куском - pullup тогда ничего не копирует
+        const char* data = reinterpret_cast<const char*>(evbuffer_pullup(input, static_cast<ev_ssize_t>(frameSize)));
+        bool valid = Codec::decode(data + headerSize, frameSize - headerSize, [connection, &server](const auto&... message){
+            server._handler.onMessage(*connection, message...);
+        });
+        evbuffer_drain(input, frameSize);
+        // ошибка протокола - остальное не разбираем, соединение закрывается
+        if (valid == false) {
+            connection->_closing = true;
+        }
+    }
+    connection->_inCallback = false;
+
+    if (connection->_closing) {
+        connection->finish();
+    }
+}
+
+template <typename Codec, typename Handler>
+void TCPConnection<Codec, Handler>::writeCallback(bufferevent*, void* arg){
+    // вывод отправлен полностью
+    TCPConnection* connection = static_cast<TCPConnection*>(arg);
+    if (connection->_closing) {
+        connection->_server->destroy(connection);
+    }
+}
+
+template <typename Codec, typename Handler>
+void TCPConnection<Codec, Handler>::eventCallback(bufferevent*, short events, void* arg){
+    TCPConnection* connection = static_cast<TCPConnection*>(arg);
+    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR | BEV_EVENT_TIMEOUT)) {
+        connection->_server->destroy(connection);
+    }
+}
+
+//////////////////////////////////////////////////
+// TCPServer
+//////////////////////////////////////////////////
+template <typename Codec, typename Handler>
+TCPServer<Codec, Handler>::TCPServer(event_base* base, const TCPServerConfig& config, Handler& handler):
+    _core(base, config, connectedCallback, this),
+    _handler(handler){
+}
+
+template <typename Codec, typename Handler>
+TCPServer<Codec, Handler>::~TCPServer(){
+    while (_connections.empty() == false) {
+        destroy(*_connections.begin());
+    }
+}
+
+template <typename Codec, typename Handler>
+bool TCPServer<Codec, Handler>::isValid() const{
+    return _core.isValid();
+}
+
+template <typename Codec, typename Handler>
+bool TCPServer<Codec, Handler>::bind(){
+    return _core.bind();
+}
+
+template <typename Codec, typename Handler>
+bool TCPServer<Codec, Handler>::accept(evutil_socket_t socket, evutil_socket_t unixSocket){
+    return _core.accept(socket, unixSocket);
+}
+
+template <typename Codec, typename Handler>
+evutil_socket_t TCPServer<Codec, Handler>::socket() const{
+    return _core.socket();
+}
+
+template <typename Codec, typename Handler>
+evutil_socket_t TCPServer<Codec, Handler>::unixSocket() const{
+    return _core.unixSocket();
+}
+
+template <typename Codec, typename Handler>
+Handler& TCPServer<Codec, Handler>::handler(){
+    return _handler;
+}
+
+template <typename Codec, typename Handler>
+TCPServerCore& TCPServer<Codec, Handler>::core(){
+    return _core;
+}
+
+template <typename Codec, typename Handler>
+void TCPServer<Codec, Handler>::destroy(Connection* connection){
+    if (_connections.erase(connection) == 0) {
+        return;
+    }
+    _handler.onClosed(*connection);
+    _core.release(connection->_bev);
+    delete connection;
+}
+
+template <typename Codec, typename Handler>
+void TCPServer<Codec, Handler>::connectedCallback(TCPServerCore&, bufferevent* bev, void* arg){
+    TCPServer* server = static_cast<TCPServer*>(arg);
+    Connection* connection = new Connection(server, bev);
+    server->_connections.insert(connection);
+
+    bufferevent_setcb(bev, Connection::readCallback, Connection::writeCallback, Connection::eventCallback, connection);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+
+    connection->_inCallback = true;
+    server->_handler.onConnected(*connection);
+    connection->_inCallback = false;
+    if (connection->_closing) {
+        connection->finish();
+    }
+}
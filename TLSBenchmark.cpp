@@ -0,0 +1,144 @@
+#include "TLSBenchmark.h"
+// std
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <cstring>
+// system
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+// openssl
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// Нагрузочный клиент для TLS серверов: каждый поток в цикле подключается, проходит рукопожатие
+// и закрывает соединение. Без возобновления каждое рукопожатие полное, с возобновлением
+// поток предъявляет билет (сессию) предыдущего соединения.
+
+//using namespace std;
+
+// одно соединение: подключение, рукопожатие, прием билетов до закрытия сервером;
+// session - предъявляемая сессия и куда сохранить новую
+static bool tlsConnectOnce(SSL_CTX* context, const sockaddr_in& serverAddr, SSL_SESSION** session, bool& reused){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (connect(fd, (const sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        close(fd);
+        return false;
+    }
+
+    SSL* ssl = SSL_new(context);
+    SSL_set_fd(ssl, fd);
+    if (session && *session) {
+        SSL_set_session(ssl, *session);
+    }
+    bool connected = (SSL_connect(ssl) == 1);
+    if (connected) {
+        reused = (SSL_session_reused(ssl) == 1);
+        // в TLS 1.3 билет приходит после рукопожатия: закрываемся первыми и дочитываем
+        SSL_shutdown(ssl);
+        char buffer[256];
+        while (SSL_read(ssl, buffer, sizeof(buffer)) > 0) {
+        }
+        if (session) {
+            SSL_SESSION* newSession = SSL_get1_session(ssl);
+            if (newSession) {
+                if (*session) {
+                    SSL_SESSION_free(*session);
+                }
+                *session = newSession;
+            }
+        }
+    }
+    SSL_free(ssl);
+    close(fd);
+    ERR_clear_error();
+    return connected;
+}
+
+int tlsHandshakeBenchmark(const char* serverAddress, std::uint16_t serverPort, int threadsCount, int durationSeconds) {
+    sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(serverPort);
+    if (inet_pton(AF_INET, serverAddress, &serverAddr.sin_addr) != 1) {
+        std::cout << "Неверный адрес сервера: " << serverAddress << std::endl;
+        return 1;
+    }
+
+    // локальный сервер с временным сертификатом - без проверки
+    SSL_CTX* context = SSL_CTX_new(TLS_client_method());
+    if (context == nullptr) {
+        std::cout << "Ошибка создания SSL_CTX клиента." << std::endl;
+        return 1;
+    }
+    SSL_CTX_set_verify(context, SSL_VERIFY_NONE, nullptr);
+
+    std::cout << "TLS benchmark: " << serverAddress << ":" << serverPort << ", threads: " << threadsCount
+              << ", duration: " << durationSeconds << "s per phase" << std::endl;
+
+    for (int phase = 0; phase < 2; ++phase) {
+        bool resume = (phase == 1);
+        std::atomic<std::uint64_t> handshakesTotal(0);
+        std::atomic<std::uint64_t> reusedTotal(0);
+        std::atomic<std::uint64_t> failedTotal(0);
+        std::atomic_bool isRunning(true);
+
+        auto threadFunc = [&](){
+            std::uint64_t handshakes = 0;
+            std::uint64_t reusedCount = 0;
+            std::uint64_t failed = 0;
+            SSL_SESSION* session = nullptr;
+            while (isRunning) {
+                bool reused = false;
+                if (tlsConnectOnce(context, serverAddr, resume ? &session : nullptr, reused)) {
+                    ++handshakes;
+                    if (reused) {
+                        ++reusedCount;
+                    }
+                } else {
+                    ++failed;
+                }
+            }
+            if (session) {
+                SSL_SESSION_free(session);
+            }
+            handshakesTotal += handshakes;
+            reusedTotal += reusedCount;
+            failedTotal += failed;
+        };
+
+        auto startTime = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threadsCount; ++i) {
+            threads.push_back(std::thread(threadFunc));
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(durationSeconds));
+        isRunning = false;
+        for (std::thread& thread: threads) {
+            thread.join();
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::uint64_t handshakes = handshakesTotal;
+        std::cout << (resume ? "Resumed" : "Full") << " handshakes: " << handshakes
+                  << ", resumed: " << reusedTotal << ", failed: " << failedTotal << std::endl;
+        std::cout << "Handshakes per second: " << (std::uint64_t)(handshakes / elapsed) << std::endl;
+    }
+
+    SSL_CTX_free(context);
+    return 0;
+}
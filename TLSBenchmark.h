@@ -0,0 +1,4 @@
+#include <cstdint>
+
+// Рукопожатий TLS в секунду: сначала полные, затем с возобновлением сессии
+int tlsHandshakeBenchmark(const char* serverAddress, std::uint16_t serverPort, int threadsCount, int durationSeconds);
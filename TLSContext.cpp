@@ -0,0 +1,214 @@
+#include "TLSContext.h"
+// std
+#include <iostream>
+#include <cstring>
+// libevent
+#include <event2/bufferevent_ssl.h>
+// openssl
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+
+
+// контекст сессий: сессии другого приложения на том же сертификате не примутся
+#define TLS_SESSION_ID_CONTEXT "LibEventServer"
+
+// сообщение и первая ошибка из очереди OpenSSL
+static void printTLSError(const char* message){
+    char text[256];
+    unsigned long error = ERR_get_error();
+    ERR_error_string_n(error, text, sizeof(text));
+    std::cout << message << ": " << (error ? text : "unknown") << std::endl;
+    ERR_clear_error();
+}
+
+TLSConfig::TLSConfig():
+    sessionCacheSize(20 * 1024),
+    sessionTimeoutSeconds(2 * 60 * 60),
+    sessionTickets(true){
+    if (RAND_bytes(ticketKeys, sizeof(ticketKeys)) != 1) {
+        printTLSError("Ошибка генерации ключей билетов TLS");
+        sessionTickets = false;
+    }
+}
+
+bool tlsGenerateSelfSigned(TLSConfig& config){
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    bool generated = (keyContext != nullptr) &&
+                     (EVP_PKEY_keygen_init(keyContext) > 0) &&
+                     (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1) > 0) &&
+                     (EVP_PKEY_keygen(keyContext, &key) > 0);
+    EVP_PKEY_CTX_free(keyContext);
+    if (generated == false) {
+        printTLSError("Ошибка генерации ключа TLS");
+        return false;
+    }
+
+    X509* certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 365 * 24 * 60 * 60);
+    X509_set_pubkey(certificate, key);
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+
+    bool result = false;
+    BIO* certificateBio = BIO_new(BIO_s_mem());
+    BIO* keyBio = BIO_new(BIO_s_mem());
+    if ((X509_sign(certificate, key, EVP_sha256()) > 0) &&
+        (PEM_write_bio_X509(certificateBio, certificate) == 1) &&
+        (PEM_write_bio_PrivateKey(keyBio, key, nullptr, nullptr, 0, nullptr, nullptr) == 1)) {
+        char* data = nullptr;
+        long size = BIO_get_mem_data(certificateBio, &data);
+        config.certificatePEM.assign(data, size);
+        size = BIO_get_mem_data(keyBio, &data);
+        config.keyPEM.assign(data, size);
+        config.certificateFile.clear();
+        config.keyFile.clear();
+        result = true;
+    } else {
+        printTLSError("Ошибка создания сертификата TLS");
+    }
+
+    BIO_free(certificateBio);
+    BIO_free(keyBio);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return result;
+}
+
+TLSServerContext::TLSServerContext(const TLSConfig& config):
+    _context(SSL_CTX_new(TLS_server_method())),
+    _handshakes(0),
+    _resumed(0){
+
+    if (_context == nullptr) {
+        printTLSError("Ошибка создания SSL_CTX");
+        return;
+    }
+    SSL_CTX_set_min_proto_version(_context, TLS1_2_VERSION);
+    SSL_CTX_set_options(_context, SSL_OP_NO_COMPRESSION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+    // буферы чтения и записи SSL освобождаются, пока соединение простаивает
+    SSL_CTX_set_mode(_context, SSL_MODE_RELEASE_BUFFERS);
+
+    if (loadCertificate(config) == false) {
+        SSL_CTX_free(_context);
+        _context = nullptr;
+        return;
+    }
+
+    // кеш сессий по ID: TLS 1.2 без билетов и TLS 1.3 при выключенных билетах
+    SSL_CTX_set_session_cache_mode(_context, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(_context, config.sessionCacheSize);
+    SSL_CTX_set_timeout(_context, config.sessionTimeoutSeconds);
+    SSL_CTX_set_session_id_context(_context, reinterpret_cast<const unsigned char*>(TLS_SESSION_ID_CONTEXT),
+                                   strlen(TLS_SESSION_ID_CONTEXT));
+
+    if (config.sessionTickets) {
+        SSL_CTX_set_tlsext_ticket_keys(_context, const_cast<unsigned char*>(config.ticketKeys), TLS_TICKET_KEYS_SIZE);
+        // одного билета TLS 1.3 хватает на следующее соединение, по умолчанию их два
+        SSL_CTX_set_num_tickets(_context, 1);
+    } else {
+        SSL_CTX_set_options(_context, SSL_OP_NO_TICKET);
+    }
+
+    SSL_CTX_set_app_data(_context, this);
+    SSL_CTX_set_info_callback(_context, infoCallback);
+}
+
+TLSServerContext::~TLSServerContext(){
+    // соединения держат ссылки на контекст, он освободится вместе с последним
+    if (_context) {
+        SSL_CTX_set_app_data(_context, nullptr);
+        SSL_CTX_free(_context);
+    }
+}
+
+bool TLSServerContext::loadCertificate(const TLSConfig& config){
+    if (config.certificateFile.empty() == false) {
+        if (SSL_CTX_use_certificate_chain_file(_context, config.certificateFile.c_str()) != 1) {
+            printTLSError("Ошибка загрузки сертификата TLS");
+            return false;
+        }
+        if (SSL_CTX_use_PrivateKey_file(_context, config.keyFile.c_str(), SSL_FILETYPE_PEM) != 1) {
+            printTLSError("Ошибка загрузки ключа TLS");
+            return false;
+        }
+    } else {
+        BIO* certificateBio = BIO_new_mem_buf(config.certificatePEM.data(), static_cast<int>(config.certificatePEM.size()));
+        X509* certificate = PEM_read_bio_X509(certificateBio, nullptr, nullptr, nullptr);
+        BIO_free(certificateBio);
+        BIO* keyBio = BIO_new_mem_buf(config.keyPEM.data(), static_cast<int>(config.keyPEM.size()));
+        EVP_PKEY* key = PEM_read_bio_PrivateKey(keyBio, nullptr, nullptr, nullptr);
+        BIO_free(keyBio);
+
+        bool loaded = (certificate != nullptr) && (key != nullptr) &&
+                      (SSL_CTX_use_certificate(_context, certificate) == 1) &&
+                      (SSL_CTX_use_PrivateKey(_context, key) == 1);
+        X509_free(certificate);
+        EVP_PKEY_free(key);
+        if (loaded == false) {
+            printTLSError("Ошибка загрузки сертификата TLS из памяти");
+            return false;
+        }
+    }
+
+    if (SSL_CTX_check_private_key(_context) != 1) {
+        printTLSError("Ключ TLS не подходит к сертификату");
+        return false;
+    }
+    return true;
+}
+
+bool TLSServerContext::isValid() const{
+    return _context != nullptr;
+}
+
+SSL_CTX* TLSServerContext::context() const{
+    return _context;
+}
+
+bufferevent* TLSServerContext::createBufferevent(event_base* base, evutil_socket_t fd, int options){
+    SSL* ssl = SSL_new(_context);
+    if (ssl == nullptr) {
+        printTLSError("Ошибка создания SSL");
+        return nullptr;
+    }
+    // с BEV_OPT_CLOSE_ON_FREE SSL освобождается вместе с bufferevent
+    bufferevent* bev = bufferevent_openssl_socket_new(base, fd, ssl, BUFFEREVENT_SSL_ACCEPTING, options);
+    if (bev == nullptr) {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    // клиенты часто закрывают соединение без close_notify - это не ошибка
+    bufferevent_openssl_set_allow_dirty_shutdown(bev, 1);
+    return bev;
+}
+
+std::uint64_t TLSServerContext::handshakesCount() const{
+    return _handshakes;
+}
+
+std::uint64_t TLSServerContext::resumedCount() const{
+    return _resumed;
+}
+
+void TLSServerContext::infoCallback(const SSL* ssl, int where, int){
+    if ((where & SSL_CB_HANDSHAKE_DONE) == 0) {
+        return;
+    }
+    TLSServerContext* context = static_cast<TLSServerContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+    if (context == nullptr) {
+        return;
+    }
+    ++context->_handshakes;
+    if (SSL_session_reused(ssl)) {
+        ++context->_resumed;
+    }
+}
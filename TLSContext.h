@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+// libevent
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+// openssl
+#include <openssl/ssl.h>
+
+// ключи билетов сессий: 16 байт имени + 32 HMAC + 32 AES
+#define TLS_TICKET_KEYS_SIZE 80
+
+//////////////////////////////////////////////////
+// Настройки TLS сервера, общие для всех потоков
+//////////////////////////////////////////////////
+struct TLSConfig {
+    std::string certificateFile;    // PEM цепочка; пусто - берется certificatePEM
+    std::string keyFile;
+    std::string certificatePEM;     // сертификат и ключ в памяти
+    std::string keyPEM;
+    long sessionCacheSize;          // кеш сессий по ID в каждом потоке - для клиентов без билетов
+    long sessionTimeoutSeconds;
+    bool sessionTickets;            // возобновление без состояния на сервере
+    // одни ключи на все потоки: билет, выданный одним потоком, принимают остальные
+    unsigned char ticketKeys[TLS_TICKET_KEYS_SIZE];
+
+    // ключи билетов генерируются случайно
+    TLSConfig();
+};
+
+// Временный самоподписанный сертификат localhost (EC P-256) в certificatePEM/keyPEM,
+// когда сертификата нет
+bool tlsGenerateSelfSigned(TLSConfig& config);
+
+//////////////////////////////////////////////////
+// SSL_CTX одного потока. У каждого цикла свой контекст: кеш сессий и счетчики
+// без общих блокировок, а общие ключи билетов дают возобновление в любом потоке.
+// Работает только в потоке своего event_base.
+//////////////////////////////////////////////////
+class TLSServerContext {
+public:
+    explicit TLSServerContext(const TLSConfig& config);
+    ~TLSServerContext();
+
+    TLSServerContext(const TLSServerContext&) = delete;
+    TLSServerContext& operator=(const TLSServerContext&) = delete;
+
+    bool isValid() const;
+    SSL_CTX* context() const;
+
+    // Серверный bufferevent_openssl для принятого сокета, рукопожатие начнется с первым чтением.
+    // fd -1 - сокет выставит владелец позже (evhttp_set_bevcb).
+    bufferevent* createBufferevent(event_base* base, evutil_socket_t fd, int options);
+
+    std::uint64_t handshakesCount() const;
+    std::uint64_t resumedCount() const;     // из них без полного рукопожатия
+
+private:
+    SSL_CTX* _context;
+    std::uint64_t _handshakes;
+    std::uint64_t _resumed;
+
+private:
+    bool loadCertificate(const TLSConfig& config);
+    static void infoCallback(const SSL* ssl, int where, int ret);
+};
@@ -0,0 +1,20 @@
+#include "TaskFuture.h"
+// std
+#include <iostream>
+
+
+static void postedCallback(evutil_socket_t, short, void* arg){
+    std::unique_ptr<std::function<void()>> function(static_cast<std::function<void()>*>(arg));
+    (*function)();
+}
+
+bool postToEventBase(event_base* base, const std::function<void()>& function){
+    // без таймаута event_base_once активирует событие сразу и будит цикл
+    std::function<void()>* posted = new std::function<void()>(function);
+    if (event_base_once(base, -1, EV_TIMEOUT, postedCallback, posted, nullptr) != 0) {
+        std::cout << "Ошибка event_base_once: задача не передана в цикл." << std::endl;
+        delete posted;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <optional>
+#include <vector>
+#include <type_traits>
+#include <utility>
+// libevent
+#include <event2/event.h>
+
+// Выполнение function в потоке цикла base при следующей итерации; можно вызывать из любого потока,
+// если evthread_use_pthreads() вызван до создания base. false - base не принял событие.
+bool postToEventBase(event_base* base, const std::function<void()>& function);
+
+// Результат задачи без значения
+struct TaskVoid {
+};
+
+// Состояние результата задачи
+enum TaskFutureStatus {
+    TASK_FUTURE_PENDING = 0,
+    TASK_FUTURE_DONE = 1,
+    TASK_FUTURE_FAILED = 2,         // отклонена, вытеснена или просрочена
+    TASK_FUTURE_CANCELLED = 3       // обработчик уничтожен или все обещания уничтожены без результата
+};
+
+template <typename T>
+class TaskPromise;
+
+template <typename T>
+struct TaskFutureState {
+    std::mutex mutex;
+    event_base* base;
+    TaskFutureStatus status;
+    std::optional<T> value;                     // пусто - задача не выполнена
+    std::function<void(T*)> continuation;
+};
+
+// Последняя копия обещания уничтожена без результата - future завершается как отмененный
+template <typename T>
+struct TaskPromiseGuard {
+    std::shared_ptr<TaskFutureState<T>> state;
+
+    ~TaskPromiseGuard();
+};
+
+//////////////////////////////////////////////////
+// Результат задачи пула, который ждут из цикла событий без блокировки.
+// Продолжение выполняется в потоке event_base, которому принадлежит обещание.
+//////////////////////////////////////////////////
+template <typename T>
+class TaskFuture {
+public:
+    // result - nullptr, если задача не выполнена (отклонена, вытеснена или просрочена)
+    typedef std::function<void(T* result)> Continuation;
+
+    TaskFuture();
+
+    bool isValid() const;
+    bool isReady() const;
+    TaskFutureStatus status() const;
+
+    // Только из потока event_base: готовый результат передается сразу, иначе - когда появится.
+    // Продолжение одно, повторный вызов заменяет еще не вызванное.
+    void then(const Continuation& continuation);
+
+private:
+    friend class TaskPromise<T>;
+
+    std::shared_ptr<TaskFutureState<T>> _state;
+
+private:
+    explicit TaskFuture(const std::shared_ptr<TaskFutureState<T>>& state);
+};
+
+//////////////////////////////////////////////////
+// Сторона, выставляющая результат. Значение выставляется один раз, из любого потока;
+// inLoop - вызов уже в потоке event_base, продолжение выполняется сразу, без события.
+// Если все копии уничтожены без результата, продолжение получает nullptr (TASK_FUTURE_CANCELLED).
+//////////////////////////////////////////////////
+template <typename T>
+class TaskPromise {
+public:
+    explicit TaskPromise(event_base* base);
+
+    TaskFuture<T> future() const;
+
+    void setValue(T&& value, bool inLoop = false);
+    void fail(bool inLoop = false);
+    void cancel(bool inLoop = false);
+
+private:
+    std::shared_ptr<TaskFutureState<T>> _state;
+    std::shared_ptr<TaskPromiseGuard<T>> _guard;
+};
+
+// Выставление результата, если он еще не выставлен
+template <typename T>
+void resolveTaskFuture(const std::shared_ptr<TaskFutureState<T>>& state, std::optional<T>&& value, TaskFutureStatus status, bool inLoop);
+
+// Тип результата функции задачи: void превращается в TaskVoid
+template <typename Function, typename Result = std::invoke_result_t<Function&>>
+struct TaskResultOf {
+    typedef Result Type;
+
+    static Type invoke(Function& function){
+        return function();
+    }
+};
+
+template <typename Function>
+struct TaskResultOf<Function, void> {
+    typedef TaskVoid Type;
+
+    static Type invoke(Function& function){
+        function();
+        return TaskVoid();
+    }
+};
+
+// Объединение результатов: продолжение получает все значения по порядку или nullptr,
+// если не выполнилась хотя бы одна задача. Только из потока event_base всех futures.
+template <typename T>
+TaskFuture<std::vector<T>> whenAll(event_base* base, const std::vector<TaskFuture<T>>& futures);
+
+//////////////////////////////////////////////////
+// TaskFuture
+//////////////////////////////////////////////////
+template <typename T>
+TaskFuture<T>::TaskFuture(){
+}
+
+template <typename T>
+TaskFuture<T>::TaskFuture(const std::shared_ptr<TaskFutureState<T>>& state):
+    _state(state){
+}
+
+template <typename T>
+bool TaskFuture<T>::isValid() const{
+    return _state != nullptr;
+}
+
+template <typename T>
+bool TaskFuture<T>::isReady() const{
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    return _state->status != TASK_FUTURE_PENDING;
+}
+
+template <typename T>
+TaskFutureStatus TaskFuture<T>::status() const{
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    return _state->status;
+}
+
+template <typename T>
+void TaskFuture<T>::then(const Continuation& continuation){
+    std::unique_lock<std::mutex> lock(_state->mutex);
+    if (_state->status == TASK_FUTURE_PENDING) {
+        _state->continuation = continuation;
+        return;
+    }
+    lock.unlock();
+    continuation(_state->value ? &(*_state->value) : nullptr);
+}
+
+//////////////////////////////////////////////////
+// TaskPromise
+//////////////////////////////////////////////////
+template <typename T>
+TaskPromise<T>::TaskPromise(event_base* base):
+    _state(std::make_shared<TaskFutureState<T>>()),
+    _guard(std::make_shared<TaskPromiseGuard<T>>()){
+    _state->base = base;
+    _state->status = TASK_FUTURE_PENDING;
+    _guard->state = _state;
+}
+
+template <typename T>
+TaskFuture<T> TaskPromise<T>::future() const{
+    return TaskFuture<T>(_state);
+}
+
+template <typename T>
+void TaskPromise<T>::setValue(T&& value, bool inLoop){
+    resolveTaskFuture(_state, std::optional<T>(std::move(value)), TASK_FUTURE_DONE, inLoop);
+}
+
+template <typename T>
+void TaskPromise<T>::fail(bool inLoop){
+    resolveTaskFuture(_state, std::optional<T>(), TASK_FUTURE_FAILED, inLoop);
+}
+
+template <typename T>
+void TaskPromise<T>::cancel(bool inLoop){
+    resolveTaskFuture(_state, std::optional<T>(), TASK_FUTURE_CANCELLED, inLoop);
+}
+
+template <typename T>
+TaskPromiseGuard<T>::~TaskPromiseGuard(){
+    // поток уничтожения может быть любым - продолжение через цикл
+    resolveTaskFuture(state, std::optional<T>(), TASK_FUTURE_CANCELLED, false);
+}
+
+template <typename T>
+void resolveTaskFuture(const std::shared_ptr<TaskFutureState<T>>& state, std::optional<T>&& value, TaskFutureStatus status, bool inLoop){
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (state->status != TASK_FUTURE_PENDING) {
+        return;
+    }
+    state->value = std::move(value);
+    state->status = status;
+    // продолжения еще нет - его вызовет then
+    std::function<void(T*)> continuation = std::move(state->continuation);
+    lock.unlock();
+    if (!continuation) {
+        return;
+    }
+
+    if (inLoop) {
+        continuation(state->value ? &(*state->value) : nullptr);
+        return;
+    }
+    postToEventBase(state->base, [state, continuation](){
+        continuation(state->value ? &(*state->value) : nullptr);
+    });
+}
+
+//////////////////////////////////////////////////
+// whenAll
+//////////////////////////////////////////////////
+template <typename T>
+TaskFuture<std::vector<T>> whenAll(event_base* base, const std::vector<TaskFuture<T>>& futures){
+    // продолжения всех futures идут в одном потоке - счетчик без атомиков
+    struct Join {
+        TaskPromise<std::vector<T>> promise;
+        std::vector<std::optional<T>> results;
+        std::size_t remaining;
+        bool failed;
+
+        explicit Join(event_base* base):
+            promise(base),
+            remaining(0),
+            failed(false){
+        }
+    };
+    std::shared_ptr<Join> join = std::make_shared<Join>(base);
+    TaskFuture<std::vector<T>> future = join->promise.future();
+    if (futures.empty()) {
+        join->promise.setValue(std::vector<T>(), true);
+        return future;
+    }
+
+    join->results.resize(futures.size());
+    join->remaining = futures.size();
+    for (std::size_t i = 0; i < futures.size(); ++i) {
+        TaskFuture<T> part = futures[i];
+        part.then([join, i](T* result){
+            if (result) {
+                join->results[i] = std::move(*result);
+            } else {
+                join->failed = true;
+            }
+            if (--join->remaining > 0) {
+                return;
+            }
+            if (join->failed) {
+                join->promise.fail(true);
+                return;
+            }
+            std::vector<T> values;
+            values.reserve(join->results.size());
+            for (std::optional<T>& value: join->results) {
+                values.push_back(std::move(*value));
+            }
+            join->promise.setValue(std::move(values), true);
+        });
+    }
+    return future;
+}
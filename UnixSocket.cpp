@@ -0,0 +1,121 @@
+#include "UnixSocket.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+// system
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// файлы сокетов, созданные этим процессом: удаляются, только пока путь указывает на них
+static std::mutex boundFilesMutex;
+static std::unordered_map<std::string, std::pair<dev_t, ino_t>> boundFiles;
+
+// true - на path никто не слушает (ECONNREFUSED), файл остался от завершившегося процесса
+static bool isStaleUnixSocket(const sockaddr_un& address, socklen_t addressLength, int type){
+    evutil_socket_t probe = socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        return false;
+    }
+    // живой сервер с полной очередью ответит EAGAIN - тоже занят
+    bool stale = (connect(probe, reinterpret_cast<const sockaddr*>(&address), addressLength) < 0) && (errno == ECONNREFUSED);
+    evutil_closesocket(probe);
+    return stale;
+}
+
+bool isUnixSocketPath(const char* path){
+    return (path != nullptr) && ((path[0] == '/') || (path[0] == '@'));
+}
+
+bool makeUnixAddress(const char* path, sockaddr_un& address, socklen_t& addressLength){
+    std::size_t length = strlen(path);
+    if ((length == 0) || (length >= sizeof(address.sun_path))) {
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, length);
+    if (path[0] == '@') {
+        // абстрактное имя: первый байт нулевой, длина адреса - без завершающего нуля
+        address.sun_path[0] = '\0';
+        addressLength = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + length);
+    } else {
+        addressLength = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + length + 1);
+    }
+    return true;
+}
+
+evutil_socket_t bindUnixSocket(const char* path, int type, int backlog){
+    sockaddr_un address;
+    socklen_t addressLength = 0;
+    if (makeUnixAddress(path, address, addressLength) == false) {
+        std::cout << "Неверный путь Unix сокета: " << path << std::endl;
+        return -1;
+    }
+
+    evutil_socket_t fd = socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cout << "Ошибка создания Unix сокета: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    // сокет, оставшийся от упавшего процесса, иначе bind вернет EADDRINUSE;
+    // сокет работающего сервера и другие файлы не трогаем
+    struct stat status;
+    if ((path[0] == '/') && (stat(path, &status) == 0) && S_ISSOCK(status.st_mode) &&
+        isStaleUnixSocket(address, addressLength, type)) {
+        unlink(path);
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), addressLength) < 0) {
+        if (errno == EADDRINUSE) {
+            std::cout << "Unix сокет " << path << " занят другим процессом." << std::endl;
+        } else {
+            std::cout << "Ошибка привязки к " << path << ": " << strerror(errno) << std::endl;
+        }
+        evutil_closesocket(fd);
+        return -1;
+    }
+    if ((path[0] == '/') && (stat(path, &status) == 0)) {
+        std::lock_guard<std::mutex> lock(boundFilesMutex);
+        boundFiles[path] = std::make_pair(status.st_dev, status.st_ino);
+    }
+    if ((type == SOCK_STREAM) && (listen(fd, backlog) < 0)) {
+        std::cout << "Ошибка listen: " << strerror(errno) << std::endl;
+        evutil_closesocket(fd);
+        removeUnixSocket(path);
+        return -1;
+    }
+    return fd;
+}
+
+void removeUnixSocket(const char* path){
+    if ((path == nullptr) || (path[0] != '/')) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(boundFilesMutex);
+    auto it = boundFiles.find(path);
+    if (it == boundFiles.end()) {
+        return;
+    }
+    // файл могли удалить и создать заново другим процессом - его сокет не наш
+    struct stat status;
+    if ((stat(path, &status) == 0) && (status.st_dev == it->second.first) && (status.st_ino == it->second.second)) {
+        unlink(path);
+    }
+    boundFiles.erase(it);
+}
+
+bool getPeerCredentials(evutil_socket_t fd, ucred& credentials){
+    // у TCP сокета SO_PEERCRED тоже отвечает, но пустыми данными
+    int domain = 0;
+    socklen_t length = sizeof(domain);
+    if ((fd < 0) || (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) != 0) || (domain != AF_UNIX)) {
+        return false;
+    }
+    length = sizeof(credentials);
+    return (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0) && (length == sizeof(credentials));
+}
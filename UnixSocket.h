@@ -0,0 +1,32 @@
+#pragma once
+
+// libevent
+#include <event2/util.h>
+// system
+#include <sys/socket.h>
+#include <sys/un.h>
+
+//////////////////////////////////////////////////
+// Unix сокеты для клиентов на том же хосте. Путь - файл в файловой системе
+// или "@имя" в абстрактном пространстве имен Linux (без файла, исчезает вместе с сокетом).
+//////////////////////////////////////////////////
+
+// '/' или '@' в начале - путь Unix сокета, иначе адрес TCP/UDP
+bool isUnixSocketPath(const char* path);
+
+// false - путь длиннее sun_path
+bool makeUnixAddress(const char* path, sockaddr_un& address, socklen_t& addressLength);
+
+// Неблокирующий сокет type (SOCK_STREAM или SOCK_DGRAM), привязанный к path;
+// SOCK_STREAM уже слушает с backlog. Файл сокета удаляется, только если на нем никто
+// не слушает (остался от прошлого запуска); сокет работающего процесса - ошибка.
+// -1 - ошибка, причина в std::cout.
+evutil_socket_t bindUnixSocket(const char* path, int type, int backlog);
+
+// удаляет файл сокета, созданный bindUnixSocket этого процесса, если путь все еще указывает на него;
+// для абстрактного имени ничего не делает
+void removeUnixSocket(const char* path);
+
+// процесс на другом конце соединения (SO_PEERCRED): pid, uid и gid на момент connect.
+// false - сокет не Unix или ошибка
+bool getPeerCredentials(evutil_socket_t fd, ucred& credentials);
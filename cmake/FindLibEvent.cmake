@@ -12,10 +12,20 @@ endforeach()
 
 find_path(LIBEVENT_INCLUDE_DIR event.h PATHS ${LibEvent_INCLUDE_PATHS})
 find_library(LIBEVENT_LIB NAMES event PATHS ${LibEvent_LIB_PATHS})
+find_library(LIBEVENT_PTHREADS_LIB NAMES event_pthreads PATHS ${LibEvent_LIB_PATHS})
+find_library(LIBEVENT_OPENSSL_LIB NAMES event_openssl PATHS ${LibEvent_LIB_PATHS})
 
 if (LIBEVENT_LIB AND LIBEVENT_INCLUDE_DIR)
   set(LibEvent_FOUND TRUE)
   set(LIBEVENT_LIB ${LIBEVENT_LIB})
+  # evthread_use_pthreads живет в отдельной библиотеке
+  if (LIBEVENT_PTHREADS_LIB)
+    list(APPEND LIBEVENT_LIB ${LIBEVENT_PTHREADS_LIB})
+  endif ()
+  # bufferevent_openssl - тоже отдельно
+  if (LIBEVENT_OPENSSL_LIB)
+    list(APPEND LIBEVENT_LIB ${LIBEVENT_OPENSSL_LIB})
+  endif ()
 else ()
   set(LibEvent_FOUND FALSE)
 endif ()
@@ -33,5 +43,7 @@ endif ()
 
 mark_as_advanced(
     LIBEVENT_LIB
+    LIBEVENT_PTHREADS_LIB
+    LIBEVENT_OPENSSL_LIB
     LIBEVENT_INCLUDE_DIR
   )
\ No newline at end of file
@@ -4,8 +4,23 @@
 #include "SingleThreadedTCP.h"
 #include "MultiThreadedTCP.h"
 #include "MultiThreadedTCPFilter.h"
+#include "MultiThreadedTCPPipeline.h"
 #include "SingleThreadedDNS.h"
 #include "SingleThreadedDNSResponder.h"
+#include "MultiThreadedDNSResponder.h"
+#include "DNSBenchmark.h"
+#include "DNSBulkResolve.h"
+#include "TLSContext.h"
+#include "TLSBenchmark.h"
+#include "IOUringTCP.h"
+#include "TCPBenchmark.h"
+#include "UnixSocket.h"
+// std
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+// system
+#include <csignal>
 
 // примеры
 // https://habrahabr.ru/post/217437/
@@ -13,9 +28,133 @@
 // https://www.ibm.com/developerworks/ru/library/l-Libevent1/
 
 
-int main()
+static void printUsage(const char* programName){
+    std::cout << "Usage: " << programName << " [mode]" << std::endl;
+    std::cout << "Modes:" << std::endl;
+    std::cout << "    http [static-dir]     - simpleOneThreadServer, /static/ from static-dir (./static)" << std::endl;
+    std::cout << "    http-mt [static-dir]  - multithreadedServer" << std::endl;
+    std::cout << "    tcp                   - tcpServer" << std::endl;
+    std::cout << "    tcp-mt                - multiThreadedTcpServer" << std::endl;
+    std::cout << "    tcp-filter            - multiThreadedTcpServerFilter (default)" << std::endl;
+    std::cout << "    tcp-filter-unlimited  - multiThreadedTcpServerFilter without client rate limits" << std::endl;
+    std::cout << "    tcp-uring             - ioUringTcpServer, tcp-filter protocol on io_uring" << std::endl;
+    std::cout << "    tcp-pipeline          - multiThreadedTcpServerPipeline, tcp-filter protocol without filters" << std::endl;
+    std::cout << "    tcp-pipeline-proto    - multiThreadedTcpServerPipeline, length + CRC32 + protobuf EchoMessage" << std::endl;
+    std::cout << "    tcp-coroutine         - multiThreadedTcpServerCoroutine, tcp-filter protocol in C++20 coroutines" << std::endl;
+    std::cout << "    https [static-dir] [cert key]    - simpleOneThreadServer over TLS" << std::endl;
+    std::cout << "    https-mt [static-dir] [cert key] - multithreadedServer over TLS" << std::endl;
+    std::cout << "    tcp-filter-tls [cert key]        - multiThreadedTcpServerFilter over TLS" << std::endl;
+    std::cout << "      without cert/key a temporary self-signed certificate is used" << std::endl;
+    std::cout << "    dns [upstream|-] [name...] - singleThreadDNSServer, caching resolver demo" << std::endl;
+    std::cout << "    dns-bulk [file|-] [concurrency] [upstream|-] - resolve names from file/stdin" << std::endl;
+    std::cout << "    dns-responder [zone]  - singleThreadDNSResponder" << std::endl;
+    std::cout << "    dns-responder-mt [zone] - multiThreadedDNSResponder" << std::endl;
+    std::cout << "    dns-bench [threads] [seconds] [window] - QPS benchmark against 127.0.0.1:5550" << std::endl;
+    std::cout << "    tls-bench [threads] [seconds] [port] - TLS handshake benchmark against 127.0.0.1:5555" << std::endl;
+    std::cout << "    tcp-bench [connections] [seconds] [port|unix-path] - tcp-filter/tcp-uring/tcp-pipeline/tcp-coroutine echo benchmark against 127.0.0.1:5555" << std::endl;
+    std::cout << "    tcp-unix-bench [connections] [seconds] [port] [unix-path] - echo latency over loopback TCP vs Unix socket (/tmp/libeventserver-5555.sock)" << std::endl;
+    std::cout << "    tcp-c10m [max] [step] [port] [server-pid] - idle connections scale benchmark (RSS per connection, accept rate, latency)" << std::endl;
+    std::cout << "      against a tcp-filter protocol server without per-IP limits (tcp-filter-unlimited, tcp-pipeline, tcp-coroutine)" << std::endl;
+}
+
+// сертификат и ключ из argv[index], argv[index + 1], иначе временный самоподписанный
+static bool loadTLSConfig(int argc, char* argv[], int index, TLSConfig& config){
+    if (argc > index + 1) {
+        config.certificateFile = argv[index];
+        config.keyFile = argv[index + 1];
+        return true;
+    }
+    return tlsGenerateSelfSigned(config);
+}
+
+int main(int argc, char* argv[])
 {
-    int result = multiThreadedTcpServerFilter();
+    const char* mode = (argc > 1) ? argv[1] : "tcp-filter";
+
+    // запись в уже закрытый клиентом сокет - ошибка bufferevent, а не завершение процесса
+    signal(SIGPIPE, SIG_IGN);
+
+    if (strcmp(mode, "http") == 0) {
+        return simpleOneThreadServer((argc > 2) ? argv[2] : "static", nullptr);
+    } else if (strcmp(mode, "http-mt") == 0) {
+        return multithreadedServer((argc > 2) ? argv[2] : "static", nullptr);
+    } else if ((strcmp(mode, "https") == 0) || (strcmp(mode, "https-mt") == 0)) {
+        TLSConfig tls;
+        if (!loadTLSConfig(argc, argv, 3, tls)) {
+            return 1;
+        }
+        const char* staticRoot = (argc > 2) ? argv[2] : "static";
+        if (strcmp(mode, "https") == 0) {
+            return simpleOneThreadServer(staticRoot, &tls);
+        }
+        return multithreadedServer(staticRoot, &tls);
+    } else if (strcmp(mode, "tcp") == 0) {
+        return tcpServer();
+    } else if (strcmp(mode, "tcp-mt") == 0) {
+        return multiThreadedTcpServer();
+    } else if (strcmp(mode, "tcp-filter") == 0) {
+        return multiThreadedTcpServerFilter(nullptr, true);
+    } else if (strcmp(mode, "tcp-filter-unlimited") == 0) {
+        return multiThreadedTcpServerFilter(nullptr, false);
+    } else if (strcmp(mode, "tcp-uring") == 0) {
+        return ioUringTcpServer();
+    } else if (strcmp(mode, "tcp-pipeline") == 0) {
+        return multiThreadedTcpServerPipeline(false);
+    } else if (strcmp(mode, "tcp-pipeline-proto") == 0) {
+        return multiThreadedTcpServerPipeline(true);
+    } else if (strcmp(mode, "tcp-coroutine") == 0) {
+        return multiThreadedTcpServerCoroutine();
+    } else if (strcmp(mode, "tcp-filter-tls") == 0) {
+        TLSConfig tls;
+        if (!loadTLSConfig(argc, argv, 2, tls)) {
+            return 1;
+        }
+        return multiThreadedTcpServerFilter(&tls, true);
+    } else if (strcmp(mode, "dns") == 0) {
+        const char* upstream = ((argc > 2) && (strcmp(argv[2], "-") != 0)) ? argv[2] : nullptr;
+        return singleThreadDNSServer(upstream, (argc > 3) ? (argc - 3) : 0, argv + 3);
+    } else if (strcmp(mode, "dns-bulk") == 0) {
+        const char* inputPath = (argc > 2) ? argv[2] : nullptr;
+        int concurrency = (argc > 3) ? atoi(argv[3]) : 256;
+        const char* upstream = ((argc > 4) && (strcmp(argv[4], "-") != 0)) ? argv[4] : nullptr;
+        return dnsBulkResolve(inputPath, upstream, concurrency);
+    } else if (strcmp(mode, "dns-responder") == 0) {
+        return singleThreadDNSResponder((argc > 2) ? argv[2] : nullptr);
+    } else if (strcmp(mode, "dns-responder-mt") == 0) {
+        return multiThreadedDNSResponder((argc > 2) ? argv[2] : nullptr);
+    } else if (strcmp(mode, "dns-bench") == 0) {
+        int threadsCount = (argc > 2) ? atoi(argv[2]) : 2;
+        int durationSeconds = (argc > 3) ? atoi(argv[3]) : 5;
+        int windowSize = (argc > 4) ? atoi(argv[4]) : 256;
+        return dnsResponderBenchmark("127.0.0.1", 5550, threadsCount, durationSeconds, windowSize);
+    } else if (strcmp(mode, "tls-bench") == 0) {
+        int threadsCount = (argc > 2) ? atoi(argv[2]) : 2;
+        int durationSeconds = (argc > 3) ? atoi(argv[3]) : 5;
+        int port = (argc > 4) ? atoi(argv[4]) : 5555;
+        return tlsHandshakeBenchmark("127.0.0.1", (std::uint16_t)port, threadsCount, durationSeconds);
+    } else if (strcmp(mode, "tcp-bench") == 0) {
+        int connectionsCount = (argc > 2) ? atoi(argv[2]) : 256;
+        int durationSeconds = (argc > 3) ? atoi(argv[3]) : 5;
+        // порт или путь Unix сокета сервера
+        const char* endpoint = (argc > 4) ? argv[4] : "5555";
+        if (isUnixSocketPath(endpoint)) {
+            return tcpEchoBenchmark(endpoint, 0, connectionsCount, durationSeconds);
+        }
+        return tcpEchoBenchmark("127.0.0.1", (std::uint16_t)atoi(endpoint), connectionsCount, durationSeconds);
+    } else if (strcmp(mode, "tcp-unix-bench") == 0) {
+        int connectionsCount = (argc > 2) ? atoi(argv[2]) : 1;
+        int durationSeconds = (argc > 3) ? atoi(argv[3]) : 5;
+        int port = (argc > 4) ? atoi(argv[4]) : 5555;
+        const char* unixPath = (argc > 5) ? argv[5] : "/tmp/libeventserver-5555.sock";
+        return tcpUnixLatencyBenchmark("127.0.0.1", (std::uint16_t)port, unixPath, connectionsCount, durationSeconds);
+    } else if (strcmp(mode, "tcp-c10m") == 0) {
+        int maxConnections = (argc > 2) ? atoi(argv[2]) : 1000000;
+        int stepConnections = (argc > 3) ? atoi(argv[3]) : 100000;
+        int port = (argc > 4) ? atoi(argv[4]) : 5555;
+        int serverPid = (argc > 5) ? atoi(argv[5]) : 0;
+        return tcpConnectionsBenchmark("127.0.0.1", (std::uint16_t)port, maxConnections, stepConnections, serverPid);
+    }
 
-    return result;
+    printUsage(argv[0]);
+    return 1;
 }